@@ -0,0 +1,497 @@
+﻿#ifdef __linux__
+
+#include "BlueZTransport.h"
+
+#include <systemd/sd-bus.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DeviceCache.h"
+
+constexpr const char* BLUEZ_SERVICE = "org.bluez";
+constexpr const char* ADAPTER_INTERFACE = "org.bluez.Adapter1";
+constexpr const char* DEVICE_INTERFACE = "org.bluez.Device1";
+constexpr const char* CHARACTERISTIC_INTERFACE = "org.bluez.GattCharacteristic1";
+
+// スキャン中にデバイス一覧を確認する間隔
+constexpr std::chrono::milliseconds SCAN_POLL_INTERVAL{ 200 };
+// 接続後、GATTサービスの解決を待つ最大時間
+constexpr std::chrono::seconds SERVICES_RESOLVE_TIMEOUT{ 10 };
+
+/**
+ * @struct BlueZBus
+ * @brief システムバスへの接続（sd-busはスレッドセーフではないのでミューテックスで保護する）
+ */
+struct BlueZBus {
+    sd_bus* bus = nullptr;
+    std::mutex mutex;
+
+    ~BlueZBus()
+    {
+        if (bus) sd_bus_flush_close_unref(bus);
+    }
+};
+
+/**
+ * @struct BlueZObject
+ * @brief GetManagedObjectsで取得したオブジェクトのうち、必要なプロパティ
+ */
+struct BlueZObject {
+    std::string path;
+    bool isAdapter = false;
+    bool isDevice = false;
+    bool isCharacteristic = false;
+
+    // org.bluez.Device1
+    std::string address;
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> manufacturerData;
+    int16_t rssi = 0;
+    bool connected = false;
+    bool servicesResolved = false;
+
+    // org.bluez.GattCharacteristic1
+    std::string uuid;
+};
+
+/**
+ * @brief "AA:BB:CC:DD:EE:FF" 形式のアドレスを数値に変換（WinRTのBluetoothAddressと同じ並び）
+ */
+static uint64_t parse_address(const std::string& text)
+{
+    uint64_t address = 0;
+    unsigned int bytes[6];
+    if (std::sscanf(text.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x",
+        &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) return 0;
+    for (unsigned int b : bytes) address = (address << 8) | (b & 0xFF);
+    return address;
+}
+
+/**
+ * @brief 数値のアドレスからBlueZのデバイスのオブジェクトパスを作る
+ */
+static std::string device_path(const std::string& adapterPath, uint64_t address)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/dev_%02X_%02X_%02X_%02X_%02X_%02X",
+        static_cast<unsigned int>((address >> 40) & 0xFF), static_cast<unsigned int>((address >> 32) & 0xFF),
+        static_cast<unsigned int>((address >> 24) & 0xFF), static_cast<unsigned int>((address >> 16) & 0xFF),
+        static_cast<unsigned int>((address >> 8) & 0xFF), static_cast<unsigned int>(address & 0xFF));
+    return adapterPath + name;
+}
+
+/**
+ * @brief プロパティ1つ分（a{sv}の要素）を読み取る
+ */
+static int read_property(sd_bus_message* m, const std::string& iface, BlueZObject& object)
+{
+    const char* name = nullptr;
+    int r = sd_bus_message_read(m, "s", &name);
+    if (r < 0) return r;
+    std::string key = name;
+
+    if (iface == DEVICE_INTERFACE && key == "Address") {
+        const char* value = nullptr;
+        r = sd_bus_message_read(m, "v", "s", &value);
+        if (r >= 0) object.address = value;
+        return r;
+    }
+    if (iface == DEVICE_INTERFACE && key == "RSSI") {
+        return sd_bus_message_read(m, "v", "n", &object.rssi);
+    }
+    if (iface == DEVICE_INTERFACE && (key == "Connected" || key == "ServicesResolved")) {
+        int value = 0;
+        r = sd_bus_message_read(m, "v", "b", &value);
+        if (r >= 0) (key == "Connected" ? object.connected : object.servicesResolved) = value != 0;
+        return r;
+    }
+    if (iface == DEVICE_INTERFACE && key == "ManufacturerData") {
+        // a{qv}、値はay
+        if ((r = sd_bus_message_enter_container(m, 'v', "a{qv}")) < 0) return r;
+        if ((r = sd_bus_message_enter_container(m, 'a', "{qv}")) < 0) return r;
+        while ((r = sd_bus_message_enter_container(m, 'e', "qv")) > 0) {
+            uint16_t company = 0;
+            const void* data = nullptr;
+            size_t size = 0;
+            if ((r = sd_bus_message_read(m, "q", &company)) < 0) return r;
+            if ((r = sd_bus_message_enter_container(m, 'v', "ay")) < 0) return r;
+            if ((r = sd_bus_message_read_array(m, 'y', &data, &size)) < 0) return r;
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            object.manufacturerData.emplace_back(company, std::vector<uint8_t>(bytes, bytes + size));
+            if ((r = sd_bus_message_exit_container(m)) < 0) return r; // v
+            if ((r = sd_bus_message_exit_container(m)) < 0) return r; // e
+        }
+        if (r < 0) return r;
+        if ((r = sd_bus_message_exit_container(m)) < 0) return r; // a
+        return sd_bus_message_exit_container(m);                    // v
+    }
+    if (iface == CHARACTERISTIC_INTERFACE && key == "UUID") {
+        const char* value = nullptr;
+        r = sd_bus_message_read(m, "v", "s", &value);
+        if (r >= 0) object.uuid = value;
+        return r;
+    }
+    return sd_bus_message_skip(m, "v");
+}
+
+/**
+ * @brief BlueZの全オブジェクトを取得する（org.freedesktop.DBus.ObjectManager.GetManagedObjects）
+ * @return 成功したら0以上、失敗したら負のエラーコード
+ */
+static int read_managed_objects(BlueZBus& bus, std::vector<BlueZObject>& objects)
+{
+    std::lock_guard<std::mutex> lock(bus.mutex);
+
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    sd_bus_message* reply = nullptr;
+    int r = sd_bus_call_method(bus.bus, BLUEZ_SERVICE, "/", "org.freedesktop.DBus.ObjectManager",
+        "GetManagedObjects", &error, &reply, "");
+    sd_bus_error_free(&error);
+    if (r < 0) return r;
+
+    objects.clear();
+    // a{oa{sa{sv}}}
+    if ((r = sd_bus_message_enter_container(reply, 'a', "{oa{sa{sv}}}")) < 0) goto done;
+    while ((r = sd_bus_message_enter_container(reply, 'e', "oa{sa{sv}}")) > 0) {
+        BlueZObject object;
+        const char* path = nullptr;
+        if ((r = sd_bus_message_read(reply, "o", &path)) < 0) goto done;
+        object.path = path;
+
+        if ((r = sd_bus_message_enter_container(reply, 'a', "{sa{sv}}")) < 0) goto done;
+        while ((r = sd_bus_message_enter_container(reply, 'e', "sa{sv}")) > 0) {
+            const char* name = nullptr;
+            if ((r = sd_bus_message_read(reply, "s", &name)) < 0) goto done;
+            std::string iface = name;
+            object.isAdapter |= iface == ADAPTER_INTERFACE;
+            object.isDevice |= iface == DEVICE_INTERFACE;
+            object.isCharacteristic |= iface == CHARACTERISTIC_INTERFACE;
+
+            if ((r = sd_bus_message_enter_container(reply, 'a', "{sv}")) < 0) goto done;
+            while ((r = sd_bus_message_enter_container(reply, 'e', "sv")) > 0) {
+                if ((r = read_property(reply, iface, object)) < 0) goto done;
+                if ((r = sd_bus_message_exit_container(reply)) < 0) goto done;
+            }
+            if (r < 0) goto done;
+            if ((r = sd_bus_message_exit_container(reply)) < 0) goto done; // a{sv}
+            if ((r = sd_bus_message_exit_container(reply)) < 0) goto done; // e
+        }
+        if (r < 0) goto done;
+        if ((r = sd_bus_message_exit_container(reply)) < 0) goto done; // a{sa{sv}}
+        if ((r = sd_bus_message_exit_container(reply)) < 0) goto done; // e
+
+        if (object.isAdapter || object.isDevice || object.isCharacteristic)
+            objects.push_back(std::move(object));
+    }
+    if (r >= 0) r = sd_bus_message_exit_container(reply);
+
+done:
+    sd_bus_message_unref(reply);
+    return r;
+}
+
+/**
+ * @brief 引数なしのメソッドを呼び出す
+ */
+static int call_simple(BlueZBus& bus, const std::string& path, const char* iface, const char* method)
+{
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    int r = sd_bus_call_method(bus.bus, BLUEZ_SERVICE, path.c_str(), iface, method, &error, nullptr, "");
+    sd_bus_error_free(&error);
+    return r;
+}
+
+/**
+ * @brief キャラクタリスティックが存在し、UUIDが一致するか確認する
+ */
+static bool characteristic_has_uuid(BlueZBus& bus, const std::string& path, const char* uuid)
+{
+    std::lock_guard<std::mutex> lock(bus.mutex);
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    char* value = nullptr;
+    int r = sd_bus_get_property_string(bus.bus, BLUEZ_SERVICE, path.c_str(), CHARACTERISTIC_INTERFACE,
+        "UUID", &error, &value);
+    sd_bus_error_free(&error);
+    bool match = r >= 0 && value && std::string(value) == uuid;
+    std::free(value);
+    return match;
+}
+
+/**
+ * @class BlueZDevice
+ * @brief BlueZで接続したコントローラー
+ */
+class BlueZDevice : public TransportDevice {
+public:
+    BlueZDevice(std::shared_ptr<BlueZBus> bus, std::string path, uint64_t address,
+        std::string inputPath, std::string writePath)
+        : bus(std::move(bus)), path(std::move(path)), address(address),
+          inputPath(std::move(inputPath)), writePath(std::move(writePath))
+    {
+    }
+
+    ~BlueZDevice() override { Close(); }
+
+    uint64_t Address() const override { return address; }
+
+    bool Subscribe(NotifyHandler handler) override
+    {
+        if (notifyFd >= 0) return false;
+
+        int fd = -1;
+        uint16_t mtu = 0;
+        {
+            std::lock_guard<std::mutex> lock(bus->mutex);
+            sd_bus_error error = SD_BUS_ERROR_NULL;
+            sd_bus_message* reply = nullptr;
+            int r = sd_bus_call_method(bus->bus, BLUEZ_SERVICE, inputPath.c_str(), CHARACTERISTIC_INTERFACE,
+                "AcquireNotify", &error, &reply, "a{sv}", 0);
+            if (r >= 0) r = sd_bus_message_read(reply, "hq", &fd, &mtu);
+            // ファイルディスクリプタはメッセージの解放時に閉じられるので複製して保持する
+            if (r >= 0) fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+            sd_bus_message_unref(reply);
+            if (r < 0 || fd < 0) {
+                std::wcerr << L"AcquireNotify failed: " << (error.message ? error.message : "") << L"\n";
+                sd_bus_error_free(&error);
+                return false;
+            }
+            sd_bus_error_free(&error);
+        }
+
+        if (pipe2(stopPipe, O_CLOEXEC) < 0) {
+            close(fd);
+            return false;
+        }
+        notifyFd = fd;
+        reader = std::thread(&BlueZDevice::Run, this, std::move(handler), mtu);
+        return true;
+    }
+
+    bool WriteCommand(std::span<const uint8_t> data) override
+    {
+        if (writePath.empty()) return false;
+
+        std::lock_guard<std::mutex> lock(bus->mutex);
+        sd_bus_message* m = nullptr;
+        sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r = sd_bus_message_new_method_call(bus->bus, &m, BLUEZ_SERVICE, writePath.c_str(),
+            CHARACTERISTIC_INTERFACE, "WriteValue");
+        if (r >= 0) r = sd_bus_message_append_array(m, 'y', data.data(), data.size());
+        // 応答なし書き込み（WinRTのWriteWithoutResponseに相当）
+        if (r >= 0) r = sd_bus_message_append(m, "a{sv}", 1, "type", "s", "command");
+        if (r >= 0) r = sd_bus_call(bus->bus, m, 0, &error, nullptr);
+        sd_bus_error_free(&error);
+        sd_bus_message_unref(m);
+        return r >= 0;
+    }
+
+    bool CanWrite() const override { return !writePath.empty(); }
+
+    void Close() override
+    {
+        if (notifyFd >= 0) {
+            // 読み取りスレッドを起こして終了させる
+            char stop = 0;
+            if (write(stopPipe[1], &stop, 1) < 0) {}
+            if (reader.joinable() && reader.get_id() != std::this_thread::get_id()) reader.join();
+            close(notifyFd);
+            close(stopPipe[0]);
+            close(stopPipe[1]);
+            notifyFd = -1;
+        }
+        if (!closed.exchange(true)) call_simple(*bus, path, DEVICE_INTERFACE, "Disconnect");
+    }
+
+private:
+    void Run(NotifyHandler handler, uint16_t mtu)
+    {
+        // 通知は1回のreadで1パケットずつ届く（SOCK_SEQPACKET）
+        std::vector<uint8_t> buffer(mtu > 0 ? mtu : 512);
+        pollfd fds[2] = { { notifyFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[1].revents) break;
+            if (fds[0].revents & (POLLHUP | POLLERR)) break; // 切断
+            if (!(fds[0].revents & POLLIN)) continue;
+
+            ssize_t n = read(notifyFd, buffer.data(), buffer.size());
+            if (n <= 0) break;
+            handler(std::span<const uint8_t>(buffer.data(), static_cast<size_t>(n)));
+        }
+    }
+
+    std::shared_ptr<BlueZBus> bus;
+    std::string path;
+    uint64_t address;
+    std::string inputPath;
+    std::string writePath;
+
+    int notifyFd = -1;
+    int stopPipe[2] = { -1, -1 };
+    std::thread reader;
+    std::atomic<bool> closed{ false };
+};
+
+BlueZTransport::BlueZTransport()
+    : bus(std::make_shared<BlueZBus>())
+{
+    if (sd_bus_open_system(&bus->bus) < 0) {
+        bus->bus = nullptr;
+        return;
+    }
+
+    // 最初に見つかったアダプターを使う
+    std::vector<BlueZObject> objects;
+    if (read_managed_objects(*bus, objects) < 0) return;
+    for (const auto& object : objects) {
+        if (object.isAdapter) {
+            adapterPath = object.path;
+            break;
+        }
+    }
+}
+
+BlueZTransport::~BlueZTransport() = default;
+
+bool BlueZTransport::IsAvailable() const
+{
+    return bus->bus != nullptr && !adapterPath.empty();
+}
+
+bool BlueZTransport::Scan(ScanHandler handler, std::chrono::milliseconds timeout)
+{
+    if (!IsAvailable()) return false;
+
+    // LEのみを探索する
+    {
+        std::lock_guard<std::mutex> lock(bus->mutex);
+        sd_bus_error error = SD_BUS_ERROR_NULL;
+        sd_bus_call_method(bus->bus, BLUEZ_SERVICE, adapterPath.c_str(), ADAPTER_INTERFACE,
+            "SetDiscoveryFilter", &error, nullptr, "a{sv}", 1, "Transport", "s", "le");
+        sd_bus_error_free(&error);
+    }
+    call_simple(*bus, adapterPath, ADAPTER_INTERFACE, "StartDiscovery");
+
+    bool found = false;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::vector<BlueZObject> objects;
+    while (!found && std::chrono::steady_clock::now() < deadline) {
+        if (read_managed_objects(*bus, objects) >= 0) {
+            for (const auto& object : objects) {
+                // 接続中のデバイスはアドバタイズしていないので対象外
+                if (!object.isDevice || object.connected) continue;
+                if (object.path.rfind(adapterPath + "/", 0) != 0) continue;
+
+                for (const auto& [company, data] : object.manufacturerData) {
+                    Advertisement adv;
+                    adv.address = parse_address(object.address);
+                    adv.companyId = company;
+                    adv.manufacturerData = data;
+                    adv.rssi = object.rssi;
+                    if (handler(adv)) {
+                        found = true;
+                        break;
+                    }
+                }
+                if (found) break;
+            }
+        }
+        if (!found) std::this_thread::sleep_for(SCAN_POLL_INTERVAL);
+    }
+
+    call_simple(*bus, adapterPath, ADAPTER_INTERFACE, "StopDiscovery");
+    return found;
+}
+
+std::shared_ptr<TransportDevice> BlueZTransport::Connect(uint64_t address)
+{
+    if (!IsAvailable()) return nullptr;
+
+    // 接続全体と、キャラクタリスティックの解決（キャッシュで省略できる部分）の時間を計測する
+    auto start = std::chrono::steady_clock::now();
+    std::string path = device_path(adapterPath, address);
+
+    // Device1.Connectは数秒かかるので、共有の接続をロックしたままにしないよう専用の接続で呼ぶ
+    // （複数台を並行して接続できるようにする）
+    {
+        BlueZBus connection;
+        if (sd_bus_open_system(&connection.bus) < 0) {
+            connection.bus = nullptr;
+            return nullptr;
+        }
+        if (call_simple(connection, path, DEVICE_INTERFACE, "Connect") < 0) return nullptr;
+    }
+
+    // GATTサービスが解決されるのを待つ
+    auto deadline = std::chrono::steady_clock::now() + SERVICES_RESOLVE_TIMEOUT;
+    bool resolved = false;
+    while (!resolved && std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard<std::mutex> lock(bus->mutex);
+            sd_bus_error error = SD_BUS_ERROR_NULL;
+            int value = 0;
+            if (sd_bus_get_property_trivial(bus->bus, BLUEZ_SERVICE, path.c_str(), DEVICE_INTERFACE,
+                "ServicesResolved", &error, 'b', &value) >= 0) resolved = value != 0;
+            sd_bus_error_free(&error);
+        }
+        if (!resolved) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (!resolved) {
+        call_simple(*bus, path, DEVICE_INTERFACE, "Disconnect");
+        return nullptr;
+    }
+
+    // 既知のコントローラーなら、前回解決したパスのUUIDだけを確認する（全オブジェクトの列挙を省略）
+    auto resolveStart = std::chrono::steady_clock::now();
+    DeviceCacheEntry cached;
+    if (LookupDeviceCache(address, cached) && !cached.input.empty()) {
+        std::string inputPath = path + "/" + cached.input;
+        std::string writePath = cached.write.empty() ? std::string() : path + "/" + cached.write;
+        if (characteristic_has_uuid(*bus, inputPath, INPUT_REPORT_UUID) &&
+            (writePath.empty() || characteristic_has_uuid(*bus, writePath, WRITE_COMMAND_UUID))) {
+            auto now = std::chrono::steady_clock::now();
+            RecordConnectTime(ConnectPath::Cached, now - start, now - resolveStart);
+            return std::make_shared<BlueZDevice>(bus, path, address, inputPath, writePath);
+        }
+        // キャッシュが古い場合は全て探し直す
+    }
+
+    // デバイス配下のキャラクタリスティックからUUIDで探す
+    std::vector<BlueZObject> objects;
+    if (read_managed_objects(*bus, objects) < 0) return nullptr;
+
+    std::string inputPath, writePath;
+    for (const auto& object : objects) {
+        if (!object.isCharacteristic || object.path.rfind(path + "/", 0) != 0) continue;
+        if (object.uuid == INPUT_REPORT_UUID) inputPath = object.path;
+        else if (object.uuid == WRITE_COMMAND_UUID) writePath = object.path;
+    }
+    if (inputPath.empty()) {
+        call_simple(*bus, path, DEVICE_INTERFACE, "Disconnect");
+        return nullptr;
+    }
+
+    // デバイスのパスからの相対パスで保存する（アダプターが変わっても使えるように）
+    StoreGattLocation(address, inputPath.substr(path.size() + 1),
+        writePath.empty() ? std::string() : writePath.substr(path.size() + 1));
+    auto now = std::chrono::steady_clock::now();
+    RecordConnectTime(ConnectPath::Discovery, now - start, now - resolveStart);
+    return std::make_shared<BlueZDevice>(bus, path, address, inputPath, writePath);
+}
+
+#endif
@@ -0,0 +1,37 @@
+﻿#pragma once
+
+#ifdef __linux__
+
+#include <memory>
+#include <string>
+
+#include "Transport.h"
+
+struct BlueZBus;
+
+/**
+ * @class BlueZTransport
+ * @brief BlueZ (D-Bus) による Linux 向けの通信バックエンド
+ *
+ * 探索と接続はD-Bus経由で行い、入力レポートはAcquireNotifyで取得した
+ * ファイルディスクリプタから直接読み取る（パケットごとのD-Busのやり取りを避ける）。
+ */
+class BlueZTransport : public Transport {
+public:
+    BlueZTransport();
+    ~BlueZTransport() override;
+
+    /**
+     * @brief BlueZに接続できたか（Bluetoothアダプターが見つかったか）
+     */
+    bool IsAvailable() const;
+
+    bool Scan(ScanHandler handler, std::chrono::milliseconds timeout) override;
+    std::shared_ptr<TransportDevice> Connect(uint64_t address) override;
+
+private:
+    std::shared_ptr<BlueZBus> bus;
+    std::string adapterPath; // 例: /org/bluez/hci0
+};
+
+#endif
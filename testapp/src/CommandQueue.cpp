@@ -0,0 +1,202 @@
+﻿#include "CommandQueue.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+CommandQueue::CommandQueue(const CommandQueueConfig& config)
+    : config(config)
+{
+}
+
+CommandQueue::~CommandQueue()
+{
+    std::vector<std::shared_ptr<DeviceQueue>> senders;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto& [key, queue] : queues) {
+            queue->wake.notify_all();
+            senders.push_back(queue);
+        }
+        senders.insert(senders.end(), retired.begin(), retired.end());
+    }
+    // 停止後は送信スレッドが増えないので、ロックの外で書き込み中のスレッドを待てる
+    for (auto& queue : senders)
+        if (queue->sender.joinable()) queue->sender.join();
+}
+
+void CommandQueue::Enqueue(const std::shared_ptr<TransportDevice>& device, std::vector<uint8_t> command, Completion done)
+{
+    Entry entry;
+    entry.command = std::move(command);
+    entry.done = std::move(done);
+    Push(device, std::move(entry));
+}
+
+void CommandQueue::EnqueueVerify(const std::shared_ptr<TransportDevice>& device, Completion done)
+{
+    Entry entry;
+    entry.verify = true;
+    entry.done = std::move(done);
+    Push(device, std::move(entry));
+}
+
+void CommandQueue::Push(const std::shared_ptr<TransportDevice>& device, Entry entry)
+{
+    if (!device) return;
+    JoinRetired();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) return;
+    auto it = queues.find(device);
+    if (it == queues.end()) {
+        auto queue = std::make_shared<DeviceQueue>();
+        queue->owner = device;
+        queue->target = device.get();
+        it = queues.emplace(queue->owner, queue).first;
+        queue->sender = std::thread(&CommandQueue::Run, this, queue);
+    }
+    DeviceQueue& queue = *it->second;
+    queue.device = device;
+    queue.entries.push_back(std::move(entry));
+    if (!queue.busy) Arm(queue, Clock::now());
+    queue.wake.notify_one();
+}
+
+void CommandQueue::ReportReceived(const TransportDevice& device)
+{
+    // 入力ハンドラから毎回呼ばれるので、確認待ちがなければ何もしない
+    if (pendingVerifies.load(std::memory_order_relaxed) == 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = Find(device);
+    if (it == queues.end() || !it->second->verifying) return;
+    it->second->reported = true;
+    it->second->wake.notify_one();
+}
+
+bool CommandQueue::WaitIdle(const TransportDevice& device, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return idle.wait_for(lock, timeout, [&]()
+        {
+            auto it = Find(device);
+            return it == queues.end() || (it->second->entries.empty() && !it->second->busy);
+        });
+}
+
+void CommandQueue::Cancel(const TransportDevice& device)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // 破棄中のデバイスのデストラクタからも呼べるように、所有権の切れたキーもアドレスが同じなら片付ける
+    for (auto it = queues.begin(); it != queues.end();) {
+        auto next = std::next(it);
+        if (it->second->target == &device) Remove(it);
+        it = next;
+    }
+}
+
+size_t CommandQueue::DeviceCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queues.size();
+}
+
+CommandQueue::QueueMap::iterator CommandQueue::Find(const TransportDevice& device)
+{
+    // 参照からは所有権がわからないので、アドレスが同じで破棄されていないデバイスのキューを探す（数台なので線形に探す）
+    for (auto it = queues.begin(); it != queues.end(); ++it)
+        if (it->second->target == &device && !it->first.expired()) return it;
+    return queues.end();
+}
+
+void CommandQueue::Remove(QueueMap::iterator it)
+{
+    std::shared_ptr<DeviceQueue> queue = it->second;
+    if (queue->verifying) pendingVerifies.fetch_sub(1, std::memory_order_relaxed);
+    queue->verifying = false;
+    queue->entries.clear();
+    queue->device.reset();
+    queue->closed = true;
+    queue->wake.notify_all();
+    queues.erase(it);
+    retired.push_back(std::move(queue));
+    idle.notify_all();
+}
+
+void CommandQueue::JoinRetired()
+{
+    // 終了した送信スレッドだけを待つ（書き込み中のスレッドを待って呼び出し側をブロックしない）
+    std::vector<std::shared_ptr<DeviceQueue>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (retired.empty()) return;
+        auto done = std::partition(retired.begin(), retired.end(), [](const auto& queue) { return !queue->exited; });
+        finished.assign(done, retired.end());
+        retired.erase(done, retired.end());
+    }
+    for (auto& queue : finished)
+        if (queue->sender.joinable()) queue->sender.join();
+}
+
+void CommandQueue::Arm(DeviceQueue& queue, Clock::time_point now)
+{
+    // 先頭が確認なら、ここから入力レポートを待ち始める
+    if (queue.entries.empty() || !queue.entries.front().verify || queue.verifying) return;
+    queue.verifying = true;
+    queue.reported = false;
+    queue.verifyDeadline = now + config.verifyTimeout;
+    pendingVerifies.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CommandQueue::Run(std::shared_ptr<DeviceQueue> queue)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping && !queue->closed)
+    {
+        if (queue->entries.empty()) {
+            // 一定時間空のままならキューを片付けて終了する（閉じたデバイスのキューとスレッドを残さない）
+            if (queue->wake.wait_for(lock, config.idleTimeout) == std::cv_status::timeout &&
+                !stopping && !queue->closed && queue->entries.empty())
+                Remove(queues.find(queue->owner));
+            continue;
+        }
+
+        // 前の書き込みの完了からの間隔と、確認の入力レポート（またはその期限）を待つ
+        auto readyAt = queue->readyAt;
+        if (queue->entries.front().verify && !queue->reported)
+            readyAt = std::max(readyAt, queue->verifyDeadline);
+        if (readyAt > Clock::now()) {
+            queue->wake.wait_until(lock, readyAt);
+            continue;
+        }
+
+        Entry entry = std::move(queue->entries.front());
+        queue->entries.pop_front();
+        queue->busy = true;
+        bool success = false;
+        if (entry.verify) {
+            success = queue->reported;
+            queue->verifying = false;
+            pendingVerifies.fetch_sub(1, std::memory_order_relaxed);
+        }
+        auto device = queue->device;
+
+        // 書き込みと完了関数の呼び出しはロックの外で行う（その間も他のデバイスは送信でき、キューにも追加できる）
+        lock.unlock();
+        if (!entry.verify) success = device->WriteCommand(entry.command);
+        if (entry.done) entry.done(success);
+        device.reset();
+        lock.lock();
+
+        queue->busy = false;
+        // 書き込みの完了から一定時間空けて次を送る
+        queue->readyAt = entry.verify ? Clock::now() : Clock::now() + config.interval;
+        // 空になったらデバイスの参照を手放す（間隔の管理のため、片付けるまでは要素を残す）
+        if (queue->entries.empty()) queue->device.reset();
+        else Arm(*queue, Clock::now());
+        idle.notify_all();
+    }
+    queue->exited = true;
+}
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Transport.h"
+
+/**
+ * @struct CommandQueueConfig
+ * @brief コマンド送信の間隔などの設定
+ */
+struct CommandQueueConfig {
+    std::chrono::milliseconds interval{ 10 };        // 同じデバイスへの書き込みが完了してから次を送るまでの間隔
+    std::chrono::milliseconds verifyTimeout{ 2000 }; // 入力レポートによる確認を待つ最大時間
+    std::chrono::milliseconds idleTimeout{ 5000 };   // 空になったキューと送信スレッドを片付けるまでの時間
+};
+
+/**
+ * @class CommandQueue
+ * @brief デバイスごとのコマンド送信キュー（デバイスごとの送信スレッドで処理する）
+ *
+ * 同じデバイスへのコマンドは前の書き込みの完了を待ってから順番に送り、
+ * 異なるデバイスのコマンドは並行して送る（応答の遅いデバイスが他のデバイスを待たせない）。
+ * 呼び出し側はブロックされない。初期化コマンドのほか、振動やLEDなど実行中のコマンドにも使う。
+ * デバイスのキューはCancelか、一定時間空のままになったときに送信スレッドごと片付ける。
+ */
+class CommandQueue {
+public:
+    /**
+     * @brief コマンドの完了時にそのデバイスの送信スレッドから呼ばれる関数
+     * @param success 書き込み（または確認）に成功したらtrue
+     */
+    using Completion = std::function<void(bool success)>;
+
+    explicit CommandQueue(const CommandQueueConfig& config = CommandQueueConfig());
+    ~CommandQueue();
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    /**
+     * @brief コマンドをキューに追加する
+     * @param device 送信先のデバイス
+     * @param command 送信するデータ
+     * @param done 完了時に呼ばれる関数（省略可）
+     */
+    void Enqueue(const std::shared_ptr<TransportDevice>& device, std::vector<uint8_t> command, Completion done = nullptr);
+
+    /**
+     * @brief 有効な入力レポートが届くまで、このデバイスの以降のコマンドを待たせる
+     * @param device 確認するデバイス
+     * @param done 確認できたか、タイムアウトしたときに呼ばれる関数（省略可）
+     * @note 入力ハンドラからReportReceivedを呼ぶ必要がある
+     */
+    void EnqueueVerify(const std::shared_ptr<TransportDevice>& device, Completion done = nullptr);
+
+    /**
+     * @brief 有効な入力レポートを受信したことを通知する（入力ハンドラから呼ぶ）
+     * @note 確認待ちがなければロックを取らずにすぐ戻る
+     */
+    void ReportReceived(const TransportDevice& device);
+
+    /**
+     * @brief デバイスのキューが空になるまで待つ
+     * @return タイムアウトまでに空になったらtrue
+     */
+    bool WaitIdle(const TransportDevice& device, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief デバイスの未送信のコマンドを破棄し、キューと送信スレッドを片付ける（完了関数は呼ばれない）
+     * @note デバイスを閉じるときに呼ぶ（破棄中のデバイスのデストラクタからも呼べる）
+     */
+    void Cancel(const TransportDevice& device);
+
+    /**
+     * @brief キューを持っているデバイスの数（片付いたことの確認用）
+     */
+    size_t DeviceCount();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::vector<uint8_t> command;
+        bool verify = false; // 入力レポートによる確認
+        Completion done;
+    };
+
+    struct DeviceQueue {
+        std::weak_ptr<TransportDevice> owner;    // キュー（mapのキー）
+        const TransportDevice* target = nullptr; // 参照で渡されたデバイスとの照合用
+        std::shared_ptr<TransportDevice> device;
+        std::deque<Entry> entries;
+        std::thread sender;                 // このデバイスの送信スレッド（最初のコマンドで開始する）
+        std::condition_variable wake;       // 送信スレッドを起こす
+        Clock::time_point readyAt{};        // 次のコマンドを送ってよい時刻
+        Clock::time_point verifyDeadline{}; // 確認の期限
+        bool busy = false;                  // 書き込み中
+        bool verifying = false;             // 先頭の確認が開始済み
+        bool reported = false;              // 確認の開始後に入力レポートが届いた
+        bool closed = false;                // キューから外された（送信スレッドは終了する）
+        bool exited = false;                // 送信スレッドが終了した（待ってもブロックしない）
+    };
+
+    // デバイスの所有権で区別する（破棄されたデバイスと同じアドレスに作られたデバイスは別のキューになる）
+    using QueueMap = std::map<std::weak_ptr<TransportDevice>, std::shared_ptr<DeviceQueue>, std::owner_less<>>;
+
+    void Push(const std::shared_ptr<TransportDevice>& device, Entry entry);
+    void Arm(DeviceQueue& queue, Clock::time_point now);
+    void Run(std::shared_ptr<DeviceQueue> queue);
+    QueueMap::iterator Find(const TransportDevice& device);
+    void Remove(QueueMap::iterator it);
+    void JoinRetired();
+
+    CommandQueueConfig config;
+
+    std::mutex mutex;
+    std::condition_variable idle; // キューの処理が進んだ
+    QueueMap queues;
+    std::vector<std::shared_ptr<DeviceQueue>> retired; // 片付けたキュー（送信スレッドは終了後の追加かデストラクタで待つ）
+    std::atomic<int> pendingVerifies{ 0 };
+    bool stopping = false;
+};
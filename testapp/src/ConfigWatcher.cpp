@@ -0,0 +1,154 @@
+﻿#include "ConfigWatcher.h"
+
+#include <system_error>
+#include <utility>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#elif defined(_WIN32)
+#include <Windows.h>
+#endif
+
+// 変更通知が使えないときに更新時刻を確認する間隔（通知が使える場合も取りこぼし対策に確認する）
+constexpr std::chrono::milliseconds POLL_INTERVAL{ 1000 };
+// 続けて届く通知をまとめる時間（エディタは保存時に複数回書き込むことがある）
+constexpr std::chrono::milliseconds DEBOUNCE_INTERVAL{ 100 };
+
+/**
+ * @brief ファイルの更新時刻を取得する
+ * @return 更新時刻（ファイルが存在しなければnullopt）
+ */
+static std::optional<std::filesystem::file_time_type> file_time(const std::string& path)
+{
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    return time;
+}
+
+ConfigWatcher::ConfigWatcher(std::vector<std::string> files, ChangeHandler handler)
+    : files(std::move(files)), handler(std::move(handler))
+{
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    Stop();
+}
+
+void ConfigWatcher::Start()
+{
+    if (running.exchange(true)) return;
+
+    // 監視を始める前の状態を基準にする
+    times.clear();
+    for (const auto& file : files)
+        times.push_back(file_time(file));
+
+#if defined(__linux__)
+    // ファイルは保存時に置き換えられることがあるので、ファイルではなくディレクトリを監視する
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd >= 0 && (inotify_add_watch(notifyFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0 ||
+        pipe2(stopPipe, O_CLOEXEC) < 0)) {
+        close(notifyFd);
+        notifyFd = -1;
+    }
+#elif defined(_WIN32)
+    changeHandle = FindFirstChangeNotificationW(L".", FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (changeHandle == INVALID_HANDLE_VALUE) changeHandle = nullptr;
+    stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#endif
+
+    thread = std::thread(&ConfigWatcher::Run, this);
+}
+
+void ConfigWatcher::Stop()
+{
+    if (!running.exchange(false)) return;
+
+    // 監視スレッドを起こして終了させる
+#if defined(__linux__)
+    if (notifyFd >= 0) {
+        char stop = 0;
+        if (write(stopPipe[1], &stop, 1) < 0) {}
+    }
+#elif defined(_WIN32)
+    if (stopEvent) SetEvent(stopEvent);
+#endif
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    wake.notify_all();
+    if (thread.joinable()) thread.join();
+
+#if defined(__linux__)
+    if (notifyFd >= 0) {
+        close(notifyFd);
+        close(stopPipe[0]);
+        close(stopPipe[1]);
+        notifyFd = -1;
+    }
+#elif defined(_WIN32)
+    if (changeHandle) FindCloseChangeNotification(changeHandle);
+    if (stopEvent) CloseHandle(stopEvent);
+    changeHandle = nullptr;
+    stopEvent = nullptr;
+#endif
+}
+
+bool ConfigWatcher::Wait(std::chrono::milliseconds timeout)
+{
+#if defined(__linux__)
+    if (notifyFd >= 0) {
+        pollfd fds[2] = { { notifyFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, static_cast<int>(timeout.count())) <= 0 || fds[1].revents) return false;
+
+        // 届いたイベントは読み捨てる（どのファイルが変わったかは更新時刻で判定する）
+        alignas(inotify_event) char buffer[4096];
+        while (read(notifyFd, buffer, sizeof(buffer)) > 0) {}
+        return true;
+    }
+#elif defined(_WIN32)
+    if (changeHandle && stopEvent) {
+        HANDLE handles[2] = { changeHandle, stopEvent };
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, static_cast<DWORD>(timeout.count()));
+        if (result != WAIT_OBJECT_0) return false;
+        FindNextChangeNotification(changeHandle);
+        return true;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait_for(lock, timeout, [this]() { return !running.load(); });
+    return false;
+}
+
+bool ConfigWatcher::Changed()
+{
+    bool changed = false;
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto time = file_time(files[i]);
+        if (time != times[i]) {
+            times[i] = time;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void ConfigWatcher::Run()
+{
+    while (running.load())
+    {
+        // 通知があれば、続けて届く通知が落ち着くまで待つ
+        if (Wait(POLL_INTERVAL)) {
+            while (running.load() && Wait(DEBOUNCE_INTERVAL)) {}
+        }
+        if (!running.load()) break;
+
+        if (Changed()) handler();
+    }
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ConfigWatcher
+ * @brief 設定ファイルの変更を監視し、変更されたらバックグラウンドのスレッドで通知する
+ *
+ * 作業ディレクトリの変更通知（Linuxはinotify、WindowsはFindFirstChangeNotification）で起き、
+ * 監視対象のファイルの更新時刻を比べて変更を判定する。エディタの保存で続けて届く通知は
+ * まとめて1回にする。通知が使えない環境では一定間隔で更新時刻を確認する。
+ */
+class ConfigWatcher {
+public:
+    /**
+     * @brief 監視対象のファイルが変更されたときに監視スレッドから呼ばれる関数
+     */
+    using ChangeHandler = std::function<void()>;
+
+    /**
+     * @param files 監視するファイル名（作業ディレクトリからの相対パス。存在しなくてもよい）
+     * @param handler 変更時に呼ばれる関数（設定の読み込みと公開を行う）
+     */
+    ConfigWatcher(std::vector<std::string> files, ChangeHandler handler);
+    ~ConfigWatcher();
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    /**
+     * @brief 監視スレッドを開始
+     */
+    void Start();
+
+    /**
+     * @brief 監視スレッドを停止し、終了を待つ
+     */
+    void Stop();
+
+private:
+    using FileTime = std::optional<std::filesystem::file_time_type>;
+
+    void Run();
+    bool Wait(std::chrono::milliseconds timeout);
+    bool Changed();
+
+    std::vector<std::string> files;
+    std::vector<FileTime> times; // 前回確認したときの更新時刻（存在しなければnullopt）
+    ChangeHandler handler;
+
+    std::atomic<bool> running{ false };
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+#if defined(__linux__)
+    int notifyFd = -1;
+    int stopPipe[2] = { -1, -1 };
+#elif defined(_WIN32)
+    void* changeHandle = nullptr;
+    void* stopEvent = nullptr;
+#endif
+};
@@ -0,0 +1,223 @@
+﻿#include "ControllerFeedback.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+// プレイヤーLEDのコマンド（初期化コマンドと同じ形式）
+constexpr uint8_t LED_COMMAND = 0x09;
+constexpr uint8_t LED_SET_PLAYER = 0x07;
+
+// 完了が届かないコマンド（切断で破棄されたものなど）を諦めるまでの時間
+constexpr std::chrono::seconds IN_FLIGHT_TIMEOUT{ 1 };
+
+/**
+ * @brief プレイヤー番号（0から）のLEDの点灯パターン（番号の数だけ下から点灯する）
+ */
+static uint8_t player_leds(int index)
+{
+    return static_cast<uint8_t>((1u << (std::clamp(index, 0, 3) + 1)) - 1);
+}
+
+uint8_t PlayerLedsForNumber(int number)
+{
+    return player_leds(number - 1);
+}
+
+std::vector<uint8_t> BuildPlayerLedCommand(uint8_t pattern)
+{
+    return { LED_COMMAND, 0x91, 0x01, LED_SET_PLAYER, 0x00, 0x08, 0x00, 0x00,
+        static_cast<uint8_t>(pattern & 0x0F), 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+}
+
+RumbleFrame RumbleFrameForMotor(const OutputFeedback& feedback, FeedbackMotor motor)
+{
+    RumbleFrame frame;
+    if (motor != FeedbackMotor::Small) frame.low.amplitude = feedback.largeMotor;
+    if (motor != FeedbackMotor::Large) frame.high.amplitude = feedback.smallMotor;
+    return frame;
+}
+
+uint8_t PlayerLedPattern(const OutputFeedback& feedback, uint8_t fallback)
+{
+    if (feedback.ledNumber >= 0) return player_leds(feedback.ledNumber);
+
+    // ライトバーは明るさを揃えてから、各プレイヤーの既定の色に最も近いものを選ぶ
+    int brightest = std::max({ feedback.red, feedback.green, feedback.blue });
+    if (brightest == 0) return fallback;
+    int r = feedback.red * 255 / brightest;
+    int g = feedback.green * 255 / brightest;
+    int b = feedback.blue * 255 / brightest;
+
+    struct Color { int r, g, b; };
+    constexpr Color PLAYER_COLORS[4] = { { 0, 0, 255 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 0, 255 } };
+    int best = 0;
+    int bestDistance = std::numeric_limits<int>::max();
+    for (int i = 0; i < 4; ++i) {
+        int dr = r - PLAYER_COLORS[i].r, dg = g - PLAYER_COLORS[i].g, db = b - PLAYER_COLORS[i].b;
+        int distance = dr * dr + dg * dg + db * db;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = i;
+        }
+    }
+    return player_leds(best);
+}
+
+std::shared_ptr<ControllerFeedback> ControllerFeedback::Create(CommandQueue& queue, std::vector<FeedbackTarget> targets,
+    const FeedbackConfig& config)
+{
+    std::shared_ptr<ControllerFeedback> feedback(new ControllerFeedback(queue, std::move(targets), config));
+    feedback->worker = std::thread(&ControllerFeedback::Run, feedback.get());
+    return feedback;
+}
+
+ControllerFeedback::ControllerFeedback(CommandQueue& queue, std::vector<FeedbackTarget> targets, const FeedbackConfig& config)
+    : queue(queue), targets(std::move(targets)), config(config)
+{
+    mixers.resize(this->targets.size());
+    sentFrames.resize(this->targets.size());
+}
+
+ControllerFeedback::~ControllerFeedback()
+{
+    Stop();
+}
+
+void ControllerFeedback::Update(const OutputFeedback& feedback)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.received++;
+        if (pending) stats.coalesced++;
+        latest = feedback;
+        pending = true;
+    }
+    wake.notify_one();
+}
+
+void ControllerFeedback::Play(const RumbleEffect& effect)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 送信前に溜まりすぎた場合は最後の効果を置き換える
+        if (queuedEffectCount < queuedEffects.size()) queuedEffectCount++;
+        queuedEffects[queuedEffectCount - 1] = effect;
+        pending = true;
+    }
+    wake.notify_one();
+}
+
+void ControllerFeedback::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (!worker.joinable()) return;
+    if (worker.get_id() == std::this_thread::get_id()) worker.detach();
+    else worker.join();
+}
+
+FeedbackStats ControllerFeedback::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void ControllerFeedback::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto lastSend = Clock::time_point{};
+    auto nextSend = Clock::time_point{};
+    bool animating = false; // 効果が鳴っていて、次のフレームも送る
+    while (true) {
+        // 送信中のコマンドが無くなり、最短の間隔が過ぎるまで待つ（その間の変化は上書きされる）
+        auto ready = [this, &animating]() { return stopping || ((pending || animating) && inFlight == 0); };
+        if (!wake.wait_for(lock, IN_FLIGHT_TIMEOUT, ready)) {
+            if ((pending || animating) && inFlight > 0 && Clock::now() - lastSend > IN_FLIGHT_TIMEOUT) inFlight = 0;
+            continue;
+        }
+        if (stopping) break;
+        if (wake.wait_until(lock, nextSend, [this]() { return stopping; })) break;
+
+        OutputFeedback feedback = latest;
+        pending = false;
+        std::array<RumbleEffect, RumbleMixer::MAX_EFFECTS> effects = queuedEffects;
+        size_t effectCount = std::exchange(queuedEffectCount, 0);
+        lock.unlock();
+
+        for (auto& mixer : mixers)
+            for (size_t i = 0; i < effectCount; ++i)
+                mixer.Play(effects[i]);
+        Send(feedback, false);
+
+        // 効果が鳴っている間と、鳴り終わってゲームの振動に戻すまでは続けて送る
+        animating = false;
+        for (size_t i = 0; i < mixers.size(); ++i)
+            animating = animating || mixers[i].Active() || mixers[i].Mix() != sentFrames[i];
+        lock.lock();
+        lastSend = Clock::now();
+        nextSend = lastSend + config.minInterval;
+    }
+    lock.unlock();
+
+    // 振動したまま終わらないように止める
+    bool rumbling = std::any_of(sentFrames.begin(), sentFrames.end(), [](const RumbleFrame& frame) { return !frame.Silent(); });
+    if (hasSent && rumbling) {
+        for (auto& mixer : mixers)
+            mixer.Clear();
+        Send(OutputFeedback(), true);
+    }
+}
+
+void ControllerFeedback::Send(const OutputFeedback& feedback, bool force)
+{
+    uint8_t leds = PlayerLedPattern(feedback, config.defaultLeds);
+    bool ledsChanged = !force && (!hasSent || leds != sentLeds);
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        const auto& target = targets[i];
+        if (ledsChanged) Enqueue(target, BuildPlayerLedCommand(leds));
+
+        // ゲームの振動に効果を重ね、変わったときだけ送る（効果は送らなくても1フレーム進める）
+        RumbleMixer& mixer = mixers[i];
+        mixer.SetContinuous(RumbleFrameForMotor(feedback, target.motor));
+        RumbleFrame frame = mixer.Mix();
+        if (force || !hasSent || frame != sentFrames[i]) {
+            RumblePacket packet = mixer.Render();
+            Enqueue(target, std::vector<uint8_t>(packet.begin(), packet.end()));
+            sentFrames[i] = frame;
+        }
+        else {
+            mixer.Advance();
+        }
+    }
+
+    hasSent = true;
+    sentLeds = leds;
+}
+
+void ControllerFeedback::Enqueue(const FeedbackTarget& target, std::vector<uint8_t> command)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight++;
+        stats.sent++;
+    }
+    // 完了はキューの送信スレッドから届く（破棄後に届いた完了は無視する）
+    queue.Enqueue(target.device, std::move(command), [self = weak_from_this()](bool)
+        {
+            if (auto feedback = self.lock()) feedback->Completed();
+        });
+}
+
+void ControllerFeedback::Completed()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (inFlight > 0) inFlight--;
+    }
+    wake.notify_one();
+}
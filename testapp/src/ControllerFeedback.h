@@ -0,0 +1,156 @@
+﻿#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CommandQueue.h"
+#include "OutputSink.h"
+#include "RumbleSynth.h"
+
+/**
+ * @enum FeedbackMotor
+ * @brief コントローラーに割り当てる仮想ゲームパッドのモーター
+ */
+enum class FeedbackMotor : uint8_t {
+    Both,   // 強い振動を低い周波数、弱い振動を高い周波数で鳴らす（Joy-Con単体、Proコンなど）
+    Large,  // 強い振動だけ（両手持ちの左Joy-Con）
+    Small   // 弱い振動だけ（両手持ちの右Joy-Con）
+};
+
+/**
+ * @struct FeedbackTarget
+ * @brief 振動とLEDを送るコントローラー
+ */
+struct FeedbackTarget {
+    std::shared_ptr<TransportDevice> device;
+    FeedbackMotor motor = FeedbackMotor::Both;
+};
+
+/**
+ * @struct FeedbackConfig
+ * @brief フィードバックの送信の設定
+ */
+struct FeedbackConfig {
+    std::chrono::milliseconds minInterval{ 30 }; // コマンドを送る最短の間隔（その間の変化は最新の状態にまとめる）
+    uint8_t defaultLeds = 0x01;                  // ゲームから指定が無いときのプレイヤーLED（ビットマスク）
+};
+
+/**
+ * @struct FeedbackStats
+ * @brief フィードバックの送信の統計
+ */
+struct FeedbackStats {
+    uint64_t received = 0;   // 出力先から受け取った状態の数
+    uint64_t sent = 0;       // 送信したコマンドの数
+    uint64_t coalesced = 0;  // 送信前に新しい状態で上書きされた数
+};
+
+/**
+ * @brief プレイヤーLEDを設定するコマンドを作る
+ * @param pattern 点灯させるLEDのビットマスク（下位4ビット）
+ */
+std::vector<uint8_t> BuildPlayerLedCommand(uint8_t pattern);
+
+/**
+ * @brief ゲームの振動をコントローラーの振動にする（強い振動は低い周波数、弱い振動は高い周波数）
+ * @param feedback ゲームからの出力
+ * @param motor コントローラーに割り当てるモーター
+ */
+RumbleFrame RumbleFrameForMotor(const OutputFeedback& feedback, FeedbackMotor motor);
+
+/**
+ * @brief プレイヤー番号のLEDの点灯パターン（番号の数だけ点灯する）
+ * @param number プレイヤー番号（1から。5以上は4として扱う）
+ */
+uint8_t PlayerLedsForNumber(int number);
+
+/**
+ * @brief ゲームからの出力をプレイヤーLEDの点灯パターンにする
+ * @param feedback ゲームからの出力
+ * @param fallback 指定が無いときのパターン
+ * @note XInputのLED番号はその番号のLED、DS4のライトバーは各プレイヤーの既定の色（青・赤・緑・ピンク）から選ぶ
+ */
+uint8_t PlayerLedPattern(const OutputFeedback& feedback, uint8_t fallback);
+
+/**
+ * @class ControllerFeedback
+ * @brief ゲームからの振動とライトバーを、コントローラーの振動とプレイヤーLEDのコマンドにして送る
+ *
+ * 出力先のスレッドから受け取った状態は最新の1件だけを保持し、専用のスレッドが
+ * コマンド送信キューに渡す。コマンドが送信中の間や最短の間隔を空けるまでの変化は
+ * 最新の状態にまとめるので、入力や他のコマンドの送信を待たせない。
+ * 振動はコントローラーごとに合成し、効果が鳴っている間は最短の間隔ごとに送り続ける。
+ */
+class ControllerFeedback : public std::enable_shared_from_this<ControllerFeedback> {
+public:
+    /**
+     * @brief フィードバックの送信を開始する
+     * @param queue コマンド送信キュー（このオブジェクトより長く存在すること）
+     * @param targets 振動とLEDを送るコントローラー
+     * @param config 送信の設定
+     */
+    static std::shared_ptr<ControllerFeedback> Create(CommandQueue& queue, std::vector<FeedbackTarget> targets,
+        const FeedbackConfig& config = FeedbackConfig());
+
+    ~ControllerFeedback();
+
+    ControllerFeedback(const ControllerFeedback&) = delete;
+    ControllerFeedback& operator=(const ControllerFeedback&) = delete;
+
+    /**
+     * @brief ゲームからの最新の状態を渡す（出力先のスレッドから呼ばれ、送信を待たずに戻る）
+     */
+    void Update(const OutputFeedback& feedback);
+
+    /**
+     * @brief 全てのコントローラーで効果（UIのクリックなど）を鳴らす（ゲームの振動に重ねる）
+     */
+    void Play(const RumbleEffect& effect);
+
+    /**
+     * @brief 送信スレッドを停止する（振動は止めてから終わる）
+     */
+    void Stop();
+
+    /**
+     * @brief 送信の統計を取得
+     */
+    FeedbackStats Stats() const;
+
+private:
+    ControllerFeedback(CommandQueue& queue, std::vector<FeedbackTarget> targets, const FeedbackConfig& config);
+
+    using Clock = std::chrono::steady_clock;
+
+    void Run();
+    void Send(const OutputFeedback& feedback, bool force);
+    void Enqueue(const FeedbackTarget& target, std::vector<uint8_t> command);
+    void Completed();
+
+    CommandQueue& queue;
+    std::vector<FeedbackTarget> targets;
+    FeedbackConfig config;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    OutputFeedback latest;       // 最新の状態
+    bool pending = false;        // 送信していない状態がある
+    size_t inFlight = 0;         // 送信中のコマンドの数
+    bool stopping = false;
+    std::array<RumbleEffect, RumbleMixer::MAX_EFFECTS> queuedEffects{}; // 次の送信で鳴らし始める効果
+    size_t queuedEffectCount = 0;
+    FeedbackStats stats;
+    std::thread worker;
+
+    // 送信スレッドだけが使う（コントローラーごとの振動の合成と、送った振動）
+    std::vector<RumbleMixer> mixers;
+    std::vector<RumbleFrame> sentFrames;
+    bool hasSent = false;
+    uint8_t sentLeds = 0;
+};
@@ -0,0 +1,150 @@
+﻿#pragma once
+
+// DS4のレポートの型
+// WindowsはViGEmの定義をそのまま使い、それ以外のプラットフォームでは同じ名前と配置の定義を置く
+#ifdef _WIN32
+
+#include <Windows.h>
+#include <ViGEm/Common.h>
+
+#else
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @enum DS4_BUTTONS
+ * @brief DS4のボタン（wButtonsのビット）
+ */
+enum DS4_BUTTONS : uint16_t {
+    DS4_BUTTON_THUMB_RIGHT    = 1 << 15,
+    DS4_BUTTON_THUMB_LEFT     = 1 << 14,
+    DS4_BUTTON_OPTIONS        = 1 << 13,
+    DS4_BUTTON_SHARE          = 1 << 12,
+    DS4_BUTTON_TRIGGER_RIGHT  = 1 << 11,
+    DS4_BUTTON_TRIGGER_LEFT   = 1 << 10,
+    DS4_BUTTON_SHOULDER_RIGHT = 1 << 9,
+    DS4_BUTTON_SHOULDER_LEFT  = 1 << 8,
+    DS4_BUTTON_TRIANGLE       = 1 << 7,
+    DS4_BUTTON_CIRCLE         = 1 << 6,
+    DS4_BUTTON_CROSS          = 1 << 5,
+    DS4_BUTTON_SQUARE         = 1 << 4
+};
+
+/**
+ * @enum DS4_SPECIAL_BUTTONS
+ * @brief DS4の特殊ボタン（bSpecialのビット）
+ */
+enum DS4_SPECIAL_BUTTONS : uint8_t {
+    DS4_SPECIAL_BUTTON_PS       = 1 << 0,
+    DS4_SPECIAL_BUTTON_TOUCHPAD = 1 << 1
+};
+
+/**
+ * @enum DS4_DPAD_DIRECTIONS
+ * @brief DS4の方向キー（wButtonsの下位4ビット）
+ */
+enum DS4_DPAD_DIRECTIONS : uint16_t {
+    DS4_BUTTON_DPAD_NONE      = 0x8,
+    DS4_BUTTON_DPAD_NORTHWEST = 0x7,
+    DS4_BUTTON_DPAD_WEST      = 0x6,
+    DS4_BUTTON_DPAD_SOUTHWEST = 0x5,
+    DS4_BUTTON_DPAD_SOUTH     = 0x4,
+    DS4_BUTTON_DPAD_SOUTHEAST = 0x3,
+    DS4_BUTTON_DPAD_EAST      = 0x2,
+    DS4_BUTTON_DPAD_NORTHEAST = 0x1,
+    DS4_BUTTON_DPAD_NORTH     = 0x0
+};
+
+/**
+ * @struct DS4_REPORT
+ * @brief DS4の入力レポートの先頭（スティック、ボタン、トリガー）
+ */
+struct DS4_REPORT {
+    uint8_t bThumbLX;
+    uint8_t bThumbLY;
+    uint8_t bThumbRX;
+    uint8_t bThumbRY;
+    uint16_t wButtons;
+    uint8_t bSpecial;
+    uint8_t bTriggerL;
+    uint8_t bTriggerR;
+};
+using PDS4_REPORT = DS4_REPORT*;
+
+/**
+ * @brief 方向キーの状態を設定する
+ */
+inline void DS4_SET_DPAD(PDS4_REPORT report, DS4_DPAD_DIRECTIONS dpad)
+{
+    report->wButtons &= ~0xF;
+    report->wButtons |= static_cast<uint16_t>(dpad);
+}
+
+/**
+ * @brief レポートを中立の状態（スティックは中央、方向キーは離した状態）にする
+ */
+inline void DS4_REPORT_INIT(PDS4_REPORT report)
+{
+    std::memset(report, 0, sizeof(DS4_REPORT));
+    report->bThumbLX = 0x80;
+    report->bThumbLY = 0x80;
+    report->bThumbRX = 0x80;
+    report->bThumbRY = 0x80;
+    DS4_SET_DPAD(report, DS4_BUTTON_DPAD_NONE);
+}
+
+#pragma pack(push, 1)
+
+/**
+ * @struct DS4_TOUCH
+ * @brief DS4のタッチパッドのデータ（2本の指）
+ */
+struct DS4_TOUCH {
+    uint8_t bPacketCounter;    // タッチのパケットの連番
+    uint8_t bIsUpTrackingNum1; // 最上位ビットが1なら離している、下位7ビットは指の番号
+    uint8_t bTouchData1[3];    // 12ビットのXとY
+    uint8_t bIsUpTrackingNum2;
+    uint8_t bTouchData2[3];
+};
+
+/**
+ * @struct DS4_REPORT_EX
+ * @brief DS4の入力レポート全体（レポートIDを除く63バイト）
+ */
+struct DS4_REPORT_EX {
+    union {
+        struct {
+            uint8_t bThumbLX;
+            uint8_t bThumbLY;
+            uint8_t bThumbRX;
+            uint8_t bThumbRY;
+            uint16_t wButtons;
+            uint8_t bSpecial;
+            uint8_t bTriggerL;
+            uint8_t bTriggerR;
+            uint16_t wTimestamp;
+            uint8_t bBatteryLvl;
+            int16_t wGyroX;
+            int16_t wGyroY;
+            int16_t wGyroZ;
+            int16_t wAccelX;
+            int16_t wAccelY;
+            int16_t wAccelZ;
+            uint8_t _bUnknown1[5];
+            uint8_t bBatteryLvlSpecial;
+            uint8_t _bUnknown2[2];
+            uint8_t bTouchPacketsN;
+            DS4_TOUCH sCurrentTouch;
+            DS4_TOUCH sPreviousTouch[2];
+        } Report;
+
+        uint8_t ReportBuffer[63];
+    };
+};
+
+#pragma pack(pop)
+
+#endif
+
+static_assert(sizeof(DS4_REPORT_EX) == 63, "DS4_REPORT_EX layout");
@@ -0,0 +1,116 @@
+﻿#include "DeviceCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+// デバイス情報のキャッシュファイル
+constexpr const char* DEVICE_CACHE_FILE = "device_cache.txt";
+// 空の位置を表す文字列（ファイル上で空白区切りにするため）
+constexpr const char* EMPTY_LOCATION = "-";
+
+// アドレスごとのデバイス情報
+static std::mutex g_deviceCacheMutex;
+static std::unordered_map<uint64_t, DeviceCacheEntry> g_deviceCache;
+
+// 接続時間の統計
+static std::mutex g_connectTimingMutex;
+static ConnectTimingStats g_connectTiming;
+
+void RecordConnectTime(ConnectPath path, std::chrono::steady_clock::duration total, std::chrono::steady_clock::duration resolve)
+{
+    double totalTime = std::chrono::duration<double>(total).count();
+    std::lock_guard<std::mutex> lock(g_connectTimingMutex);
+    ConnectTiming& timing = (path == ConnectPath::Cached) ? g_connectTiming.cached : g_connectTiming.discovery;
+    timing.count++;
+    timing.totalTime += totalTime;
+    timing.maxTime = std::max(timing.maxTime, totalTime);
+    timing.resolveTime += std::chrono::duration<double>(resolve).count();
+}
+
+ConnectTimingStats GetConnectTimingStats()
+{
+    std::lock_guard<std::mutex> lock(g_connectTimingMutex);
+    return g_connectTiming;
+}
+
+void PrintConnectTimingStats()
+{
+    ConnectTimingStats stats = GetConnectTimingStats();
+    auto print = [](const wchar_t* name, const ConnectTiming& timing)
+        {
+            if (timing.count == 0) return;
+            std::wcout << L"  " << name << L": " << timing.count << L" connect(s), mean " << timing.totalTime / timing.count * 1000.0
+                << L" ms / max " << timing.maxTime * 1000.0 << L" ms (resolve mean " << timing.resolveTime / timing.count * 1000.0 << L" ms)\n";
+        };
+    if (stats.cached.count == 0 && stats.discovery.count == 0) return;
+    std::wcout << L"Connect time:\n";
+    print(L"cached", stats.cached);
+    print(L"full discovery", stats.discovery);
+}
+
+void LoadDeviceCache()
+{
+    std::ifstream ifs(DEVICE_CACHE_FILE);
+    if (!ifs.is_open()) return;
+
+    std::lock_guard<std::mutex> lock(g_deviceCacheMutex);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        // 形式: <16進アドレス> <種類> <入力の位置> <書き込みの位置>
+        std::istringstream iss(line);
+        uint64_t address = 0;
+        int model = 0;
+        DeviceCacheEntry entry;
+        if (iss >> std::hex >> address >> std::dec >> model >> entry.input >> entry.write) {
+            if (entry.input == EMPTY_LOCATION) entry.input.clear();
+            if (entry.write == EMPTY_LOCATION) entry.write.clear();
+            entry.model = static_cast<ControllerModel>(model);
+            g_deviceCache[address] = entry;
+        }
+    }
+    std::wcout << L"Loaded " << g_deviceCache.size() << L" known controller(s).\n";
+}
+
+void SaveDeviceCache()
+{
+    std::lock_guard<std::mutex> lock(g_deviceCacheMutex);
+    if (g_deviceCache.empty()) return;
+
+    std::ofstream ofs(DEVICE_CACHE_FILE, std::ios::trunc);
+    if (!ofs.is_open()) {
+        std::wcerr << L"Failed to write device_cache.txt.\n";
+        return;
+    }
+    for (const auto& [address, entry] : g_deviceCache) {
+        ofs << std::hex << address << std::dec << ' ' << static_cast<int>(entry.model) << ' '
+            << (entry.input.empty() ? EMPTY_LOCATION : entry.input) << ' '
+            << (entry.write.empty() ? EMPTY_LOCATION : entry.write) << '\n';
+    }
+}
+
+bool LookupDeviceCache(uint64_t address, DeviceCacheEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(g_deviceCacheMutex);
+    auto it = g_deviceCache.find(address);
+    if (it == g_deviceCache.end()) return false;
+    entry = it->second;
+    return true;
+}
+
+void StoreGattLocation(uint64_t address, const std::string& input, const std::string& write)
+{
+    std::lock_guard<std::mutex> lock(g_deviceCacheMutex);
+    auto& entry = g_deviceCache[address];
+    entry.input = input;
+    entry.write = write;
+}
+
+void StoreControllerModel(uint64_t address, ControllerModel model)
+{
+    std::lock_guard<std::mutex> lock(g_deviceCacheMutex);
+    g_deviceCache[address].model = model;
+}
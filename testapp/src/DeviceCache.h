@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Transport.h"
+
+/**
+ * @struct DeviceCacheEntry
+ * @brief 接続したことのあるコントローラーの情報（アドレスごと）
+ *
+ * キャラクタリスティックの位置は通信バックエンドごとの表現で保存する
+ * （WinRT: "<サービスUUID>/<ハンドル>"、BlueZ: デバイス配下のオブジェクトパス）。
+ */
+struct DeviceCacheEntry {
+    std::string input;  // 入力用キャラクタリスティックの位置（空なら未解決）
+    std::string write;  // 書き込み用キャラクタリスティックの位置（空なら無し）
+    ControllerModel model = ControllerModel::Unknown;
+};
+
+/**
+ * @enum ConnectPath
+ * @brief 接続でキャラクタリスティックを解決した方法
+ */
+enum class ConnectPath {
+    Cached,    // キャッシュした位置から直接取得した
+    Discovery, // 全てのサービスを探した（キャッシュが無いか古かった）
+};
+
+/**
+ * @struct ConnectTiming
+ * @brief 解決方法ごとの接続時間の統計
+ */
+struct ConnectTiming {
+    uint32_t count = 0;       // 接続した回数
+    double totalTime = 0.0;   // 接続全体の時間の合計 [s]
+    double maxTime = 0.0;     // 接続全体の最大の時間 [s]
+    double resolveTime = 0.0; // そのうちキャラクタリスティックの解決にかかった時間の合計 [s]
+};
+
+/**
+ * @struct ConnectTimingStats
+ * @brief 接続時間の統計（初回の接続と再接続の両方を含む）
+ */
+struct ConnectTimingStats {
+    ConnectTiming cached;
+    ConnectTiming discovery;
+};
+
+/**
+ * @brief 接続にかかった時間を記録する（通信バックエンドのConnectから、成功したときに呼ぶ）
+ * @param path キャラクタリスティックを解決した方法
+ * @param total Connectの呼び出しから戻るまでの時間
+ * @param resolve そのうちキャラクタリスティックの解決にかかった時間（キャッシュで省略できる部分）
+ */
+void RecordConnectTime(ConnectPath path, std::chrono::steady_clock::duration total, std::chrono::steady_clock::duration resolve);
+
+/**
+ * @brief 接続時間の統計を取得
+ */
+ConnectTimingStats GetConnectTimingStats();
+
+/**
+ * @brief 接続時間の統計をコンソールに表示する（接続が無ければ表示しない）
+ */
+void PrintConnectTimingStats();
+
+/**
+ * @brief device_cache.txt からアドレスごとのキャッシュを読み込む
+ */
+void LoadDeviceCache();
+
+/**
+ * @brief アドレスごとのキャッシュを device_cache.txt に保存
+ */
+void SaveDeviceCache();
+
+/**
+ * @brief キャッシュからデバイスの情報を取得
+ * @param address コントローラーのBluetoothアドレス
+ * @param entry 取得した情報を格納する参照
+ * @return キャッシュに存在した場合はtrue
+ */
+bool LookupDeviceCache(uint64_t address, DeviceCacheEntry& entry);
+
+/**
+ * @brief 解決したキャラクタリスティックの位置を登録（種類は保持する）
+ * @param address コントローラーのBluetoothアドレス
+ * @param input 入力用キャラクタリスティックの位置
+ * @param write 書き込み用キャラクタリスティックの位置（無ければ空）
+ */
+void StoreGattLocation(uint64_t address, const std::string& input, const std::string& write);
+
+/**
+ * @brief コントローラーの種類を登録（キャラクタリスティックの位置は保持する）
+ * @param address コントローラーのBluetoothアドレス
+ * @param model コントローラーの種類
+ */
+void StoreControllerModel(uint64_t address, ControllerModel model);
@@ -0,0 +1,73 @@
+﻿#include "DeviceClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+// 回帰の重み（約200サンプルの窓に相当）
+constexpr double CLOCK_REGRESSION_ALPHA = 1.0 / 200.0;
+// ドリフトの基準となる傾きを記録するまでのサンプル数
+constexpr uint64_t CLOCK_INITIAL_SAMPLES = 200;
+
+double DeviceClock::ToHostTime(uint32_t ticks, double arrival)
+{
+    if (!started) {
+        started = true;
+        lastTicks = ticks;
+        unwrapped = ticks;
+        firstTicks = unwrapped;
+        firstArrival = arrival;
+        count = 0;
+        meanX = meanY = varX = covXY = residualVar = 0.0;
+        initialSlope = 0.0;
+    }
+    else {
+        // 32ビットカウンタの巻き戻りを補正（差分は符号なしで計算）
+        unwrapped += static_cast<uint32_t>(ticks - lastTicks);
+        lastTicks = ticks;
+    }
+
+    // 桁落ちを避けるため最初のサンプルからの相対値で回帰する
+    double x = static_cast<double>(unwrapped - firstTicks);
+    double y = arrival - firstArrival;
+
+    // 回帰直線からのずれ（更新前の推定で評価）
+    double slope = varX > 0.0 ? covXY / varX : 0.0;
+    if (slope > 0.0) {
+        double residual = y - (meanY + slope * (x - meanX));
+        double a = CLOCK_REGRESSION_ALPHA;
+        residualVar = (1.0 - a) * (residualVar + a * residual * residual);
+    }
+
+    // 指数重み付きの平均・分散・共分散を更新（立ち上がりは単純平均）
+    ++count;
+    double a = std::max(1.0 / count, CLOCK_REGRESSION_ALPHA);
+    double dx = x - meanX;
+    double dy = y - meanY;
+    meanX += a * dx;
+    meanY += a * dy;
+    varX = (1.0 - a) * (varX + a * dx * dx);
+    covXY = (1.0 - a) * (covXY + a * dx * dy);
+
+    slope = varX > 0.0 ? covXY / varX : 0.0;
+    if (slope <= 0.0) return arrival;
+
+    if (count == CLOCK_INITIAL_SAMPLES) initialSlope = slope;
+
+    // サンプルが受信より後に取得されることはないので受信時刻で上限をかける
+    double predicted = firstArrival + meanY + slope * (x - meanX);
+    return std::min(predicted, arrival);
+}
+
+DeviceClockStats DeviceClock::Stats() const
+{
+    DeviceClockStats stats;
+    stats.samples = count;
+    if (varX <= 0.0) return stats;
+
+    stats.secondsPerTick = covXY / varX;
+    stats.offset = meanY - stats.secondsPerTick * meanX;
+    stats.jitter = std::sqrt(residualVar);
+    if (initialSlope > 0.0)
+        stats.driftPpm = (stats.secondsPerTick / initialSlope - 1.0) * 1e6;
+    return stats;
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <cstdint>
+
+/**
+ * @struct DeviceClockStats
+ * @brief コントローラーの時計とホストの時計の対応関係の推定値
+ */
+struct DeviceClockStats {
+    double secondsPerTick = 0.0; // タイムスタンプ1あたりのホスト秒数
+    double offset = 0.0;         // 最初のサンプル基準のオフセット（秒）
+    double driftPpm = 0.0;       // 推定開始時からの時計の進み方の変化(ppm)
+    double jitter = 0.0;         // 受信時刻の回帰直線からのずれの標準偏差（秒）
+    uint64_t samples = 0;        // 観測したサンプル数
+};
+
+/**
+ * @class DeviceClock
+ * @brief コントローラーのタイムスタンプをホストの時刻（秒）に変換する
+ *
+ * 32ビットのカウンタの巻き戻りを補正し、(タイムスタンプ, 受信時刻) の組から
+ * 指数重み付きのオンライン線形回帰でオフセットとドリフトを推定する。
+ */
+class DeviceClock {
+public:
+    /**
+     * @param ticks コントローラーのタイムスタンプ
+     * @param arrival 受信したホスト時刻（秒）
+     * @return サンプルが取得されたホスト時刻の推定値（秒）
+     */
+    double ToHostTime(uint32_t ticks, double arrival);
+
+    DeviceClockStats Stats() const;
+
+    void Reset() { started = false; }
+
+private:
+    bool started = false;
+    uint32_t lastTicks = 0;
+    uint64_t unwrapped = 0;
+    uint64_t firstTicks = 0;
+    double firstArrival = 0.0;
+
+    // 指数重み付きの平均・分散・共分散（x: タイムスタンプ, y: 受信時刻）
+    uint64_t count = 0;
+    double meanX = 0.0;
+    double meanY = 0.0;
+    double varX = 0.0;
+    double covXY = 0.0;
+    double residualVar = 0.0;
+    double initialSlope = 0.0;
+};
@@ -0,0 +1,715 @@
+﻿#ifdef _WIN32
+// winsock2.hはWindows.hより前に読み込む必要がある
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#endif
+
+#include "DsuServer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32) || defined(__linux__)
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <random>
+#include <thread>
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// パケットの共通部分
+constexpr uint16_t DSU_PROTOCOL_VERSION = 1001;
+constexpr size_t DSU_HEADER_SIZE = 16;            // マジック、バージョン、長さ、CRC32、ID
+constexpr size_t DSU_CRC_OFFSET = 8;
+constexpr size_t DSU_TYPE_OFFSET = DSU_HEADER_SIZE;
+constexpr size_t DSU_PAYLOAD_OFFSET = DSU_HEADER_SIZE + 4;
+
+// メッセージの種類
+constexpr uint32_t DSU_MESSAGE_VERSION = 0x100000;
+constexpr uint32_t DSU_MESSAGE_INFO = 0x100001;
+constexpr uint32_t DSU_MESSAGE_DATA = 0x100002;
+
+// データの要求の登録方法
+constexpr uint8_t DSU_REGISTER_SLOT = 0x01;
+constexpr uint8_t DSU_REGISTER_MAC = 0x02;
+
+// スロットの情報（種類の後ろの11バイト）
+constexpr uint8_t DSU_SLOT_CONNECTED = 2;
+constexpr uint8_t DSU_MODEL_FULL_GYRO = 2;
+constexpr uint8_t DSU_CONNECTION_BLUETOOTH = 2;
+constexpr uint8_t DSU_BATTERY_NONE = 0;
+constexpr size_t DSU_SLOT_INFO_SIZE = 11;
+
+// パケットの大きさ
+constexpr size_t DSU_VERSION_PACKET_SIZE = DSU_PAYLOAD_OFFSET + 2;
+constexpr size_t DSU_INFO_PACKET_SIZE = DSU_PAYLOAD_OFFSET + DSU_SLOT_INFO_SIZE + 1;
+static_assert(DSU_DATA_PACKET_SIZE == DSU_PAYLOAD_OFFSET + DSU_SLOT_INFO_SIZE + 69, "DSU data packet layout");
+
+// データのパケットで毎回変わる部分の先頭（スロットの情報と接続中のフラグの後ろ、パケット番号から）
+// ここまでのCRC32は接続したときに計算しておき、送信ごとには残りだけを計算する
+constexpr size_t DSU_DATA_VARIABLE_OFFSET = DSU_PAYLOAD_OFFSET + DSU_SLOT_INFO_SIZE + 1;
+
+// Joy-Conのモーションの単位（ジャイロは48000 = 360deg/s、加速度は4096 = 1G）
+constexpr float GYRO_DPS_PER_LSB = 360.0f / 48000.0f;
+constexpr float ACCEL_G_PER_LSB = 1.0f / 4096.0f;
+
+/**
+ * @brief CRC32（zlibと同じ多項式）の表を作る
+ */
+static constexpr std::array<uint32_t, 256> build_crc32_table()
+{
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC32_TABLE = build_crc32_table();
+constexpr uint32_t CRC32_INITIAL = 0xFFFFFFFFu;
+
+/**
+ * @brief CRC32の途中の状態に続きのデータを加える（最後にビットを反転すると値になる）
+ */
+static uint32_t crc32_update(uint32_t state, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        state = CRC32_TABLE[(state ^ data[i]) & 0xFF] ^ (state >> 8);
+    return state;
+}
+
+static void put_le16(uint8_t* out, uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void put_le32(uint8_t* out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+static void put_le64(uint8_t* out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+static void put_float(uint8_t* out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_le32(out, bits);
+}
+
+static uint32_t get_le32(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+        (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+/**
+ * @brief サーバーからのパケットのヘッダーと種類を書き込む（CRC32は0にしておく）
+ */
+static void write_header(uint8_t* packet, size_t size, uint32_t serverId, uint32_t type)
+{
+    std::memcpy(packet, "DSUS", 4);
+    put_le16(packet + 4, DSU_PROTOCOL_VERSION);
+    put_le16(packet + 6, static_cast<uint16_t>(size - DSU_HEADER_SIZE));
+    put_le32(packet + DSU_CRC_OFFSET, 0);
+    put_le32(packet + 12, serverId);
+    put_le32(packet + DSU_TYPE_OFFSET, type);
+}
+
+/**
+ * @brief パケット全体のCRC32を書き込む
+ */
+static void finish_packet(uint8_t* packet, size_t size)
+{
+    put_le32(packet + DSU_CRC_OFFSET, ~crc32_update(CRC32_INITIAL, packet, size));
+}
+
+/**
+ * @brief スロットの情報（状態、種類、接続方法、MACアドレス、バッテリー）を書き込む
+ * @param mac MACアドレス（接続していなければnullptr）
+ */
+static void write_slot_info(uint8_t* out, uint8_t slot, const uint8_t* mac)
+{
+    std::memset(out, 0, DSU_SLOT_INFO_SIZE);
+    out[0] = slot;
+    if (!mac) return;
+    out[1] = DSU_SLOT_CONNECTED;
+    out[2] = DSU_MODEL_FULL_GYRO;
+    out[3] = DSU_CONNECTION_BLUETOOTH;
+    std::memcpy(out + 4, mac, 6);
+    out[10] = DSU_BATTERY_NONE;
+}
+
+// DS4のDPAD（方向の番号）→ DSUの1バイト目のビット（左0x80、下0x40、右0x20、上0x10）
+constexpr uint8_t DSU_DPAD[16] = {
+    0x10, 0x30, 0x20, 0x60, 0x40, 0xC0, 0x80, 0x90,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/**
+ * @brief データのパケットの入力部分（パケット番号の後ろから）を書き込む
+ * @note 軸の向きはDS4レポートと同じ。スティックの上下はDSUの上が正に合わせて反転する
+ */
+static void write_controller_data(uint8_t* packet, const DS4_REPORT_EX& report, uint64_t timestampUs)
+{
+    const auto& r = report.Report;
+    auto pressed = [&](uint16_t button) { return (r.wButtons & button) != 0; };
+    auto analog = [&](uint16_t button) { return static_cast<uint8_t>(pressed(button) ? 0xFF : 0x00); };
+    uint8_t dpad = DSU_DPAD[r.wButtons & 0xF];
+
+    uint8_t* out = packet + DSU_DATA_VARIABLE_OFFSET + 4;
+    out[0] = static_cast<uint8_t>(dpad |
+        (pressed(DS4_BUTTON_OPTIONS) ? 0x08 : 0) | (pressed(DS4_BUTTON_THUMB_RIGHT) ? 0x04 : 0) |
+        (pressed(DS4_BUTTON_THUMB_LEFT) ? 0x02 : 0) | (pressed(DS4_BUTTON_SHARE) ? 0x01 : 0));
+    out[1] = static_cast<uint8_t>(
+        (pressed(DS4_BUTTON_SQUARE) ? 0x80 : 0) | (pressed(DS4_BUTTON_CROSS) ? 0x40 : 0) |
+        (pressed(DS4_BUTTON_CIRCLE) ? 0x20 : 0) | (pressed(DS4_BUTTON_TRIANGLE) ? 0x10 : 0) |
+        (pressed(DS4_BUTTON_SHOULDER_RIGHT) ? 0x08 : 0) | (pressed(DS4_BUTTON_SHOULDER_LEFT) ? 0x04 : 0) |
+        (pressed(DS4_BUTTON_TRIGGER_RIGHT) ? 0x02 : 0) | (pressed(DS4_BUTTON_TRIGGER_LEFT) ? 0x01 : 0));
+    out[2] = (r.bSpecial & DS4_SPECIAL_BUTTON_PS) ? 1 : 0;
+    out[3] = (r.bSpecial & DS4_SPECIAL_BUTTON_TOUCHPAD) ? 1 : 0;
+
+    // スティック
+    out[4] = r.bThumbLX;
+    out[5] = static_cast<uint8_t>(255 - r.bThumbLY);
+    out[6] = r.bThumbRX;
+    out[7] = static_cast<uint8_t>(255 - r.bThumbRY);
+
+    // アナログのDPAD（左、下、右、上）、ボタン（Y、B、A、X）、R1、L1、R2、L2
+    out[8] = (dpad & 0x80) ? 0xFF : 0x00;
+    out[9] = (dpad & 0x40) ? 0xFF : 0x00;
+    out[10] = (dpad & 0x20) ? 0xFF : 0x00;
+    out[11] = (dpad & 0x10) ? 0xFF : 0x00;
+    out[12] = analog(DS4_BUTTON_SQUARE);
+    out[13] = analog(DS4_BUTTON_CROSS);
+    out[14] = analog(DS4_BUTTON_CIRCLE);
+    out[15] = analog(DS4_BUTTON_TRIANGLE);
+    out[16] = analog(DS4_BUTTON_SHOULDER_RIGHT);
+    out[17] = analog(DS4_BUTTON_SHOULDER_LEFT);
+    out[18] = r.bTriggerR;
+    out[19] = r.bTriggerL;
+
+    // タッチ（2点、各6バイト）は使わないので0のまま
+    // モーション: サンプル時刻（マイクロ秒）、加速度（G）、ジャイロ（deg/s: ピッチ、ヨー、ロール）
+    out += 32;
+    put_le64(out, timestampUs);
+    put_float(out + 8, r.wAccelX * ACCEL_G_PER_LSB);
+    put_float(out + 12, r.wAccelY * ACCEL_G_PER_LSB);
+    put_float(out + 16, r.wAccelZ * ACCEL_G_PER_LSB);
+    put_float(out + 20, r.wGyroX * GYRO_DPS_PER_LSB);
+    put_float(out + 24, r.wGyroY * GYRO_DPS_PER_LSB);
+    put_float(out + 28, r.wGyroZ * GYRO_DPS_PER_LSB);
+}
+
+bool SelectDsuServerConfig(DsuServerConfig& config)
+{
+    const char* value = std::getenv("JOYCON_DSU");
+    if (!value || std::string(value).empty() || std::string(value) == "0") return false;
+    if (std::string(value) == "1") return true;
+
+    char* end = nullptr;
+    long port = std::strtol(value, &end, 10);
+    if (*end != '\0' || port <= 0 || port > 65535) {
+        std::wcerr << L"Invalid JOYCON_DSU value. Using port " << DSU_DEFAULT_PORT << L".\n";
+        return true;
+    }
+    config.port = static_cast<uint16_t>(port);
+    return true;
+}
+
+#if defined(_WIN32) || defined(__linux__)
+
+#ifdef _WIN32
+using DsuSocket = SOCKET;
+constexpr DsuSocket INVALID_DSU_SOCKET = INVALID_SOCKET;
+
+// Winsockには停止を知らせるパイプが無いので、受信スレッドはこの間隔で停止の要求を確認する
+constexpr int DSU_STOP_CHECK_MS = 100;
+#else
+using DsuSocket = int;
+constexpr DsuSocket INVALID_DSU_SOCKET = -1;
+#endif
+
+/**
+ * @brief ソケットを使えるようにする（WindowsではWinsockを初期化する。stop_socketsと対で呼ぶ）
+ */
+static bool start_sockets()
+{
+#ifdef _WIN32
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    return true;
+#endif
+}
+
+static void stop_sockets()
+{
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+static void close_socket(DsuSocket socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+/**
+ * @brief 直前のソケットのエラーの説明
+ */
+static std::string socket_error()
+{
+#ifdef _WIN32
+    return "error " + std::to_string(WSAGetLastError());
+#else
+    return std::strerror(errno);
+#endif
+}
+
+/**
+ * @brief パケットを1つの宛先に送る（送信バッファがいっぱいでも待たない）
+ * @return 送信できた場合はtrue
+ */
+static bool send_packet(DsuSocket socket, const uint8_t* packet, size_t size, const sockaddr_in& to)
+{
+#ifdef _WIN32
+    // ソケットはノンブロッキングにしてある
+    int sent = sendto(socket, reinterpret_cast<const char*>(packet), static_cast<int>(size), 0, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+    return sent == static_cast<int>(size);
+#else
+    ssize_t sent = sendto(socket, packet, size, MSG_DONTWAIT, reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+    return sent == static_cast<ssize_t>(size);
+#endif
+}
+
+/**
+ * @class UdpDsuServer
+ * @brief 1つのノンブロッキングのUDPソケットで動くDSUサーバー
+ *
+ * 要求は受信スレッドで処理し、データのパケットは入力スレッドから購読中の全クライアントへ
+ * Linuxではsendmmsgでまとめて、Windowsではsendtoで1つずつ送る。パケットはスロットごとに確保しておき、
+ * 変わらない先頭部分のCRC32の途中の状態を保持して、送信ごとには入力の部分だけを計算する。
+ */
+class UdpDsuServer : public DsuServer {
+public:
+    static std::unique_ptr<UdpDsuServer> Create(const DsuServerConfig& config);
+
+    ~UdpDsuServer() override;
+
+    UdpDsuServer(const UdpDsuServer&) = delete;
+    UdpDsuServer& operator=(const UdpDsuServer&) = delete;
+
+    void Connect(uint8_t slot, uint64_t address) override;
+    void Disconnect(uint8_t slot, uint64_t address) override;
+    void Publish(uint8_t slot, uint64_t address, const DS4_REPORT_EX& report, uint64_t timestampUs) override;
+    uint16_t Port() const override { return port; }
+    DsuStats Stats() const override;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    UdpDsuServer(DsuSocket fd, const DsuServerConfig& config);
+
+    void Run();
+    void HandleRequest(const uint8_t* data, size_t size, const sockaddr_in& from);
+    void Subscribe(const sockaddr_in& from, uint8_t flags, uint8_t slot, const uint8_t* mac);
+    void ExpireClients();
+
+    struct Slot {
+        std::array<uint8_t, DSU_DATA_PACKET_SIZE> packet{}; // 送信するパケット（先頭は接続したときに書き込む）
+        uint32_t prefixCrc = 0;                             // 変わらない先頭部分のCRC32の途中の状態
+        uint32_t packetNumber = 0;
+        bool connected = false;
+        uint64_t address = 0;                               // 接続しているコントローラーのアドレス
+        std::array<uint8_t, 6> mac{};
+    };
+
+    struct Client {
+        sockaddr_in address{};
+        std::array<Clock::time_point, DSU_MAX_SLOTS> lastRequest{}; // スロットごとの最後のデータの要求
+    };
+
+    DsuSocket fd;
+#ifdef _WIN32
+    std::atomic<bool> running{ true };
+#else
+    int stopPipe[2] = { -1, -1 };
+#endif
+    uint16_t port = 0;
+    uint32_t serverId;
+    DsuServerConfig config;
+    std::thread receiver;
+
+    mutable std::mutex mutex;
+    std::array<Slot, DSU_MAX_SLOTS> slots{};
+    std::array<Client, DSU_MAX_CLIENTS> clients{};
+    size_t clientCount = 0;
+#ifdef _WIN32
+    std::array<const sockaddr_in*, DSU_MAX_CLIENTS> targets{}; // 送信先（送信ごとに書き換える）
+#else
+    std::array<iovec, DSU_MAX_SLOTS> slotIov{};
+    std::array<mmsghdr, DSU_MAX_CLIENTS> messages{}; // sendmmsgに渡す送信先（送信ごとに書き換える）
+#endif
+    DsuStats stats;
+};
+
+std::unique_ptr<UdpDsuServer> UdpDsuServer::Create(const DsuServerConfig& config)
+{
+    if (!start_sockets()) {
+        std::wcerr << L"Failed to initialize sockets.\n";
+        return nullptr;
+    }
+
+#ifdef _WIN32
+    DsuSocket fd = socket(AF_INET, SOCK_DGRAM, 0);
+#else
+    DsuSocket fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#endif
+    if (fd == INVALID_DSU_SOCKET) {
+        std::wcerr << L"Failed to create DSU socket: " << socket_error().c_str() << L"\n";
+        stop_sockets();
+        return nullptr;
+    }
+
+#ifdef _WIN32
+    // 送信バッファがいっぱいでも入力スレッドを待たせない
+    u_long nonBlocking = 1;
+    ioctlsocket(fd, FIONBIO, &nonBlocking);
+
+    // 応答を送ったクライアントが終了していると、次の受信がWSAECONNRESETで失敗し続けるので、その通知を止める
+    BOOL reportReset = FALSE;
+    DWORD returned = 0;
+    WSAIoctl(fd, SIO_UDP_CONNRESET, &reportReset, sizeof(reportReset), nullptr, 0, &returned, nullptr, nullptr);
+#endif
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.address.c_str(), &address.sin_addr) != 1) {
+        std::wcerr << L"Invalid DSU server address: " << std::wstring(config.address.begin(), config.address.end()) << L"\n";
+        close_socket(fd);
+        stop_sockets();
+        return nullptr;
+    }
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::wcerr << L"Failed to bind DSU server to port " << config.port << L": " << socket_error().c_str() << L"\n";
+        close_socket(fd);
+        stop_sockets();
+        return nullptr;
+    }
+
+    // 以降はデストラクターがソケットを閉じる
+    std::unique_ptr<UdpDsuServer> server(new UdpDsuServer(fd, config));
+#ifndef _WIN32
+    if (pipe2(server->stopPipe, O_CLOEXEC) < 0) {
+        std::wcerr << L"Failed to create DSU stop pipe: " << std::strerror(errno) << L"\n";
+        return nullptr;
+    }
+#endif
+
+    // ポート0の場合は割り当てられたポートを取得する
+    socklen_t length = sizeof(address);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) == 0)
+        server->port = ntohs(address.sin_port);
+
+    server->receiver = std::thread(&UdpDsuServer::Run, server.get());
+    return server;
+}
+
+UdpDsuServer::UdpDsuServer(DsuSocket fd, const DsuServerConfig& config)
+    : fd(fd), port(config.port), serverId(std::random_device()()), config(config)
+{
+#ifndef _WIN32
+    for (size_t i = 0; i < DSU_MAX_SLOTS; ++i)
+        slotIov[i] = { slots[i].packet.data(), DSU_DATA_PACKET_SIZE };
+#endif
+}
+
+UdpDsuServer::~UdpDsuServer()
+{
+#ifdef _WIN32
+    running = false;
+    if (receiver.joinable()) receiver.join();
+#else
+    if (receiver.joinable()) {
+        char stop = 0;
+        if (write(stopPipe[1], &stop, 1) < 0) {}
+        receiver.join();
+    }
+    if (stopPipe[0] >= 0) close(stopPipe[0]);
+    if (stopPipe[1] >= 0) close(stopPipe[1]);
+#endif
+    close_socket(fd);
+    stop_sockets();
+}
+
+void UdpDsuServer::Connect(uint8_t slot, uint64_t address)
+{
+    if (slot >= DSU_MAX_SLOTS) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Slot& s = slots[slot];
+    s.address = address;
+    for (int i = 0; i < 6; ++i)
+        s.mac[i] = static_cast<uint8_t>(address >> ((5 - i) * 8));
+
+    // パケット番号より前は接続している間は変わらないので、ここでCRC32の途中の状態まで求めておく
+    s.packet.fill(0);
+    write_header(s.packet.data(), DSU_DATA_PACKET_SIZE, serverId, DSU_MESSAGE_DATA);
+    write_slot_info(s.packet.data() + DSU_PAYLOAD_OFFSET, slot, s.mac.data());
+    s.packet[DSU_PAYLOAD_OFFSET + DSU_SLOT_INFO_SIZE] = 1; // 接続中
+    s.prefixCrc = crc32_update(CRC32_INITIAL, s.packet.data(), DSU_DATA_VARIABLE_OFFSET);
+    s.packetNumber = 0;
+    s.connected = true;
+}
+
+void UdpDsuServer::Disconnect(uint8_t slot, uint64_t address)
+{
+    if (slot >= DSU_MAX_SLOTS) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Slot& s = slots[slot];
+    if (s.address != address) return;
+    s.connected = false;
+}
+
+void UdpDsuServer::Publish(uint8_t slot, uint64_t address, const DS4_REPORT_EX& report, uint64_t timestampUs)
+{
+    if (slot >= DSU_MAX_SLOTS) return;
+    auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Slot& s = slots[slot];
+    // 入れ替えの間は古いプレイヤーの入力スレッドがまだ動いているので、新しいコントローラーのパケットを上書きしない
+    if (!s.connected || s.address != address) return;
+
+    // 購読中のクライアントを集める（いなければパケットも作らない）
+    unsigned int count = 0;
+    for (size_t i = 0; i < clientCount; ++i) {
+        if (now - clients[i].lastRequest[slot] >= config.clientTimeout) continue;
+#ifdef _WIN32
+        targets[count++] = &clients[i].address;
+#else
+        msghdr& header = messages[count++].msg_hdr;
+        header.msg_name = &clients[i].address;
+        header.msg_namelen = sizeof(sockaddr_in);
+        header.msg_iov = &slotIov[slot];
+        header.msg_iovlen = 1;
+#endif
+    }
+    if (count == 0) return;
+
+    uint8_t* packet = s.packet.data();
+    put_le32(packet + DSU_DATA_VARIABLE_OFFSET, s.packetNumber++);
+    write_controller_data(packet, report, timestampUs);
+    uint32_t crc = crc32_update(s.prefixCrc, packet + DSU_DATA_VARIABLE_OFFSET, DSU_DATA_PACKET_SIZE - DSU_DATA_VARIABLE_OFFSET);
+    put_le32(packet + DSU_CRC_OFFSET, ~crc);
+
+    // 送信バッファがいっぱいでも待たずに捨てる（次の入力で最新の状態を送る）
+#ifdef _WIN32
+    // Winsockにはsendmmsgが無いので1つずつ送る（購読するのは多くても数個のエミュレーター）
+    unsigned int delivered = 0;
+    for (unsigned int i = 0; i < count; ++i)
+        if (send_packet(fd, packet, DSU_DATA_PACKET_SIZE, *targets[i])) delivered++;
+#else
+    int sent = sendmmsg(fd, messages.data(), count, MSG_DONTWAIT);
+    unsigned int delivered = sent > 0 ? static_cast<unsigned int>(sent) : 0;
+#endif
+    stats.sent += delivered;
+    stats.dropped += count - delivered;
+}
+
+DsuStats UdpDsuServer::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void UdpDsuServer::Run()
+{
+    std::array<uint8_t, 1024> buffer;
+    while (true) {
+#ifdef _WIN32
+        // 停止の要求と購読の期限切れを確認するため、要求が無くても一定の間隔で起きる
+        WSAPOLLFD fds[1] = { { fd, POLLRDNORM, 0 } };
+        int ready = WSAPoll(fds, 1, DSU_STOP_CHECK_MS);
+        if (!running || ready == SOCKET_ERROR) break;
+#else
+        // 購読の期限切れを確認するため、要求が無くても1秒ごとに起きる
+        pollfd fds[2] = { { fd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        int ready = poll(fds, 2, 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+#endif
+
+        // 溜まっている要求をすべて処理する
+        while (fds[0].revents & POLLIN) {
+            sockaddr_in from{};
+#ifdef _WIN32
+            int length = sizeof(from);
+            int size = recvfrom(fd, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0, reinterpret_cast<sockaddr*>(&from), &length);
+            if (size == SOCKET_ERROR) {
+                int error = WSAGetLastError();
+                if (error != WSAEWOULDBLOCK && error != WSAECONNRESET && error != WSAEMSGSIZE)
+                    std::wcerr << L"Failed to receive DSU request: " << socket_error().c_str() << L"\n";
+                break;
+            }
+#else
+            socklen_t length = sizeof(from);
+            ssize_t size = recvfrom(fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&from), &length);
+            if (size < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNREFUSED)
+                    std::wcerr << L"Failed to receive DSU request: " << std::strerror(errno) << L"\n";
+                break;
+            }
+#endif
+            HandleRequest(buffer.data(), static_cast<size_t>(size), from);
+        }
+        ExpireClients();
+    }
+}
+
+void UdpDsuServer::HandleRequest(const uint8_t* data, size_t size, const sockaddr_in& from)
+{
+    // ヘッダー、長さ、CRC32を確かめる（CRC32はその部分を0にして計算する）
+    bool valid = size >= DSU_PAYLOAD_OFFSET && std::memcmp(data, "DSUC", 4) == 0 &&
+        (data[4] | (data[5] << 8)) == DSU_PROTOCOL_VERSION && (data[6] | (data[7] << 8)) == static_cast<int>(size - DSU_HEADER_SIZE);
+    if (valid) {
+        const uint8_t zero[4] = {};
+        uint32_t crc = crc32_update(CRC32_INITIAL, data, DSU_CRC_OFFSET);
+        crc = crc32_update(crc, zero, 4);
+        crc = crc32_update(crc, data + DSU_CRC_OFFSET + 4, size - DSU_CRC_OFFSET - 4);
+        valid = ~crc == get_le32(data + DSU_CRC_OFFSET);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.requests++;
+        if (!valid) stats.invalid++;
+    }
+    if (!valid) return;
+
+    const uint8_t* payload = data + DSU_PAYLOAD_OFFSET;
+    size_t payloadSize = size - DSU_PAYLOAD_OFFSET;
+    auto reply = [&](const uint8_t* packet, size_t packetSize)
+        {
+            send_packet(fd, packet, packetSize, from);
+        };
+
+    switch (get_le32(data + DSU_TYPE_OFFSET)) {
+    case DSU_MESSAGE_VERSION:
+    {
+        uint8_t packet[DSU_VERSION_PACKET_SIZE];
+        write_header(packet, sizeof(packet), serverId, DSU_MESSAGE_VERSION);
+        put_le16(packet + DSU_PAYLOAD_OFFSET, DSU_PROTOCOL_VERSION);
+        finish_packet(packet, sizeof(packet));
+        reply(packet, sizeof(packet));
+        break;
+    }
+    case DSU_MESSAGE_INFO:
+    {
+        // 要求されたスロットごとに1つずつ返す
+        if (payloadSize < 4) break;
+        size_t count = std::min<size_t>(get_le32(payload), std::min(payloadSize - 4, DSU_MAX_SLOTS));
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t slot = payload[4 + i];
+            if (slot >= DSU_MAX_SLOTS) continue;
+            uint8_t packet[DSU_INFO_PACKET_SIZE];
+            write_header(packet, sizeof(packet), serverId, DSU_MESSAGE_INFO);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                write_slot_info(packet + DSU_PAYLOAD_OFFSET, slot, slots[slot].connected ? slots[slot].mac.data() : nullptr);
+            }
+            packet[DSU_PAYLOAD_OFFSET + DSU_SLOT_INFO_SIZE] = 0;
+            finish_packet(packet, sizeof(packet));
+            reply(packet, sizeof(packet));
+        }
+        break;
+    }
+    case DSU_MESSAGE_DATA:
+        if (payloadSize < 8) break;
+        Subscribe(from, payload[0], payload[1], payload + 2);
+        break;
+    default:
+        break;
+    }
+}
+
+void UdpDsuServer::Subscribe(const sockaddr_in& from, uint8_t flags, uint8_t slot, const uint8_t* mac)
+{
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = std::find_if(clients.begin(), clients.begin() + clientCount, [&](const Client& client)
+        {
+            return client.address.sin_addr.s_addr == from.sin_addr.s_addr && client.address.sin_port == from.sin_port;
+        });
+    if (it == clients.begin() + clientCount) {
+        if (clientCount == DSU_MAX_CLIENTS) return; // いっぱいの場合は期限切れを待つ
+        it = clients.begin() + clientCount++;
+        *it = Client{ from, {} };
+    }
+
+    // 登録方法が無ければ全スロット、スロット番号やMACアドレスの指定があれば一致するものだけ
+    for (size_t i = 0; i < DSU_MAX_SLOTS; ++i) {
+        bool match = flags == 0 ||
+            ((flags & DSU_REGISTER_SLOT) && slot == i) ||
+            ((flags & DSU_REGISTER_MAC) && slots[i].connected && std::memcmp(slots[i].mac.data(), mac, 6) == 0);
+        if (match) it->lastRequest[i] = now;
+    }
+}
+
+void UdpDsuServer::ExpireClients()
+{
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < clientCount;) {
+        const auto& requests = clients[i].lastRequest;
+        bool active = std::any_of(requests.begin(), requests.end(), [&](Clock::time_point time) { return now - time < config.clientTimeout; });
+        if (active)
+            ++i;
+        else
+            clients[i] = clients[--clientCount]; // 最後のクライアントで詰める
+    }
+}
+
+#endif // _WIN32 || __linux__
+
+std::unique_ptr<DsuServer> CreateDsuServer(const DsuServerConfig& config)
+{
+#if defined(_WIN32) || defined(__linux__)
+    return UdpDsuServer::Create(config);
+#else
+    (void)config;
+    std::wcerr << L"DSU server is only available on Windows and Linux.\n";
+    return nullptr;
+#endif
+}
@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "OutputSink.h"
+
+// DSU（cemuhook）プロトコル
+constexpr uint16_t DSU_DEFAULT_PORT = 26760;
+constexpr size_t DSU_MAX_SLOTS = 4;          // プロトコルで扱えるコントローラーの数
+constexpr size_t DSU_MAX_CLIENTS = 16;       // 同時に購読できるクライアントの数
+constexpr size_t DSU_DATA_PACKET_SIZE = 100; // コントローラーのデータのパケットの大きさ
+
+/**
+ * @struct DsuServerConfig
+ * @brief DSUサーバーの設定
+ */
+struct DsuServerConfig {
+    std::string address = "127.0.0.1";          // 待ち受けるアドレス（既定はローカルのみ）
+    uint16_t port = DSU_DEFAULT_PORT;            // 待ち受けるポート（0は空いているポート）
+    std::chrono::milliseconds clientTimeout{ 5000 }; // データの要求が途絶えたクライアントの購読を止めるまでの時間
+};
+
+/**
+ * @struct DsuStats
+ * @brief DSUサーバーの送受信の統計
+ */
+struct DsuStats {
+    uint64_t requests = 0; // 受け取った要求
+    uint64_t invalid = 0;  // 形式やCRCが正しくない要求
+    uint64_t sent = 0;     // 送信したデータのパケット
+    uint64_t dropped = 0;  // 送信できなかったデータのパケット（送信バッファがいっぱいなど）
+};
+
+/**
+ * @class DsuServer
+ * @brief 各プレイヤーのボタン、スティック、モーションをDSU（cemuhook）プロトコルでエミュレーターに公開する
+ *
+ * 仮想DS4のモーションを読めないエミュレーター（Cemu、Dolphinなど）向け。
+ * プレイヤー番号のスロットに、デコードしたレポートをコントローラーの時計のサンプル時刻で送る。
+ */
+class DsuServer {
+public:
+    virtual ~DsuServer() = default;
+
+    /**
+     * @brief スロットにコントローラーを接続する
+     * @param slot スロット（0からDSU_MAX_SLOTS - 1）
+     * @param address コントローラーのアドレス（MACアドレスとして公開する）
+     */
+    virtual void Connect(uint8_t slot, uint64_t address) = 0;
+
+    /**
+     * @brief スロットのコントローラーを切断する
+     * @param address 切断するコントローラーのアドレス（入れ替えで既に別のコントローラーが接続していれば何もしない）
+     */
+    virtual void Disconnect(uint8_t slot, uint64_t address) = 0;
+
+    /**
+     * @brief スロットの最新の入力を購読しているクライアントに送る（入力スレッドから呼ばれ、送信を待たない）
+     * @param slot スロット
+     * @param address 入力したコントローラーのアドレス（スロットに接続しているものと違えば送らない）
+     * @param report デコードしたDS4レポート
+     * @param timestampUs サンプル時刻（マイクロ秒）
+     */
+    virtual void Publish(uint8_t slot, uint64_t address, const DS4_REPORT_EX& report, uint64_t timestampUs) = 0;
+
+    /**
+     * @brief 待ち受けているポート
+     */
+    virtual uint16_t Port() const = 0;
+
+    /**
+     * @brief 送受信の統計を取得
+     */
+    virtual DsuStats Stats() const = 0;
+};
+
+/**
+ * @brief 環境変数からDSUサーバーの設定を選ぶ
+ * @param config 設定を格納する
+ * @return 有効にする場合はtrue
+ * @note JOYCON_DSU=1 で既定のポート、JOYCON_DSU=<ポート番号> でそのポートを使う（未設定か0なら無効）
+ */
+bool SelectDsuServerConfig(DsuServerConfig& config);
+
+/**
+ * @brief DSUサーバーを作成し、要求の受信を開始する
+ * @return 作成したサーバー（失敗した場合やこのプラットフォームで使えない場合はnullptr）
+ */
+std::unique_ptr<DsuServer> CreateDsuServer(const DsuServerConfig& config = DsuServerConfig());
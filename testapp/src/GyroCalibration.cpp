@@ -0,0 +1,162 @@
+﻿#include "GyroCalibration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// ジャイロバイアスのキャッシュファイル
+constexpr const char* GYRO_BIAS_CACHE_FILE = "gyro_bias_cache.txt";
+
+// アドレスごとのバイアスキャッシュ
+static std::mutex g_biasCacheMutex;
+static std::unordered_map<uint64_t, std::array<float, 3>> g_biasCache;
+
+GyroBiasEstimator::GyroBiasEstimator(uint64_t address, const GyroBiasConfig& config)
+    : address(address), config(config)
+{
+    // 既知のコントローラーなら前回のバイアスから開始する
+    if (address != 0 && LookupGyroBias(address, bias)) {
+        calibrated = true;
+    }
+}
+
+void GyroBiasEstimator::Process(std::vector<uint8_t>& buffer)
+{
+    if (buffer.size() < 0x3C) return;
+
+    MotionData motion = DecodeMotion(buffer);
+    Update(motion);
+    Apply(motion);
+
+    // 補正後のジャイロ値をバッファに書き戻す
+    EncodeMotion(buffer, motion);
+}
+
+void GyroBiasEstimator::Update(const MotionData& motion)
+{
+    const std::array<int16_t, 6> sample = {
+        motion.gyroX, motion.gyroY, motion.gyroZ,
+        motion.accelX, motion.accelY, motion.accelZ
+    };
+
+    // 最も古いサンプルを和から取り除き、新しいサンプルを加える
+    auto& slot = window[head];
+    for (size_t i = 0; i < 6; ++i) {
+        if (count == WINDOW_SIZE) {
+            sum[i] -= slot[i];
+            sumSq[i] -= static_cast<int64_t>(slot[i]) * slot[i];
+        }
+        sum[i] += sample[i];
+        sumSq[i] += static_cast<int64_t>(sample[i]) * sample[i];
+    }
+    slot = sample;
+    head = (head + 1) % WINDOW_SIZE;
+    if (count < WINDOW_SIZE) ++count;
+
+    // ウィンドウが埋まるまでは判定しない
+    if (count < WINDOW_SIZE) return;
+
+    const float n = static_cast<float>(WINDOW_SIZE);
+    std::array<float, 3> mean{};
+    bool still = true;
+    for (size_t i = 0; i < 6; ++i) {
+        float m = sum[i] / n;
+        float var = sumSq[i] / n - m * m;
+        if (i < 3) {
+            mean[i] = m;
+            if (var > config.gyroVarianceThreshold || std::abs(m) > config.maxBiasMagnitude) still = false;
+        }
+        else if (var > config.accelVarianceThreshold) {
+            still = false;
+        }
+    }
+
+    bool wasStationary = stationary;
+    stationary = still;
+
+    if (stationary) {
+        if (!calibrated) {
+            // 初回はウィンドウ平均をそのままバイアスとする
+            bias = mean;
+            calibrated = true;
+            if (address != 0) StoreGyroBias(address, bias);
+        }
+        else {
+            for (size_t i = 0; i < 3; ++i) {
+                bias[i] += config.adaptRate * (mean[i] - bias[i]);
+            }
+        }
+    }
+    else if (wasStationary && address != 0) {
+        // 静止区間の終わりに推定値をキャッシュへ反映
+        StoreGyroBias(address, bias);
+    }
+}
+
+void GyroBiasEstimator::Apply(MotionData& motion) const
+{
+    if (!calibrated) return;
+
+    auto correct = [](int16_t value, float b) -> int16_t {
+        long v = std::lround(value - b);
+        return static_cast<int16_t>(std::clamp(v, -32768L, 32767L));
+    };
+
+    motion.gyroX = correct(motion.gyroX, bias[0]);
+    motion.gyroY = correct(motion.gyroY, bias[1]);
+    motion.gyroZ = correct(motion.gyroZ, bias[2]);
+}
+
+void LoadGyroBiasCache()
+{
+    std::ifstream ifs(GYRO_BIAS_CACHE_FILE);
+    if (!ifs.is_open()) return;
+
+    std::lock_guard<std::mutex> lock(g_biasCacheMutex);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        // 形式: <16進アドレス> <X> <Y> <Z>
+        std::istringstream iss(line);
+        uint64_t address = 0;
+        std::array<float, 3> bias{};
+        if (iss >> std::hex >> address >> std::dec >> bias[0] >> bias[1] >> bias[2]) {
+            g_biasCache[address] = bias;
+        }
+    }
+    std::wcout << L"Loaded gyro bias for " << g_biasCache.size() << L" controller(s).\n";
+}
+
+void SaveGyroBiasCache()
+{
+    std::lock_guard<std::mutex> lock(g_biasCacheMutex);
+    if (g_biasCache.empty()) return;
+
+    std::ofstream ofs(GYRO_BIAS_CACHE_FILE, std::ios::trunc);
+    if (!ofs.is_open()) {
+        std::wcerr << L"Failed to write gyro_bias_cache.txt.\n";
+        return;
+    }
+    for (const auto& [address, bias] : g_biasCache) {
+        ofs << std::hex << address << std::dec << ' ' << bias[0] << ' ' << bias[1] << ' ' << bias[2] << '\n';
+    }
+}
+
+bool LookupGyroBias(uint64_t address, std::array<float, 3>& bias)
+{
+    std::lock_guard<std::mutex> lock(g_biasCacheMutex);
+    auto it = g_biasCache.find(address);
+    if (it == g_biasCache.end()) return false;
+    bias = it->second;
+    return true;
+}
+
+void StoreGyroBias(uint64_t address, const std::array<float, 3>& bias)
+{
+    std::lock_guard<std::mutex> lock(g_biasCacheMutex);
+    g_biasCache[address] = bias;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "JoyConDecoder.h"
+
+/**
+ * @struct GyroBiasConfig
+ * @brief ジャイロバイアス推定の閾値設定（単位はすべてセンサーの生値）
+ */
+struct GyroBiasConfig {
+    float gyroVarianceThreshold = 10000.0f;  // 静止とみなすジャイロ分散の上限（標準偏差 約0.75deg/s）
+    float accelVarianceThreshold = 6400.0f;  // 静止とみなす加速度分散の上限（標準偏差 約0.02G）
+    float maxBiasMagnitude = 800.0f;         // バイアスとして許容する平均値の上限（約6deg/s、ゆっくりした回転を除外）
+    float adaptRate = 0.05f;                 // 較正済みのときのバイアス追従率 (0-1)
+};
+
+/**
+ * @class GyroBiasEstimator
+ * @brief 静止区間を検出しながらジャイロのバイアスを継続的に推定・補正するクラス
+ *
+ * 直近WINDOW_SIZEサンプルの和と二乗和を保持し、分散をO(1)で更新する。
+ * 推定値はコントローラーのBluetoothアドレスごとにキャッシュされ、再接続時に引き継がれる。
+ */
+class GyroBiasEstimator {
+public:
+    static constexpr size_t WINDOW_SIZE = 32;
+
+    /**
+     * @param address コントローラーのBluetoothアドレス（キャッシュのキー、0ならキャッシュしない）
+     * @param config 静止判定の閾値
+     */
+    explicit GyroBiasEstimator(uint64_t address = 0, const GyroBiasConfig& config = {});
+
+    /**
+     * @brief 入力レポートのモーションデータで推定を更新し、バッファ内のジャイロ値からバイアスを差し引く
+     * @param buffer Joy-Conからの生データ（ジャイロ部分が書き換えられる）
+     */
+    void Process(std::vector<uint8_t>& buffer);
+
+    /**
+     * @brief モーションデータ1サンプルで推定を更新
+     * @param motion デコード済みのモーションデータ
+     */
+    void Update(const MotionData& motion);
+
+    /**
+     * @brief 推定済みのバイアスをジャイロ値から差し引く
+     * @param motion 補正するモーションデータ
+     */
+    void Apply(MotionData& motion) const;
+
+    bool IsStationary() const { return stationary; }
+    bool IsCalibrated() const { return calibrated; }
+    uint64_t Address() const { return address; }
+    std::array<float, 3> Bias() const { return bias; }
+
+private:
+    uint64_t address;
+    GyroBiasConfig config;
+
+    // スライディングウィンドウ（ジャイロ3軸 + 加速度3軸）
+    std::array<std::array<int16_t, 6>, WINDOW_SIZE> window{};
+    std::array<int64_t, 6> sum{};
+    std::array<int64_t, 6> sumSq{};
+    size_t head = 0;
+    size_t count = 0;
+
+    std::array<float, 3> bias{};
+    bool calibrated = false;
+    bool stationary = false;
+};
+
+/**
+ * @brief gyro_bias_cache.txt からアドレスごとのバイアスを読み込む
+ */
+void LoadGyroBiasCache();
+
+/**
+ * @brief アドレスごとのバイアスを gyro_bias_cache.txt に保存
+ */
+void SaveGyroBiasCache();
+
+/**
+ * @brief キャッシュからバイアスを取得
+ * @param address コントローラーのBluetoothアドレス
+ * @param bias 取得したバイアスを格納する参照
+ * @return キャッシュに存在した場合はtrue
+ */
+bool LookupGyroBias(uint64_t address, std::array<float, 3>& bias);
+
+/**
+ * @brief バイアスをキャッシュに登録
+ * @param address コントローラーのBluetoothアドレス
+ * @param bias 登録するバイアス
+ */
+void StoreGyroBias(uint64_t address, const std::array<float, 3>& bias);
@@ -0,0 +1,150 @@
+﻿#include "GyroStick.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// ジャイロの生値1あたりの角速度(deg/s)。48000 = 360deg/s
+constexpr float GYRO_DPS_PER_LSB = 360.0f / 48000.0f;
+constexpr float PI = 3.14159265358979f;
+
+void LoadGyroStickConfig(GyroStickConfig& config)
+{
+    std::ifstream ifs("gyro_stick.txt");
+    if (!ifs.is_open()) return;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        try {
+            if (key == "mode") {
+                if (value == "aim")        config.mode = GyroStickMode::Aim;
+                else if (value == "flick") config.mode = GyroStickMode::Flick;
+                else                       config.mode = GyroStickMode::Off;
+            }
+            else if (key == "sensitivity")      config.sensitivity = std::stof(value);
+            else if (key == "deadzone")         config.deadzone = std::stof(value);
+            else if (key == "smooth_threshold") config.smoothThreshold = std::stof(value);
+            else if (key == "smooth_time")      config.smoothTime = std::stof(value);
+            else if (key == "mix")              config.mixWithStick = (value == "1" || value == "true");
+            else if (key == "invert_x")         config.invertX = (value == "1" || value == "true");
+            else if (key == "invert_y")         config.invertY = (value == "1" || value == "true");
+            else if (key == "flick_threshold")  config.flickThreshold = std::stof(value);
+            else if (key == "flick_turn_rate")  config.flickTurnRate = std::stof(value);
+        }
+        catch (const std::exception&) {
+            std::wcerr << L"Invalid value in gyro_stick.txt: " << std::wstring(line.begin(), line.end()) << L"\n";
+        }
+    }
+}
+
+GyroStickMapper::GyroStickMapper(const GyroStickConfig& config)
+    : config(config)
+{
+}
+
+/**
+ * @brief 小さい角速度のみを平滑化する（段階的スムージング）
+ * @param filtered 平滑化の状態
+ * @param value 現在の角速度(deg/s)
+ * @param dt 経過時間（秒）
+ * @return 出力する角速度(deg/s)
+ */
+float GyroStickMapper::SmoothVelocity(float& filtered, float value, float dt) const
+{
+    float alpha = dt / (config.smoothTime + dt);
+    filtered += alpha * (value - filtered);
+
+    // 閾値の半分から閾値までの間で、平滑化した値から生の値へ徐々に切り替える
+    float half = config.smoothThreshold * 0.5f;
+    float direct = half > 0.0f ? std::clamp((std::abs(value) - half) / half, 0.0f, 1.0f) : 1.0f;
+    return direct * value + (1.0f - direct) * filtered;
+}
+
+/**
+ * @brief フリックスティックの状態を更新し、X方向の出力を計算
+ * @param stickX 物理右スティックのX (-1.0 to 1.0)
+ * @param stickY 物理右スティックのY (-1.0 to 1.0、上が正)
+ * @param dt 経過時間（秒）
+ * @return X方向のスティック出力 (-1.0 to 1.0)
+ */
+float GyroStickMapper::UpdateFlick(float stickX, float stickY, float dt)
+{
+    float magnitude = std::hypot(stickX, stickY);
+    if (magnitude >= config.flickThreshold) {
+        float angle = std::atan2(stickX, stickY) * 180.0f / PI; // 前方0度、右が正
+        if (!flickActive) {
+            // 倒した瞬間にその方向へ振り向く
+            flickActive = true;
+            flickRemaining += angle;
+        }
+        else {
+            // 倒したまま回した分だけ追加で旋回
+            float delta = angle - flickLastAngle;
+            if (delta > 180.0f) delta -= 360.0f;
+            if (delta < -180.0f) delta += 360.0f;
+            flickRemaining += delta;
+        }
+        flickLastAngle = angle;
+    }
+    else if (magnitude < config.flickThreshold * 0.8f) {
+        flickActive = false;
+    }
+
+    // ゲームの旋回速度で残りの旋回量を消化する
+    float maxStep = config.flickTurnRate * dt;
+    if (maxStep <= 0.0f) return 0.0f;
+    float step = std::clamp(flickRemaining, -maxStep, maxStep);
+    flickRemaining -= step;
+    return step / maxStep;
+}
+
+void GyroStickMapper::Apply(DS4_REPORT_EX& report, float dt)
+{
+    if (config.mode == GyroStickMode::Off) return;
+
+    // ヨー(Y軸)を左右、ピッチ(X軸)を上下に割り当てる
+    float yaw = -report.Report.wGyroY * GYRO_DPS_PER_LSB;
+    float pitch = report.Report.wGyroX * GYRO_DPS_PER_LSB;
+    if (config.invertX) yaw = -yaw;
+    if (config.invertY) pitch = -pitch;
+
+    // デッドゾーン（デッドゾーン分を差し引いて出力の不連続を避ける）
+    float speed = std::hypot(yaw, pitch);
+    if (speed < config.deadzone) {
+        yaw = pitch = 0.0f;
+    }
+    else {
+        float scale = (speed - config.deadzone) / speed;
+        yaw *= scale;
+        pitch *= scale;
+    }
+
+    float gyroX = SmoothVelocity(filteredX, yaw, dt) * config.sensitivity;
+    float gyroY = SmoothVelocity(filteredY, pitch, dt) * config.sensitivity;
+
+    // 物理右スティックの値 (-1.0 to 1.0、上が正)
+    float stickX = (report.Report.bThumbRX - 128) / 127.0f;
+    float stickY = (128 - report.Report.bThumbRY) / 127.0f;
+
+    float outX = gyroX;
+    float outY = gyroY;
+    if (config.mode == GyroStickMode::Flick) {
+        outX += UpdateFlick(stickX, stickY, dt);
+    }
+    else if (config.mixWithStick) {
+        outX += stickX;
+        outY += stickY;
+    }
+
+    outX = std::clamp(outX, -1.0f, 1.0f);
+    outY = std::clamp(outY, -1.0f, 1.0f);
+
+    report.Report.bThumbRX = static_cast<uint8_t>(std::lround(outX * 127 + 128));
+    report.Report.bThumbRY = static_cast<uint8_t>(std::lround(128 - outY * 127));
+}
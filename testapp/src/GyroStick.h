@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <string>
+
+#include "JoyConDecoder.h"
+
+/**
+ * @enum GyroStickMode
+ * @brief ジャイロを右スティックに割り当てるモード
+ */
+enum class GyroStickMode {
+    Off,   // 無効
+    Aim,   // ジャイロの角速度をスティックの傾きに変換
+    Flick  // Aimに加え、物理右スティックをフリックスティックとして扱う
+};
+
+/**
+ * @struct GyroStickConfig
+ * @brief ジャイロ→右スティック変換の設定
+ */
+struct GyroStickConfig {
+    GyroStickMode mode = GyroStickMode::Off;
+    float sensitivity = 1.0f / 120.0f;  // 1deg/sあたりのスティックの傾き（120deg/sで最大）
+    float deadzone = 2.0f;              // この角速度(deg/s)未満は無視
+    float smoothThreshold = 8.0f;       // この角速度(deg/s)未満のみ平滑化する（大きな動きは遅延なし）
+    float smoothTime = 0.02f;           // 平滑化の時定数（秒）
+    bool mixWithStick = true;           // 物理スティックの入力と合成するか
+    bool invertX = false;
+    bool invertY = false;
+    float flickThreshold = 0.9f;        // フリックとみなすスティックの傾き (0-1)
+    float flickTurnRate = 360.0f;       // ゲーム側でスティック最大時の旋回速度(deg/s)
+};
+
+/**
+ * @brief gyro_stick.txt からジャイロ→右スティックの設定を読み込む
+ * @param config 読み込んだ値で上書きする設定
+ * @note 形式は1行ごとに "キー=値"（例: sensitivity=0.01）
+ */
+void LoadGyroStickConfig(GyroStickConfig& config);
+
+/**
+ * @class GyroStickMapper
+ * @brief ジャイロの角速度を右スティックの傾きに変換する出力段
+ *
+ * OutputPipelineから出力クロックのティックごとに呼び出される。
+ */
+class GyroStickMapper {
+public:
+    explicit GyroStickMapper(const GyroStickConfig& config);
+
+    /**
+     * @brief レポートの右スティックにジャイロの入力を適用
+     * @param report 更新するレポート
+     * @param dt 経過時間（秒）
+     */
+    void Apply(DS4_REPORT_EX& report, float dt);
+
+    const GyroStickConfig& Config() const { return config; }
+
+private:
+    float SmoothVelocity(float& filtered, float value, float dt) const;
+    float UpdateFlick(float stickX, float stickY, float dt);
+
+    GyroStickConfig config;
+
+    // 平滑化の状態
+    float filteredX = 0.0f;
+    float filteredY = 0.0f;
+
+    // フリックスティックの状態
+    bool flickActive = false;
+    float flickLastAngle = 0.0f;
+    float flickRemaining = 0.0f;  // 残りの旋回量(deg)
+};
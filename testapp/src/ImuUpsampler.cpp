@@ -0,0 +1,99 @@
+﻿#include "ImuUpsampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// サンプル間隔の平均に使う平滑化係数
+constexpr double PERIOD_SMOOTHING = 0.05;
+
+void LoadImuUpsamplerConfig(ImuUpsamplerConfig& config)
+{
+    std::ifstream ifs("imu_upsampler.txt");
+    if (!ifs.is_open()) return;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        try {
+            if (key == "enabled")                 config.enabled = (value == "1" || value == "true");
+            else if (key == "render_delay_ms")      config.renderDelay = value == "auto" ? -1.0f : std::stof(value) / 1000.0f;
+            else if (key == "max_extrapolation_ms") config.maxExtrapolation = std::stof(value) / 1000.0f;
+        }
+        catch (const std::exception&) {
+            std::wcerr << L"Invalid value in imu_upsampler.txt: " << std::wstring(line.begin(), line.end()) << L"\n";
+        }
+    }
+}
+
+ImuUpsampler::ImuUpsampler(const ImuUpsamplerConfig& config)
+    : config(config)
+{
+}
+
+void ImuUpsampler::Push(double time, const MotionData& motion)
+{
+    // 時刻が進んでいないサンプルは最新値の更新として扱う
+    if (count > 0 && time <= times[1]) time = times[1];
+
+    // 通知の間隔を平均し、補間のための遅延に使う
+    if (count > 0 && time > times[1]) {
+        double span = time - times[1];
+        period = period > 0.0 ? period + (span - period) * PERIOD_SMOOTHING : span;
+    }
+
+    times[0] = times[1];
+    values[0] = values[1];
+    times[1] = time;
+    values[1] = {
+        static_cast<float>(motion.gyroX), static_cast<float>(motion.gyroY), static_cast<float>(motion.gyroZ),
+        static_cast<float>(motion.accelX), static_cast<float>(motion.accelY), static_cast<float>(motion.accelZ)
+    };
+    if (count < 2) ++count;
+}
+
+bool ImuUpsampler::Sample(double time, MotionData& out) const
+{
+    if (count == 0) return false;
+
+    std::array<float, 6> v = values[1];
+    double span = times[1] - times[0];
+
+    if (count == 2 && span > 0.0) {
+        // 直前の区間内なら線形補間、最新サンプルより後（次のサンプルが遅れている）なら上限付きで線形外挿
+        double t = std::min(time, times[1] + config.maxExtrapolation);
+        float w = static_cast<float>((t - times[0]) / span);
+        w = std::max(w, 0.0f);
+        for (size_t i = 0; i < 6; ++i) {
+            v[i] = values[0][i] + (values[1][i] - values[0][i]) * w;
+        }
+    }
+
+    auto to_short = [](float f) -> int16_t {
+        return static_cast<int16_t>(std::clamp(std::lround(f), -32768L, 32767L));
+    };
+    out.gyroX = to_short(v[0]);
+    out.gyroY = to_short(v[1]);
+    out.gyroZ = to_short(v[2]);
+    out.accelX = to_short(v[3]);
+    out.accelY = to_short(v[4]);
+    out.accelZ = to_short(v[5]);
+    return true;
+}
+
+double ImuUpsampler::RenderDelay() const
+{
+    return config.renderDelay >= 0.0f ? config.renderDelay : period;
+}
+
+uint16_t ToDS4Timestamp(double time)
+{
+    // DS4のタイムスタンプは16/3us(約5.33us)単位で、16ビットで巻き戻る
+    return static_cast<uint16_t>(static_cast<uint64_t>(time * 1e6 * 3.0 / 16.0) & 0xFFFF);
+}
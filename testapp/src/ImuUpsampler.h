@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "JoyConDecoder.h"
+
+/**
+ * @struct ImuUpsamplerConfig
+ * @brief IMUアップサンプリングの設定
+ */
+struct ImuUpsamplerConfig {
+    bool enabled = true;             // 出力クロックで中間サンプルを生成するか
+    float renderDelay = -1.0f;       // 出力時刻から遅らせて補間する時間（秒）。負なら直近のサンプル間隔（1レポート周期）
+    float maxExtrapolation = 0.008f; // 次のサンプルが遅れたときに最新サンプルから外挿する最大時間（秒）
+};
+
+/**
+ * @brief imu_upsampler.txt からIMUアップサンプリングの設定を読み込む
+ * @param config 読み込んだ値で上書きする設定
+ * @note 形式は1行ごとに "キー=値"（enabled, render_delay_ms（autoで1レポート周期）, max_extrapolation_ms）
+ */
+void LoadImuUpsamplerConfig(ImuUpsamplerConfig& config);
+
+/**
+ * @class ImuUpsampler
+ * @brief 低頻度のIMUサンプルから任意の時刻のモーションデータを補間・外挿する
+ *
+ * 出力クロックでは出力時刻から約1レポート周期遅らせた時刻を描画する。通常は直近2サンプルの
+ * 間の補間になり、次のサンプルが遅れたときだけ上限付きで外挿する。
+ */
+class ImuUpsampler {
+public:
+    explicit ImuUpsampler(const ImuUpsamplerConfig& config = {});
+
+    /**
+     * @brief 新しいIMUサンプルを追加
+     * @param time サンプルのホスト時刻（秒）
+     * @param motion モーションデータ
+     */
+    void Push(double time, const MotionData& motion);
+
+    /**
+     * @brief 指定時刻のモーションデータを生成
+     * @param time 出力するホスト時刻（秒）
+     * @param out 生成したモーションデータを格納する参照
+     * @return サンプルが1つもない場合はfalse
+     */
+    bool Sample(double time, MotionData& out) const;
+
+    /**
+     * @brief 出力時刻から遅らせて補間する時間（設定値、自動なら平滑化したサンプル間隔）
+     * @return 遅延（秒）
+     */
+    double RenderDelay() const;
+
+    void Reset() { count = 0; period = 0.0; }
+
+    const ImuUpsamplerConfig& Config() const { return config; }
+
+private:
+    ImuUpsamplerConfig config;
+
+    // 直近2サンプル（ジャイロ3軸 + 加速度3軸）
+    std::array<double, 2> times{};
+    std::array<std::array<float, 6>, 2> values{};
+    int count = 0;
+
+    double period = 0.0; // 平滑化したサンプル間隔（秒）
+};
+
+/**
+ * @brief ホスト時刻をDS4レポートのタイムスタンプ（5.33us単位）に変換
+ * @param time ホスト時刻（秒）
+ * @return DS4レポートのwTimestampに設定する値
+ */
+uint16_t ToDS4Timestamp(double time);
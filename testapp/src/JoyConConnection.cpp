@@ -0,0 +1,243 @@
+﻿#include "JoyConConnection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DeviceCache.h"
+#include "ReconnectingDevice.h"
+
+// Joy-Conのスキャンを待つ最大時間
+constexpr std::chrono::seconds SCAN_TIMEOUT{ 30 };
+// アドバタイズで種類が分からないとき、入力レポートからの推定を待つ最大時間
+constexpr std::chrono::milliseconds MODEL_DETECT_TIMEOUT{ 1000 };
+
+std::shared_ptr<TransportDevice> WaitForJoyCon(Transport& transport, const std::wstring& prompt)
+{
+    std::wcout << prompt << L"\n";
+    std::wcout << L"Scanning for Joy-Con... (Waiting up to 30 seconds)\n";
+
+    // 製造元データがJoy-Conのものと一致した最初のデバイスを選ぶ
+    uint64_t address = 0;
+    bool found = transport.Scan([&address](const Advertisement& adv)
+        {
+            if (!IsJoyConAdvertisement(adv)) return false;
+            address = adv.address;
+            return true;
+        }, SCAN_TIMEOUT);
+
+    if (!found)
+    {
+        std::wcerr << L"Timeout: Joy-Con not found.\n";
+        exit(1);
+    }
+
+    auto device = transport.Connect(address);
+    if (!device)
+    {
+        std::wcerr << L"Failed to get GATT services.\n";
+        exit(1);
+    }
+    return device;
+}
+
+/**
+ * @brief コントローラーに接続し、通知の受信と初期化コマンドの送信を開始する
+ * @param model アドバタイズから判定した種類（Unknownなら前回の種類か、入力レポートから推定する）
+ * @param logMutex コンソール出力を他のスレッドと混ざらないようにするミューテックス
+ * @return 接続したコントローラー（失敗した場合はnullptr）
+ */
+static std::shared_ptr<ReconnectingDevice> connect_controller(Transport& transport, uint64_t address, ControllerModel model,
+    CommandQueue& queue, const ReconnectConfig& reconnect, std::mutex& logMutex)
+{
+    // 接続にかかった時間を計測（キャッシュが効いているかの確認用）
+    DeviceCacheEntry cached;
+    bool found = LookupDeviceCache(address, cached);
+    bool known = found && !cached.input.empty();
+    // アドバタイズで判定できなければ、前回の種類を使う
+    if (model == ControllerModel::Unknown && found) model = cached.model;
+    auto start = std::chrono::steady_clock::now();
+    auto connection = transport.Connect(address);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (!connection) return nullptr;
+
+    // 通知の途絶を監視して自動で再接続するデバイスとして扱う
+    auto device = std::make_shared<ReconnectingDevice>(transport, queue, connection, model, reconnect);
+    if (!device->Start()) {
+        device->Close();
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        std::wcout << L"Connected " << std::hex << address << std::dec << L" in " << elapsed.count()
+            << L" ms (" << (known ? L"cached" : L"full discovery") << L").\n";
+    }
+
+    // 初期化コマンドはキューに積むだけで、送信の完了は待たない
+    if (device->CanWrite())
+        SendCustomCommands(queue, device);
+
+    // 種類が分からなければ、最初の入力レポートから推定する
+    if (device->Model() == ControllerModel::Unknown)
+        device->WaitForModel(MODEL_DETECT_TIMEOUT);
+    return device;
+}
+
+std::vector<std::shared_ptr<ReconnectingDevice>> TryConnectJoyCons(Transport& transport, size_t count, CommandQueue& queue,
+    const ReconnectConfig& reconnect)
+{
+    std::wcout << L"Scanning for " << count << L" controller(s)... (Waiting up to 30 seconds)\n";
+
+    std::mutex mutex;
+    std::condition_variable done;
+    // 接続できたデバイスと、スキャンで見つかった順番（スロットは接続の完了順ではなく見つかった順にする）
+    std::vector<std::pair<uint64_t, std::shared_ptr<ReconnectingDevice>>> devices;
+    uint64_t discovered = 0;
+    std::set<uint64_t> pending;                               // 接続・初期化中のアドレス
+    std::set<uint64_t> ready;                                 // 接続済みのアドレス
+    std::vector<std::thread> workers;
+
+    // 見つかったデバイスを別スレッドで接続する（接続の待ち時間は重なるが、順番は見つかった順のまま）
+    auto connect = [&](uint64_t address, ControllerModel model, uint64_t order)
+        {
+            auto device = connect_controller(transport, address, model, queue, reconnect, mutex);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.erase(address);
+            if (device && devices.size() < count) {
+                devices.emplace_back(order, device);
+                ready.insert(address);
+                std::wcout << L"Controller " << devices.size() << L"/" << count << L" ready: "
+                    << ControllerModelName(device->Model()) << L".\n";
+            }
+            else if (device) {
+                device->Close();
+            }
+            else {
+                std::wcerr << L"Failed to connect to a controller. Retrying...\n";
+            }
+            done.notify_all();
+        };
+
+    // 空きスロットがある間はスキャンを続け、全スロット分の接続を開始したら止める
+    auto onAdvertisement = [&](const Advertisement& adv)
+        {
+            if (!IsJoyConAdvertisement(adv)) return false;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (devices.size() + pending.size() >= count) return true;
+            if (pending.count(adv.address) || ready.count(adv.address)) return false;
+
+            pending.insert(adv.address);
+            workers.emplace_back(connect, adv.address, ParseControllerModel(adv.manufacturerData), discovered++);
+            return devices.size() + pending.size() >= count;
+        };
+
+    auto deadline = std::chrono::steady_clock::now() + SCAN_TIMEOUT;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (devices.size() >= count) break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) break;
+
+        transport.Scan(onAdvertisement, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now));
+
+        // 接続中のデバイスを待つ（失敗した分は再びスキャンする）
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return pending.empty(); });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    if (devices.size() < count)
+        std::wcerr << L"Timeout: only " << devices.size() << L" of " << count << L" controllers found.\n";
+
+    // 同期した順（=プレイヤーの順）に並べる。接続に失敗したものは詰める
+    std::sort(devices.begin(), devices.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<std::shared_ptr<ReconnectingDevice>> ordered;
+    for (auto& [order, device] : devices)
+        ordered.push_back(std::move(device));
+    return ordered;
+}
+
+std::vector<std::shared_ptr<ReconnectingDevice>> ConnectJoyCons(Transport& transport, size_t count, CommandQueue& queue,
+    const ReconnectConfig& reconnect)
+{
+    auto devices = TryConnectJoyCons(transport, count, queue, reconnect);
+    if (devices.size() < count)
+        exit(1);
+    return devices;
+}
+
+std::vector<std::shared_ptr<ReconnectingDevice>> ConnectJoyConsByAddress(Transport& transport, const std::vector<uint64_t>& addresses,
+    CommandQueue& queue, const ReconnectConfig& reconnect)
+{
+    std::vector<std::shared_ptr<ReconnectingDevice>> devices(addresses.size());
+    std::mutex mutex;
+
+    // 既知のアドレスにはスキャンせず、全台並行して接続する
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < addresses.size(); ++i) {
+        if (addresses[i] == 0) continue;
+        workers.emplace_back([&, i]()
+            {
+                devices[i] = connect_controller(transport, addresses[i], ControllerModel::Unknown, queue, reconnect, mutex);
+                if (!devices[i]) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::wcerr << L"Failed to reconnect " << std::hex << addresses[i] << std::dec << L".\n";
+                }
+            });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    // 接続できなかった分と、アドレスが無い分はスキャンで見つかったものを順に割り当てる
+    size_t missing = std::count(devices.begin(), devices.end(), nullptr);
+    if (missing == 0) return devices;
+
+    std::wcout << L"Please sync the remaining " << missing << L" controller(s) now.\n";
+    auto found = ConnectJoyCons(transport, missing, queue, reconnect);
+    auto next = found.begin();
+    for (auto& device : devices)
+        if (!device) device = *next++;
+    return devices;
+}
+
+void SendCustomCommands(CommandQueue& queue, const std::shared_ptr<TransportDevice>& device)
+{
+    // 送信するコマンドのリスト
+    static const std::vector<std::vector<uint8_t>> commands = {
+        { 0x0c, 0x91, 0x01, 0x02, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 },
+        { 0x0c, 0x91, 0x01, 0x04, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 }
+    };
+
+    // 前の書き込みが完了してから次を送る（待機はキューが行う）
+    for (const auto& cmd : commands)
+    {
+        queue.Enqueue(device, cmd, [](bool success)
+            {
+                if (success)
+                    std::wcout << L"Command sent successfully.\n";
+                else
+                    std::wcout << L"Failed to send command.\n";
+            });
+    }
+
+    // 初期化後に有効な入力レポートが届くかを確認
+    queue.EnqueueVerify(device, [address = device->Address()](bool success)
+        {
+            if (!success)
+                std::wcerr << L"No input report from " << std::hex << address << std::dec << L" after init commands.\n";
+        });
+}
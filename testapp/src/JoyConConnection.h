@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CommandQueue.h"
+#include "ReconnectingDevice.h"
+#include "Transport.h"
+
+/**
+ * @brief Joy-ConのBluetooth LEアドバタイズを待ち受け、接続する
+ * @param transport 使用する通信バックエンド
+ * @param prompt ユーザーに表示するプロンプトメッセージ
+ * @return 接続に成功したJoy-Con（見つからない場合はエラーで終了する）
+ */
+std::shared_ptr<TransportDevice> WaitForJoyCon(Transport& transport, const std::wstring& prompt);
+
+/**
+ * @brief 1回のスキャンで複数のコントローラーを探し、並行して接続・初期化する
+ * @param transport 使用する通信バックエンド
+ * @param count 接続するコントローラーの台数
+ * @param queue 初期化コマンドを送信するキュー
+ * @param reconnect 接続後の途絶の検出と再接続の設定
+ * @return 接続したコントローラー（スキャンで見つかった順=同期した順。見つからない場合はエラーで終了する）
+ * @note 見つかったデバイスはスキャンを続けたまま別スレッドで接続し、初期化コマンドはキューから
+ *       非同期に送るので、全体の所要時間は最も遅い1台の接続時間に近くなる
+ */
+std::vector<std::shared_ptr<ReconnectingDevice>> ConnectJoyCons(Transport& transport, size_t count, CommandQueue& queue,
+    const ReconnectConfig& reconnect);
+
+/**
+ * @brief 既知のアドレスのコントローラーに、スキャンせずに並行して接続・初期化する
+ * @param addresses 接続するアドレス（0の要素はスキャンで見つかったコントローラーを割り当てる）
+ * @return addressesと同じ順の接続したコントローラー
+ * @note 接続できなかったアドレスもスキャンで探し直す（見つからない場合はエラーで終了する）
+ */
+std::vector<std::shared_ptr<ReconnectingDevice>> ConnectJoyConsByAddress(Transport& transport, const std::vector<uint64_t>& addresses,
+    CommandQueue& queue, const ReconnectConfig& reconnect);
+
+/**
+ * @brief ConnectJoyConsと同じだが、見つからない場合も終了せずに接続できた分だけを返す
+ * @note 実行中のプレイヤーの追加など、失敗してもアプリを続ける場合に使う
+ */
+std::vector<std::shared_ptr<ReconnectingDevice>> TryConnectJoyCons(Transport& transport, size_t count, CommandQueue& queue,
+    const ReconnectConfig& reconnect);
+
+/**
+ * @brief Joy-Conに初期化用のカスタムコマンドを送信（キューに積んですぐ戻る）
+ * @param queue コマンドを送信するキュー
+ * @param device コマンドを送信するJoy-Con
+ * @note Joy-Conが安定してレポートを送信するために必要。最初の有効な入力レポートで初期化を確認する
+ *       （ReconnectingDeviceは受信したレポートを CommandQueue::ReportReceived に通知する）
+ */
+void SendCustomCommands(CommandQueue& queue, const std::shared_ptr<TransportDevice>& device);
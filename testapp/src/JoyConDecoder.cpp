@@ -1,8 +1,6 @@
 ﻿#include "JoyConDecoder.h"
 #include <cmath>
 #include <algorithm>
-#include <ViGEm/Client.h>
-#include <ViGEm/Common.h>
 
 #include <cstdint>
 #include <vector>
@@ -134,7 +132,7 @@ void EncodeDS4Touch(DS4_TOUCH& touch, uint8_t trackingId, uint16_t x, uint16_t y
  * @param rightShoulder 右ショルダーボタンが押されているかを格納する参照
  */
 static void decode_triggers_shoulders(uint32_t state, bool isLeft, bool upright,
-    BYTE& leftTrigger, BYTE& rightTrigger,
+    uint8_t& leftTrigger, uint8_t& rightTrigger,
     bool& leftShoulder, bool& rightShoulder) {
 
     // ZL/ZRボタンはデジタルトリガーとして扱う
@@ -225,7 +223,7 @@ DS4_REPORT_EX GenerateDS4Report(const std::vector<uint8_t>& buffer, JoyConSide s
     EncodeDS4Touch(report.Report.sCurrentTouch, 1, touchX, touchY);
 
     // トリガーとショルダーボタンの状態をデコード
-    BYTE leftTrigger = 0, rightTrigger = 0;
+    uint8_t leftTrigger = 0, rightTrigger = 0;
     bool leftShoulder = false, rightShoulder = false;
     decode_triggers_shoulders(state, isLeft, upright, leftTrigger, rightTrigger, leftShoulder, rightShoulder);
 
@@ -236,8 +234,8 @@ DS4_REPORT_EX GenerateDS4Report(const std::vector<uint8_t>& buffer, JoyConSide s
     if (rightTrigger)  report.Report.wButtons |= DS4_BUTTON_TRIGGER_RIGHT;
 
     // スティックの値を0-255の範囲に変換して設定
-    report.Report.bThumbLX = static_cast<BYTE>((stickX / 32767.0f) * 127 + 128);
-    report.Report.bThumbLY = static_cast<BYTE>((stickY / 32767.0f) * 127 + 128);
+    report.Report.bThumbLX = static_cast<uint8_t>((stickX / 32767.0f) * 127 + 128);
+    report.Report.bThumbLY = static_cast<uint8_t>((stickY / 32767.0f) * 127 + 128);
 
     // 加速度センサーの値をレポートに設定
     report.Report.wAccelX = to_signed_16(buffer[0x30], buffer[0x31]);
@@ -282,11 +280,11 @@ DS4_REPORT_EX GenerateDualJoyConDS4Report(const std::vector<uint8_t>& leftBuffer
 
     // ボタンの状態を結合します。
     // 左のDPADはそのまま使い、他のボタンは両方のレポートのOをとる
-    USHORT leftDpad = leftReport.Report.wButtons & 0xF; // DPAD部分のみ抽出
-    USHORT leftButtonsNoDpad = leftReport.Report.wButtons & ~0xF; // DPAD以外
-    USHORT rightButtonsNoDpad = rightReport.Report.wButtons & ~0xF; // DPAD以外
+    uint16_t leftDpad = leftReport.Report.wButtons & 0xF; // DPAD部分のみ抽出
+    uint16_t leftButtonsNoDpad = leftReport.Report.wButtons & ~0xF; // DPAD以外
+    uint16_t rightButtonsNoDpad = rightReport.Report.wButtons & ~0xF; // DPAD以外
 
-    USHORT combinedButtons = leftButtonsNoDpad | rightButtonsNoDpad;
+    uint16_t combinedButtons = leftButtonsNoDpad | rightButtonsNoDpad;
     report.Report.wButtons = combinedButtons | leftDpad;
 
     // 特殊ボタン（PSボタンなど）の状態を結合
@@ -309,7 +307,7 @@ DS4_REPORT_EX GenerateDualJoyConDS4Report(const std::vector<uint8_t>& leftBuffer
     uint32_t leftState = (leftBuffer[4] << 16) | (leftBuffer[5] << 8) | leftBuffer[6];
     uint32_t rightState = (rightBuffer[3] << 16) | (rightBuffer[4] << 8) | rightBuffer[5];
 
-    BYTE lt = 0, rt = 0;
+    uint8_t lt = 0, rt = 0;
     bool ls = false, rs = false;
 
     // 左Joy-Conのトリガー/ショルダー
@@ -560,4 +558,55 @@ DS4_REPORT_EX GenerateNSOGCReport(const std::vector<uint8_t>& buffer)
     report.Report.wGyroZ = to_signed_16(buffer[0x3A], buffer[0x3B]);
 
     return report;
-}
\ No newline at end of file
+}
+/**
+ * @brief 生データからモーションセンサーの値をデコード
+ * @param buffer Joy-Conからの入力レポートのデータバッファ
+ * @return デコードされたモーションデータ（バッファが不十分な場合はすべて0）
+ */
+MotionData DecodeMotion(const std::vector<uint8_t>& buffer)
+{
+    MotionData motion{};
+    if (buffer.size() < 0x3C) return motion;
+
+    motion.accelX = to_signed_16(buffer[0x30], buffer[0x31]);
+    motion.accelY = to_signed_16(buffer[0x32], buffer[0x33]);
+    motion.accelZ = to_signed_16(buffer[0x34], buffer[0x35]);
+    motion.gyroX = to_signed_16(buffer[0x36], buffer[0x37]);
+    motion.gyroY = to_signed_16(buffer[0x38], buffer[0x39]);
+    motion.gyroZ = to_signed_16(buffer[0x3A], buffer[0x3B]);
+
+    return motion;
+}
+
+/**
+ * @brief モーションセンサーの値を生データに書き戻す
+ * @param buffer Joy-Conからの入力レポートのデータバッファ（書き換えられる）
+ * @param motion 書き込むモーションデータ（バッファが不十分な場合は何もしない）
+ */
+void EncodeMotion(std::vector<uint8_t>& buffer, const MotionData& motion)
+{
+    if (buffer.size() < 0x3C) return;
+
+    const int16_t values[6] = {
+        motion.accelX, motion.accelY, motion.accelZ,
+        motion.gyroX, motion.gyroY, motion.gyroZ
+    };
+    for (size_t i = 0; i < 6; ++i) {
+        uint16_t v = static_cast<uint16_t>(values[i]);
+        buffer[0x30 + i * 2] = v & 0xFF;
+        buffer[0x30 + i * 2 + 1] = (v >> 8) & 0xFF;
+    }
+}
+
+/**
+ * @brief 生データから入力レポートのタイムスタンプ（パケットID）を取得
+ * @param buffer Joy-Conからの入力レポートのデータバッファ
+ * @return コントローラー側のタイムスタンプ（リトルエンディアン32ビット）
+ */
+uint32_t DecodeTimestamp(const std::vector<uint8_t>& buffer)
+{
+    if (buffer.size() < 4) return 0;
+    return static_cast<uint32_t>(buffer[0]) | (static_cast<uint32_t>(buffer[1]) << 8) |
+        (static_cast<uint32_t>(buffer[2]) << 16) | (static_cast<uint32_t>(buffer[3]) << 24);
+}
@@ -3,8 +3,7 @@
 #include <vector>
 #include <utility>
 #include <cstdint>
-#include <Windows.h>
-#include <ViGEm/Client.h>
+#include "DS4Report.h"
 
 /**
  * @enum JoyConSide
@@ -31,8 +30,8 @@ enum class JoyConOrientation {
 struct StickData {
     int16_t x;  // X軸の値 (-32767 to 32767)
     int16_t y;  // Y軸の値 (-32767 to 32767)
-    BYTE rx; // 0-255に変換されたX軸の値
-    BYTE ry; // 0-255に変換されたY軸の値
+    uint8_t rx; // 0-255に変換されたX軸の値
+    uint8_t ry; // 0-255に変換されたY軸の値
 };
 
 /**
@@ -40,8 +39,8 @@ struct StickData {
  * @brief モーションセンサー（ジャイロ・加速度）のデータを保持する構造体
  */
 struct MotionData {
-    SHORT gyroX, gyroY, gyroZ;   // ジャイロセンサーの各軸の値
-    SHORT accelX, accelY, accelZ; // 加速度センサーの各軸の値
+    int16_t gyroX, gyroY, gyroZ;   // ジャイロセンサーの各軸の値
+    int16_t accelX, accelY, accelZ; // 加速度センサーの各軸の値
 };
 
 
@@ -119,4 +118,23 @@ MotionData DecodeMotion(
     const std::vector<uint8_t>& buffer
 );
 
+/**
+ * @brief モーションセンサーの値を生データに書き戻す
+ * @param buffer Joy-Conからの生データ（書き換えられる）
+ * @param motion 書き込むモーションデータ
+ */
+void EncodeMotion(
+    std::vector<uint8_t>& buffer,
+    const MotionData& motion
+);
+
+
+/**
+ * @brief 生データから入力レポートのタイムスタンプ（パケットID）を取得
+ * @param buffer Joy-Conからの生データ
+ * @return コントローラー側のタイムスタンプ（バッファが不十分な場合は0）
+ */
+uint32_t DecodeTimestamp(
+    const std::vector<uint8_t>& buffer
+);
 
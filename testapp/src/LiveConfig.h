@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class LiveConfig
+ * @brief 実行中に差し替えられる設定（読み取りはロックを取らない）
+ *
+ * 設定は公開した時点で不変になり、ポインタの差し替えで新しい設定に切り替わる。
+ * 入力ハンドラなどの読み取り側は、レポートごとにGetで最新の設定を参照する。
+ * 公開した設定は終了まで解放しないので、読み取り中に差し替わっても参照は有効なまま
+ * （設定ファイルの保存ごとに1つ増えるだけなので、メモリの増加は無視できる）。
+ * @tparam T 設定の型
+ */
+template <typename T>
+class LiveConfig {
+public:
+    explicit LiveConfig(T initial = T()) { Publish(std::move(initial)); }
+
+    LiveConfig(const LiveConfig&) = delete;
+    LiveConfig& operator=(const LiveConfig&) = delete;
+
+    /**
+     * @brief 現在の設定を取得する（ロックを取らない）
+     * @note 参照はこのオブジェクトが存在する間有効
+     */
+    const T& Get() const { return *current.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 公開した回数（設定が変わったかの判定用）
+     */
+    uint32_t Version() const { return version.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 新しい設定を公開する（次の読み取りから使われる）
+     */
+    void Publish(T config)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        versions.push_back(std::make_unique<const T>(std::move(config)));
+        current.store(versions.back().get(), std::memory_order_release);
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<const T*> current{ nullptr };
+    std::atomic<uint32_t> version{ 0 };
+    std::mutex mutex;
+    std::vector<std::unique_ptr<const T>> versions; // 公開した全ての設定
+};
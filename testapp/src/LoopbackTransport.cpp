@@ -0,0 +1,238 @@
+﻿#include "LoopbackTransport.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "DeviceCache.h"
+
+// 合成レポートのサイズ（IMUデータの末尾0x3Cを含む）
+constexpr size_t SYNTHETIC_REPORT_SIZE = 0x40;
+// ループバックデバイスのアドレスの先頭（任天堂のOUIに似せない値）
+constexpr uint64_t LOOPBACK_ADDRESS_BASE = 0x0200000000A0;
+// キャッシュに記録するキャラクタリスティックの位置（ループバックでは形だけ）
+constexpr const char* LOOPBACK_INPUT_LOCATION = "loopback/input";
+constexpr const char* LOOPBACK_WRITE_LOCATION = "loopback/write";
+
+/**
+ * @brief リトルエンディアンの16ビット値を書き込む
+ */
+static void put_le16(std::vector<uint8_t>& buffer, size_t offset, int16_t value)
+{
+    buffer[offset] = static_cast<uint8_t>(value & 0xFF);
+    buffer[offset + 1] = static_cast<uint8_t>((static_cast<uint16_t>(value) >> 8) & 0xFF);
+}
+
+ReportSource MakeSyntheticReportSource(std::chrono::microseconds interval)
+{
+    uint32_t counter = 0;
+    return [counter, interval](std::vector<uint8_t>& report) mutable
+        {
+            report.assign(SYNTHETIC_REPORT_SIZE, 0);
+
+            // タイムスタンプ（マイクロ秒単位で進める）
+            uint32_t timestamp = static_cast<uint32_t>(counter * interval.count());
+            for (size_t i = 0; i < 4; ++i) report[i] = static_cast<uint8_t>(timestamp >> (i * 8));
+
+            // 左右のスティックを中央(0x800, 0x800)にする
+            for (size_t offset : { size_t{ 10 }, size_t{ 13 } }) {
+                report[offset] = 0x00;
+                report[offset + 1] = 0x08;
+                report[offset + 2] = 0x80;
+            }
+
+            // 加速度: 重力1G (4096)、ジャイロ: 0.5Hzで振幅30deg/sの正弦波 (48000 = 360deg/s)
+            double t = counter * interval.count() * 1e-6;
+            put_le16(report, 0x34, 4096);
+            put_le16(report, 0x38, static_cast<int16_t>(std::lround(4000.0 * std::sin(t * 3.14159265358979))));
+
+            ++counter;
+            return true;
+        };
+}
+
+ReportSource LoadCaptureReportSource(const std::string& path, bool loop)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) return nullptr;
+
+    std::vector<std::vector<uint8_t>> reports;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        // PrintRawNotificationの接頭辞を読み飛ばす
+        auto bracket = line.find(']');
+        std::istringstream iss(bracket == std::string::npos ? line : line.substr(bracket + 1));
+
+        std::vector<uint8_t> report;
+        std::string token;
+        while (iss >> token) {
+            try {
+                report.push_back(static_cast<uint8_t>(std::stoul(token, nullptr, 16)));
+            }
+            catch (const std::exception&) {
+                break;
+            }
+        }
+        if (!report.empty()) reports.push_back(std::move(report));
+    }
+    if (reports.empty()) return nullptr;
+
+    size_t index = 0;
+    return [reports = std::move(reports), index, loop](std::vector<uint8_t>& report) mutable
+        {
+            if (index == reports.size()) {
+                if (!loop) return false;
+                index = 0;
+            }
+            report = reports[index++];
+            return true;
+        };
+}
+
+LoopbackTransport::~LoopbackTransport() = default;
+
+void LoopbackTransport::AddDevice(uint64_t address, ReportSource source, std::chrono::microseconds interval)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.push_back({ address, std::move(source), interval });
+}
+
+bool LoopbackTransport::Scan(ScanHandler handler, std::chrono::milliseconds)
+{
+    // ハンドラから接続できるよう、ロックを外してから通知する
+    std::vector<uint64_t> advertising;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : entries) {
+            // 接続中のデバイスは実機と同様にアドバタイズしない
+            if (!entry.connected) advertising.push_back(entry.address);
+        }
+    }
+
+    for (uint64_t address : advertising) {
+        Advertisement adv;
+        adv.address = address;
+        adv.companyId = JOYCON_MANUFACTURER_ID;
+        adv.manufacturerData = JOYCON_MANUFACTURER_PREFIX;
+        if (handler(adv)) return true;
+    }
+    return false;
+}
+
+std::shared_ptr<TransportDevice> LoopbackTransport::Connect(uint64_t address)
+{
+    // 実機の通信バックエンドと同じくキャッシュを引き、無ければ全サービスの探索の代わりに待つ
+    auto start = std::chrono::steady_clock::now();
+    DeviceCacheEntry cached;
+    bool known = LookupDeviceCache(address, cached) && !cached.input.empty();
+    if (!known && discoveryDelay.count() > 0) std::this_thread::sleep_for(discoveryDelay);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : entries) {
+        if (entry.address != address || entry.connected) continue;
+        entry.connected = true;
+        if (!known) StoreGattLocation(address, LOOPBACK_INPUT_LOCATION, LOOPBACK_WRITE_LOCATION);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        RecordConnectTime(known ? ConnectPath::Cached : ConnectPath::Discovery, elapsed, elapsed);
+        // 閉じたら再びアドバタイズ・接続できるようにする
+        return std::make_shared<LoopbackDevice>(entry.address, entry.source, entry.interval, [this, address]()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& e : entries) {
+                    if (e.address == address) e.connected = false;
+                }
+            });
+    }
+    return nullptr;
+}
+
+LoopbackDevice::LoopbackDevice(uint64_t address, ReportSource source, std::chrono::microseconds interval, std::function<void()> release)
+    : address(address), source(std::move(source)), interval(interval), release(std::move(release))
+{
+}
+
+LoopbackDevice::~LoopbackDevice()
+{
+    Close();
+}
+
+bool LoopbackDevice::Subscribe(NotifyHandler handler)
+{
+    if (running.exchange(true)) return false;
+    thread = std::thread(&LoopbackDevice::Run, this, std::move(handler));
+    return true;
+}
+
+void LoopbackDevice::Run(NotifyHandler handler)
+{
+    std::vector<uint8_t> report;
+    auto next = std::chrono::steady_clock::now();
+    while (running.load(std::memory_order_acquire)) {
+        if (!source(report)) break;
+        handler(std::span<const uint8_t>(report.data(), report.size()));
+
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+bool LoopbackDevice::WriteCommand(std::span<const uint8_t> data)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.emplace_back(data.begin(), data.end());
+    return true;
+}
+
+void LoopbackDevice::Close()
+{
+    running.store(false, std::memory_order_release);
+    if (thread.joinable() && thread.get_id() != std::this_thread::get_id()) thread.join();
+    if (release) {
+        release();
+        release = nullptr;
+    }
+}
+
+std::vector<std::vector<uint8_t>> LoopbackDevice::WrittenCommands() const
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    return commands;
+}
+
+/**
+ * @brief 整数の環境変数を読み込む
+ */
+static long env_long(const char* name, long fallback)
+{
+    const char* value = std::getenv(name);
+    if (!value) return fallback;
+    char* end = nullptr;
+    long parsed = std::strtol(value, &end, 10);
+    return (end != value && parsed > 0) ? parsed : fallback;
+}
+
+std::unique_ptr<Transport> CreateLoopbackTransportFromEnvironment()
+{
+    auto transport = std::make_unique<LoopbackTransport>();
+
+    long devices = env_long("JOYCON_LOOPBACK_DEVICES", 4);
+    auto interval = std::chrono::microseconds(env_long("JOYCON_LOOPBACK_INTERVAL_US", 8000));
+    const char* capture = std::getenv("JOYCON_CAPTURE");
+    transport->SetDiscoveryDelay(std::chrono::milliseconds(env_long("JOYCON_LOOPBACK_DISCOVERY_MS", 0)));
+
+    for (long i = 0; i < devices; ++i) {
+        ReportSource source;
+        if (capture) {
+            source = LoadCaptureReportSource(capture);
+            if (!source) {
+                std::wcerr << L"Failed to load capture file. Using synthetic reports.\n";
+                capture = nullptr;
+            }
+        }
+        if (!source) source = MakeSyntheticReportSource(interval);
+        transport->AddDevice(LOOPBACK_ADDRESS_BASE + i, std::move(source), interval);
+    }
+    return transport;
+}
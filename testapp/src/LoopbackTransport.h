@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Transport.h"
+
+/**
+ * @brief ループバックデバイスが送信する入力レポートを生成する関数
+ * @param report 生成したレポートを格納する参照（容量は再利用される）
+ * @return 送信するレポートがなくなったらfalse
+ */
+using ReportSource = std::function<bool(std::vector<uint8_t>& report)>;
+
+/**
+ * @brief 合成したJoy-Conの入力レポートを生成するソース
+ * @param interval レポートの間隔（タイムスタンプの進み方に使う）
+ * @note スティックは中央、ジャイロはゆっくりした正弦波、加速度は重力1G
+ */
+ReportSource MakeSyntheticReportSource(std::chrono::microseconds interval);
+
+/**
+ * @brief キャプチャファイルの入力レポートを順に再生するソース
+ * @param path 1行に1レポートを16進数で記録したファイル（PrintRawNotificationの出力をそのまま使える）
+ * @param loop 末尾まで再生したら先頭から繰り返すか
+ * @return ソース（ファイルが読めない、または空の場合は空の関数）
+ */
+ReportSource LoadCaptureReportSource(const std::string& path, bool loop = true);
+
+/**
+ * @class LoopbackTransport
+ * @brief 実機の代わりにプロセス内でレポートを生成する通信バックエンド
+ *
+ * Bluetoothのない環境でのパイプラインの動作確認や、遅延・スループットの計測に使う。
+ */
+class LoopbackTransport : public Transport {
+public:
+    ~LoopbackTransport() override;
+
+    /**
+     * @brief 仮想デバイスを追加
+     * @param address デバイスのアドレス
+     * @param source 入力レポートのソース
+     * @param interval 入力レポートの送信間隔
+     */
+    void AddDevice(uint64_t address, ReportSource source, std::chrono::microseconds interval);
+
+    /**
+     * @brief キャッシュに無いデバイスへの接続で、全サービスの探索の代わりに待つ時間を設定（既定は0）
+     * @note 実機と同様にデバイスのキャッシュを引いて記録するので、キャッシュの有無による接続時間の差を再現できる
+     */
+    void SetDiscoveryDelay(std::chrono::milliseconds delay) { discoveryDelay = delay; }
+
+    bool Scan(ScanHandler handler, std::chrono::milliseconds timeout) override;
+    std::shared_ptr<TransportDevice> Connect(uint64_t address) override;
+
+private:
+    struct Entry {
+        uint64_t address;
+        ReportSource source;
+        std::chrono::microseconds interval;
+        bool connected = false;
+    };
+
+    std::mutex mutex;
+    std::vector<Entry> entries;
+    std::chrono::milliseconds discoveryDelay{ 0 };
+};
+
+/**
+ * @class LoopbackDevice
+ * @brief ループバックの仮想デバイス（専用スレッドから一定間隔で通知する）
+ */
+class LoopbackDevice : public TransportDevice {
+public:
+    LoopbackDevice(uint64_t address, ReportSource source, std::chrono::microseconds interval, std::function<void()> release = nullptr);
+    ~LoopbackDevice() override;
+
+    uint64_t Address() const override { return address; }
+    bool Subscribe(NotifyHandler handler) override;
+    bool WriteCommand(std::span<const uint8_t> data) override;
+    bool CanWrite() const override { return true; }
+    void Close() override;
+
+    /**
+     * @brief これまでに書き込まれたコマンド
+     */
+    std::vector<std::vector<uint8_t>> WrittenCommands() const;
+
+private:
+    void Run(NotifyHandler handler);
+
+    uint64_t address;
+    ReportSource source;
+    std::chrono::microseconds interval;
+
+    std::atomic<bool> running{ false };
+    std::thread thread;
+    std::function<void()> release; // 閉じたときにトランスポートへ返す（再接続できるようにする）
+
+    mutable std::mutex commandMutex;
+    std::vector<std::vector<uint8_t>> commands;
+};
+
+/**
+ * @brief 環境変数の設定からループバックの通信バックエンドを作成する
+ * @note JOYCON_CAPTURE=ファイル でキャプチャを再生（未指定なら合成レポート）、
+ *       JOYCON_LOOPBACK_DEVICES=台数（既定4）、JOYCON_LOOPBACK_INTERVAL_US=間隔（既定8000）、
+ *       JOYCON_LOOPBACK_DISCOVERY_MS=キャッシュに無いデバイスの探索にかかる時間（既定0）
+ */
+std::unique_ptr<Transport> CreateLoopbackTransportFromEnvironment();
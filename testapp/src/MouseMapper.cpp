@@ -0,0 +1,188 @@
+﻿#include "MouseMapper.h"
+
+#include <bit>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// 左Joy-Con: ZL=左, L=右, スティック押し込み=中, 十字下=進む, 十字上=戻る
+static const MouseBindings LEFT_BINDINGS = { {
+    { DS4_BUTTON_TRIGGER_LEFT, DS4_BUTTON_TRIGGER_LEFT },
+    { DS4_BUTTON_SHOULDER_LEFT, DS4_BUTTON_SHOULDER_LEFT },
+    { DS4_BUTTON_THUMB_LEFT, DS4_BUTTON_THUMB_LEFT },
+    { 0xF, DS4_BUTTON_DPAD_SOUTH },
+    { 0xF, DS4_BUTTON_DPAD_NORTH },
+} };
+
+// 右Joy-Con: ZR=左, R=右, スティック押し込み=中, X(×)=進む, B(△)=戻る
+static const MouseBindings RIGHT_BINDINGS = { {
+    { DS4_BUTTON_TRIGGER_RIGHT, DS4_BUTTON_TRIGGER_RIGHT },
+    { DS4_BUTTON_SHOULDER_RIGHT, DS4_BUTTON_SHOULDER_RIGHT },
+    { DS4_BUTTON_THUMB_RIGHT, DS4_BUTTON_THUMB_RIGHT },
+    { DS4_BUTTON_CROSS, DS4_BUTTON_CROSS },
+    { DS4_BUTTON_TRIANGLE, DS4_BUTTON_TRIANGLE },
+} };
+
+const MouseBindings& DefaultMouseBindings(JoyConSide side)
+{
+    return side == JoyConSide::Left ? LEFT_BINDINGS : RIGHT_BINDINGS;
+}
+
+// mouse_bindings.txtに書ける操作の名前（MouseActionの順）
+static const char* const ACTION_NAMES[MouseActionCount] = { "left", "right", "middle", "forward", "back" };
+
+/**
+ * @brief Joy-Conのボタン名をDS4レポートのボタン条件に変換する（デコーダーの割り当てに合わせる）
+ * @return 知らない名前ならfalse
+ */
+static bool parse_button(const std::string& name, MouseButtonBinding& binding)
+{
+    struct NamedButton {
+        const char* name;
+        MouseButtonBinding binding;
+    };
+    static const NamedButton BUTTONS[] = {
+        { "ZL", { DS4_BUTTON_TRIGGER_LEFT, DS4_BUTTON_TRIGGER_LEFT } },
+        { "ZR", { DS4_BUTTON_TRIGGER_RIGHT, DS4_BUTTON_TRIGGER_RIGHT } },
+        { "L", { DS4_BUTTON_SHOULDER_LEFT, DS4_BUTTON_SHOULDER_LEFT } },
+        { "R", { DS4_BUTTON_SHOULDER_RIGHT, DS4_BUTTON_SHOULDER_RIGHT } },
+        { "LS", { DS4_BUTTON_THUMB_LEFT, DS4_BUTTON_THUMB_LEFT } },
+        { "RS", { DS4_BUTTON_THUMB_RIGHT, DS4_BUTTON_THUMB_RIGHT } },
+        { "A", { DS4_BUTTON_CIRCLE, DS4_BUTTON_CIRCLE } },
+        { "B", { DS4_BUTTON_TRIANGLE, DS4_BUTTON_TRIANGLE } },
+        { "X", { DS4_BUTTON_CROSS, DS4_BUTTON_CROSS } },
+        { "Y", { DS4_BUTTON_SQUARE, DS4_BUTTON_SQUARE } },
+        { "PLUS", { DS4_BUTTON_OPTIONS, DS4_BUTTON_OPTIONS } },
+        { "MINUS", { DS4_BUTTON_SHARE, DS4_BUTTON_SHARE } },
+        { "UP", { 0xF, DS4_BUTTON_DPAD_NORTH } },
+        { "DOWN", { 0xF, DS4_BUTTON_DPAD_SOUTH } },
+        { "LEFT", { 0xF, DS4_BUTTON_DPAD_WEST } },
+        { "RIGHT", { 0xF, DS4_BUTTON_DPAD_EAST } },
+        { "NONE", { 0, 1 } }, // 常に一致しない
+    };
+    for (const auto& button : BUTTONS) {
+        if (name == button.name) {
+            binding = button.binding;
+            return true;
+        }
+    }
+    return false;
+}
+
+void LoadMouseBindings(MouseConfig& config)
+{
+    std::ifstream ifs("mouse_bindings.txt");
+    if (!ifs.is_open()) return;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        // キーは "左右.操作"（例: right.forward）
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        auto dot = key.find('.');
+        MouseBindings* bindings = nullptr;
+        if (dot != std::string::npos) {
+            std::string side = key.substr(0, dot);
+            if (side == "left") bindings = &config.left;
+            else if (side == "right") bindings = &config.right;
+        }
+
+        bool parsed = false;
+        if (bindings) {
+            std::string action = key.substr(dot + 1);
+            for (size_t i = 0; i < MouseActionCount; ++i) {
+                if (action == ACTION_NAMES[i]) {
+                    parsed = parse_button(value, (*bindings)[i]);
+                    break;
+                }
+            }
+        }
+        if (!parsed) {
+            std::wcerr << L"Invalid value in mouse_bindings.txt: " << std::wstring(line.begin(), line.end()) << L"\n";
+        }
+    }
+}
+
+void MouseEventBuffer::Push(const MouseEvent& event)
+{
+    if (count == CAPACITY) Flush();
+    events[count++] = event;
+}
+
+void MouseEventBuffer::Flush()
+{
+    if (count == 0) return;
+    sink.SubmitMouse(std::span<const MouseEvent>(events.data(), count));
+    count = 0;
+}
+
+MouseState::MouseState(JoyConSide side, const LiveConfig<MouseConfig>& config)
+    : side(side), config(config)
+{
+}
+
+void MouseState::Update(const DS4_REPORT_EX& report, MouseEventBuffer& out)
+{
+    // 呼び出し間隔はデバッグ表示用に記録するだけ（表示は別スレッドで行う）
+    auto now = std::chrono::steady_clock::now();
+    if (lastUpdate.time_since_epoch().count() != 0) {
+        lastIntervalMs.store(std::chrono::duration<float, std::milli>(now - lastUpdate).count(), std::memory_order_relaxed);
+    }
+    lastUpdate = now;
+
+    // 設定はレポートごとに読み直すので、ファイルの変更は次のレポートから反映される
+    const MouseConfig& settings = config.Get();
+
+    // ボタン状態のビットマスクを作り、変化したビットだけイベントにする
+    const MouseBindings& bindings = settings.Bindings(side);
+    uint32_t current = 0;
+    for (size_t i = 0; i < MouseActionCount; ++i) {
+        if ((report.Report.wButtons & bindings[i].mask) == bindings[i].value) current |= 1u << i;
+    }
+    uint32_t previous = buttons.load(std::memory_order_relaxed);
+    for (uint32_t changed = current ^ previous; changed != 0; changed &= changed - 1) {
+        int action = std::countr_zero(changed);
+        MouseEvent event;
+        event.type = MouseEventType::Button;
+        event.button = static_cast<MouseAction>(action);
+        event.pressed = ((current >> action) & 1) != 0;
+        out.Push(event);
+    }
+    buttons.store(current, std::memory_order_relaxed);
+
+    // マウスカーソルの操作（移動がないときはイベントを送らない）
+    uint16_t x = report.Report.sCurrentTouch.bTouchData1[0] | ((report.Report.sCurrentTouch.bTouchData1[1] & 0x0F) << 8);
+    uint16_t y = ((report.Report.sCurrentTouch.bTouchData1[1] & 0xF0) >> 4) | (report.Report.sCurrentTouch.bTouchData1[2] << 4);
+    if (hasCursor) {
+        double sensitivity = settings.sensitivity;
+        int32_t dx = static_cast<int32_t>((x - prevX) * sensitivity);
+        int32_t dy = static_cast<int32_t>((prevY - y) * sensitivity);
+        if (dx != 0 || dy != 0) {
+            MouseEvent event;
+            event.type = MouseEventType::Move;
+            event.dx = dx;
+            event.dy = dy;
+            out.Push(event);
+        }
+    }
+    hasCursor = true;
+    prevX = x;
+    prevY = y;
+
+    // スクロールは傾きを渡すだけで、イベントはTickで生成する
+    scroll.SetDeflection((128 - static_cast<int>(report.Report.bThumbLY)) / 127.0f);
+}
+
+void MouseState::Tick(float dt, MouseEventBuffer& out)
+{
+    int delta = scroll.Tick(dt, config.Get().scroll);
+    if (delta == 0) return; // 静止中はイベントを送らない
+
+    MouseEvent event;
+    event.type = MouseEventType::Wheel;
+    event.wheel = delta;
+    out.Push(event);
+}
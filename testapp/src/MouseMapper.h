@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "JoyConDecoder.h"
+#include "LiveConfig.h"
+#include "OutputSink.h"
+#include "ScrollEngine.h"
+
+/**
+ * @struct MouseButtonBinding
+ * @brief マウスのボタンに割り当てるDS4レポートのボタン条件
+ * @note (wButtons & mask) == value のとき押されているとみなす（十字キーは下位4ビットの値で判定）
+ */
+struct MouseButtonBinding {
+    uint16_t mask;
+    uint16_t value;
+};
+
+using MouseBindings = std::array<MouseButtonBinding, MouseActionCount>;
+
+/**
+ * @brief Joy-Conの左右に応じた既定のボタン割り当て
+ * @param side Joy-Conの左右
+ * @return MouseActionの順に並んだ割り当て
+ */
+const MouseBindings& DefaultMouseBindings(JoyConSide side);
+
+/**
+ * @struct MouseConfig
+ * @brief マウス操作の設定（実行中に設定ファイルから読み直される）
+ */
+struct MouseConfig {
+    double sensitivity = 1.0; // カーソル移動の倍率（mouse_sensitivity.txt）
+    ScrollConfig scroll;      // スクロールの設定（scroll.txt）
+    MouseBindings left = DefaultMouseBindings(JoyConSide::Left);   // 左Joy-Conのボタン割り当て（mouse_bindings.txt）
+    MouseBindings right = DefaultMouseBindings(JoyConSide::Right); // 右Joy-Conのボタン割り当て（mouse_bindings.txt）
+
+    const MouseBindings& Bindings(JoyConSide side) const { return side == JoyConSide::Left ? left : right; }
+};
+
+/**
+ * @brief ボタン割り当てをファイルから読み込む（mouse_bindings.txt）
+ * @param config 読み込んだ割り当てで上書きする設定（ファイルに無い操作は元の割り当てのまま）
+ * @note 1行に1つ "left.forward=UP" のように書く。操作は left, right, middle, forward, back、
+ *       ボタンは ZL, ZR, L, R, LS, RS, A, B, X, Y, PLUS, MINUS, UP, DOWN, LEFT, RIGHT, NONE（割り当てない）
+ */
+void LoadMouseBindings(MouseConfig& config);
+
+/**
+ * @class MouseEventBuffer
+ * @brief 送信するマウスイベントを固定長の配列にためて、まとめて出力先に渡す
+ */
+class MouseEventBuffer {
+public:
+    static constexpr size_t CAPACITY = 32;
+
+    /**
+     * @param sink 送信先（このバッファより長く存在すること）
+     */
+    explicit MouseEventBuffer(OutputSink& sink) : sink(sink) {}
+
+    /**
+     * @brief イベントを追加（満杯なら先に送信する）
+     */
+    void Push(const MouseEvent& event);
+
+    /**
+     * @brief たまったイベントを1回の送信で出力先に渡す
+     */
+    void Flush();
+
+    size_t Size() const { return count; }
+
+private:
+    OutputSink& sink;
+    std::array<MouseEvent, CAPACITY> events{};
+    size_t count = 0;
+};
+
+/**
+ * @class MouseState
+ * @brief プレイヤーごとのマウス操作の状態
+ *
+ * ボタン状態をビットマスクで保持し、前回との差分から押下・解放のイベントだけを生成する。
+ */
+class MouseState {
+public:
+    /**
+     * @param side Joy-Conの左右（設定のどちらのボタン割り当てを使うか）
+     * @param config マウス操作の設定（レポートごとに最新の設定を参照する。このオブジェクトより長く存在すること）
+     */
+    MouseState(JoyConSide side, const LiveConfig<MouseConfig>& config);
+
+    /**
+     * @brief レポートからボタンとカーソルのイベントを生成する（入力スレッドから呼ばれる）
+     * @param report デコード済みのDS4レポート
+     * @param out イベントを追加するバッファ
+     */
+    void Update(const DS4_REPORT_EX& report, MouseEventBuffer& out);
+
+    /**
+     * @brief スクロールのイベントを生成する（出力クロックから呼ばれる）
+     * @param dt 前回のティックからの経過時間（秒）
+     * @param out イベントを追加するバッファ
+     */
+    void Tick(float dt, MouseEventBuffer& out);
+
+    /**
+     * @brief 直前のUpdate呼び出しの間隔（ミリ秒、デバッグ表示用）
+     */
+    float LastIntervalMs() const { return lastIntervalMs.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 押されているボタン（MouseActionのビットマスク、デバッグ表示用）
+     */
+    uint32_t Buttons() const { return buttons.load(std::memory_order_relaxed); }
+
+private:
+    JoyConSide side;
+    const LiveConfig<MouseConfig>& config;
+    ScrollEngine scroll;
+
+    std::atomic<uint32_t> buttons{ 0 }; // MouseActionのビットマスク（書き込みは入力スレッドのみ、表示は別スレッドで読む）
+    bool hasCursor = false;
+    uint16_t prevX = 0;
+    uint16_t prevY = 0;
+
+    std::chrono::steady_clock::time_point lastUpdate{};
+    std::atomic<float> lastIntervalMs{ 0.0f };
+};
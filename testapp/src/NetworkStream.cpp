@@ -0,0 +1,553 @@
+﻿#ifdef _WIN32
+// winsock2.hはWindows.hより前に読み込む必要がある
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#endif
+
+#include "NetworkStream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// フレームの先頭のバイト（上位7ビットは形式のバージョン、最下位ビットはキーフレーム）
+constexpr uint8_t NET_FRAME_VERSION = 1;
+constexpr uint8_t NET_FRAME_KEYFRAME = 0x01;
+
+// 受信スレッドが停止の要求を確認する間隔
+constexpr int NET_RECEIVE_TIMEOUT_MS = 100;
+
+#ifdef _WIN32
+constexpr NetworkSocket INVALID_NETWORK_SOCKET = INVALID_SOCKET;
+#else
+constexpr NetworkSocket INVALID_NETWORK_SOCKET = -1;
+#endif
+
+/**
+ * @brief 現在時刻（steady_clockのマイクロ秒）
+ */
+static uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief ソケットを使えるようにする（WindowsではWinsockを初期化する。stop_socketsと対で呼ぶ）
+ */
+static bool start_sockets()
+{
+#ifdef _WIN32
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    return true;
+#endif
+}
+
+static void stop_sockets()
+{
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+static void close_socket(NetworkSocket socket)
+{
+#ifdef _WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+/**
+ * @brief 直前のソケットのエラーの説明
+ */
+static std::string socket_error()
+{
+#ifdef _WIN32
+    return "error " + std::to_string(WSAGetLastError());
+#else
+    return std::strerror(errno);
+#endif
+}
+
+// --- フィールドの読み書き ---
+
+/**
+ * @brief レポートのフィールドの値を読む（タッチの座標は3バイトをまとめて1つの値にする）
+ */
+static int32_t get_field(const DS4_REPORT_EX& report, size_t index)
+{
+    const auto& r = report.Report;
+    const auto& touch = r.sCurrentTouch;
+    auto data24 = [](const uint8_t* data) { return static_cast<int32_t>(data[0] | (data[1] << 8) | (data[2] << 16)); };
+    switch (index) {
+    case 0:  return r.bThumbLX;
+    case 1:  return r.bThumbLY;
+    case 2:  return r.bThumbRX;
+    case 3:  return r.bThumbRY;
+    case 4:  return r.wButtons;
+    case 5:  return r.bSpecial;
+    case 6:  return r.bTriggerL;
+    case 7:  return r.bTriggerR;
+    case 8:  return r.wTimestamp;
+    case 9:  return r.bBatteryLvl;
+    case 10: return r.wGyroX;
+    case 11: return r.wGyroY;
+    case 12: return r.wGyroZ;
+    case 13: return r.wAccelX;
+    case 14: return r.wAccelY;
+    case 15: return r.wAccelZ;
+    case 16: return r.bTouchPacketsN;
+    case 17: return touch.bPacketCounter;
+    case 18: return touch.bIsUpTrackingNum1;
+    case 19: return data24(touch.bTouchData1);
+    case 20: return touch.bIsUpTrackingNum2;
+    case 21: return data24(touch.bTouchData2);
+    default: return 0;
+    }
+}
+
+/**
+ * @brief レポートのフィールドに値を書く
+ */
+static void set_field(DS4_REPORT_EX& report, size_t index, int32_t value)
+{
+    auto& r = report.Report;
+    auto& touch = r.sCurrentTouch;
+    auto byte = static_cast<uint8_t>(value);
+    auto data24 = [value](uint8_t* data)
+        {
+            data[0] = static_cast<uint8_t>(value);
+            data[1] = static_cast<uint8_t>(value >> 8);
+            data[2] = static_cast<uint8_t>(value >> 16);
+        };
+    switch (index) {
+    case 0:  r.bThumbLX = byte; break;
+    case 1:  r.bThumbLY = byte; break;
+    case 2:  r.bThumbRX = byte; break;
+    case 3:  r.bThumbRY = byte; break;
+    case 4:  r.wButtons = static_cast<uint16_t>(value); break;
+    case 5:  r.bSpecial = byte; break;
+    case 6:  r.bTriggerL = byte; break;
+    case 7:  r.bTriggerR = byte; break;
+    case 8:  r.wTimestamp = static_cast<uint16_t>(value); break;
+    case 9:  r.bBatteryLvl = byte; break;
+    case 10: r.wGyroX = static_cast<int16_t>(value); break;
+    case 11: r.wGyroY = static_cast<int16_t>(value); break;
+    case 12: r.wGyroZ = static_cast<int16_t>(value); break;
+    case 13: r.wAccelX = static_cast<int16_t>(value); break;
+    case 14: r.wAccelY = static_cast<int16_t>(value); break;
+    case 15: r.wAccelZ = static_cast<int16_t>(value); break;
+    case 16: r.bTouchPacketsN = byte; break;
+    case 17: touch.bPacketCounter = byte; break;
+    case 18: touch.bIsUpTrackingNum1 = byte; break;
+    case 19: data24(touch.bTouchData1); break;
+    case 20: touch.bIsUpTrackingNum2 = byte; break;
+    case 21: data24(touch.bTouchData2); break;
+    default: break;
+    }
+}
+
+// --- 可変長整数 ---
+
+static uint8_t* write_varint(uint8_t* out, uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+/**
+ * @brief 可変長整数を読む
+ * @return 読めなかった場合（途中で終わる、長すぎる）はfalse
+ */
+static bool read_varint(const uint8_t*& data, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+// 符号付きの差を小さい符号なしの値にする（0, -1, 1, -2, ... → 0, 1, 2, 3, ...）
+static uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// --- 符号化と復元 ---
+
+NetFrameEncoder::NetFrameEncoder(uint8_t player, std::chrono::milliseconds keyframeInterval)
+    : player(player), keyframeIntervalUs(static_cast<uint64_t>(keyframeInterval.count()) * 1000)
+{
+}
+
+size_t NetFrameEncoder::Encode(const DS4_REPORT_EX& report, uint64_t timeUs, uint8_t* out)
+{
+    bool keyframe = !hasKeyframe || timeUs - keyTimeUs >= keyframeIntervalUs;
+    uint32_t current = sequence++;
+
+    std::array<int32_t, NET_FIELD_COUNT> values;
+    for (size_t i = 0; i < NET_FIELD_COUNT; ++i)
+        values[i] = get_field(report, i);
+
+    // 先頭、プレイヤー、連番。差分はキーフレームからの連番と時刻の差も付ける
+    uint8_t* p = out;
+    *p++ = static_cast<uint8_t>((NET_FRAME_VERSION << 1) | (keyframe ? NET_FRAME_KEYFRAME : 0));
+    *p++ = player;
+    p = write_varint(p, current);
+    static constexpr std::array<int32_t, NET_FIELD_COUNT> ZERO{};
+    const auto& base = keyframe ? ZERO : keyValues;
+    if (keyframe) {
+        p = write_varint(p, timeUs);
+    }
+    else {
+        p = write_varint(p, current - keySequence);
+        p = write_varint(p, timeUs - keyTimeUs);
+    }
+
+    // 変わったフィールドのビットマスクと、その差
+    uint32_t mask = 0;
+    for (size_t i = 0; i < NET_FIELD_COUNT; ++i)
+        if (values[i] != base[i]) mask |= 1u << i;
+    p = write_varint(p, mask);
+    for (size_t i = 0; i < NET_FIELD_COUNT; ++i)
+        if (mask & (1u << i)) p = write_varint(p, zigzag(values[i] - base[i]));
+
+    if (keyframe) {
+        hasKeyframe = true;
+        keySequence = current;
+        keyTimeUs = timeUs;
+        keyValues = values;
+    }
+    return static_cast<size_t>(p - out);
+}
+
+bool PeekNetFramePlayer(const uint8_t* data, size_t size, uint8_t& player)
+{
+    if (size < 3 || (data[0] >> 1) != NET_FRAME_VERSION) return false;
+    player = data[1];
+    return true;
+}
+
+NetFrameDecoder::Result NetFrameDecoder::Decode(const uint8_t* data, size_t size, DS4_REPORT_EX& report, NetFrameInfo& info)
+{
+    const uint8_t* end = data + size;
+    if (size < 3 || (data[0] >> 1) != NET_FRAME_VERSION) return Result::Invalid;
+    info.keyframe = (data[0] & NET_FRAME_KEYFRAME) != 0;
+    info.player = data[1];
+    const uint8_t* p = data + 2;
+
+    uint64_t sequence, time, mask;
+    uint64_t keyOffset = 0;
+    if (!read_varint(p, end, sequence)) return Result::Invalid;
+    if (!info.keyframe && !read_varint(p, end, keyOffset)) return Result::Invalid;
+    if (!read_varint(p, end, time) || !read_varint(p, end, mask)) return Result::Invalid;
+    if (mask >> NET_FIELD_COUNT) return Result::Invalid;
+    info.sequence = static_cast<uint32_t>(sequence);
+
+    // 最後に復元したフレームより古いフレームは捨てる（連番の一周は差で扱う）
+    // 最後の連番は復元できたときだけ進める（壊れたフレームの連番で、後に届く正しいフレームを古いとみなさない）
+    if (hasLast && static_cast<int32_t>(info.sequence - lastSequence) <= 0) return Result::Stale;
+
+    // 抜けた連番は、これまでに受け取った最新の連番からの差で数える
+    // （キーフレームが無く復元できなかったフレームも受け取った連番に含め、同じ抜けを二重に数えない）
+    info.lost = 0;
+    bool newest = !hasHighest || static_cast<int32_t>(info.sequence - highestSequence) > 0;
+    if (hasHighest && newest) info.lost = info.sequence - highestSequence - 1;
+    auto received = [&] {
+        if (!newest) return;
+        hasHighest = true;
+        highestSequence = info.sequence;
+    };
+
+    std::array<int32_t, NET_FIELD_COUNT> values{};
+    if (info.keyframe) {
+        info.sendTimeUs = time;
+    }
+    else {
+        if (!hasKeyframe || info.sequence - static_cast<uint32_t>(keyOffset) != keySequence) {
+            received();
+            return Result::MissingKeyframe;
+        }
+        info.sendTimeUs = keyTimeUs + time;
+        values = keyValues;
+    }
+
+    for (size_t i = 0; i < NET_FIELD_COUNT; ++i) {
+        if (!(mask & (1ull << i))) continue;
+        uint64_t value;
+        if (!read_varint(p, end, value)) return Result::Invalid;
+        values[i] = static_cast<int32_t>(static_cast<uint32_t>(values[i]) + static_cast<uint32_t>(unzigzag(static_cast<uint32_t>(value))));
+    }
+
+    if (info.keyframe) {
+        hasKeyframe = true;
+        keySequence = info.sequence;
+        keyTimeUs = info.sendTimeUs;
+        keyValues = values;
+    }
+    hasLast = true;
+    lastSequence = info.sequence;
+    received();
+
+    report = DS4_REPORT_EX{};
+    for (size_t i = 0; i < NET_FIELD_COUNT; ++i)
+        set_field(report, i, values[i]);
+    return Result::Ok;
+}
+
+// --- 送信側 ---
+
+void LoadNetworkSinkConfig(NetworkSinkConfig& config)
+{
+    const char* target = std::getenv("JOYCON_NETWORK_TARGET");
+    if (!target) return;
+
+    std::string value(target);
+    auto colon = value.rfind(':');
+    if (colon != std::string::npos && value.find(':') == colon) {
+        int port = std::atoi(value.c_str() + colon + 1);
+        if (port > 0 && port <= 65535) config.port = static_cast<uint16_t>(port);
+        else std::wcerr << L"Invalid port in JOYCON_NETWORK_TARGET. Using " << config.port << L".\n";
+        value.resize(colon);
+    }
+    if (!value.empty()) config.host = value;
+}
+
+std::unique_ptr<NetworkSink> NetworkSink::Create(const NetworkSinkConfig& config, uint8_t player)
+{
+    if (!start_sockets()) {
+        std::wcerr << L"Failed to initialize sockets.\n";
+        return nullptr;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    std::string port = std::to_string(config.port);
+    if (getaddrinfo(config.host.c_str(), port.c_str(), &hints, &result) != 0 || !result) {
+        std::wcerr << L"Failed to resolve " << std::wstring(config.host.begin(), config.host.end()) << L".\n";
+        stop_sockets();
+        return nullptr;
+    }
+
+    // 送信先に接続しておき、送信ごとには宛先を渡さない
+    NetworkSocket sock = INVALID_NETWORK_SOCKET;
+    for (addrinfo* ai = result; ai && sock == INVALID_NETWORK_SOCKET; ai = ai->ai_next) {
+        sock = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock == INVALID_NETWORK_SOCKET) continue;
+        if (connect(sock, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) != 0) {
+            close_socket(sock);
+            sock = INVALID_NETWORK_SOCKET;
+        }
+    }
+    freeaddrinfo(result);
+    if (sock == INVALID_NETWORK_SOCKET) {
+        std::wcerr << L"Failed to connect network output: " << socket_error().c_str() << L"\n";
+        stop_sockets();
+        return nullptr;
+    }
+
+    // 送信バッファがいっぱいでも入力スレッドを待たせない
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonBlocking);
+#else
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+#endif
+    return std::unique_ptr<NetworkSink>(new NetworkSink(sock, config, player));
+}
+
+NetworkSink::NetworkSink(NetworkSocket socket, const NetworkSinkConfig& config, uint8_t player)
+    : socket(socket), encoder(player, config.keyframeInterval)
+{
+}
+
+NetworkSink::~NetworkSink()
+{
+    close_socket(socket);
+    stop_sockets();
+}
+
+bool NetworkSink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    size_t size = encoder.Encode(report, now_us(), buffer.data());
+    auto sent = send(socket, reinterpret_cast<const char*>(buffer.data()), static_cast<int>(size), 0);
+    if (sent != static_cast<decltype(sent)>(size)) return false;
+    bytesSent.fetch_add(size, std::memory_order_relaxed);
+    return true;
+}
+
+bool NetworkSink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    // マウスは送らない（受信側は仮想パッドだけを作る）
+    (void)events;
+    return false;
+}
+
+// --- 受信側 ---
+
+std::unique_ptr<NetworkSource> NetworkSource::Create(const NetworkSourceConfig& config, SinkFactory factory)
+{
+    if (!start_sockets()) {
+        std::wcerr << L"Failed to initialize sockets.\n";
+        return nullptr;
+    }
+
+    NetworkSocket sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == INVALID_NETWORK_SOCKET) {
+        std::wcerr << L"Failed to create network input socket: " << socket_error().c_str() << L"\n";
+        stop_sockets();
+        return nullptr;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.address.c_str(), &address.sin_addr) != 1 ||
+        bind(sock, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::wcerr << L"Failed to bind network input to port " << config.port << L": " << socket_error().c_str() << L"\n";
+        close_socket(sock);
+        stop_sockets();
+        return nullptr;
+    }
+
+    // 停止の要求を確認できるように受信に時間制限を付ける
+#ifdef _WIN32
+    DWORD timeout = NET_RECEIVE_TIMEOUT_MS;
+#else
+    timeval timeout{ 0, NET_RECEIVE_TIMEOUT_MS * 1000 };
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+    std::unique_ptr<NetworkSource> source(new NetworkSource(sock, std::move(factory)));
+    socklen_t length = sizeof(address);
+    if (getsockname(sock, reinterpret_cast<sockaddr*>(&address), &length) == 0)
+        source->port = ntohs(address.sin_port);
+    source->receiver = std::thread(&NetworkSource::Run, source.get());
+    return source;
+}
+
+NetworkSource::NetworkSource(NetworkSocket socket, SinkFactory factory)
+    : socket(socket), factory(std::move(factory))
+{
+}
+
+NetworkSource::~NetworkSource()
+{
+    running = false;
+    if (receiver.joinable()) receiver.join();
+    close_socket(socket);
+    stop_sockets();
+}
+
+NetworkStreamStats NetworkSource::Stats(uint8_t player) const
+{
+    if (player >= NET_MAX_PLAYERS) return {};
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return streams[player].stats;
+}
+
+void NetworkSource::Run()
+{
+    std::array<uint8_t, 512> buffer;
+    while (running) {
+        auto size = recv(socket, reinterpret_cast<char*>(buffer.data()), static_cast<int>(buffer.size()), 0);
+        if (size <= 0) continue; // 時間切れ（停止の要求を確認する）
+        HandleFrame(buffer.data(), static_cast<size_t>(size));
+    }
+}
+
+void NetworkSource::HandleFrame(const uint8_t* data, size_t size)
+{
+    uint8_t player;
+    if (!PeekNetFramePlayer(data, size, player) || player >= NET_MAX_PLAYERS) return;
+    Stream& stream = streams[player];
+
+    DS4_REPORT_EX report;
+    NetFrameInfo info;
+    NetFrameDecoder::Result result = stream.decoder.Decode(data, size, report, info);
+    if (result == NetFrameDecoder::Result::Invalid) return;
+
+    // 最初に復元できたフレームでプレイヤーの出力先を作る（関係の無いパケットでパッドを作らない）
+    if (result == NetFrameDecoder::Result::Ok) {
+        if (!stream.resolved) {
+            stream.sink = factory(player);
+            stream.resolved = true;
+        }
+        if (stream.sink) stream.sink->SubmitReport(report);
+    }
+    double now = static_cast<double>(now_us());
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    NetworkStreamStats& stats = stream.stats;
+    if (stats.bytes == 0) stats.firstUs = now;
+    stats.lastUs = now;
+    stats.bytes += size;
+    switch (result) {
+    case NetFrameDecoder::Result::Ok:
+    {
+        stats.frames++;
+        if (info.keyframe) stats.keyframes++;
+        stats.lost += info.lost;
+        // 送信側と同じ時計の場合だけ遅延として数える（別のマシンの時計は比べられない）
+        double latency = now - static_cast<double>(info.sendTimeUs);
+        if (latency >= 0.0 && latency < 1e6) {
+            stats.latencyCount++;
+            stats.latencyTotalUs += latency;
+            stats.latencyMaxUs = std::max(stats.latencyMaxUs, latency);
+        }
+        break;
+    }
+    case NetFrameDecoder::Result::Stale:
+        stats.stale++;
+        break;
+    case NetFrameDecoder::Result::MissingKeyframe:
+        stats.lost += info.lost;
+        stats.skipped++;
+        break;
+    case NetFrameDecoder::Result::Invalid:
+        break;
+    }
+}
+
+void PrintNetworkStreamStats(uint8_t player, const NetworkStreamStats& stats)
+{
+    double seconds = (stats.lastUs - stats.firstUs) / 1e6;
+    std::wcout << L"Network player " << (player + 1) << L": " << stats.frames << L" frames (" << stats.keyframes
+        << L" keyframes), " << (stats.frames > 0 ? static_cast<double>(stats.bytes) / stats.frames : 0.0) << L" bytes/frame";
+    if (seconds > 0.0)
+        std::wcout << L", " << stats.bytes / seconds / 1000.0 << L" kB/s";
+    std::wcout << L", " << stats.lost << L" lost, " << stats.stale << L" stale, " << stats.skipped << L" skipped";
+    if (stats.latencyCount > 0)
+        std::wcout << L", latency mean " << stats.latencyTotalUs / stats.latencyCount << L" us / max " << stats.latencyMaxUs << L" us";
+    std::wcout << L"\n";
+}
@@ -0,0 +1,256 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "OutputSink.h"
+
+// ネットワークの入力ストリーム
+constexpr uint16_t NET_DEFAULT_PORT = 26770;
+constexpr size_t NET_MAX_FRAME_SIZE = 128; // 1フレームの最大の大きさ（全フィールドが変わったキーフレーム）
+constexpr size_t NET_MAX_PLAYERS = 8;      // 受信側で扱うプレイヤーの数
+
+// 送るフィールドの数（スティック、ボタン、トリガー、タイムスタンプ、バッテリー、モーション、タッチ）
+constexpr size_t NET_FIELD_COUNT = 22;
+
+#ifdef _WIN32
+using NetworkSocket = uintptr_t; // SOCKET
+#else
+using NetworkSocket = int;
+#endif
+
+/**
+ * @struct NetFrameInfo
+ * @brief 受信したフレームの情報
+ */
+struct NetFrameInfo {
+    uint8_t player = 0;      // 送信側のプレイヤー番号（0から）
+    uint32_t sequence = 0;   // 連番
+    bool keyframe = false;   // キーフレーム（前のフレームに依存しない）
+    uint64_t sendTimeUs = 0; // 送信側の時刻（マイクロ秒）
+    uint32_t lost = 0;       // 受け取った最新のフレームからこのフレームまでに届かなかったフレームの数
+};
+
+/**
+ * @class NetFrameEncoder
+ * @brief DS4レポートを差分のフレームにする
+ *
+ * フレームは直前のキーフレームからの差分で、変わったフィールドのビットマスクと、
+ * 各フィールドの差（ジグザグ符号化した可変長整数）を並べる。どのフレームもキーフレーム
+ * だけに依存するので、差分のフレームが失われても次のフレームは復元できる。
+ * キーフレームは一定の間隔で送り、キーフレームが失われても次のキーフレームで回復する。
+ */
+class NetFrameEncoder {
+public:
+    /**
+     * @param player プレイヤー番号（0から）
+     * @param keyframeInterval キーフレームを送る間隔
+     */
+    explicit NetFrameEncoder(uint8_t player, std::chrono::milliseconds keyframeInterval = std::chrono::milliseconds(100));
+
+    /**
+     * @brief レポートをフレームにする
+     * @param report 送るレポート
+     * @param timeUs 送信側の時刻（マイクロ秒）
+     * @param out 書き込む先（NET_MAX_FRAME_SIZEバイト以上）
+     * @return フレームの大きさ
+     */
+    size_t Encode(const DS4_REPORT_EX& report, uint64_t timeUs, uint8_t* out);
+
+private:
+    uint8_t player;
+    uint64_t keyframeIntervalUs;
+    uint32_t sequence = 0;
+
+    bool hasKeyframe = false;
+    uint32_t keySequence = 0;
+    uint64_t keyTimeUs = 0;
+    std::array<int32_t, NET_FIELD_COUNT> keyValues{};
+};
+
+/**
+ * @class NetFrameDecoder
+ * @brief 1人のプレイヤーのフレームをDS4レポートに戻す
+ */
+class NetFrameDecoder {
+public:
+    enum class Result {
+        Ok,
+        Stale,           // 既に受け取ったフレームより古い（順序の入れ替わり）
+        MissingKeyframe, // 依存するキーフレームを受け取っていない
+        Invalid          // 形式が正しくない
+    };
+
+    /**
+     * @brief フレームを復元する
+     * @param data 受信したフレーム
+     * @param size フレームの大きさ
+     * @param report 復元したレポート（送らないフィールドは0）
+     * @param info フレームの情報
+     */
+    Result Decode(const uint8_t* data, size_t size, DS4_REPORT_EX& report, NetFrameInfo& info);
+
+private:
+    bool hasLast = false;         // 最後に復元したフレーム（これより古いフレームは捨てる）
+    uint32_t lastSequence = 0;
+    bool hasHighest = false;      // 受け取った最新のフレーム（抜けた数はここから数える）
+    uint32_t highestSequence = 0;
+
+    bool hasKeyframe = false;
+    uint32_t keySequence = 0;
+    uint64_t keyTimeUs = 0;
+    std::array<int32_t, NET_FIELD_COUNT> keyValues{};
+};
+
+/**
+ * @brief フレームのプレイヤー番号を取得する（復元する前に振り分けるため）
+ * @return フレームが短すぎるか、形式の版が違う場合はfalse
+ */
+bool PeekNetFramePlayer(const uint8_t* data, size_t size, uint8_t& player);
+
+/**
+ * @struct NetworkSinkConfig
+ * @brief ネットワークの出力先の設定
+ */
+struct NetworkSinkConfig {
+    std::string host = "127.0.0.1";                           // 受信側のホスト
+    uint16_t port = NET_DEFAULT_PORT;                         // 受信側のポート
+    std::chrono::milliseconds keyframeInterval{ 100 };        // キーフレームを送る間隔
+};
+
+/**
+ * @brief 環境変数 JOYCON_NETWORK_TARGET（host または host:port）から送信先を読み込む
+ */
+void LoadNetworkSinkConfig(NetworkSinkConfig& config);
+
+/**
+ * @class NetworkSink
+ * @brief プレイヤーの状態を差分のフレームにして、UDPで別のマシンのNetworkSourceに送る
+ */
+class NetworkSink : public OutputSink {
+public:
+    /**
+     * @brief 送信先に接続したUDPソケットを作成する
+     * @param player プレイヤー番号（0から。受信側はこの番号ごとに仮想パッドを作る）
+     * @return 作成した出力先（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<NetworkSink> Create(const NetworkSinkConfig& config, uint8_t player);
+
+    ~NetworkSink() override;
+
+    NetworkSink(const NetworkSink&) = delete;
+    NetworkSink& operator=(const NetworkSink&) = delete;
+
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return L"Network"; }
+
+    /**
+     * @brief 送信したバイト数
+     */
+    uint64_t BytesSent() const { return bytesSent.load(std::memory_order_relaxed); }
+
+private:
+    NetworkSink(NetworkSocket socket, const NetworkSinkConfig& config, uint8_t player);
+
+    NetworkSocket socket;
+    NetFrameEncoder encoder; // 出力段から直列に呼ばれるので排他しない
+    std::array<uint8_t, NET_MAX_FRAME_SIZE> buffer{};
+    std::atomic<uint64_t> bytesSent{ 0 };
+};
+
+/**
+ * @struct NetworkSourceConfig
+ * @brief ネットワークの入力元の設定
+ */
+struct NetworkSourceConfig {
+    std::string address = "127.0.0.1"; // 待ち受けるアドレス（既定はローカルのみ。別のマシンから受けるには0.0.0.0などを指定する）
+    uint16_t port = NET_DEFAULT_PORT; // 待ち受けるポート（0は空いているポート）
+};
+
+/**
+ * @struct NetworkStreamStats
+ * @brief 1人のプレイヤーの受信の統計
+ */
+struct NetworkStreamStats {
+    uint64_t frames = 0;     // 復元したフレーム
+    uint64_t keyframes = 0;  // そのうちのキーフレーム
+    uint64_t bytes = 0;      // 受信したバイト数
+    uint64_t lost = 0;       // 届かなかったフレーム（連番の抜け）
+    uint64_t stale = 0;      // 順序が入れ替わって捨てたフレーム
+    uint64_t skipped = 0;    // キーフレームが無く復元できなかったフレーム
+    double firstUs = 0.0;    // 最初と最後に受信した時刻（帯域の計算用、マイクロ秒）
+    double lastUs = 0.0;
+    uint64_t latencyCount = 0; // 送信から出力までの時間（同じマシンの時計の場合だけ意味がある）
+    double latencyTotalUs = 0.0;
+    double latencyMaxUs = 0.0;
+};
+
+/**
+ * @class NetworkSource
+ * @brief NetworkSinkからのフレームを受信し、プレイヤーごとのローカルの出力先（仮想パッド）に渡す
+ */
+class NetworkSource {
+public:
+    /**
+     * @brief プレイヤーの出力先を返す関数（最初のフレームを復元できたときに受信スレッドから呼ばれる）
+     * @return 出力先（呼び出し側が所有し、NetworkSourceより長く存在すること。nullptrならそのプレイヤーは捨てる）
+     */
+    using SinkFactory = std::function<OutputSink*(uint8_t player)>;
+
+    /**
+     * @brief ポートを開き、受信を開始する
+     * @return 作成した入力元（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<NetworkSource> Create(const NetworkSourceConfig& config, SinkFactory factory);
+
+    ~NetworkSource();
+
+    NetworkSource(const NetworkSource&) = delete;
+    NetworkSource& operator=(const NetworkSource&) = delete;
+
+    /**
+     * @brief 待ち受けているポート
+     */
+    uint16_t Port() const { return port; }
+
+    /**
+     * @brief プレイヤーの受信の統計を取得
+     */
+    NetworkStreamStats Stats(uint8_t player) const;
+
+private:
+    NetworkSource(NetworkSocket socket, SinkFactory factory);
+
+    void Run();
+    void HandleFrame(const uint8_t* data, size_t size);
+
+    struct Stream {
+        NetFrameDecoder decoder;
+        OutputSink* sink = nullptr;
+        bool resolved = false; // 出力先を作成済み
+        NetworkStreamStats stats;
+    };
+
+    NetworkSocket socket;
+    uint16_t port = 0;
+    SinkFactory factory;
+    std::atomic<bool> running{ true };
+    std::thread receiver;
+
+    mutable std::mutex statsMutex;
+    std::array<Stream, NET_MAX_PLAYERS> streams{};
+};
+
+/**
+ * @brief プレイヤーの受信の統計をコンソールに表示（帯域、欠落、遅延）
+ */
+void PrintNetworkStreamStats(uint8_t player, const NetworkStreamStats& stats);
@@ -0,0 +1,64 @@
+﻿#include "OutputClock.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#pragma comment(lib, "winmm.lib") // timeBeginPeriodを使用するためにリンク
+#endif
+
+OutputClock::OutputClock(TickHandler handler, std::chrono::microseconds period)
+    : handler(std::move(handler)), period(period)
+{
+}
+
+OutputClock::~OutputClock()
+{
+    Stop();
+}
+
+void OutputClock::Start()
+{
+    if (running.exchange(true)) return; // 既に動作中
+
+#ifdef _WIN32
+    // スリープの分解能を1msに上げる（既定の約15.6msでは高頻度出力ができない）
+    timeBeginPeriod(1);
+#endif
+
+    thread = std::thread(&OutputClock::Run, this);
+}
+
+void OutputClock::Stop()
+{
+    if (!running.exchange(false)) return;
+
+    if (thread.joinable())
+        thread.join();
+
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void OutputClock::Run()
+{
+    using clock = std::chrono::steady_clock;
+
+    auto next = clock::now();
+    auto last = next;
+
+    while (running.load(std::memory_order_acquire))
+    {
+        next += period;
+        std::this_thread::sleep_until(next);
+
+        auto now = clock::now();
+        float dt = std::chrono::duration<float>(now - last).count();
+        last = now;
+
+        // 大きく遅れた場合は追いつこうとせず、次の周期から再開する
+        if (now - next > period * 4)
+            next = now;
+
+        handler(dt);
+    }
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+/**
+ * @class OutputClock
+ * @brief 一定周期でコールバックを呼び出す出力用の高頻度クロック
+ *
+ * 入力の通知間隔（約15ms～60ms）とは独立に、仮想コントローラーへの出力を
+ * 一定レートで生成するために使用する。
+ */
+class OutputClock {
+public:
+    /**
+     * @brief 各ティックで呼び出される関数
+     * @param dt 前回のティックからの経過時間（秒）
+     */
+    using TickHandler = std::function<void(float dt)>;
+
+    // 既定の出力周期（250Hz）
+    static constexpr std::chrono::microseconds DEFAULT_PERIOD{ 4000 };
+
+    explicit OutputClock(TickHandler handler, std::chrono::microseconds period = DEFAULT_PERIOD);
+    ~OutputClock();
+
+    OutputClock(const OutputClock&) = delete;
+    OutputClock& operator=(const OutputClock&) = delete;
+
+    /**
+     * @brief クロックスレッドを開始
+     */
+    void Start();
+
+    /**
+     * @brief クロックスレッドを停止し、終了を待つ
+     */
+    void Stop();
+
+    std::chrono::microseconds Period() const { return period; }
+
+private:
+    void Run();
+
+    TickHandler handler;
+    std::chrono::microseconds period;
+    std::atomic<bool> running{ false };
+    std::thread thread;
+};
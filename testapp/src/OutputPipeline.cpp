@@ -0,0 +1,103 @@
+﻿#include "OutputPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+double HostTimeSeconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+OutputPipeline::OutputPipeline(const OutputPipelineConfig& config, OutputHandler handler)
+    : config(config), handler(std::move(handler)), upsampler(config.upsampler), gyroStick(config.gyroStick),
+      stickFilter(config.stickFilter)
+{
+}
+
+void OutputPipeline::SetSampleHandler(SampleHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sampleHandler = std::move(handler);
+}
+
+bool OutputPipeline::NeedsClock() const
+{
+    return config.upsampler.enabled || config.gyroStick.mode != GyroStickMode::Off;
+}
+
+void OutputPipeline::Submit(const DS4_REPORT_EX& report, uint32_t deviceTimestamp)
+{
+    double now = HostTimeSeconds();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // コントローラーのタイムスタンプからサンプル時刻を求める
+    Store(report, deviceClock.ToHostTime(deviceTimestamp, now));
+    Emit(now);
+}
+
+void OutputPipeline::SubmitAt(const DS4_REPORT_EX& report, double sampleTime)
+{
+    double now = HostTimeSeconds();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Store(report, std::min(sampleTime, now));
+    Emit(now);
+}
+
+void OutputPipeline::Tick(float)
+{
+    double now = HostTimeSeconds();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hasReport) return;
+    Emit(now);
+}
+
+void OutputPipeline::Store(const DS4_REPORT_EX& report, double sampleTime)
+{
+    latest = report;
+    hasReport = true;
+
+    MotionData motion{
+        report.Report.wGyroX, report.Report.wGyroY, report.Report.wGyroZ,
+        report.Report.wAccelX, report.Report.wAccelY, report.Report.wAccelZ
+    };
+    upsampler.Push(sampleTime, motion);
+
+    if (sampleHandler) sampleHandler(report, sampleTime);
+}
+
+void OutputPipeline::Emit(double now)
+{
+    DS4_REPORT_EX report = latest;
+
+    // 出力時刻から約1レポート周期遅らせた時刻のモーションデータを補間する
+    // （遅らせないと出力時刻は常に最新サンプルより後になり、補間せず外挿だけになる）
+    double renderTime = now;
+    if (config.upsampler.enabled) {
+        // 遅延は平均したサンプル間隔に追従するので、描画する時刻が戻らないようにする
+        renderTime = std::max(now - upsampler.RenderDelay(), lastRender);
+        lastRender = renderTime;
+        MotionData motion;
+        if (upsampler.Sample(renderTime, motion)) {
+            report.Report.wGyroX = motion.gyroX;
+            report.Report.wGyroY = motion.gyroY;
+            report.Report.wGyroZ = motion.gyroZ;
+            report.Report.wAccelX = motion.accelX;
+            report.Report.wAccelY = motion.accelY;
+            report.Report.wAccelZ = motion.accelZ;
+        }
+    }
+    report.Report.wTimestamp = ToDS4Timestamp(renderTime);
+
+    // ジャイロ→右スティック変換（前回の出力からの経過時間で更新）
+    float dt = lastEmit > 0.0 ? static_cast<float>(std::min(now - lastEmit, 0.1)) : 0.0f;
+    lastEmit = now;
+    gyroStick.Apply(report, dt);
+
+    // スティックのノイズとジャイロ由来の揺れを抑える
+    stickFilter.Apply(report, dt);
+
+    handler(report);
+}
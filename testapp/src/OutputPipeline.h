@@ -0,0 +1,99 @@
+﻿#pragma once
+
+#include <functional>
+#include <mutex>
+
+#include "JoyConDecoder.h"
+#include "DeviceClock.h"
+#include "GyroStick.h"
+#include "ImuUpsampler.h"
+#include "StickFilter.h"
+
+/**
+ * @struct OutputPipelineConfig
+ * @brief プレイヤーごとの出力段の設定
+ */
+struct OutputPipelineConfig {
+    ImuUpsamplerConfig upsampler;
+    GyroStickConfig gyroStick;
+    StickFilterConfig stickFilter;
+};
+
+/**
+ * @class OutputPipeline
+ * @brief デコード済みレポートに出力段（IMUアップサンプリング、ジャイロ→右スティック、スティックフィルター）を適用して送信する
+ *
+ * 入力通知ではSubmitで即座に1回出力し、通知の間は出力クロックのTickで中間の出力を生成する。
+ * 出力はすべて内部のミューテックスで直列化され、タイムスタンプの順序が保たれる。
+ */
+class OutputPipeline {
+public:
+    /**
+     * @brief 生成したレポートを送信する関数（仮想コントローラーの更新など）
+     */
+    using OutputHandler = std::function<void(const DS4_REPORT_EX& report)>;
+
+    /**
+     * @brief 出力段を通す前の入力レポートを、コントローラーの時計から求めたサンプル時刻と受け取る関数
+     */
+    using SampleHandler = std::function<void(const DS4_REPORT_EX& report, double sampleTime)>;
+
+    OutputPipeline(const OutputPipelineConfig& config, OutputHandler handler);
+
+    /**
+     * @brief 投入された入力レポートを受け取る関数を設定する（DSUサーバーへの公開など）
+     * @note 補間やスティックの変換をする前のレポートを、投入ごとに1回呼ぶ
+     */
+    void SetSampleHandler(SampleHandler handler);
+
+    /**
+     * @brief 新しい入力レポートを投入し、即座に出力する（入力スレッドから呼ばれる）
+     * @param report デコード済みのDS4レポート
+     * @param deviceTimestamp コントローラー側のタイムスタンプ
+     */
+    void Submit(const DS4_REPORT_EX& report, uint32_t deviceTimestamp);
+
+    /**
+     * @brief サンプル時刻が求まっている入力レポートを投入し、即座に出力する
+     * @param report デコード済みのDS4レポート
+     * @param sampleTime サンプルが取得されたホスト時刻（秒）
+     * @note 左右のJoy-Conを同期して合成したレポートなど、複数の時計から作られた入力に使う
+     */
+    void SubmitAt(const DS4_REPORT_EX& report, double sampleTime);
+
+    /**
+     * @brief 出力クロックのティックで中間の出力を生成する
+     * @param dt 前回のティックからの経過時間（秒）
+     */
+    void Tick(float dt);
+
+    /**
+     * @brief 出力クロックによる駆動が必要か
+     * @return アップサンプリングまたはジャイロ→右スティックが有効ならtrue
+     */
+    bool NeedsClock() const;
+
+private:
+    void Store(const DS4_REPORT_EX& report, double sampleTime);
+    void Emit(double now);
+
+    OutputPipelineConfig config;
+    OutputHandler handler;
+    SampleHandler sampleHandler;
+
+    std::mutex mutex;
+    DeviceClock deviceClock;
+    ImuUpsampler upsampler;
+    GyroStickMapper gyroStick;
+    StickFilter stickFilter;
+
+    DS4_REPORT_EX latest{};
+    bool hasReport = false;
+    double lastEmit = 0.0;
+    double lastRender = 0.0; // 前回モーションデータを補間した時刻
+};
+
+/**
+ * @brief 出力時刻に使うホストの単調増加時刻（秒）
+ */
+double HostTimeSeconds();
@@ -0,0 +1,193 @@
+﻿#include "OutputSink.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "NetworkStream.h"
+#ifdef _WIN32
+#include "ViGEmSink.h"
+#endif
+#ifdef __linux__
+#include "UInputSink.h"
+#include "UHidSink.h"
+#endif
+
+/**
+ * @brief 現在時刻（steady_clockのナノ秒）
+ */
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// DS4の出力レポート
+constexpr uint8_t DS4_OUTPUT_REPORT = 0x05;
+constexpr uint8_t DS4_OUTPUT_MOTOR = 0x01;     // 有効フラグ: 振動
+constexpr uint8_t DS4_OUTPUT_LIGHTBAR = 0x02;  // 有効フラグ: ライトバー
+
+bool ParseDS4OutputReport(const uint8_t* data, size_t size, OutputFeedback& feedback)
+{
+    // [0]=0x05, [1]=有効フラグ, [4]=弱い振動, [5]=強い振動, [6..8]=ライトバーのRGB
+    if (size < 9 || data[0] != DS4_OUTPUT_REPORT) return false;
+    uint8_t flags = data[1];
+    if (flags & DS4_OUTPUT_MOTOR) {
+        feedback.smallMotor = data[4];
+        feedback.largeMotor = data[5];
+    }
+    if (flags & DS4_OUTPUT_LIGHTBAR) {
+        feedback.red = data[6];
+        feedback.green = data[7];
+        feedback.blue = data[8];
+    }
+    return (flags & (DS4_OUTPUT_MOTOR | DS4_OUTPUT_LIGHTBAR)) != 0;
+}
+
+OutputSinkType SelectOutputSinkType()
+{
+    const char* name = std::getenv("JOYCON_OUTPUT");
+    if (name) {
+        std::string value(name);
+        if (value == "vigem") return OutputSinkType::ViGEm;
+        if (value == "uinput") return OutputSinkType::UInput;
+        if (value == "uhid") return OutputSinkType::UHid;
+        if (value == "network") return OutputSinkType::Network;
+        if (value == "record") return OutputSinkType::Recording;
+        std::wcerr << L"Unknown JOYCON_OUTPUT value. Using the default output.\n";
+    }
+#ifdef __linux__
+    return OutputSinkType::UInput;
+#else
+    return OutputSinkType::ViGEm;
+#endif
+}
+
+std::unique_ptr<OutputSink> CreateOutputSink(OutputSinkType type, PVIGEM_CLIENT client, PadType pad, uint8_t player)
+{
+    if (pad == PadType::X360 && type != OutputSinkType::ViGEm)
+        std::wcerr << L"Xbox 360 output is only available with ViGEm. Using DS4 output.\n";
+
+    switch (type) {
+    case OutputSinkType::ViGEm:
+#ifdef _WIN32
+        if (pad == PadType::X360) return ViGEmX360Sink::Create(client);
+        return ViGEmSink::Create(client);
+#else
+        (void)client;
+        std::wcerr << L"ViGEm output is only available on Windows.\n";
+        return nullptr;
+#endif
+    case OutputSinkType::UInput:
+#ifdef __linux__
+    {
+        UInputSinkConfig config;
+        const char* path = std::getenv("JOYCON_UINPUT_PATH");
+        if (path) config.path = path;
+        return UInputSink::Create(config);
+    }
+#else
+        std::wcerr << L"uinput output is only available on Linux.\n";
+        return nullptr;
+#endif
+    case OutputSinkType::UHid:
+#ifdef __linux__
+    {
+        UHidSinkConfig config;
+        const char* path = std::getenv("JOYCON_UHID_PATH");
+        if (path) config.path = path;
+        return UHidSink::Create(config);
+    }
+#else
+        std::wcerr << L"UHID output is only available on Linux.\n";
+        return nullptr;
+#endif
+    case OutputSinkType::Network:
+    {
+        NetworkSinkConfig config;
+        LoadNetworkSinkConfig(config);
+        return NetworkSink::Create(config, player);
+    }
+    case OutputSinkType::Recording:
+        return std::make_unique<RecordingSink>();
+    }
+    return nullptr;
+}
+
+bool RecordingSink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    int64_t time = now_ns();
+    std::lock_guard<std::mutex> lock(mutex);
+    reports.push_back({ time, report });
+    return true;
+}
+
+bool RecordingSink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    mouseEvents.insert(mouseEvents.end(), events.begin(), events.end());
+    return true;
+}
+
+std::vector<RecordedReport> RecordingSink::Reports() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return reports;
+}
+
+std::vector<MouseEvent> RecordingSink::MouseEvents() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return mouseEvents;
+}
+
+void RecordingSink::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    reports.clear();
+    mouseEvents.clear();
+}
+
+bool TimedSink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    int64_t start = now_ns();
+    bool ok = inner->SubmitReport(report);
+    Record(now_ns() - start);
+    return ok;
+}
+
+bool TimedSink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    int64_t start = now_ns();
+    bool ok = inner->SubmitMouse(events);
+    Record(now_ns() - start);
+    return ok;
+}
+
+void TimedSink::Record(int64_t elapsedNs)
+{
+    // 入力スレッドと出力クロックの両方から呼ばれるのでアトミックに集計する
+    frames.fetch_add(1, std::memory_order_relaxed);
+    totalNs.fetch_add(elapsedNs, std::memory_order_relaxed);
+    int64_t previous = maxNs.load(std::memory_order_relaxed);
+    while (elapsedNs > previous && !maxNs.compare_exchange_weak(previous, elapsedNs, std::memory_order_relaxed)) {
+    }
+}
+
+SinkTiming TimedSink::Timing() const
+{
+    SinkTiming timing;
+    timing.frames = frames.load(std::memory_order_relaxed);
+    if (timing.frames > 0) {
+        timing.meanUs = totalNs.load(std::memory_order_relaxed) / 1000.0 / timing.frames;
+        timing.maxUs = maxNs.load(std::memory_order_relaxed) / 1000.0;
+    }
+    return timing;
+}
+
+void PrintSinkTiming(const TimedSink& sink)
+{
+    SinkTiming timing = sink.Timing();
+    std::wcout << L"Output sink " << sink.Name() << L": " << timing.frames << L" frames, mean "
+        << timing.meanUs << L" us / max " << timing.maxUs << L" us\n";
+}
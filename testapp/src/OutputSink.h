@@ -0,0 +1,237 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "DS4Report.h"
+
+// ViGEmのクライアント（ViGEm/Client.hと同じ宣言。ViGEm以外の出力先ではヘッダーを読み込まない）
+typedef struct _VIGEM_CLIENT_T* PVIGEM_CLIENT;
+
+/**
+ * @enum MouseAction
+ * @brief マウスのボタン操作（状態のビット位置を兼ねる）
+ */
+enum MouseAction : uint8_t {
+    MouseLeft = 0,
+    MouseRight,
+    MouseMiddle,
+    MouseX1,     // 進む
+    MouseX2,     // 戻る
+    MouseActionCount
+};
+
+/**
+ * @enum MouseEventType
+ * @brief マウスイベントの種類
+ */
+enum class MouseEventType : uint8_t {
+    Move,   // カーソルの相対移動
+    Wheel,  // ホイールの回転
+    Button  // ボタンの押下・解放
+};
+
+/**
+ * @struct MouseEvent
+ * @brief 出力先に依存しないマウスイベント
+ */
+struct MouseEvent {
+    MouseEventType type = MouseEventType::Move;
+    MouseAction button = MouseLeft; // Button: 操作したボタン
+    bool pressed = false;           // Button: 押下ならtrue
+    int32_t dx = 0;                 // Move: 横方向の移動量
+    int32_t dy = 0;                 // Move: 縦方向の移動量（下が正）
+    int32_t wheel = 0;              // Wheel: 回転量（WHEEL_DELTA=120単位、上が正）
+};
+
+/**
+ * @struct OutputFeedback
+ * @brief ゲームから仮想ゲームパッドに送られた振動とライトバーの状態
+ */
+struct OutputFeedback {
+    uint8_t largeMotor = 0;  // 強い振動（左のモーター、0-255）
+    uint8_t smallMotor = 0;  // 弱い振動（右のモーター、0-255）
+    uint8_t red = 0;         // ライトバーの色
+    uint8_t green = 0;
+    uint8_t blue = 0;
+    int8_t ledNumber = -1;   // XInputのプレイヤー番号のLED（0-3、無ければ-1）
+};
+
+/**
+ * @brief 振動・ライトバーの状態を受け取るハンドラ（出力先のスレッドから呼ばれる）
+ */
+using FeedbackHandler = std::function<void(const OutputFeedback&)>;
+
+/**
+ * @brief DS4の出力レポート（USBのレポート0x05）から振動とライトバーを読み取る
+ * @param data レポートIDから始まる出力レポート
+ * @param size レポートの大きさ
+ * @param feedback 更新する状態（有効フラグが立っている項目だけを書き換える）
+ * @return 振動かライトバーのどちらかを更新したらtrue
+ */
+bool ParseDS4OutputReport(const uint8_t* data, size_t size, OutputFeedback& feedback);
+
+/**
+ * @class OutputSink
+ * @brief プレイヤー1人分の出力先（仮想ゲームパッドとマウス）
+ *
+ * 入力ハンドラや出力クロックは生成したレポートとマウスイベントを渡すだけで、
+ * 出力の方法（ViGEm、uinput、記録など）には依存しない。
+ */
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    /**
+     * @brief 仮想ゲームパッドの状態を更新する（1フレームに1回呼ばれる）
+     * @return 更新に成功したらtrue
+     */
+    virtual bool SubmitReport(const DS4_REPORT_EX& report) = 0;
+
+    /**
+     * @brief マウスイベントをまとめて送る
+     * @return 送信に成功したらtrue
+     */
+    virtual bool SubmitMouse(std::span<const MouseEvent> events) = 0;
+
+    /**
+     * @brief 出力先の名前（表示用）
+     */
+    virtual const wchar_t* Name() const = 0;
+
+    /**
+     * @brief 振動・ライトバーの変化を受け取るハンドラを設定する
+     * @note ゲームからの出力を受け取れない出力先では何もしない
+     */
+    virtual void SetFeedbackHandler(FeedbackHandler handler) { (void)handler; }
+};
+
+/**
+ * @enum OutputSinkType
+ * @brief 出力先の種類
+ */
+enum class OutputSinkType : uint8_t {
+    ViGEm,     // ViGEmの仮想DS4コントローラーとSendInput（Windows）
+    UInput,    // /dev/uinput の仮想ゲームパッドとマウス（Linux）
+    UHid,      // /dev/uhid のHIDレベルの仮想DS4（Linux、モーションとタッチパッドも届く）
+    Network,   // UDPで別のマシンに送る（受信側は --receive で仮想パッドに出力する）
+    Recording  // メモリに記録するだけ（動作確認用）
+};
+
+/**
+ * @enum PadType
+ * @brief 仮想ゲームパッドの種類（プレイヤーごとに選ぶ）
+ */
+enum class PadType : uint8_t {
+    DS4,   // DualShock 4
+    X360   // Xbox 360（XInput）。ViGEmのみ対応し、他の出力先ではDS4として出力する
+};
+
+/**
+ * @brief 使用する出力先の種類を環境変数 JOYCON_OUTPUT（vigem/uinput/uhid/record）から決める
+ * @note 指定が無ければWindowsはViGEm、Linuxはuinput
+ */
+OutputSinkType SelectOutputSinkType();
+
+/**
+ * @brief 出力先を作成する
+ * @param type 出力先の種類
+ * @param client ViGEmクライアント（ViGEm以外では使わない）
+ * @param pad 仮想ゲームパッドの種類
+ * @param player プレイヤー番号（0から。ネットワークの受信側はこの番号ごとに仮想パッドを作る）
+ * @return 作成した出力先（失敗した場合はnullptr）
+ */
+std::unique_ptr<OutputSink> CreateOutputSink(OutputSinkType type, PVIGEM_CLIENT client, PadType pad = PadType::DS4, uint8_t player = 0);
+
+/**
+ * @struct RecordedReport
+ * @brief 記録したゲームパッドの状態
+ */
+struct RecordedReport {
+    int64_t timeNs;         // 受け取った時刻（steady_clockのナノ秒）
+    DS4_REPORT_EX report;
+};
+
+/**
+ * @class RecordingSink
+ * @brief 受け取ったレポートとマウスイベントをメモリに記録する出力先
+ * @note 仮想デバイスの無い環境での動作確認や、出力の比較に使う
+ */
+class RecordingSink : public OutputSink {
+public:
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return L"Recording"; }
+
+    /**
+     * @brief 記録したレポートのコピーを取得
+     */
+    std::vector<RecordedReport> Reports() const;
+
+    /**
+     * @brief 記録したマウスイベントのコピーを取得
+     */
+    std::vector<MouseEvent> MouseEvents() const;
+
+    /**
+     * @brief 記録を消去する
+     */
+    void Clear();
+
+private:
+    mutable std::mutex mutex;
+    std::vector<RecordedReport> reports;
+    std::vector<MouseEvent> mouseEvents;
+};
+
+/**
+ * @struct SinkTiming
+ * @brief 出力先の1フレームあたりの処理時間
+ */
+struct SinkTiming {
+    uint64_t frames = 0;       // 計測した呼び出しの回数（レポートとマウスイベントの送信）
+    double meanUs = 0.0;       // 平均時間 [us]
+    double maxUs = 0.0;        // 最大時間 [us]
+};
+
+/**
+ * @class TimedSink
+ * @brief 別の出力先を包み、SubmitReportとSubmitMouseにかかった時間を計測する
+ */
+class TimedSink : public OutputSink {
+public:
+    explicit TimedSink(std::unique_ptr<OutputSink> inner) : inner(std::move(inner)) {}
+
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return inner->Name(); }
+    void SetFeedbackHandler(FeedbackHandler handler) override { inner->SetFeedbackHandler(std::move(handler)); }
+
+    /**
+     * @brief 包んでいる出力先
+     */
+    OutputSink& Inner() const { return *inner; }
+
+    /**
+     * @brief 計測した処理時間を取得
+     */
+    SinkTiming Timing() const;
+
+private:
+    void Record(int64_t elapsedNs);
+
+    std::unique_ptr<OutputSink> inner;
+    std::atomic<uint64_t> frames{ 0 };
+    std::atomic<int64_t> totalNs{ 0 };
+    std::atomic<int64_t> maxNs{ 0 };
+};
+
+/**
+ * @brief 出力先の処理時間をコンソールに表示する
+ */
+void PrintSinkTiming(const TimedSink& sink);
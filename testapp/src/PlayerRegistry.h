@@ -0,0 +1,170 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class PlayerRegistry
+ * @brief 実行中にプレイヤーを追加・削除・置換できるプレイヤー一覧
+ *
+ * 読み取り側（出力クロックなど）はRCU方式のスナップショットを参照するだけで、ロックを取らない。
+ * 書き込み側は一覧をコピーして変更したものを差し替え、差し替え前のスナップショットを
+ * 読み取り中のスレッドがいなくなってから古い一覧を解放する。削除したプレイヤーは
+ * 書き込み側のスレッドで破棄されるので、プレイヤーの終了処理で他のプレイヤーが止まることはない。
+ * @tparam Player プレイヤーの型
+ */
+template <typename Player>
+class PlayerRegistry {
+public:
+    // スロット番号を添字とするプレイヤーの一覧（空きスロットはnullptr）
+    using Players = std::vector<std::shared_ptr<Player>>;
+
+    /**
+     * @class Snapshot
+     * @brief 読み取り中のプレイヤー一覧（破棄するまで一覧は解放されない）
+     * @note 短時間だけ保持すること（保持している間、書き込み側は古い一覧の解放を待つ）
+     */
+    class Snapshot {
+    public:
+        ~Snapshot() { readers->fetch_sub(1, std::memory_order_release); }
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        const Players& operator*() const { return *players; }
+        const Players* operator->() const { return players; }
+
+    private:
+        friend class PlayerRegistry;
+        Snapshot(std::atomic<uint32_t>* readers, const Players* players) : readers(readers), players(players) {}
+
+        std::atomic<uint32_t>* readers;
+        const Players* players;
+    };
+
+    PlayerRegistry() : current(new Players()) {}
+    ~PlayerRegistry() { delete current.load(); }
+
+    PlayerRegistry(const PlayerRegistry&) = delete;
+    PlayerRegistry& operator=(const PlayerRegistry&) = delete;
+
+    /**
+     * @brief 現在のプレイヤー一覧を取得する（ロックを取らない）
+     */
+    Snapshot Read() const
+    {
+        // 現在の世代の読み取り数を増やしてから一覧を読む（書き込み側はこの数が0になるのを待つ）
+        auto* counter = &readers[epoch.load() & 1];
+        counter->fetch_add(1);
+        return Snapshot(counter, current.load());
+    }
+
+    /**
+     * @brief 最初の空きスロットにプレイヤーを追加する
+     * @return 追加したスロット番号
+     */
+    size_t Add(std::shared_ptr<Player> player)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto next = std::make_unique<Players>(*current.load());
+        size_t slot = FreeSlotLocked(*next);
+        if (slot == next->size()) next->push_back(std::move(player));
+        else (*next)[slot] = std::move(player);
+        Publish(std::move(next));
+        return slot;
+    }
+
+    /**
+     * @brief プレイヤーを削除する（プレイヤーは読み取りが終わってからこのスレッドで破棄される）
+     * @return スロットにプレイヤーがいればtrue
+     */
+    bool Remove(size_t slot)
+    {
+        return Replace(slot, nullptr);
+    }
+
+    /**
+     * @brief スロットのプレイヤーを置き換える（空きスロットなら追加する）
+     * @return 置き換える前にプレイヤーがいればtrue
+     */
+    bool Replace(size_t slot, std::shared_ptr<Player> player)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto next = std::make_unique<Players>(*current.load());
+        if (slot >= next->size()) {
+            if (!player) return false;
+            next->resize(slot + 1);
+        }
+        bool existed = (*next)[slot] != nullptr;
+        (*next)[slot] = std::move(player);
+        // 末尾の空きスロットは詰める
+        while (!next->empty() && !next->back()) next->pop_back();
+        Publish(std::move(next));
+        return existed;
+    }
+
+    /**
+     * @brief 全てのプレイヤーを削除する
+     */
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        Publish(std::make_unique<Players>());
+    }
+
+    /**
+     * @brief 次にAddで使われるスロット番号
+     */
+    size_t FreeSlot() const
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        return FreeSlotLocked(*current.load());
+    }
+
+    /**
+     * @brief 登録中のプレイヤー数
+     */
+    size_t Count() const
+    {
+        auto players = Read();
+        size_t count = 0;
+        for (const auto& player : *players)
+            if (player) count++;
+        return count;
+    }
+
+private:
+    static size_t FreeSlotLocked(const Players& players)
+    {
+        size_t slot = 0;
+        while (slot < players.size() && players[slot]) slot++;
+        return slot;
+    }
+
+    /**
+     * @brief 新しい一覧に差し替え、古い一覧を読み取り中のスレッドがいなくなってから解放する
+     */
+    void Publish(std::unique_ptr<Players> next)
+    {
+        std::unique_ptr<Players> old(current.exchange(next.release()));
+
+        // 世代を2回進め、それぞれ前の世代の読み取りが終わるのを待つ
+        // （世代を読んでから読み取り数を増やすまでの間に進んだ場合も、2回目で待てる）
+        for (int i = 0; i < 2; ++i) {
+            uint32_t previous = epoch.fetch_add(1);
+            while (readers[previous & 1].load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+        }
+        // ここで古い一覧（と、削除したプレイヤーの最後の参照）を解放する
+    }
+
+    std::atomic<Players*> current;
+    std::atomic<uint32_t> epoch{ 0 };
+    mutable std::atomic<uint32_t> readers[2]{};
+    mutable std::mutex writeMutex;
+};
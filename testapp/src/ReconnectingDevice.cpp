@@ -0,0 +1,253 @@
+﻿#include "ReconnectingDevice.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "JoyConConnection.h"
+
+using Clock = std::chrono::steady_clock;
+
+// 種類を確定するまでに、同じ推定が続く必要があるレポートの数
+constexpr int FINGERPRINT_REPORTS = 4;
+
+/**
+ * @brief 現在時刻（steady_clockのナノ秒）
+ */
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+void LoadReconnectConfig(ReconnectConfig& config)
+{
+    std::ifstream ifs("reconnect.txt");
+    if (!ifs.is_open()) return;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        try {
+            if (key == "expected_interval_ms")    config.expectedInterval = std::chrono::milliseconds(std::max(1, std::stoi(value)));
+            else if (key == "stall_intervals")    config.stallIntervals = std::max(1, std::stoi(value));
+            else if (key == "initial_backoff_ms") config.initialBackoff = std::chrono::milliseconds(std::max(1, std::stoi(value)));
+            else if (key == "max_backoff_ms")     config.maxBackoff = std::chrono::milliseconds(std::max(1, std::stoi(value)));
+        }
+        catch (const std::exception&) {
+            std::wcerr << L"Invalid value in reconnect.txt: " << std::wstring(line.begin(), line.end()) << L"\n";
+        }
+    }
+}
+
+void PrintReconnectStats(uint64_t address, const ReconnectStats& stats)
+{
+    if (stats.stalls == 0) return;
+    double mean = stats.reconnects > 0 ? stats.totalLatency / stats.reconnects : 0.0;
+    std::wcout << L"Controller " << std::hex << address << std::dec << L": " << stats.stalls << L" stall(s), "
+        << stats.reconnects << L" reconnect(s), " << stats.failedAttempts << L" failed attempt(s), latency mean "
+        << mean * 1000.0 << L" ms / max " << stats.maxLatency * 1000.0 << L" ms\n";
+}
+
+ReconnectingDevice::ReconnectingDevice(Transport& transport, CommandQueue& queue, std::shared_ptr<TransportDevice> device,
+    ControllerModel model, const ReconnectConfig& config)
+    : transport(transport), queue(queue), config(config), address(device->Address()), device(std::move(device)), model(model)
+{
+}
+
+ReconnectingDevice::~ReconnectingDevice()
+{
+    Close();
+}
+
+bool ReconnectingDevice::Start()
+{
+    std::shared_ptr<TransportDevice> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (started || closing) return false;
+        started = true;
+        current = device;
+    }
+
+    if (!current->Subscribe([this](std::span<const uint8_t> data) { OnNotify(data); }))
+        return false;
+
+    // 通知の監視を開始（最初のレポートが届くまでは途絶とみなさない）
+    watchdog = std::thread(&ReconnectingDevice::Run, this);
+    return true;
+}
+
+bool ReconnectingDevice::Subscribe(NotifyHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!started || hasHandler.load() || closing) return false;
+    this->handler = std::move(handler);
+    hasHandler.store(true, std::memory_order_release);
+    return true;
+}
+
+bool ReconnectingDevice::WriteCommand(std::span<const uint8_t> data)
+{
+    std::shared_ptr<TransportDevice> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (state.load() != ConnectionState::Connected) return false;
+        current = device;
+    }
+    return current->WriteCommand(data);
+}
+
+bool ReconnectingDevice::CanWrite() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return device->CanWrite();
+}
+
+void ReconnectingDevice::Close()
+{
+    std::shared_ptr<TransportDevice> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closing) return;
+        closing = true;
+        state = ConnectionState::Closed;
+        current = device;
+    }
+    wake.notify_all();
+    modelFound.notify_all();
+    if (watchdog.joinable() && watchdog.get_id() != std::this_thread::get_id()) watchdog.join();
+    // 未送信のコマンドを捨て、このデバイスの送信キューとスレッドを片付ける
+    queue.Cancel(*this);
+    current->Close();
+}
+
+ReconnectStats ReconnectingDevice::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+ControllerModel ReconnectingDevice::WaitForModel(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    modelFound.wait_for(lock, timeout, [this]() { return model.load() != ControllerModel::Unknown || closing; });
+    return model.load();
+}
+
+void ReconnectingDevice::OnNotify(std::span<const uint8_t> data)
+{
+    lastNotify.store(now_ns(), std::memory_order_relaxed);
+
+    if (data.size() >= 0x3C) {
+        // 初期化コマンドの確認待ちに通知
+        queue.ReportReceived(*this);
+
+        // 種類が不明なら、同じ推定が続いたところで確定する
+        if (model.load(std::memory_order_relaxed) == ControllerModel::Unknown) {
+            ControllerModel guess = FingerprintControllerModel(data);
+            fingerprintCount = (guess == fingerprint) ? fingerprintCount + 1 : 1;
+            fingerprint = guess;
+            if (guess != ControllerModel::Unknown && fingerprintCount >= FINGERPRINT_REPORTS) {
+                std::lock_guard<std::mutex> lock(mutex);
+                model.store(guess);
+                modelFound.notify_all();
+            }
+        }
+    }
+
+    if (hasHandler.load(std::memory_order_acquire)) handler(data);
+}
+
+void ReconnectingDevice::Run()
+{
+    const auto stallTimeout = config.expectedInterval * config.stallIntervals;
+    const int64_t stallTimeoutNs = std::chrono::duration_cast<std::chrono::nanoseconds>(stallTimeout).count();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!closing)
+    {
+        wake.wait_for(lock, config.expectedInterval * std::max(1, config.stallIntervals / 4));
+        if (closing) break;
+
+        int64_t last = lastNotify.load(std::memory_order_relaxed);
+        if (last == 0 || now_ns() - last < stallTimeoutNs) continue;
+
+        // 通知が途絶えたので、古い接続を閉じて再接続する
+        auto stalledAt = Clock::now();
+        stats.stalls++;
+        state = ConnectionState::Stalled;
+        std::wcerr << L"Controller " << std::hex << address << std::dec << L" stalled (no input for "
+            << stallTimeout.count() << L" ms). Reconnecting...\n";
+
+        auto old = device;
+        lock.unlock();
+        old->Close();
+        lock.lock();
+
+        state = ConnectionState::Reconnecting;
+        auto backoff = config.initialBackoff;
+        bool reconnected = false;
+        while (!closing)
+        {
+            // 再接続を試す前に待つ（失敗するたびに倍にする）
+            if (wake.wait_for(lock, backoff, [this]() { return closing; })) break;
+
+            lock.unlock();
+            reconnected = Reconnect();
+            lock.lock();
+            if (reconnected) break;
+
+            stats.failedAttempts++;
+            backoff = std::min(backoff * 2, config.maxBackoff);
+        }
+        if (!reconnected) break;
+
+        double latency = std::chrono::duration<double>(Clock::now() - stalledAt).count();
+        stats.reconnects++;
+        stats.lastLatency = latency;
+        stats.maxLatency = std::max(stats.maxLatency, latency);
+        stats.totalLatency += latency;
+        state = ConnectionState::Connected;
+        std::wcout << L"Controller " << std::hex << address << std::dec << L" reconnected in "
+            << latency * 1000.0 << L" ms (" << stats.reconnects << L" reconnect(s)).\n";
+    }
+}
+
+bool ReconnectingDevice::Reconnect()
+{
+    // キャッシュした接続情報を使って接続する
+    auto fresh = transport.Connect(address);
+    if (!fresh) return false;
+
+    // 最初のレポートが届くまでの猶予として、受信時刻を現在にしておく
+    lastNotify.store(now_ns(), std::memory_order_relaxed);
+    if (!fresh->Subscribe([this](std::span<const uint8_t> data) { OnNotify(data); })) {
+        fresh->Close();
+        return false;
+    }
+
+    bool closed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = closing;
+        if (!closed) {
+            device = fresh;
+            state = ConnectionState::Connected;
+        }
+    }
+    if (closed) {
+        // 閉じると受信スレッドの終了を待ち、そのスレッドのOnNotifyは同じミューテックスを取るので、ロックの外で閉じる
+        fresh->Close();
+        return false;
+    }
+
+    // 同じ入力ハンドラ（同じ仮想コントローラー）のまま、初期化コマンドを送り直す
+    if (fresh->CanWrite())
+        SendCustomCommands(queue, shared_from_this());
+    return true;
+}
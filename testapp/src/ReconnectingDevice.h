@@ -0,0 +1,143 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "CommandQueue.h"
+#include "Transport.h"
+
+/**
+ * @struct ReconnectConfig
+ * @brief 通知の途絶の検出と再接続の設定
+ */
+struct ReconnectConfig {
+    std::chrono::milliseconds expectedInterval{ 15 };  // 入力レポートの想定間隔
+    int stallIntervals = 20;                            // この回数分の間隔、通知が無ければ途絶とみなす
+    std::chrono::milliseconds initialBackoff{ 250 };   // 最初の再接続までの待ち時間
+    std::chrono::milliseconds maxBackoff{ 8000 };      // 再接続の待ち時間の上限（失敗ごとに倍にする）
+};
+
+/**
+ * @brief reconnect.txt から再接続の設定を読み込む
+ * @param config 読み込んだ値を格納する設定（ファイルに無い項目は変更しない）
+ */
+void LoadReconnectConfig(ReconnectConfig& config);
+
+/**
+ * @enum ConnectionState
+ * @brief デバイスの接続状態
+ */
+enum class ConnectionState : uint8_t {
+    Connected,    // 通知を受信中
+    Stalled,      // 通知が途絶えた
+    Reconnecting, // 再接続を試行中
+    Closed        // 終了済み
+};
+
+/**
+ * @struct ReconnectStats
+ * @brief 再接続の統計
+ */
+struct ReconnectStats {
+    uint32_t stalls = 0;          // 途絶を検出した回数
+    uint32_t reconnects = 0;      // 再接続に成功した回数
+    uint32_t failedAttempts = 0;  // 失敗した再接続の試行回数
+    double lastLatency = 0.0;     // 直近の途絶の検出から復帰までの時間 [s]
+    double maxLatency = 0.0;      // 最大の復帰時間 [s]
+    double totalLatency = 0.0;    // 復帰時間の合計 [s]
+};
+
+/**
+ * @brief 再接続の統計をコンソールに表示する（途絶が無かったデバイスは表示しない）
+ */
+void PrintReconnectStats(uint64_t address, const ReconnectStats& stats);
+
+/**
+ * @class ReconnectingDevice
+ * @brief 通知の途絶を監視し、自動で再接続するデバイス
+ *
+ * 接続済みのデバイスを包み、アプリからは同じデバイスとして見える。再接続しても
+ * 入力ハンドラは同じものを使い続けるので、ハンドラが更新する仮想コントローラーも変わらない
+ * （ゲーム側のコントローラーの割り当てが保たれる）。再接続はキャッシュした接続情報を使う。
+ * 通知はStartの時点から受信し、入力ハンドラが設定される前のレポートは初期化の確認と
+ * コントローラーの種類の推定だけに使う。
+ */
+class ReconnectingDevice : public TransportDevice, public std::enable_shared_from_this<ReconnectingDevice> {
+public:
+    /**
+     * @param transport 再接続に使う通信バックエンド（このデバイスより長く存在すること）
+     * @param queue 再接続後の初期化コマンドを送るキュー（このデバイスより長く存在すること）
+     * @param device 接続済みのデバイス
+     * @param model アドバタイズなどから判定済みのコントローラーの種類（不明ならUnknown）
+     * @param config 再接続の設定
+     */
+    ReconnectingDevice(Transport& transport, CommandQueue& queue, std::shared_ptr<TransportDevice> device,
+        ControllerModel model = ControllerModel::Unknown, const ReconnectConfig& config = ReconnectConfig());
+    ~ReconnectingDevice() override;
+
+    /**
+     * @brief 通知の受信と監視を開始する
+     * @return 通知の有効化に成功したらtrue
+     */
+    bool Start();
+
+    uint64_t Address() const override { return address; }
+    bool Subscribe(NotifyHandler handler) override;
+    bool WriteCommand(std::span<const uint8_t> data) override;
+    bool CanWrite() const override;
+    void Close() override;
+
+    /**
+     * @brief 現在の接続状態
+     */
+    ConnectionState State() const { return state.load(); }
+
+    /**
+     * @brief 再接続の統計を取得
+     */
+    ReconnectStats Stats() const;
+
+    /**
+     * @brief コントローラーの種類（判定できていなければUnknown）
+     */
+    ControllerModel Model() const { return model.load(); }
+
+    /**
+     * @brief コントローラーの種類が判定できるまで待つ（入力レポートから推定する）
+     * @param timeout 待つ最大時間
+     * @return 判定した種類（タイムアウトした場合はUnknown）
+     */
+    ControllerModel WaitForModel(std::chrono::milliseconds timeout);
+
+private:
+    void Run();
+    void OnNotify(std::span<const uint8_t> data);
+    bool Reconnect();
+
+    Transport& transport;
+    CommandQueue& queue;
+    ReconnectConfig config;
+    uint64_t address;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::shared_ptr<TransportDevice> device; // 現在の接続（再接続で置き換わる）
+    NotifyHandler handler;
+    std::atomic<bool> hasHandler{ false }; // handlerの設定が完了した
+    std::condition_variable modelFound;
+    ReconnectStats stats;
+    bool closing = false;
+
+    std::atomic<ConnectionState> state{ ConnectionState::Connected };
+    std::atomic<ControllerModel> model;
+    ControllerModel fingerprint = ControllerModel::Unknown; // 推定中の種類（通知スレッドのみが使う）
+    int fingerprintCount = 0;                               // 同じ推定が続いた回数
+    bool started = false;
+    std::atomic<int64_t> lastNotify{ 0 }; // 最後に通知を受信した時刻（steady_clockのナノ秒、0は未受信）
+    std::thread watchdog;
+};
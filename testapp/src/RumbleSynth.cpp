@@ -0,0 +1,179 @@
+﻿#include "RumbleSynth.h"
+
+#include <algorithm>
+
+// 表はコンパイル時に作る（std::log2はconstexprではないので級数で求める）
+constexpr double LN2 = 0.693147180559945309417;
+
+/**
+ * @brief log2をコンパイル時に求める（x > 0）
+ */
+static constexpr double const_log2(double x)
+{
+    // 仮数を[1, 2)に揃え、ln(m) = 2 atanh((m - 1) / (m + 1)) の級数を足す
+    int exponent = 0;
+    while (x >= 2.0) { x /= 2.0; ++exponent; }
+    while (x < 1.0) { x *= 2.0; --exponent; }
+    double y = (x - 1.0) / (x + 1.0);
+    double y2 = y * y;
+    double term = y;
+    double sum = 0.0;
+    for (int n = 1; n < 60; n += 2) {
+        sum += term / n;
+        term *= y2;
+    }
+    return exponent + 2.0 * sum / LN2;
+}
+
+/**
+ * @brief 0以上の値を四捨五入して範囲に収める
+ */
+static constexpr uint8_t const_round(double value, int maximum)
+{
+    if (value <= 0.0) return 0;
+    int rounded = static_cast<int>(value + 0.5);
+    return static_cast<uint8_t>(rounded > maximum ? maximum : rounded);
+}
+
+/**
+ * @brief 振幅（0-255）の表を作る（HD振動の振幅は対数で、小さい振幅ほど細かい）
+ */
+static constexpr std::array<uint8_t, 256> build_amplitude_table()
+{
+    std::array<uint8_t, 256> table{};
+    for (int i = 1; i < 256; ++i) {
+        double amplitude = i / 255.0;
+        double encoded;
+        if (amplitude > 0.23) encoded = const_log2(amplitude * 8.7) * 32.0;
+        else if (amplitude > 0.12) encoded = const_log2(amplitude * 17.0) * 16.0;
+        else encoded = ((const_log2(amplitude) * 32.0) - 96.0) / (5.0 - amplitude * amplitude) - 1.0;
+        table[i] = const_round(encoded, 100);
+    }
+    return table;
+}
+
+/**
+ * @brief 周波数（Hz）の表を作る（log2(f / 10) * 32）
+ */
+static constexpr std::array<uint8_t, RUMBLE_HIGH_MAX_FREQUENCY + 1> build_frequency_table()
+{
+    std::array<uint8_t, RUMBLE_HIGH_MAX_FREQUENCY + 1> table{};
+    for (int f = 10; f <= RUMBLE_HIGH_MAX_FREQUENCY; ++f)
+        table[f] = const_round(const_log2(f / 10.0) * 32.0, 255);
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> AMPLITUDE_TABLE = build_amplitude_table();
+constexpr std::array<uint8_t, RUMBLE_HIGH_MAX_FREQUENCY + 1> FREQUENCY_TABLE = build_frequency_table();
+
+static_assert(AMPLITUDE_TABLE[0] == 0 && AMPLITUDE_TABLE[255] == 100, "amplitude table range");
+static_assert(FREQUENCY_TABLE[RUMBLE_LOW_MIN_FREQUENCY] == 0x40 && FREQUENCY_TABLE[RUMBLE_HIGH_MIN_FREQUENCY] == 0x60,
+    "frequency table band start");
+static_assert(FREQUENCY_TABLE[RUMBLE_LOW_MAX_FREQUENCY] <= 0xBF && FREQUENCY_TABLE[RUMBLE_HIGH_MAX_FREQUENCY] <= 0xDF,
+    "frequency table band end");
+
+uint8_t EncodeRumbleAmplitude(uint8_t amplitude)
+{
+    return AMPLITUDE_TABLE[amplitude];
+}
+
+uint8_t EncodeRumbleFrequency(uint16_t frequency)
+{
+    return FREQUENCY_TABLE[std::min(frequency, RUMBLE_HIGH_MAX_FREQUENCY)];
+}
+
+RumblePacket EncodeRumbleFrame(uint8_t sequence, const RumbleFrame& frame)
+{
+    // 高い周波数: 9ビット、振幅は0～200 / 低い周波数: 7ビット、振幅は64～114
+    uint16_t highFrequency = std::clamp(frame.high.frequency, RUMBLE_HIGH_MIN_FREQUENCY, RUMBLE_HIGH_MAX_FREQUENCY);
+    uint16_t lowFrequency = std::clamp(frame.low.frequency, RUMBLE_LOW_MIN_FREQUENCY, RUMBLE_LOW_MAX_FREQUENCY);
+    uint16_t hf = static_cast<uint16_t>((EncodeRumbleFrequency(highFrequency) - 0x60) * 4);
+    uint8_t lf = static_cast<uint8_t>(EncodeRumbleFrequency(lowFrequency) - 0x40);
+    uint8_t hfAmp = static_cast<uint8_t>(EncodeRumbleAmplitude(frame.high.amplitude) * 2);
+    uint16_t lfAmp = static_cast<uint16_t>(EncodeRumbleAmplitude(frame.low.amplitude) / 2 + 64);
+
+    return {
+        static_cast<uint8_t>(RUMBLE_HEADER | (sequence & 0x0F)),
+        static_cast<uint8_t>(hf & 0xFF),
+        static_cast<uint8_t>(hfAmp + ((hf >> 8) & 0xFF)),
+        static_cast<uint8_t>(lf + ((lfAmp >> 8) & 0xFF)),
+        static_cast<uint8_t>(lfAmp & 0xFF),
+    };
+}
+
+void RumbleMixer::Play(const RumbleEffect& effect)
+{
+    if (effect.frames == 0) return;
+
+    size_t slot = effectCount;
+    if (effectCount == MAX_EFFECTS) {
+        // いっぱいのときは残りが最も短いものを置き換える
+        slot = 0;
+        for (size_t i = 1; i < effectCount; ++i)
+            if (voices[i].remaining < voices[slot].remaining) slot = i;
+    }
+    else {
+        effectCount++;
+    }
+    voices[slot] = { effect, effect.frames };
+}
+
+void RumbleMixer::Clear()
+{
+    continuous = RumbleFrame();
+    effectCount = 0;
+}
+
+/**
+ * @brief 帯域に振動を足す（周波数は最も大きく鳴らしているものにする）
+ * @param loudest これまでで最も大きい振幅
+ */
+static void mix_band(RumbleBand& mixed, int& total, uint8_t& loudest, const RumbleBand& band, uint8_t amplitude)
+{
+    if (amplitude == 0) return;
+    total += amplitude;
+    if (amplitude > loudest) {
+        loudest = amplitude;
+        mixed.frequency = band.frequency;
+    }
+}
+
+RumbleFrame RumbleMixer::Mix() const
+{
+    RumbleFrame mixed;
+    int lowTotal = 0, highTotal = 0;
+    uint8_t lowLoudest = 0, highLoudest = 0;
+
+    mix_band(mixed.low, lowTotal, lowLoudest, continuous.low, continuous.low.amplitude);
+    mix_band(mixed.high, highTotal, highLoudest, continuous.high, continuous.high.amplitude);
+    for (size_t i = 0; i < effectCount; ++i) {
+        const Voice& voice = voices[i];
+        const RumbleFrame& frame = voice.effect.frame;
+        // フェードは残りのフレーム数に比例して下げる
+        uint16_t scale = voice.effect.fade ? voice.remaining : 1;
+        uint16_t range = voice.effect.fade ? voice.effect.frames : 1;
+        mix_band(mixed.low, lowTotal, lowLoudest, frame.low, static_cast<uint8_t>(frame.low.amplitude * scale / range));
+        mix_band(mixed.high, highTotal, highLoudest, frame.high, static_cast<uint8_t>(frame.high.amplitude * scale / range));
+    }
+
+    mixed.low.amplitude = static_cast<uint8_t>(std::min(lowTotal, 255));
+    mixed.high.amplitude = static_cast<uint8_t>(std::min(highTotal, 255));
+    return mixed;
+}
+
+void RumbleMixer::Advance()
+{
+    for (size_t i = 0; i < effectCount;) {
+        if (--voices[i].remaining == 0)
+            voices[i] = voices[--effectCount]; // 最後の効果で詰める
+        else
+            ++i;
+    }
+}
+
+RumblePacket RumbleMixer::Render()
+{
+    RumblePacket packet = EncodeRumbleFrame(sequence++, Mix());
+    Advance();
+    return packet;
+}
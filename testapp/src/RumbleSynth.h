@@ -0,0 +1,140 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// 振動のパケットの大きさ（先頭 + HD振動の4バイト）
+constexpr size_t RUMBLE_PACKET_SIZE = 5;
+using RumblePacket = std::array<uint8_t, RUMBLE_PACKET_SIZE>;
+
+// 振動のパケットの先頭（下位4ビットは連番）
+constexpr uint8_t RUMBLE_HEADER = 0x50;
+
+// 各帯域で鳴らせる周波数（Hz、範囲外は端の値にする）
+constexpr uint16_t RUMBLE_LOW_MIN_FREQUENCY = 40;
+constexpr uint16_t RUMBLE_LOW_MAX_FREQUENCY = 626;
+constexpr uint16_t RUMBLE_HIGH_MIN_FREQUENCY = 80;
+constexpr uint16_t RUMBLE_HIGH_MAX_FREQUENCY = 1252;
+
+// 既定の周波数（強い振動は低い周波数、弱い振動は高い周波数で鳴らす）
+constexpr uint16_t RUMBLE_LOW_FREQUENCY = 160;
+constexpr uint16_t RUMBLE_HIGH_FREQUENCY = 320;
+
+/**
+ * @struct RumbleBand
+ * @brief 1つの帯域の振動（周波数と振幅）
+ */
+struct RumbleBand {
+    uint16_t frequency = 0; // 周波数（Hz）
+    uint8_t amplitude = 0;  // 振幅（0-255）
+
+    bool operator==(const RumbleBand&) const = default;
+};
+
+/**
+ * @struct RumbleFrame
+ * @brief 1フレームの振動（低い帯域と高い帯域）
+ */
+struct RumbleFrame {
+    RumbleBand low{ RUMBLE_LOW_FREQUENCY, 0 };
+    RumbleBand high{ RUMBLE_HIGH_FREQUENCY, 0 };
+
+    bool operator==(const RumbleFrame&) const = default;
+
+    /**
+     * @brief 振幅が無い（鳴っていない）
+     */
+    bool Silent() const { return low.amplitude == 0 && high.amplitude == 0; }
+};
+
+/**
+ * @struct RumbleEffect
+ * @brief 決まったフレーム数だけ鳴らす効果（UIのクリックなど）
+ */
+struct RumbleEffect {
+    RumbleFrame frame;   // 鳴らす振動
+    uint16_t frames = 1; // 鳴らすフレーム数
+    bool fade = false;   // 最後のフレームに向けて振幅を下げる
+};
+
+// UIのクリック（高い周波数の短い振動）
+constexpr RumbleEffect HAPTIC_CLICK{ { { RUMBLE_LOW_FREQUENCY, 0 }, { 640, 200 } }, 2, true };
+
+/**
+ * @brief 振幅（0-255）をHD振動の振幅の値（0-100）にする（コンパイル時に作った表を引く）
+ */
+uint8_t EncodeRumbleAmplitude(uint8_t amplitude);
+
+/**
+ * @brief 周波数（Hz）をHD振動の周波数の値にする（コンパイル時に作った表を引く）
+ */
+uint8_t EncodeRumbleFrequency(uint16_t frequency);
+
+/**
+ * @brief 1フレームの振動をパケットにする
+ * @param sequence パケットの連番（下位4ビットを使う）
+ * @param frame 振動（周波数は各帯域の範囲に収める）
+ */
+RumblePacket EncodeRumbleFrame(uint8_t sequence, const RumbleFrame& frame);
+
+/**
+ * @class RumbleMixer
+ * @brief コントローラー1台分の振動を合成する
+ *
+ * ゲームの振動（次に設定するまで続く）と、決まったフレーム数だけ鳴らす効果を
+ * 固定の大きさのバッファで重ねる。振幅は帯域ごとに足して上限で切り、周波数は
+ * その帯域で最も大きく鳴らしているものを使う。メモリーの確保はしない。
+ * 1つのスレッドから使う。
+ */
+class RumbleMixer {
+public:
+    // 同時に鳴らせる効果の数（いっぱいのときは残りが最も短いものを置き換える）
+    static constexpr size_t MAX_EFFECTS = 4;
+
+    /**
+     * @brief ゲームの振動を設定する
+     */
+    void SetContinuous(const RumbleFrame& frame) { continuous = frame; }
+
+    /**
+     * @brief 効果を鳴らし始める
+     */
+    void Play(const RumbleEffect& effect);
+
+    /**
+     * @brief 効果をすべて止め、ゲームの振動も無しにする
+     */
+    void Clear();
+
+    /**
+     * @brief 現在のフレームの振動を合成する
+     */
+    RumbleFrame Mix() const;
+
+    /**
+     * @brief 効果を1フレーム進める（終わった効果は外す）
+     */
+    void Advance();
+
+    /**
+     * @brief 現在のフレームをパケットにして、1フレーム進める
+     */
+    RumblePacket Render();
+
+    /**
+     * @brief 鳴っている効果がある（次のフレームで振動が変わる）
+     */
+    bool Active() const { return effectCount > 0; }
+
+private:
+    struct Voice {
+        RumbleEffect effect;
+        uint16_t remaining = 0; // 残りのフレーム数
+    };
+
+    RumbleFrame continuous;
+    std::array<Voice, MAX_EFFECTS> voices{};
+    size_t effectCount = 0;
+    uint8_t sequence = 0;
+};
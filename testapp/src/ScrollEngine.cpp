@@ -0,0 +1,68 @@
+﻿#include "ScrollEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// ホイール1ノッチあたりの量（WinUser.hのWHEEL_DELTA）
+constexpr float WHEEL_UNITS_PER_NOTCH = 120.0f;
+
+void LoadScrollConfig(ScrollConfig& config)
+{
+    std::ifstream ifs("scroll.txt");
+    if (!ifs.is_open()) return;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        try {
+            if (key == "deadzone")       config.deadzone = std::stof(value);
+            else if (key == "max_speed") config.maxSpeed = std::stof(value);
+            else if (key == "exponent")  config.exponent = std::stof(value);
+            else if (key == "step")      config.step = std::max(1, std::stoi(value));
+            else if (key == "invert")    config.invert = (value == "1" || value == "true");
+        }
+        catch (const std::exception&) {
+            std::wcerr << L"Invalid value in scroll.txt: " << std::wstring(line.begin(), line.end()) << L"\n";
+        }
+    }
+}
+
+ScrollEngine::ScrollEngine(const ScrollConfig& config)
+    : config(config)
+{
+}
+
+int ScrollEngine::Tick(float dt, const ScrollConfig& config)
+{
+    float value = deflection.load(std::memory_order_relaxed);
+    if (config.invert) value = -value;
+
+    // デッドゾーン内では何も送らず、端数も捨てる（離したときに余分なスクロールが出ないように）
+    float magnitude = std::abs(value);
+    if (magnitude < config.deadzone) {
+        accumulated = 0.0f;
+        return 0;
+    }
+
+    // 応答カーブ: デッドゾーンの外側を 0-1 に正規化して指数で曲げる
+    float range = std::max(1.0f - config.deadzone, 1e-3f);
+    float normalized = std::min((magnitude - config.deadzone) / range, 1.0f);
+    float speed = config.maxSpeed * std::pow(normalized, config.exponent) * WHEEL_UNITS_PER_NOTCH;
+
+    accumulated += std::copysign(speed * dt, value);
+
+    // 最小量に達した分だけ送信する
+    int steps = static_cast<int>(accumulated / config.step);
+    if (steps == 0) return 0;
+
+    int delta = steps * config.step;
+    accumulated -= static_cast<float>(delta);
+    return delta;
+}
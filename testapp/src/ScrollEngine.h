@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include <atomic>
+
+/**
+ * @struct ScrollConfig
+ * @brief スティックによるスクロールの設定
+ */
+struct ScrollConfig {
+    float deadzone = 0.15f;   // この傾き (0-1) 未満ではスクロールしない
+    float maxSpeed = 15.0f;   // 最大まで倒したときの速度（ホイールのノッチ数/秒）
+    float exponent = 2.0f;    // 応答カーブの指数（大きいほど小さな傾きで細かく動く）
+    int step = 15;            // 1回のイベントで送る最小量（120で1ノッチ）
+    bool invert = false;      // スクロール方向を反転
+};
+
+/**
+ * @brief scroll.txt からスクロールの設定を読み込む
+ * @param config 読み込んだ値で上書きする設定
+ * @note 形式は1行ごとに "キー=値"（deadzone, max_speed, exponent, step, invert）
+ */
+void LoadScrollConfig(ScrollConfig& config);
+
+/**
+ * @class ScrollEngine
+ * @brief スティックの傾きを時間で積算し、高解像度のホイール量に変換する
+ *
+ * 入力スレッドはSetDeflectionで最新の傾きを渡すだけで、
+ * ホイール量の生成は出力クロックのTickで行う。
+ */
+class ScrollEngine {
+public:
+    explicit ScrollEngine(const ScrollConfig& config = {});
+
+    /**
+     * @brief スティックの傾きを設定する（入力スレッドから呼ばれる）
+     * @param value 縦方向の傾き (-1.0 to 1.0、上が正)
+     */
+    void SetDeflection(float value) { deflection.store(value, std::memory_order_relaxed); }
+
+    /**
+     * @brief 経過時間分のスクロール量を計算する（出力クロックから呼ばれる）
+     * @param dt 前回のティックからの経過時間（秒）
+     * @return 送信するホイール量（WHEEL_DELTA=120単位、送信不要なら0）
+     */
+    int Tick(float dt) { return Tick(dt, config); }
+
+    /**
+     * @brief 指定した設定で経過時間分のスクロール量を計算する（設定を実行中に差し替える場合に使う）
+     * @param dt 前回のティックからの経過時間（秒）
+     * @param config スクロールの設定
+     * @return 送信するホイール量（WHEEL_DELTA=120単位、送信不要なら0）
+     */
+    int Tick(float dt, const ScrollConfig& config);
+
+    const ScrollConfig& Config() const { return config; }
+
+private:
+    ScrollConfig config;
+    std::atomic<float> deflection{ 0.0f };
+    float accumulated = 0.0f; // 未送信のホイール量
+};
@@ -0,0 +1,220 @@
+﻿#include "Session.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// コントローラーの種類の名前（添字がControllerTypeの値）
+static const char* const CONTROLLER_TYPE_NAMES[] = { "auto", "single", "dual", "pro", "gc" };
+constexpr int CONTROLLER_TYPE_COUNT = sizeof(CONTROLLER_TYPE_NAMES) / sizeof(CONTROLLER_TYPE_NAMES[0]);
+
+/**
+ * @brief 大文字・小文字を区別せずに比較する
+ */
+static bool equals_ignore_case(const std::string& a, const char* b)
+{
+    if (a.size() != std::strlen(b)) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) return false;
+    return true;
+}
+
+bool ParseSessionPlayer(const std::string& spec, SessionPlayer& player)
+{
+    SessionPlayer parsed;
+    std::istringstream fields(spec);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        auto eq = field.find('=');
+        if (eq == std::string::npos) return false;
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        if (key == "type") {
+            int type = -1;
+            for (int i = 0; i < CONTROLLER_TYPE_COUNT; ++i)
+                if (equals_ignore_case(value, CONTROLLER_TYPE_NAMES[i]) || value == std::to_string(i)) type = i;
+            if (type < 0) return false;
+            parsed.controllerType = type;
+        }
+        else if (key == "side") {
+            if (equals_ignore_case(value, "L")) parsed.side = JoyConSide::Left;
+            else if (equals_ignore_case(value, "R")) parsed.side = JoyConSide::Right;
+            else if (equals_ignore_case(value, "A")) parsed.side = std::nullopt;
+            else return false;
+        }
+        else if (key == "orientation") {
+            if (equals_ignore_case(value, "U")) parsed.orientation = JoyConOrientation::Upright;
+            else if (equals_ignore_case(value, "S")) parsed.orientation = JoyConOrientation::Sideways;
+            else return false;
+        }
+        else if (key == "gyro") {
+            if (equals_ignore_case(value, "off")) parsed.gyroStickMode = GyroStickMode::Off;
+            else if (equals_ignore_case(value, "aim")) parsed.gyroStickMode = GyroStickMode::Aim;
+            else if (equals_ignore_case(value, "flick")) parsed.gyroStickMode = GyroStickMode::Flick;
+            else return false;
+        }
+        else if (key == "pad") {
+            if (equals_ignore_case(value, "ds4")) parsed.pad = PadType::DS4;
+            else if (equals_ignore_case(value, "x360")) parsed.pad = PadType::X360;
+            else return false;
+        }
+        else if (key == "devices") {
+            // 16進のアドレスを + で区切る
+            std::istringstream addresses(value);
+            std::string address;
+            while (std::getline(addresses, address, '+')) {
+                try {
+                    parsed.addresses.push_back(std::stoull(address, nullptr, 16));
+                }
+                catch (const std::exception&) {
+                    return false;
+                }
+            }
+        }
+        else {
+            return false;
+        }
+    }
+    player = parsed;
+    return true;
+}
+
+std::string FormatSessionPlayer(const SessionPlayer& player)
+{
+    std::ostringstream oss;
+    int type = (player.controllerType >= 0 && player.controllerType < CONTROLLER_TYPE_COUNT) ? player.controllerType : 0;
+    oss << "type=" << CONTROLLER_TYPE_NAMES[type];
+    oss << ",side=" << (!player.side ? "A" : (*player.side == JoyConSide::Left ? "L" : "R"));
+    oss << ",orientation=" << (player.orientation == JoyConOrientation::Sideways ? "S" : "U");
+    oss << ",gyro=" << (player.gyroStickMode == GyroStickMode::Aim ? "aim" : player.gyroStickMode == GyroStickMode::Flick ? "flick" : "off");
+    oss << ",pad=" << (player.pad == PadType::X360 ? "x360" : "ds4");
+    if (!player.addresses.empty()) {
+        oss << ",devices=";
+        for (size_t i = 0; i < player.addresses.size(); ++i)
+            oss << (i > 0 ? "+" : "") << std::hex << player.addresses[i] << std::dec;
+    }
+    return oss.str();
+}
+
+bool ParseSessionOptions(int argc, char* argv[], SessionOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--session" && i + 1 < argc) {
+            options.path = argv[++i];
+        }
+        else if (arg == "--new") {
+            options.restore = false;
+        }
+        else if (arg == "--no-save") {
+            options.save = false;
+        }
+        else if (arg == "--debug") {
+            options.session.debug = true;
+        }
+        else if (arg == "--no-debug") {
+            options.session.debug = false;
+        }
+        else if (arg == "--receive" && i + 1 < argc) {
+            // <port> または <address>:<port>
+            std::string value = argv[++i];
+            auto colon = value.rfind(':');
+            if (colon != std::string::npos) {
+                options.receiveAddress = value.substr(0, colon);
+                value.erase(0, colon + 1);
+            }
+            int port = std::atoi(value.c_str());
+            if (port <= 0 || port > 65535) {
+                std::wcerr << L"Invalid port: " << argv[i] << L"\n";
+                return false;
+            }
+            options.receivePort = static_cast<uint16_t>(port);
+        }
+        else if (arg == "--player" && i + 1 < argc) {
+            SessionPlayer player;
+            if (!ParseSessionPlayer(argv[++i], player)) {
+                std::wcerr << L"Invalid player: " << argv[i] << L"\n";
+                return false;
+            }
+            options.session.players.push_back(player);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PrintSessionUsage(const char* program)
+{
+    std::wcout << L"Usage: " << program << L" [options]\n"
+        << L"  --session <file>  Session file to restore and save\n"
+        << L"  --new             Ignore the saved session and ask for the players\n"
+        << L"  --no-save         Do not save the session on exit\n"
+        << L"  --debug           Enable debug output (--no-debug to disable)\n"
+        << L"  --receive [<address>:]<port>\n"
+        << L"                    Receive players sent with JOYCON_OUTPUT=network and output them locally\n"
+        << L"                    (listens on 127.0.0.1 unless an address such as 0.0.0.0 is given)\n"
+        << L"  --player <spec>   Add a player without prompting (repeatable), e.g.\n"
+        << L"                    type=single,side=L,orientation=S,gyro=aim,pad=x360,devices=98b6e9000001\n"
+        << L"                    type: auto/single/dual/pro/gc, side: L/R/A, orientation: U/S, gyro: off/aim/flick, pad: ds4/x360\n";
+}
+
+bool LoadSession(const std::string& path, Session& session)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) return false;
+
+    Session loaded;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        SessionPlayer player;
+        if (key == "debug" && (value == "y" || value == "n")) loaded.debug = (value == "y");
+        else if (key == "player" && ParseSessionPlayer(value, player)) loaded.players.push_back(player);
+        else std::wcerr << L"Invalid value in " << std::wstring(path.begin(), path.end()) << L": "
+            << std::wstring(line.begin(), line.end()) << L"\n";
+    }
+    if (loaded.players.empty()) return false;
+
+    session = loaded;
+    return true;
+}
+
+void SaveSession(const std::string& path, const Session& session)
+{
+    if (session.players.empty()) return;
+
+    std::ofstream ofs(path, std::ios::trunc);
+    if (!ofs.is_open()) {
+        std::wcerr << L"Failed to write " << std::wstring(path.begin(), path.end()) << L".\n";
+        return;
+    }
+    ofs << "# Saved on exit. Restored on the next start (use --new to ask again).\n";
+    if (session.debug) ofs << "debug=" << (*session.debug ? "y" : "n") << '\n';
+    for (const auto& player : session.players)
+        ofs << "player=" << FormatSessionPlayer(player) << '\n';
+}
+
+Session ResolveSession(const SessionOptions& options)
+{
+    Session session;
+    if (!options.session.players.empty()) {
+        session.players = options.session.players;
+    }
+    else if (options.restore && LoadSession(options.path, session)) {
+        std::wcout << L"Restoring " << session.players.size() << L" player(s) from "
+            << std::wstring(options.path.begin(), options.path.end()) << L" (use --new to start over).\n";
+    }
+    // コマンドライン引数の指定を優先する
+    if (options.session.debug) session.debug = options.session.debug;
+    return session;
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "GyroStick.h"
+#include "JoyConDecoder.h"
+#include "OutputSink.h"
+
+/**
+ * @struct SessionPlayer
+ * @brief セッションに保存するプレイヤー1人分の設定
+ */
+struct SessionPlayer {
+    int controllerType = 0;                                      // コントローラーの種類（アプリのControllerTypeの値、0は自動判定）
+    std::optional<JoyConSide> side;                              // Joy-Conの左右（nulloptは自動判定）
+    JoyConOrientation orientation = JoyConOrientation::Upright;  // Joy-Conの持ち方
+    GyroStickMode gyroStickMode = GyroStickMode::Off;            // ジャイロ→右スティック変換のモード
+    PadType pad = PadType::DS4;                                  // 仮想ゲームパッドの種類
+    std::vector<uint64_t> addresses;                             // 割り当てたコントローラーのアドレス（0はスキャンで探す）
+};
+
+/**
+ * @struct Session
+ * @brief 起動時の質問への回答をまとめたセッション
+ */
+struct Session {
+    std::optional<bool> debug;           // デバッグ表示のON/OFF（nulloptは未指定）
+    std::vector<SessionPlayer> players;  // プレイヤーの設定（空なら起動時に質問する）
+};
+
+/**
+ * @struct SessionOptions
+ * @brief コマンドライン引数で指定されたセッションの設定
+ */
+struct SessionOptions {
+    std::string path;        // セッションファイルのパス（--session）
+    bool restore = true;     // 保存したセッションを復元する（--new で無効）
+    bool save = true;        // 終了時にセッションを保存する（--no-save で無効）
+    uint16_t receivePort = 0; // ネットワークの入力を受信して仮想パッドに出力するポート（--receive、0は受信しない）
+    std::string receiveAddress; // 受信を待ち受けるアドレス（--receive <address>:<port>、空ならローカルのみ）
+    Session session;         // --player / --debug / --no-debug で指定した内容
+};
+
+/**
+ * @brief プレイヤー設定の文字列を解析する
+ * @param spec "type=dual,gyro=aim,devices=98b6e9000001+98b6e9000002" の形式（カンマ区切りのkey=value）
+ * @param player 解析結果を格納するプレイヤー設定
+ * @return 解析に成功したらtrue
+ * @note type: auto/single/dual/pro/gc（または0～4）、side: L/R/A、orientation: U/S、gyro: off/aim/flick、pad: ds4/x360
+ */
+bool ParseSessionPlayer(const std::string& spec, SessionPlayer& player);
+
+/**
+ * @brief プレイヤー設定を ParseSessionPlayer で読める文字列にする
+ */
+std::string FormatSessionPlayer(const SessionPlayer& player);
+
+/**
+ * @brief コマンドライン引数を解析する
+ * @param options 解析結果を格納する設定（pathには既定のファイル名を入れておく）
+ * @return 引数が正しければtrue（falseなら PrintSessionUsage で使い方を表示して終了する）
+ */
+bool ParseSessionOptions(int argc, char* argv[], SessionOptions& options);
+
+/**
+ * @brief コマンドライン引数の使い方をコンソールに表示
+ */
+void PrintSessionUsage(const char* program);
+
+/**
+ * @brief セッションファイルを読み込む
+ * @return プレイヤーが1人以上含まれていればtrue
+ */
+bool LoadSession(const std::string& path, Session& session);
+
+/**
+ * @brief セッションファイルに保存する
+ */
+void SaveSession(const std::string& path, const Session& session);
+
+/**
+ * @brief コマンドライン引数とセッションファイルから、起動時に使うセッションを決める
+ * @param options コマンドライン引数で指定された設定
+ * @return 使うセッション（プレイヤーが空なら起動時に質問する）
+ * @note --player の指定があればセッションファイルより優先する
+ */
+Session ResolveSession(const SessionOptions& options);
@@ -0,0 +1,185 @@
+﻿#include "SharedState.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+// 書き込みの途中の状態を読み直す回数（書き込みは数十ナノ秒で終わるので、超えるのは書き込み側が止まったとき）
+constexpr int READ_RETRIES = 1000;
+
+uint64_t SharedStateNowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+
+/**
+ * @brief ファイルマッピングの名前（セッションごとの名前空間）
+ */
+static std::string mapping_name(const std::string& name)
+{
+    return "Local\\" + name;
+}
+
+std::unique_ptr<SharedStateRegion> SharedStateRegion::Create(const std::string& name)
+{
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(SharedStateLayout), mapping_name(name).c_str());
+    if (!mapping) {
+        std::wcerr << L"Failed to create shared memory (error " << GetLastError() << L").\n";
+        return nullptr;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedStateLayout));
+    if (!view) {
+        std::wcerr << L"Failed to map shared memory (error " << GetLastError() << L").\n";
+        CloseHandle(mapping);
+        return nullptr;
+    }
+    return std::unique_ptr<SharedStateRegion>(new SharedStateRegion(static_cast<SharedStateLayout*>(view), reinterpret_cast<uintptr_t>(mapping), name, true));
+}
+
+std::unique_ptr<SharedStateRegion> SharedStateRegion::Open(const std::string& name)
+{
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, mapping_name(name).c_str());
+    if (!mapping) return nullptr;
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(SharedStateLayout));
+    if (!view) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+    return std::unique_ptr<SharedStateRegion>(new SharedStateRegion(static_cast<SharedStateLayout*>(view), reinterpret_cast<uintptr_t>(mapping), name, false));
+}
+
+SharedStateRegion::~SharedStateRegion()
+{
+    // ファイルマッピングは全てのハンドルが閉じられると消える
+    UnmapViewOfFile(layout);
+    CloseHandle(reinterpret_cast<HANDLE>(handle));
+}
+
+#else
+
+/**
+ * @brief POSIXの共有メモリの名前
+ */
+static std::string mapping_name(const std::string& name)
+{
+    return "/" + name;
+}
+
+std::unique_ptr<SharedStateRegion> SharedStateRegion::Create(const std::string& name)
+{
+    std::string path = mapping_name(name);
+    int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::wcerr << L"Failed to create shared memory: " << std::strerror(errno) << L"\n";
+        return nullptr;
+    }
+    if (ftruncate(fd, sizeof(SharedStateLayout)) < 0) {
+        std::wcerr << L"Failed to resize shared memory: " << std::strerror(errno) << L"\n";
+        close(fd);
+        shm_unlink(path.c_str());
+        return nullptr;
+    }
+    void* view = mmap(nullptr, sizeof(SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // 割り当てた後は記述子が無くても残る
+    if (view == MAP_FAILED) {
+        std::wcerr << L"Failed to map shared memory: " << std::strerror(errno) << L"\n";
+        shm_unlink(path.c_str());
+        return nullptr;
+    }
+    return std::unique_ptr<SharedStateRegion>(new SharedStateRegion(static_cast<SharedStateLayout*>(view), 0, name, true));
+}
+
+std::unique_ptr<SharedStateRegion> SharedStateRegion::Open(const std::string& name)
+{
+    int fd = shm_open(mapping_name(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return nullptr;
+
+    // 書き込み側が大きさを決める前なら開かない
+    struct stat info {};
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(SharedStateLayout)) {
+        close(fd);
+        return nullptr;
+    }
+    void* view = mmap(nullptr, sizeof(SharedStateLayout), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return nullptr;
+    return std::unique_ptr<SharedStateRegion>(new SharedStateRegion(static_cast<SharedStateLayout*>(view), 0, name, false));
+}
+
+SharedStateRegion::~SharedStateRegion()
+{
+    munmap(layout, sizeof(SharedStateLayout));
+    // 名前を消しても、開いている読み取り側の割り当ては残る（activeが0なので開き直す）
+    if (owner) shm_unlink(mapping_name(name).c_str());
+}
+
+#endif
+
+SharedStateRegion::SharedStateRegion(SharedStateLayout* layout, uintptr_t handle, std::string name, bool owner)
+    : layout(layout), handle(handle), name(std::move(name)), owner(owner)
+{
+}
+
+std::unique_ptr<SharedStateReader> SharedStateReader::Open(const std::string& name)
+{
+    auto region = SharedStateRegion::Open(name);
+    if (!region) return nullptr;
+
+    // 初期化を終えていて、同じ配置のものだけを読む
+    const SharedStateHeader& header = region->Layout().header;
+    if (header.magic.load(std::memory_order_acquire) != SHARED_STATE_MAGIC || header.version != SHARED_STATE_VERSION ||
+        header.slotSize != sizeof(SharedStateSlot) || header.slotCount > SHARED_STATE_MAX_SLOTS)
+        return nullptr;
+    return std::unique_ptr<SharedStateReader>(new SharedStateReader(std::move(region)));
+}
+
+SharedStateReader::SharedStateReader(std::unique_ptr<SharedStateRegion> region)
+    : region(std::move(region))
+{
+}
+
+bool SharedStateReader::Read(size_t slot, SharedPlayerState& state) const
+{
+    if (slot >= SlotCount()) return false;
+    const SharedStateSlot& s = region->Layout().slots[slot];
+
+    uint64_t words[SHARED_STATE_WORDS];
+    for (int attempt = 0; attempt < READ_RETRIES; ++attempt) {
+        uint32_t before = s.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue; // 書き込み中
+
+        for (size_t i = 0; i < SHARED_STATE_WORDS; ++i)
+            words[i] = s.words[i].load(std::memory_order_relaxed);
+
+        // 状態を読み終えてから連番を読み直す
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) == before) {
+            std::memcpy(&state, words, sizeof(state));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SharedStateReader::Active() const
+{
+    return region->Layout().header.active.load(std::memory_order_acquire) != 0;
+}
+
+size_t SharedStateReader::SlotCount() const
+{
+    return region->Layout().header.slotCount;
+}
@@ -0,0 +1,157 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// 共有メモリに公開する状態の配置（書き込み側と読み取り側で共通）
+constexpr uint32_t SHARED_STATE_MAGIC = 0x4D53324A;    // "J2SM"
+constexpr uint32_t SHARED_STATE_VERSION = 1;
+constexpr size_t SHARED_STATE_MAX_SLOTS = 8;           // プレイヤーのスロットの数
+constexpr const char* SHARED_STATE_DEFAULT_NAME = "joycon2-state";
+
+/**
+ * @struct SharedPlayerState
+ * @brief 1人のプレイヤーの最新の入力（出力段を通す前のデコードした値）
+ *
+ * スティックはスティックフィルターとジャイロ→右スティックを通す前の値。
+ * モーションはJoy-Conの単位のまま（ジャイロは48000 = 360deg/s、加速度は4096 = 1G）。
+ */
+struct SharedPlayerState {
+    uint64_t address = 0;          // コントローラーのアドレス
+    uint64_t sampleTimeUs = 0;     // コントローラーの時計から求めたサンプル時刻（SharedStateNowUsと同じ時計、マイクロ秒）
+    uint64_t publishTimeUs = 0;    // 公開した時刻（同じ時計）
+    uint64_t samples = 0;          // 接続してから公開したサンプルの数（変化の検出に使う）
+    uint32_t buttons = 0;          // 下位16ビットがDS4のwButtons、その上の8ビットがbSpecial
+    uint16_t reportTimestamp = 0;  // DS4レポートのタイムスタンプ（5.33マイクロ秒単位）
+    uint8_t connected = 0;         // コントローラーが接続中なら1
+    uint8_t battery = 0;           // バッテリー残量（DS4の値）
+    uint8_t sticks[4] = {};        // 左X、左Y、右X、右Y（0-255、中央は128）
+    uint8_t triggers[2] = {};      // L2、R2（0-255）
+    int16_t gyro[3] = {};          // ジャイロ X、Y、Z
+    int16_t accel[3] = {};         // 加速度 X、Y、Z
+    uint8_t reserved[6] = {};
+};
+static_assert(sizeof(SharedPlayerState) == 64, "SharedPlayerState layout");
+
+constexpr size_t SHARED_STATE_WORDS = sizeof(SharedPlayerState) / sizeof(uint64_t);
+
+// プロセス間で使うので、アトミック変数はロックを使わずに実装されていること
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "shared state needs lock-free atomics");
+
+/**
+ * @struct SharedStateSlot
+ * @brief シーケンスロックで保護した1人分の状態
+ *
+ * 書き込み側は連番を奇数にしてから状態を書き、書き終えたら偶数に戻す。
+ * 読み取り側は連番が偶数で、読む前と後で変わっていなければ、壊れていない状態を読めている。
+ * 状態は8バイトずつのアトミック変数に置き、読み取りと書き込みが重なってもデータ競合にしない。
+ */
+struct alignas(64) SharedStateSlot {
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    std::atomic<uint64_t> words[SHARED_STATE_WORDS];
+};
+
+/**
+ * @struct SharedStateHeader
+ * @brief 共有メモリの先頭
+ */
+struct alignas(64) SharedStateHeader {
+    std::atomic<uint32_t> magic;  // 書き込み側が初期化を終えるとSHARED_STATE_MAGIC
+    uint32_t version;             // SHARED_STATE_VERSION
+    uint32_t slotCount;           // スロットの数
+    uint32_t slotSize;            // sizeof(SharedStateSlot)
+    std::atomic<uint32_t> active; // 書き込み側が公開している間は1（終了すると0になり、読み取り側は開き直す）
+};
+
+/**
+ * @struct SharedStateLayout
+ * @brief 共有メモリ全体の配置
+ */
+struct SharedStateLayout {
+    SharedStateHeader header;
+    SharedStateSlot slots[SHARED_STATE_MAX_SLOTS];
+};
+
+/**
+ * @class SharedStateRegion
+ * @brief 名前付きの共有メモリの割り当て（WindowsはファイルマッピングのLocal\、それ以外はPOSIXの共有メモリ）
+ */
+class SharedStateRegion {
+public:
+    /**
+     * @brief 書き込み用に作成する（既にあれば同じものを使う）
+     * @return 作成した領域（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<SharedStateRegion> Create(const std::string& name);
+
+    /**
+     * @brief 読み取り専用で開く
+     * @return 開いた領域（書き込み側が作成していない場合はnullptr）
+     */
+    static std::unique_ptr<SharedStateRegion> Open(const std::string& name);
+
+    ~SharedStateRegion();
+
+    SharedStateRegion(const SharedStateRegion&) = delete;
+    SharedStateRegion& operator=(const SharedStateRegion&) = delete;
+
+    SharedStateLayout& Layout() const { return *layout; }
+
+private:
+    SharedStateRegion(SharedStateLayout* layout, uintptr_t handle, std::string name, bool owner);
+
+    SharedStateLayout* layout;
+    uintptr_t handle; // WindowsのファイルマッピングのHANDLE（それ以外は使わない）
+    std::string name;
+    bool owner;       // 作成した側は閉じるときに名前を削除する
+};
+
+/**
+ * @class SharedStateReader
+ * @brief 共有メモリからプレイヤーの最新の状態を読み取る（読み取り側のライブラリ）
+ *
+ * Readはシステムコールを使わず、書き込み側を待たせることもない。いくつのプロセスからでも読める。
+ */
+class SharedStateReader {
+public:
+    /**
+     * @brief 書き込み側が公開している共有メモリを開く
+     * @param name 共有メモリの名前（書き込み側の JOYCON_SHARED_STATE と同じもの）
+     * @return 開いた読み取り側（公開されていないか形式が違う場合はnullptr）
+     */
+    static std::unique_ptr<SharedStateReader> Open(const std::string& name = SHARED_STATE_DEFAULT_NAME);
+
+    /**
+     * @brief スロットの最新の状態を読み取る
+     * @param slot スロット（プレイヤー番号 - 1）
+     * @param state 読み取った状態
+     * @return 読み取れた場合はtrue（書き込み側が書き込みの途中で止まっている場合などはfalse）
+     * @note 接続していないスロットも読めるので、state.connectedを確認すること
+     */
+    bool Read(size_t slot, SharedPlayerState& state) const;
+
+    /**
+     * @brief 書き込み側がまだ公開しているか（falseになったら開き直す）
+     */
+    bool Active() const;
+
+    /**
+     * @brief スロットの数
+     */
+    size_t SlotCount() const;
+
+private:
+    explicit SharedStateReader(std::unique_ptr<SharedStateRegion> region);
+
+    std::unique_ptr<SharedStateRegion> region;
+};
+
+/**
+ * @brief 公開する時刻の時計（steady_clockのマイクロ秒。どのプロセスでも同じ時計になる）
+ */
+uint64_t SharedStateNowUs();
@@ -0,0 +1,118 @@
+﻿#include "SharedStatePublisher.h"
+
+#include <cstdlib>
+#include <cstring>
+
+bool SelectSharedStateConfig(SharedStateConfig& config)
+{
+    const char* value = std::getenv("JOYCON_SHARED_STATE");
+    if (!value || std::string(value).empty() || std::string(value) == "0") return false;
+    if (std::string(value) != "1") config.name = value;
+    return true;
+}
+
+std::unique_ptr<SharedStatePublisher> SharedStatePublisher::Create(const SharedStateConfig& config)
+{
+    auto region = SharedStateRegion::Create(config.name);
+    if (!region) return nullptr;
+
+    // 前回の実行が残した領域を再利用することもあるので、読み取り側を止めてから初期化し直す
+    SharedStateLayout& layout = region->Layout();
+    layout.header.magic.store(0, std::memory_order_relaxed);
+    layout.header.active.store(0, std::memory_order_relaxed);
+    layout.header.version = SHARED_STATE_VERSION;
+    layout.header.slotCount = static_cast<uint32_t>(SHARED_STATE_MAX_SLOTS);
+    layout.header.slotSize = sizeof(SharedStateSlot);
+    for (SharedStateSlot& slot : layout.slots) {
+        slot.sequence.store(0, std::memory_order_relaxed);
+        for (auto& word : slot.words)
+            word.store(0, std::memory_order_relaxed);
+    }
+    layout.header.active.store(1, std::memory_order_relaxed);
+    layout.header.magic.store(SHARED_STATE_MAGIC, std::memory_order_release);
+
+    return std::unique_ptr<SharedStatePublisher>(new SharedStatePublisher(std::move(region)));
+}
+
+SharedStatePublisher::SharedStatePublisher(std::unique_ptr<SharedStateRegion> region)
+    : region(std::move(region))
+{
+}
+
+SharedStatePublisher::~SharedStatePublisher()
+{
+    // 開いたままの読み取り側に、公開を終えたことを知らせる
+    region->Layout().header.active.store(0, std::memory_order_release);
+}
+
+void SharedStatePublisher::Write(uint8_t slot, const SharedPlayerState& state)
+{
+    SharedStateSlot& s = region->Layout().slots[slot];
+    uint64_t words[SHARED_STATE_WORDS];
+    std::memcpy(words, &state, sizeof(words));
+
+    // 連番を奇数にしてから書き、書き終えたら偶数にする（同じスロットの書き込みはミューテックスで直列なので、比較交換は要らない）
+    uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+    s.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < SHARED_STATE_WORDS; ++i)
+        s.words[i].store(words[i], std::memory_order_relaxed);
+    s.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void SharedStatePublisher::Connect(uint8_t slot, uint64_t address)
+{
+    if (slot >= SHARED_STATE_MAX_SLOTS) return;
+
+    std::lock_guard<std::mutex> lock(mutexes[slot]);
+    SharedPlayerState& state = states[slot];
+    state = SharedPlayerState();
+    state.address = address;
+    state.connected = 1;
+    state.publishTimeUs = SharedStateNowUs();
+    Write(slot, state);
+}
+
+void SharedStatePublisher::Disconnect(uint8_t slot, uint64_t address)
+{
+    if (slot >= SHARED_STATE_MAX_SLOTS) return;
+
+    std::lock_guard<std::mutex> lock(mutexes[slot]);
+    SharedPlayerState& state = states[slot];
+    if (!state.connected || state.address != address) return;
+    state.connected = 0;
+    state.publishTimeUs = SharedStateNowUs();
+    Write(slot, state);
+}
+
+void SharedStatePublisher::Publish(uint8_t slot, uint64_t address, const DS4_REPORT_EX& report, uint64_t sampleTimeUs)
+{
+    if (slot >= SHARED_STATE_MAX_SLOTS) return;
+
+    std::lock_guard<std::mutex> lock(mutexes[slot]);
+    SharedPlayerState& state = states[slot];
+    // 入れ替えの間は古いプレイヤーの入力スレッドがまだ動いているので、新しいコントローラーの状態を上書きしない
+    if (!state.connected || state.address != address) return;
+
+    const auto& r = report.Report;
+    state.sampleTimeUs = sampleTimeUs;
+    state.publishTimeUs = SharedStateNowUs();
+    state.samples++;
+    state.buttons = r.wButtons | (static_cast<uint32_t>(r.bSpecial) << 16);
+    state.reportTimestamp = r.wTimestamp;
+    state.battery = r.bBatteryLvl;
+    state.sticks[0] = r.bThumbLX;
+    state.sticks[1] = r.bThumbLY;
+    state.sticks[2] = r.bThumbRX;
+    state.sticks[3] = r.bThumbRY;
+    state.triggers[0] = r.bTriggerL;
+    state.triggers[1] = r.bTriggerR;
+    state.gyro[0] = r.wGyroX;
+    state.gyro[1] = r.wGyroY;
+    state.gyro[2] = r.wGyroZ;
+    state.accel[0] = r.wAccelX;
+    state.accel[1] = r.wAccelY;
+    state.accel[2] = r.wAccelZ;
+    Write(slot, state);
+    published.fetch_add(1, std::memory_order_relaxed);
+}
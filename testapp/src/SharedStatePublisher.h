@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "OutputSink.h"
+#include "SharedState.h"
+
+/**
+ * @struct SharedStateConfig
+ * @brief 共有メモリへの公開の設定
+ */
+struct SharedStateConfig {
+    std::string name = SHARED_STATE_DEFAULT_NAME; // 共有メモリの名前
+};
+
+/**
+ * @brief 環境変数から共有メモリへの公開の設定を選ぶ
+ * @param config 設定を格納する
+ * @return 有効にする場合はtrue
+ * @note JOYCON_SHARED_STATE=1 で既定の名前、JOYCON_SHARED_STATE=<名前> でその名前を使う（未設定か0なら無効）
+ */
+bool SelectSharedStateConfig(SharedStateConfig& config);
+
+/**
+ * @class SharedStatePublisher
+ * @brief 各プレイヤーのデコードした入力を共有メモリに公開する（オーバーレイや入力表示、解析ツール向け）
+ *
+ * スロットごとのシーケンスロックで書くので、読み取り側（SharedStateReader）がいくつあっても
+ * 書き込み側は待たない。同じスロットに書くのはプレイヤーの入れ替えの間だけ重なるので、
+ * スロットごとのミューテックス（このプロセスの中だけ）で直列にする。
+ */
+class SharedStatePublisher {
+public:
+    /**
+     * @brief 共有メモリを作成し、全スロットを未接続にして公開を開始する
+     * @return 作成した公開側（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<SharedStatePublisher> Create(const SharedStateConfig& config = SharedStateConfig());
+
+    ~SharedStatePublisher();
+
+    SharedStatePublisher(const SharedStatePublisher&) = delete;
+    SharedStatePublisher& operator=(const SharedStatePublisher&) = delete;
+
+    /**
+     * @brief スロットにコントローラーを接続する
+     * @param slot スロット（0からSHARED_STATE_MAX_SLOTS - 1）
+     * @param address コントローラーのアドレス
+     */
+    void Connect(uint8_t slot, uint64_t address);
+
+    /**
+     * @brief スロットのコントローラーを切断する
+     * @param address 切断するコントローラーのアドレス（入れ替えで既に別のコントローラーが接続していれば何もしない）
+     */
+    void Disconnect(uint8_t slot, uint64_t address);
+
+    /**
+     * @brief スロットの最新の入力を公開する（入力スレッドから呼ばれる）
+     * @param slot スロット
+     * @param address 入力したコントローラーのアドレス（入れ替えで既に別のコントローラーが接続していれば何もしない）
+     * @param report 出力段を通す前のデコードしたDS4レポート
+     * @param sampleTimeUs サンプル時刻（SharedStateNowUsと同じ時計、マイクロ秒）
+     */
+    void Publish(uint8_t slot, uint64_t address, const DS4_REPORT_EX& report, uint64_t sampleTimeUs);
+
+    /**
+     * @brief 公開したサンプルの数
+     */
+    uint64_t Published() const { return published.load(std::memory_order_relaxed); }
+
+private:
+    explicit SharedStatePublisher(std::unique_ptr<SharedStateRegion> region);
+
+    void Write(uint8_t slot, const SharedPlayerState& state);
+
+    std::unique_ptr<SharedStateRegion> region;
+    std::array<std::mutex, SHARED_STATE_MAX_SLOTS> mutexes;
+    std::array<SharedPlayerState, SHARED_STATE_MAX_SLOTS> states{}; // 最後に書いた状態（書き込み側の写し）
+    std::atomic<uint64_t> published{ 0 };
+};
@@ -0,0 +1,212 @@
+﻿#include "StickFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+constexpr float PI = 3.14159265358979f;
+
+void LoadStickFilterConfig(StickFilterConfig& config, int player)
+{
+    std::ifstream ifs("stick_filter.txt");
+    if (!ifs.is_open()) return;
+
+    const std::string prefix = "player" + std::to_string(player) + ".";
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+
+        // プレイヤー番号付きのキーは該当するプレイヤーのみ
+        if (key.rfind("player", 0) == 0) {
+            if (key.rfind(prefix, 0) != 0) continue;
+            key = key.substr(prefix.size());
+        }
+
+        try {
+            if (key == "type") {
+                if (value == "one_euro")    config.type = StickFilterType::OneEuro;
+                else if (value == "kalman") config.type = StickFilterType::Kalman;
+                else                        config.type = StickFilterType::None;
+            }
+            else if (key == "min_cutoff")        config.minCutoff = std::stof(value);
+            else if (key == "beta")              config.beta = std::stof(value);
+            else if (key == "d_cutoff")          config.derivativeCutoff = std::stof(value);
+            else if (key == "process_noise")     config.processNoise = std::stof(value);
+            else if (key == "measurement_noise") config.measurementNoise = std::stof(value);
+        }
+        catch (const std::exception&) {
+            std::wcerr << L"Invalid value in stick_filter.txt: " << std::wstring(line.begin(), line.end()) << L"\n";
+        }
+    }
+}
+
+const wchar_t* StickFilterName(StickFilterType type)
+{
+    switch (type) {
+    case StickFilterType::OneEuro: return L"One Euro";
+    case StickFilterType::Kalman:  return L"Kalman";
+    default:                       return L"None";
+    }
+}
+
+/**
+ * @brief 1次ローパスフィルターの係数
+ * @param cutoff カットオフ周波数(Hz)
+ * @param dt サンプル間隔（秒）
+ */
+static float lowpass_alpha(float cutoff, float dt)
+{
+    float tau = 1.0f / (2.0f * PI * cutoff);
+    return 1.0f / (1.0f + tau / dt);
+}
+
+StickFilter::StickFilter(const StickFilterConfig& config)
+    : config(config)
+{
+}
+
+void StickFilter::Apply(DS4_REPORT_EX& report, float dt)
+{
+    if (config.type == StickFilterType::None) return;
+
+    // スティック値を -1.0 to 1.0 に正規化
+    uint8_t* raw[AXES] = {
+        &report.Report.bThumbLX, &report.Report.bThumbLY,
+        &report.Report.bThumbRX, &report.Report.bThumbRY
+    };
+    Axes axes;
+    for (size_t i = 0; i < AXES; ++i) axes[i] = (*raw[i] - 128) / 127.0f;
+
+    Process(axes, dt);
+
+    for (size_t i = 0; i < AXES; ++i) {
+        float v = std::clamp(axes[i], -1.0f, 1.0f);
+        *raw[i] = static_cast<uint8_t>(std::lround(v * 127 + 128));
+    }
+}
+
+void StickFilter::Process(Axes& axes, float dt)
+{
+    if (config.type == StickFilterType::None) return;
+
+    if (!initialized) {
+        // 最初の値で状態を初期化（立ち上がりの遅れを避ける）
+        initialized = true;
+        prevValue = axes;
+        prevDerivative.fill(0.0f);
+        position = axes;
+        velocity.fill(0.0f);
+        p00.fill(config.measurementNoise);
+        p01.fill(0.0f);
+        p11.fill(0.0f);
+        return;
+    }
+    if (dt <= 0.0f) {
+        // 同時刻の再出力は前回の値を使う
+        axes = config.type == StickFilterType::Kalman ? position : prevValue;
+        return;
+    }
+
+    if (config.type == StickFilterType::OneEuro) ProcessOneEuro(axes, dt);
+    else ProcessKalman(axes, dt);
+}
+
+void StickFilter::ProcessOneEuro(Axes& axes, float dt)
+{
+    const float derivativeAlpha = lowpass_alpha(config.derivativeCutoff, dt);
+    for (size_t i = 0; i < AXES; ++i) {
+        // 速度を推定し、速いほどカットオフ周波数を上げて遅れを減らす
+        float derivative = (axes[i] - prevValue[i]) / dt;
+        prevDerivative[i] += derivativeAlpha * (derivative - prevDerivative[i]);
+
+        float cutoff = config.minCutoff + config.beta * std::abs(prevDerivative[i]);
+        prevValue[i] += lowpass_alpha(cutoff, dt) * (axes[i] - prevValue[i]);
+        axes[i] = prevValue[i];
+    }
+}
+
+void StickFilter::ProcessKalman(Axes& axes, float dt)
+{
+    // 等速度モデル: 加速度を白色雑音とみなしたプロセス雑音
+    const float dt2 = dt * dt;
+    const float q00 = config.processNoise * dt2 * dt2 * 0.25f;
+    const float q01 = config.processNoise * dt2 * dt * 0.5f;
+    const float q11 = config.processNoise * dt2;
+    const float r = config.measurementNoise;
+
+    for (size_t i = 0; i < AXES; ++i) {
+        // 予測
+        position[i] += velocity[i] * dt;
+        p00[i] += dt * (2.0f * p01[i] + dt * p11[i]) + q00;
+        p01[i] += dt * p11[i] + q01;
+        p11[i] += q11;
+
+        // 観測による更新
+        float gain0 = p00[i] / (p00[i] + r);
+        float gain1 = p01[i] / (p00[i] + r);
+        float residual = axes[i] - position[i];
+        position[i] += gain0 * residual;
+        velocity[i] += gain1 * residual;
+
+        p11[i] -= gain1 * p01[i];
+        p01[i] *= 1.0f - gain0;
+        p00[i] *= 1.0f - gain0;
+
+        axes[i] = position[i];
+    }
+}
+
+float MeasureStickFilterDelay(const StickFilterConfig& config, float rate, float speed)
+{
+    if (config.type == StickFilterType::None || rate <= 0.0f || speed <= 0.0f) return 0.0f;
+
+    // 一定速度で変化する入力を与え、十分に収束した後の出力の遅れを測る
+    StickFilter filter(config);
+    const float dt = 1.0f / rate;
+    const float start = -0.9f;
+    const float duration = 1.6f / speed; // -0.9 から 0.7 まで
+    StickFilter::Axes axes{};
+
+    float input = start;
+    for (float t = 0.0f; t < duration; t += dt) {
+        input = start + speed * t;
+        axes.fill(input);
+        filter.Process(axes, dt);
+    }
+    return std::max(0.0f, (input - axes[0]) / speed);
+}
+
+float MeasureStickFilterJitter(const StickFilterConfig& config, float rate, float noise)
+{
+    if (config.type == StickFilterType::None || rate <= 0.0f || noise <= 0.0f) return 1.0f;
+
+    // 一定の位置に再現可能な一様ノイズ（線形合同法）を加え、収束した後の入出力の揺れを比べる
+    StickFilter filter(config);
+    const float dt = 1.0f / rate;
+    const float center = 0.2f;
+    const int warmup = static_cast<int>(rate);
+    const int samples = static_cast<int>(rate * 2.0f);
+    uint32_t seed = 12345;
+    double inputSquares = 0.0;
+    double outputSquares = 0.0;
+    StickFilter::Axes axes{};
+
+    for (int i = 0; i < warmup + samples; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        float offset = noise * (static_cast<float>(seed >> 8) / 8388608.0f - 1.0f);
+        axes.fill(center + offset);
+        filter.Process(axes, dt);
+        if (i < warmup) continue;
+        inputSquares += static_cast<double>(offset) * offset;
+        outputSquares += static_cast<double>(axes[0] - center) * (axes[0] - center);
+    }
+    return static_cast<float>(std::sqrt(outputSquares / inputSquares));
+}
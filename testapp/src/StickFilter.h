@@ -0,0 +1,115 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "JoyConDecoder.h"
+
+/**
+ * @enum StickFilterType
+ * @brief スティック出力に適用するフィルターの種類
+ */
+enum class StickFilterType {
+    None,    // フィルターなし
+    OneEuro, // One Euroフィルター（速度に応じてカットオフ周波数を変える適応ローパス）
+    Kalman   // 等速度モデルのカルマンフィルター
+};
+
+/**
+ * @struct StickFilterConfig
+ * @brief スティックフィルターの設定（値はスティックを -1.0 to 1.0 に正規化した単位）
+ */
+struct StickFilterConfig {
+    StickFilterType type = StickFilterType::None;
+
+    // One Euroフィルター
+    float minCutoff = 2.0f;     // 静止時のカットオフ周波数(Hz)。小さいほど揺れが減るが遅れる
+    float beta = 0.5f;          // 速度に対するカットオフ周波数の増加量。大きいほど速い動きの遅れが減る
+    float derivativeCutoff = 1.0f; // 速度推定のカットオフ周波数(Hz)
+
+    // カルマンフィルター
+    float processNoise = 1000.0f;      // 加速度のばらつき（大きいほど追従が速い）
+    float measurementNoise = 0.0001f;  // 観測値の分散（大きいほど平滑化が強い）
+};
+
+/**
+ * @brief stick_filter.txt からスティックフィルターの設定を読み込む
+ * @param config 読み込んだ値で上書きする設定
+ * @param player プレイヤー番号（1から）
+ * @note 形式は1行ごとに "キー=値"（例: type=one_euro）。
+ *       "player2.beta=1.0" のようにプレイヤー番号を付けたキーはそのプレイヤーにのみ適用される
+ */
+void LoadStickFilterConfig(StickFilterConfig& config, int player);
+
+/**
+ * @brief フィルターの種類の表示名
+ */
+const wchar_t* StickFilterName(StickFilterType type);
+
+/**
+ * @class StickFilter
+ * @brief 左右スティックの4軸をまとめて処理するフィルター段
+ *
+ * 状態は軸ごとの固定長配列で保持し、4軸を同じループで処理する（動的確保なし）。
+ */
+class StickFilter {
+public:
+    static constexpr size_t AXES = 4; // LX, LY, RX, RY
+    using Axes = std::array<float, AXES>;
+
+    explicit StickFilter(const StickFilterConfig& config = {});
+
+    /**
+     * @brief レポートのスティック値にフィルターを適用
+     * @param report 更新するレポート
+     * @param dt 前回の適用からの経過時間（秒）
+     */
+    void Apply(DS4_REPORT_EX& report, float dt);
+
+    /**
+     * @brief 正規化した4軸の値にフィルターを適用
+     * @param axes 入力値（フィルター後の値で上書きされる）
+     * @param dt 前回の適用からの経過時間（秒）
+     */
+    void Process(Axes& axes, float dt);
+
+    void Reset() { initialized = false; }
+
+    const StickFilterConfig& Config() const { return config; }
+
+private:
+    void ProcessOneEuro(Axes& axes, float dt);
+    void ProcessKalman(Axes& axes, float dt);
+
+    StickFilterConfig config;
+    bool initialized = false;
+
+    // One Euro: 前回の出力と速度の推定値
+    Axes prevValue{};
+    Axes prevDerivative{};
+
+    // カルマン: 位置・速度と共分散行列（対称なので3要素）
+    Axes position{};
+    Axes velocity{};
+    Axes p00{};
+    Axes p01{};
+    Axes p11{};
+};
+
+/**
+ * @brief 一定速度の入力に対するフィルターの遅れ（群遅延）を測定する
+ * @param config 測定するフィルターの設定
+ * @param rate フィルターを適用するレート(Hz)
+ * @param speed 入力の変化速度（正規化単位/秒）
+ * @return 入力に対する出力の遅れ（秒）
+ */
+float MeasureStickFilterDelay(const StickFilterConfig& config, float rate, float speed = 0.5f);
+
+/**
+ * @brief 静止したスティックのノイズがフィルター後にどれだけ残るかを測定する
+ * @param config 測定するフィルターの設定
+ * @param rate フィルターを適用するレート(Hz)
+ * @param noise 入力に加える一様ノイズの振幅（正規化単位）
+ * @return 出力に残る揺れの実効値と入力のノイズの実効値の比（1ならそのまま、0なら完全に除去）
+ */
+float MeasureStickFilterJitter(const StickFilterConfig& config, float rate, float noise = 0.01f);
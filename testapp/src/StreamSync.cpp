@@ -0,0 +1,59 @@
+﻿#include "StreamSync.h"
+
+#include <algorithm>
+#include <cmath>
+
+// 左右の時刻差の平均に使う平滑化係数
+constexpr double SKEW_SMOOTHING = 0.02;
+
+DualStreamSync::DualStreamSync(const ImuUpsamplerConfig& config)
+{
+    left.upsampler = ImuUpsampler(config);
+    right.upsampler = ImuUpsampler(config);
+}
+
+void DualStreamSync::Push(JoyConSide side, const std::vector<uint8_t>& buffer, double arrival)
+{
+    if (buffer.size() < 0x3C) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Stream& stream = Get(side);
+    stream.time = stream.clock.ToHostTime(DecodeTimestamp(buffer), arrival);
+    stream.upsampler.Push(stream.time, DecodeMotion(buffer));
+    stream.latest = buffer;
+    stream.valid = true;
+}
+
+bool DualStreamSync::Merge(std::vector<uint8_t>& leftOut, std::vector<uint8_t>& rightOut, double& time)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!left.valid || !right.valid) return false;
+
+    // 新しい方のサンプル時刻を基準にする（古い方は外挿、上限は補間器の設定に従う）
+    time = std::max(left.time, right.time);
+
+    double skew = std::abs(left.time - right.time);
+    meanSkew = merged == 0 ? skew : meanSkew + (skew - meanSkew) * SKEW_SMOOTHING;
+    maxSkew = std::max(maxSkew, skew);
+    ++merged;
+
+    leftOut = left.latest;
+    rightOut = right.latest;
+
+    MotionData motion;
+    if (left.upsampler.Sample(time, motion)) EncodeMotion(leftOut, motion);
+    if (right.upsampler.Sample(time, motion)) EncodeMotion(rightOut, motion);
+    return true;
+}
+
+StreamSyncStats DualStreamSync::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    StreamSyncStats stats;
+    stats.meanSkew = meanSkew;
+    stats.maxSkew = maxSkew;
+    stats.merged = merged;
+    stats.left = left.clock.Stats();
+    stats.right = right.clock.Stats();
+    return stats;
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "JoyConDecoder.h"
+#include "DeviceClock.h"
+#include "ImuUpsampler.h"
+
+/**
+ * @struct StreamSyncStats
+ * @brief 左右のストリームの同期状態
+ */
+struct StreamSyncStats {
+    double meanSkew = 0.0;  // 左右の最新サンプル時刻の差の平均（秒）
+    double maxSkew = 0.0;   // 左右の最新サンプル時刻の差の最大値（秒）
+    uint64_t merged = 0;    // 合成したレポート数
+    DeviceClockStats left;
+    DeviceClockStats right;
+};
+
+/**
+ * @class DualStreamSync
+ * @brief 左右のJoy-Conの入力を共通の時間軸に揃えて合成する
+ *
+ * 左右それぞれのタイムスタンプをDeviceClockでホスト時刻に変換し、
+ * 新しい方のサンプル時刻に合わせて他方のIMUを補間・外挿する。
+ * ボタンとスティックは遅延を増やさないよう常に最新の値を使う。
+ */
+class DualStreamSync {
+public:
+    explicit DualStreamSync(const ImuUpsamplerConfig& config = {});
+
+    /**
+     * @brief 片側の入力レポートを追加
+     * @param side 入力元のJoy-Con
+     * @param buffer Joy-Conからの生データ
+     * @param arrival 受信したホスト時刻（秒）
+     */
+    void Push(JoyConSide side, const std::vector<uint8_t>& buffer, double arrival);
+
+    /**
+     * @brief 左右のレポートを同じ時刻に揃えて取得
+     * @param left 揃えた左Joy-Conのデータを格納する参照
+     * @param right 揃えた右Joy-Conのデータを格納する参照
+     * @param time 揃えたサンプルのホスト時刻（秒）を格納する参照
+     * @return 両方のレポートがまだ揃っていない場合はfalse
+     * @note 出力先のバッファは容量を再利用するので、呼び出し側で使い回せば確保は最初の1回だけ
+     */
+    bool Merge(std::vector<uint8_t>& left, std::vector<uint8_t>& right, double& time);
+
+    StreamSyncStats Stats() const;
+
+private:
+    struct Stream {
+        DeviceClock clock;
+        ImuUpsampler upsampler;
+        std::vector<uint8_t> latest;
+        double time = 0.0;
+        bool valid = false;
+    };
+
+    Stream& Get(JoyConSide side) { return side == JoyConSide::Left ? left : right; }
+
+    mutable std::mutex mutex;
+    Stream left;
+    Stream right;
+
+    double meanSkew = 0.0;
+    double maxSkew = 0.0;
+    uint64_t merged = 0;
+};
@@ -0,0 +1,84 @@
+﻿#include "Transport.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "LoopbackTransport.h"
+#ifdef _WIN32
+#include "WinRtTransport.h"
+#elif defined(HAVE_BLUEZ)
+#include "BlueZTransport.h"
+#endif
+
+bool IsJoyConAdvertisement(const Advertisement& adv)
+{
+    if (adv.companyId != JOYCON_MANUFACTURER_ID) return false;
+    return adv.manufacturerData.size() >= std::size(JOYCON_MANUFACTURER_PREFIX) &&
+        std::equal(std::begin(JOYCON_MANUFACTURER_PREFIX), std::end(JOYCON_MANUFACTURER_PREFIX), adv.manufacturerData.begin());
+}
+
+ControllerModel ParseControllerModel(std::span<const uint8_t> manufacturerData)
+{
+    if (manufacturerData.size() < PRODUCT_ID_OFFSET + 2) return ControllerModel::Unknown;
+    if (!std::equal(std::begin(JOYCON_MANUFACTURER_PREFIX), std::end(JOYCON_MANUFACTURER_PREFIX), manufacturerData.begin()))
+        return ControllerModel::Unknown;
+
+    uint16_t productId = static_cast<uint16_t>(manufacturerData[PRODUCT_ID_OFFSET] |
+        (manufacturerData[PRODUCT_ID_OFFSET + 1] << 8));
+    switch (productId) {
+    case JOYCON_LEFT_PRODUCT_ID:    return ControllerModel::JoyConLeft;
+    case JOYCON_RIGHT_PRODUCT_ID:   return ControllerModel::JoyConRight;
+    case PRO_CONTROLLER_PRODUCT_ID: return ControllerModel::ProController;
+    case NSO_GC_PRODUCT_ID:         return ControllerModel::NSOGCController;
+    default:                        return ControllerModel::Unknown;
+    }
+}
+
+ControllerModel FingerprintControllerModel(std::span<const uint8_t> report)
+{
+    if (report.size() < 0x3C) return ControllerModel::Unknown;
+
+    // スティックのデータ（各3バイト）が全て0なら、そのスティックは無い
+    auto present = [&](size_t offset) { return (report[offset] | report[offset + 1] | report[offset + 2]) != 0; };
+    bool leftStick = present(10);
+    bool rightStick = present(13);
+
+    if (leftStick && rightStick) return ControllerModel::ProController;
+    if (leftStick) return ControllerModel::JoyConLeft;
+    if (rightStick) return ControllerModel::JoyConRight;
+    return ControllerModel::Unknown;
+}
+
+const wchar_t* ControllerModelName(ControllerModel model)
+{
+    switch (model) {
+    case ControllerModel::JoyConLeft:      return L"Joy-Con (L)";
+    case ControllerModel::JoyConRight:     return L"Joy-Con (R)";
+    case ControllerModel::ProController:   return L"Pro Controller";
+    case ControllerModel::NSOGCController: return L"NSO GC Controller";
+    default:                               return L"Unknown";
+    }
+}
+
+std::unique_ptr<Transport> CreateTransport()
+{
+    const char* name = std::getenv("JOYCON_TRANSPORT");
+    if (name && std::string(name) == "loopback") {
+        std::wcout << L"Using loopback transport.\n";
+        return CreateLoopbackTransportFromEnvironment();
+    }
+
+#ifdef _WIN32
+    return std::make_unique<WinRtTransport>();
+#elif defined(HAVE_BLUEZ) // Linuxでlibsystemdがあるときだけビルドする
+    auto bluez = std::make_unique<BlueZTransport>();
+    if (bluez->IsAvailable()) return bluez;
+    std::wcerr << L"BlueZ is not available. Using loopback transport.\n";
+    return CreateLoopbackTransportFromEnvironment();
+#else
+    std::wcerr << L"No Bluetooth transport available on this platform. Using loopback transport.\n";
+    return CreateLoopbackTransportFromEnvironment();
+#endif
+}
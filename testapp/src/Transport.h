@@ -0,0 +1,152 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+// Joy-ConのBluetooth Manufacturer ID (Nintendo)
+constexpr uint16_t JOYCON_MANUFACTURER_ID = 1363;
+// Joy-ConのAdvertisementパケットに含まれる製造元データのプレフィックス
+constexpr uint8_t JOYCON_MANUFACTURER_PREFIX[] = { 0x01, 0x00, 0x03, 0x7E };
+// 製造元データ内のプロダクトIDの位置（プレフィックスの後、ベンダーID 0x057E の上位バイトに続くリトルエンディアン）
+constexpr size_t PRODUCT_ID_OFFSET = 5;
+// Switch 2世代のコントローラーのプロダクトID
+constexpr uint16_t JOYCON_RIGHT_PRODUCT_ID = 0x2066;
+constexpr uint16_t JOYCON_LEFT_PRODUCT_ID = 0x2067;
+constexpr uint16_t PRO_CONTROLLER_PRODUCT_ID = 0x2069;
+constexpr uint16_t NSO_GC_PRODUCT_ID = 0x2073;
+// Joy-ConのGATTサービスで入力レポートを受け取るためのキャラクタリスティックUUID
+constexpr const char* INPUT_REPORT_UUID = "ab7de9be-89fe-49ad-828f-118f09df7fd2";
+// Joy-Conにコマンドを送信するためのキャラクタリスティックUUID
+constexpr const char* WRITE_COMMAND_UUID = "649d4ac9-8eb7-4e6c-af44-1ea54fe5f005";
+
+/**
+ * @enum ControllerModel
+ * @brief 接続したデバイスのハードウェアの種類
+ */
+enum class ControllerModel : uint8_t {
+    Unknown = 0,
+    JoyConLeft = 1,
+    JoyConRight = 2,
+    ProController = 3,
+    NSOGCController = 4
+};
+
+/**
+ * @struct Advertisement
+ * @brief スキャンで受信したアドバタイズの製造元データ（1セクション分）
+ * @note manufacturerDataはコールバック中のみ有効な借用データ
+ */
+struct Advertisement {
+    uint64_t address = 0;
+    uint16_t companyId = 0;
+    std::span<const uint8_t> manufacturerData;
+    int16_t rssi = 0;
+};
+
+/**
+ * @brief アドバタイズがJoy-Con（Switch 2世代のコントローラー）のものか判定
+ */
+bool IsJoyConAdvertisement(const Advertisement& adv);
+
+/**
+ * @brief 製造元データからコントローラーの種類を判定する（メモリ確保なし）
+ * @param manufacturerData アドバタイズの製造元データ（Nintendoの1セクション分）
+ * @return 判定できない場合はControllerModel::Unknown
+ */
+ControllerModel ParseControllerModel(std::span<const uint8_t> manufacturerData);
+
+/**
+ * @brief 入力レポートの内容からコントローラーの種類を推定する（アドバタイズで判定できない場合用）
+ * @param report 入力レポート
+ * @return 推定できない場合はControllerModel::Unknown
+ * @note 使われていないスティックのデータは0になることを利用する。両方のスティックがある場合は
+ *       ProコントローラーとGCコントローラーを区別できないのでProControllerを返す
+ */
+ControllerModel FingerprintControllerModel(std::span<const uint8_t> report);
+
+/**
+ * @brief コントローラーの種類の表示名
+ */
+const wchar_t* ControllerModelName(ControllerModel model);
+
+/**
+ * @class TransportDevice
+ * @brief 接続済みのコントローラー1台との通信
+ */
+class TransportDevice {
+public:
+    /**
+     * @brief 入力レポートを受け取る関数
+     * @param data 受信したデータ（コールバック中のみ有効な借用データ）
+     */
+    using NotifyHandler = std::function<void(std::span<const uint8_t> data)>;
+
+    virtual ~TransportDevice() = default;
+
+    /**
+     * @brief Bluetoothアドレス（キャッシュやバイアス推定のキーに使う）
+     */
+    virtual uint64_t Address() const = 0;
+
+    /**
+     * @brief 入力レポートの通知を有効化し、受信ごとにhandlerを呼び出す
+     * @return 通知の有効化に成功したらtrue
+     */
+    virtual bool Subscribe(NotifyHandler handler) = 0;
+
+    /**
+     * @brief コマンド用キャラクタリスティックへ書き込む（応答なし書き込み）
+     * @return 書き込みに成功したらtrue
+     */
+    virtual bool WriteCommand(std::span<const uint8_t> data) = 0;
+
+    /**
+     * @brief コマンドを書き込めるか（コマンド用キャラクタリスティックが見つかったか）
+     */
+    virtual bool CanWrite() const = 0;
+
+    /**
+     * @brief 通知を止めて接続を閉じる
+     * @note 実行中のhandlerが終わるまで待ってから戻る（handlerの中から呼んだ場合を除く）。戻った後はhandlerが参照するものを破棄してよい
+     */
+    virtual void Close() = 0;
+};
+
+/**
+ * @class Transport
+ * @brief コントローラーの探索と接続を行う通信バックエンド
+ *
+ * WinRTのBluetooth LE、プロセス内のループバックなどを同じインターフェースで扱う。
+ */
+class Transport {
+public:
+    /**
+     * @brief アドバタイズを受け取る関数
+     * @return trueを返すとスキャンを終了する
+     */
+    using ScanHandler = std::function<bool(const Advertisement& adv)>;
+
+    virtual ~Transport() = default;
+
+    /**
+     * @brief アドバタイズをスキャンする（handlerがtrueを返すかタイムアウトするまで待つ）
+     * @return handlerがtrueを返して終了した場合はtrue、タイムアウトした場合はfalse
+     */
+    virtual bool Scan(ScanHandler handler, std::chrono::milliseconds timeout) = 0;
+
+    /**
+     * @brief 指定したアドレスのコントローラーに接続し、キャラクタリスティックを解決する
+     * @return 接続したデバイス（失敗した場合はnullptr）
+     */
+    virtual std::shared_ptr<TransportDevice> Connect(uint64_t address) = 0;
+};
+
+/**
+ * @brief 環境に応じた通信バックエンドを作成する
+ * @note 環境変数 JOYCON_TRANSPORT=loopback でループバックを使う（既定はプラットフォームのBluetooth）
+ */
+std::unique_ptr<Transport> CreateTransport();
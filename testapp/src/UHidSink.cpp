@@ -0,0 +1,337 @@
+﻿#include "UHidSink.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// 仮想DS4のID（USB接続のCUH-ZCT1として認識させる）
+constexpr uint16_t DS4_VENDOR_ID = 0x054C;
+constexpr uint16_t DS4_PRODUCT_ID = 0x05C4;
+
+// レポートID
+constexpr uint8_t DS4_INPUT_REPORT = 0x01;          // 入力（ReportBufferの63バイト）
+constexpr uint8_t DS4_CALIBRATION_REPORT = 0x02;    // 機能: IMUのキャリブレーション
+constexpr uint8_t DS4_PAIRING_INFO_REPORT = 0x12;   // 機能: ペアリング情報（MACアドレス）
+constexpr uint8_t DS4_MAC_ADDRESS_REPORT = 0x81;    // 機能: MACアドレス（古いドライバーが使う）
+constexpr uint8_t DS4_FIRMWARE_INFO_REPORT = 0xA3;  // 機能: ファームウェア情報
+
+// 入力レポートの大きさ（レポートIDを含む）
+constexpr size_t DS4_INPUT_REPORT_SIZE = 1 + sizeof(DS4_REPORT_EX::ReportBuffer);
+
+// USB接続のDS4と同じ並びのレポートディスクリプター
+// （入力0x01は63バイト、出力0x05は31バイト、機能レポートはドライバーが初期化時に読む大きさ）
+static constexpr uint8_t DS4_REPORT_DESCRIPTOR[] = {
+    0x05, 0x01,       // Usage Page (Generic Desktop)
+    0x09, 0x05,       // Usage (Game Pad)
+    0xA1, 0x01,       // Collection (Application)
+    0x85, 0x01,       //   Report ID (1)
+    0x09, 0x30,       //   Usage (X)       左スティック
+    0x09, 0x31,       //   Usage (Y)
+    0x09, 0x32,       //   Usage (Z)       右スティック
+    0x09, 0x35,       //   Usage (Rz)
+    0x15, 0x00,       //   Logical Minimum (0)
+    0x26, 0xFF, 0x00, //   Logical Maximum (255)
+    0x75, 0x08,       //   Report Size (8)
+    0x95, 0x04,       //   Report Count (4)
+    0x81, 0x02,       //   Input (Data, Variable, Absolute)
+    0x09, 0x39,       //   Usage (Hat switch) 十字キー
+    0x15, 0x00,       //   Logical Minimum (0)
+    0x25, 0x07,       //   Logical Maximum (7)
+    0x35, 0x00,       //   Physical Minimum (0)
+    0x46, 0x3B, 0x01, //   Physical Maximum (315)
+    0x65, 0x14,       //   Unit (Degrees)
+    0x75, 0x04,       //   Report Size (4)
+    0x95, 0x01,       //   Report Count (1)
+    0x81, 0x42,       //   Input (Data, Variable, Absolute, Null State)
+    0x65, 0x00,       //   Unit (None)
+    0x05, 0x09,       //   Usage Page (Button) ボタン12個 + PS + タッチパッド
+    0x19, 0x01,       //   Usage Minimum (1)
+    0x29, 0x0E,       //   Usage Maximum (14)
+    0x15, 0x00,       //   Logical Minimum (0)
+    0x25, 0x01,       //   Logical Maximum (1)
+    0x75, 0x01,       //   Report Size (1)
+    0x95, 0x0E,       //   Report Count (14)
+    0x81, 0x02,       //   Input (Data, Variable, Absolute)
+    0x06, 0x00, 0xFF, //   Usage Page (Vendor Defined 0xFF00)
+    0x09, 0x20,       //   Usage (0x20)   レポートのカウンター
+    0x75, 0x06,       //   Report Size (6)
+    0x95, 0x01,       //   Report Count (1)
+    0x81, 0x02,       //   Input (Data, Variable, Absolute)
+    0x05, 0x01,       //   Usage Page (Generic Desktop)
+    0x09, 0x33,       //   Usage (Rx)      L2
+    0x09, 0x34,       //   Usage (Ry)      R2
+    0x15, 0x00,       //   Logical Minimum (0)
+    0x26, 0xFF, 0x00, //   Logical Maximum (255)
+    0x75, 0x08,       //   Report Size (8)
+    0x95, 0x02,       //   Report Count (2)
+    0x81, 0x02,       //   Input (Data, Variable, Absolute)
+    0x06, 0x00, 0xFF, //   Usage Page (Vendor Defined 0xFF00)
+    0x09, 0x21,       //   Usage (0x21)   タイムスタンプ、バッテリー、IMU、タッチパッド
+    0x95, 0x36,       //   Report Count (54)
+    0x81, 0x02,       //   Input (Data, Variable, Absolute)
+    0x85, 0x05,       //   Report ID (5)
+    0x09, 0x22,       //   Usage (0x22)   振動とライトバー
+    0x95, 0x1F,       //   Report Count (31)
+    0x91, 0x02,       //   Output (Data, Variable, Absolute)
+    0x85, 0x02,       //   Report ID (2)
+    0x09, 0x24,       //   Usage (0x24)   キャリブレーション
+    0x95, 0x24,       //   Report Count (36)
+    0xB1, 0x02,       //   Feature (Data, Variable, Absolute)
+    0x85, 0x12,       //   Report ID (0x12)
+    0x09, 0x25,       //   Usage (0x25)   ペアリング情報
+    0x95, 0x0F,       //   Report Count (15)
+    0xB1, 0x02,       //   Feature (Data, Variable, Absolute)
+    0x85, 0x81,       //   Report ID (0x81)
+    0x09, 0x26,       //   Usage (0x26)   MACアドレス
+    0x95, 0x06,       //   Report Count (6)
+    0xB1, 0x02,       //   Feature (Data, Variable, Absolute)
+    0x85, 0xA3,       //   Report ID (0xA3)
+    0x09, 0x27,       //   Usage (0x27)   ファームウェア情報
+    0x95, 0x30,       //   Report Count (48)
+    0xB1, 0x02,       //   Feature (Data, Variable, Absolute)
+    0xC0,             // End Collection
+};
+
+// キャリブレーションの値（ジャイロは 8640 / (540 * 2 / 2) = 16 LSB/(deg/s)、加速度は 8192 LSB/G）
+constexpr int16_t GYRO_RANGE = 8640;
+constexpr int16_t GYRO_SPEED = 540;
+constexpr int16_t ACCEL_RANGE = 8192;
+
+/**
+ * @brief 16ビットの値をリトルエンディアンで書き込む
+ */
+static void put_le16(uint8_t* out, int16_t value)
+{
+    out[0] = static_cast<uint8_t>(value & 0xFF);
+    out[1] = static_cast<uint8_t>((static_cast<uint16_t>(value) >> 8) & 0xFF);
+}
+
+/**
+ * @brief 機能レポートの内容を作る
+ * @param id レポートID
+ * @param mac 仮想DS4のMACアドレス
+ * @param out 書き込み先（UHID_DATA_MAXバイト）
+ * @return レポートの大きさ（レポートIDを含む。対応しないIDなら0）
+ */
+static size_t build_feature_report(uint8_t id, const std::array<uint8_t, 6>& mac, uint8_t* out)
+{
+    switch (id) {
+    case DS4_CALIBRATION_REPORT:
+    {
+        // バイアスは0（補正済みの値を送る）。USB（BUS_USBで作成する）の並びは軸ごとに+と-が交互で、
+        // +ピッチ、-ピッチ、+ヨー、-ヨー、+ロール、-ロール（Bluetoothは+を3つ、-を3つの順）
+        std::memset(out, 0, 37);
+        for (int i = 0; i < 3; ++i) {
+            put_le16(out + 7 + i * 4, GYRO_RANGE);
+            put_le16(out + 9 + i * 4, -GYRO_RANGE);
+        }
+        put_le16(out + 19, GYRO_SPEED);
+        put_le16(out + 21, GYRO_SPEED);
+        for (int i = 0; i < 3; ++i) {
+            put_le16(out + 23 + i * 4, ACCEL_RANGE);
+            put_le16(out + 25 + i * 4, -ACCEL_RANGE);
+        }
+        out[0] = id;
+        return 37;
+    }
+    case DS4_PAIRING_INFO_REPORT:
+    case DS4_MAC_ADDRESS_REPORT:
+    {
+        // MACアドレスは下位バイトから
+        size_t size = (id == DS4_PAIRING_INFO_REPORT) ? 16 : 7;
+        std::memset(out, 0, size);
+        out[0] = id;
+        for (size_t i = 0; i < mac.size(); ++i)
+            out[1 + i] = mac[mac.size() - 1 - i];
+        return size;
+    }
+    case DS4_FIRMWARE_INFO_REPORT:
+        std::memset(out, 0, 49);
+        out[0] = id;
+        put_le16(out + 35, 0x0100); // ハードウェアのバージョン
+        put_le16(out + 41, 0x0100); // ファームウェアのバージョン
+        return 49;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief プレイヤーごとに異なるMACアドレスを作る（ドライバーは同じアドレスのデバイスを拒否する）
+ * @note ローカル管理アドレスとして、プロセスIDと作成した順番から作る
+ */
+static std::array<uint8_t, 6> next_mac_address()
+{
+    static std::atomic<uint8_t> counter{ 0 };
+    uint16_t pid = static_cast<uint16_t>(getpid());
+    return { 0x02, 0x4A, 0x43, static_cast<uint8_t>(pid >> 8), static_cast<uint8_t>(pid & 0xFF), counter.fetch_add(1) };
+}
+
+std::unique_ptr<UHidSink> UHidSink::Create(const UHidSinkConfig& config)
+{
+    int fd = open(config.path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        std::wcerr << L"Failed to open " << std::wstring(config.path.begin(), config.path.end()) << L": " << std::strerror(errno) << L"\n";
+        return nullptr;
+    }
+    return Attach(fd, config);
+}
+
+std::unique_ptr<UHidSink> UHidSink::Attach(int fd, const UHidSinkConfig& config)
+{
+    std::unique_ptr<UHidSink> sink(new UHidSink(fd));
+    if (pipe2(sink->stopPipe, O_CLOEXEC) < 0) {
+        std::wcerr << L"Failed to create UHID stop pipe: " << std::strerror(errno) << L"\n";
+        return nullptr;
+    }
+
+    uhid_event create{};
+    create.type = UHID_CREATE2;
+    std::snprintf(reinterpret_cast<char*>(create.u.create2.name), sizeof(create.u.create2.name), "%s", config.name.c_str());
+    std::snprintf(reinterpret_cast<char*>(create.u.create2.uniq), sizeof(create.u.create2.uniq), "%02x:%02x:%02x:%02x:%02x:%02x",
+        sink->mac[0], sink->mac[1], sink->mac[2], sink->mac[3], sink->mac[4], sink->mac[5]);
+    create.u.create2.rd_size = sizeof(DS4_REPORT_DESCRIPTOR);
+    create.u.create2.bus = BUS_USB;
+    create.u.create2.vendor = DS4_VENDOR_ID;
+    create.u.create2.product = DS4_PRODUCT_ID;
+    create.u.create2.version = 0x0100;
+    std::memcpy(create.u.create2.rd_data, DS4_REPORT_DESCRIPTOR, sizeof(DS4_REPORT_DESCRIPTOR));
+    if (!sink->WriteEvent(create, sizeof(create))) {
+        std::wcerr << L"Failed to create UHID device: " << std::strerror(errno) << L"\n";
+        return nullptr;
+    }
+
+    sink->reader = std::thread(&UHidSink::Run, sink.get());
+    return sink;
+}
+
+UHidSink::UHidSink(int fd) : fd(fd), mac(next_mac_address())
+{
+    // 入力レポートの種類、大きさ、レポートIDは変わらないので最初に設定しておく
+    inputEvent.type = UHID_INPUT2;
+    inputEvent.u.input2.size = DS4_INPUT_REPORT_SIZE;
+    inputEvent.u.input2.data[0] = DS4_INPUT_REPORT;
+}
+
+UHidSink::~UHidSink()
+{
+    // 受信スレッドを止めてから仮想デバイスを削除する
+    if (reader.joinable()) {
+        char stop = 0;
+        if (write(stopPipe[1], &stop, 1) < 0) {}
+        reader.join();
+
+        uhid_event destroy{};
+        destroy.type = UHID_DESTROY;
+        WriteEvent(destroy, sizeof(destroy.type));
+    }
+    if (stopPipe[0] >= 0) close(stopPipe[0]);
+    if (stopPipe[1] >= 0) close(stopPipe[1]);
+    close(fd);
+}
+
+bool UHidSink::WriteEvent(const uhid_event& event, size_t size)
+{
+    ssize_t written = write(fd, &event, size);
+    return written == static_cast<ssize_t>(size);
+}
+
+bool UHidSink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    // ReportBufferは入力レポートのレポートIDの後ろと同じ並びなので、送信用のイベントに直接書き込む
+    std::memcpy(inputEvent.u.input2.data + 1, report.ReportBuffer, sizeof(report.ReportBuffer));
+    return WriteEvent(inputEvent, offsetof(uhid_event, u.input2.data) + DS4_INPUT_REPORT_SIZE);
+}
+
+bool UHidSink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    // DS4にはマウスが無いので送らない（マウス操作にはuinputかViGEmを使う）
+    (void)events;
+    return false;
+}
+
+void UHidSink::SetFeedbackHandler(FeedbackHandler handler)
+{
+    std::lock_guard<std::mutex> lock(feedbackMutex);
+    feedbackHandler = std::move(handler);
+}
+
+void UHidSink::Run()
+{
+    uhid_event event;
+    while (true) {
+        pollfd fds[2] = { { fd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        if (fds[0].revents & (POLLERR | POLLHUP)) break;
+
+        ssize_t size = read(fd, &event, sizeof(event));
+        if (size < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            std::wcerr << L"Failed to read UHID event: " << std::strerror(errno) << L"\n";
+            break;
+        }
+        if (size < static_cast<ssize_t>(sizeof(event.type))) break;
+        HandleEvent(event);
+    }
+}
+
+void UHidSink::HandleEvent(const uhid_event& event)
+{
+    switch (event.type) {
+    case UHID_OUTPUT:
+        if (event.u.output.rtype == UHID_OUTPUT_REPORT)
+            HandleOutput(event.u.output.data, event.u.output.size);
+        break;
+    case UHID_GET_REPORT:
+    {
+        // 機能レポートは固定の値で応答し、それ以外は失敗を返す
+        uhid_event reply{};
+        reply.type = UHID_GET_REPORT_REPLY;
+        reply.u.get_report_reply.id = event.u.get_report.id;
+        size_t size = (event.u.get_report.rtype == UHID_FEATURE_REPORT)
+            ? build_feature_report(event.u.get_report.rnum, mac, reply.u.get_report_reply.data) : 0;
+        reply.u.get_report_reply.err = size ? 0 : EIO;
+        reply.u.get_report_reply.size = static_cast<uint16_t>(size);
+        WriteEvent(reply, offsetof(uhid_event, u.get_report_reply.data) + size);
+        break;
+    }
+    case UHID_SET_REPORT:
+    {
+        // 出力レポートがSET_REPORTで届いた場合も振動とライトバーとして扱う
+        if (event.u.set_report.rtype == UHID_OUTPUT_REPORT)
+            HandleOutput(event.u.set_report.data, event.u.set_report.size);
+        uhid_event reply{};
+        reply.type = UHID_SET_REPORT_REPLY;
+        reply.u.set_report_reply.id = event.u.set_report.id;
+        reply.u.set_report_reply.err = 0;
+        WriteEvent(reply, offsetof(uhid_event, u.set_report_reply.err) + sizeof(reply.u.set_report_reply.err));
+        break;
+    }
+    default:
+        // UHID_START/STOP/OPEN/CLOSE は何もしない（入力は常に送り、開かれていなければ捨てられる）
+        break;
+    }
+}
+
+void UHidSink::HandleOutput(const uint8_t* data, size_t size)
+{
+    if (!ParseDS4OutputReport(data, size, feedback)) return;
+
+    std::lock_guard<std::mutex> lock(feedbackMutex);
+    if (feedbackHandler) feedbackHandler(feedback);
+}
+
+#endif // __linux__
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#ifdef __linux__
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/uhid.h>
+
+#include "OutputSink.h"
+
+/**
+ * @struct UHidSinkConfig
+ * @brief UHIDの出力先の設定
+ */
+struct UHidSinkConfig {
+    std::string path = "/dev/uhid";                 // デバイスノード
+    std::string name = "Joy-Con Virtual DualShock 4"; // 作成する仮想デバイスの名前
+};
+
+/**
+ * @class UHidSink
+ * @brief /dev/uhid にHIDレベルの仮想DS4（USB接続のCUH-ZCT1）を作成して出力する
+ *
+ * DS4のレポートディスクリプターで仮想デバイスを作り、DS4_REPORT_EXのReportBufferを
+ * そのまま入力レポート0x01として送る（ReportBufferはUSBのDS4の入力レポートと同じ並び）。
+ * evdevのゲームパッドと違い、カーネルのドライバー（hid-playstation）がモーションセンサーと
+ * タッチパッドのデバイスも作る。
+ *
+ * ドライバーからの要求（GET_REPORT/SET_REPORT、出力レポート）は受信スレッドで処理する。
+ * 機能レポート（キャリブレーション、ペアリング情報、ファームウェア情報）には固定の値で応答し、
+ * 出力レポート0x05の振動とライトバーはフィードバックのハンドラに渡す。
+ */
+class UHidSink : public OutputSink {
+public:
+    /**
+     * @brief デバイスノードを開き、仮想DS4を作成する
+     * @return 作成した出力先（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<UHidSink> Create(const UHidSinkConfig& config = UHidSinkConfig());
+
+    /**
+     * @brief 開いたデスクリプターに仮想DS4を作成する
+     * @param fd UHIDのデスクリプター（所有権を受け取る。動作確認ではソケットペアの片側でもよい）
+     * @return 作成した出力先（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<UHidSink> Attach(int fd, const UHidSinkConfig& config = UHidSinkConfig());
+
+    ~UHidSink() override;
+
+    UHidSink(const UHidSink&) = delete;
+    UHidSink& operator=(const UHidSink&) = delete;
+
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return L"UHID"; }
+    void SetFeedbackHandler(FeedbackHandler handler) override;
+
+    /**
+     * @brief 仮想DS4のMACアドレス（ペアリング情報で返す。プレイヤーごとに異なる）
+     */
+    const std::array<uint8_t, 6>& MacAddress() const { return mac; }
+
+private:
+    explicit UHidSink(int fd);
+
+    void Run();
+    void HandleEvent(const uhid_event& event);
+    void HandleOutput(const uint8_t* data, size_t size);
+    bool WriteEvent(const uhid_event& event, size_t size);
+
+    int fd;
+    int stopPipe[2] = { -1, -1 };
+    std::thread reader;
+    std::array<uint8_t, 6> mac{};
+
+    // 入力レポートの送信用（種類とレポートIDは設定済みで、ReportBufferを直接書き込む）
+    uhid_event inputEvent{};
+
+    std::mutex feedbackMutex;
+    FeedbackHandler feedbackHandler;
+    OutputFeedback feedback; // 受信スレッドだけが更新する最新の状態
+};
+
+#endif // __linux__
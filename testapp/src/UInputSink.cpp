@@ -0,0 +1,265 @@
+﻿#include "UInputSink.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// 1回のwriteで送るイベントの最大数（ボタン13個 + 軸8本 + EV_SYN が収まる）
+constexpr size_t MAX_FRAME_EVENTS = 32;
+// 仮想ゲームパッドのID（DS4として認識させる）
+constexpr uint16_t DS4_VENDOR_ID = 0x054C;
+constexpr uint16_t DS4_PRODUCT_ID = 0x05C4;
+
+// DS4のボタンとevdevのボタンの対応
+struct ButtonMapping {
+    uint16_t mask;
+    uint16_t code;
+};
+static constexpr ButtonMapping BUTTON_MAP[] = {
+    { DS4_BUTTON_CROSS, BTN_SOUTH },
+    { DS4_BUTTON_CIRCLE, BTN_EAST },
+    { DS4_BUTTON_SQUARE, BTN_WEST },
+    { DS4_BUTTON_TRIANGLE, BTN_NORTH },
+    { DS4_BUTTON_SHOULDER_LEFT, BTN_TL },
+    { DS4_BUTTON_SHOULDER_RIGHT, BTN_TR },
+    { DS4_BUTTON_TRIGGER_LEFT, BTN_TL2 },
+    { DS4_BUTTON_TRIGGER_RIGHT, BTN_TR2 },
+    { DS4_BUTTON_SHARE, BTN_SELECT },
+    { DS4_BUTTON_OPTIONS, BTN_START },
+    { DS4_BUTTON_THUMB_LEFT, BTN_THUMBL },
+    { DS4_BUTTON_THUMB_RIGHT, BTN_THUMBR },
+};
+
+// DS4レポートの軸（ReportBuffer上の位置）とevdevの軸の対応（値は0-255）
+struct AxisMapping {
+    uint8_t offset;
+    uint16_t code;
+};
+static constexpr AxisMapping AXIS_MAP[] = {
+    { 0, ABS_X },   // bThumbLX
+    { 1, ABS_Y },   // bThumbLY
+    { 2, ABS_RX },  // bThumbRX
+    { 3, ABS_RY },  // bThumbRY
+    { 7, ABS_Z },   // bTriggerL
+    { 8, ABS_RZ },  // bTriggerR
+};
+
+// 十字キーの値（wButtonsの下位4ビット、8は中立）からハットスイッチの値
+static constexpr int HAT_X[9] = { 0, 1, 1, 1, 0, -1, -1, -1, 0 };
+static constexpr int HAT_Y[9] = { -1, -1, 0, 1, 1, 1, 0, -1, 0 };
+
+// マウスのボタンとevdevのボタンの対応（MouseActionの順）
+static constexpr uint16_t MOUSE_BUTTONS[MouseActionCount] = { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA };
+
+/**
+ * @class EventFrame
+ * @brief 1フレーム分のイベントを固定長の配列にため、まとめて書き込む
+ */
+class EventFrame {
+public:
+    explicit EventFrame(int fd) : fd(fd) {}
+
+    void Push(uint16_t type, uint16_t code, int32_t value)
+    {
+        // 満杯なら先に書き込む（EV_SYNまでが1フレームなので、分割しても反映は1回）
+        if (count == MAX_FRAME_EVENTS) Flush();
+        input_event& event = events[count++];
+        event = input_event{};
+        event.type = type;
+        event.code = code;
+        event.value = value;
+    }
+
+    bool Empty() const { return count == 0 && !flushed; }
+
+    /**
+     * @brief EV_SYNを付けて書き込む（イベントが無ければ何もしない）
+     */
+    bool Finish()
+    {
+        if (Empty()) return true;
+        Push(EV_SYN, SYN_REPORT, 0);
+        return Flush() && ok;
+    }
+
+private:
+    bool Flush()
+    {
+        ssize_t size = static_cast<ssize_t>(count * sizeof(input_event));
+        if (count > 0 && write(fd, events, size) != size) ok = false;
+        count = 0;
+        flushed = true;
+        return ok;
+    }
+
+    int fd;
+    input_event events[MAX_FRAME_EVENTS];
+    size_t count = 0;
+    bool flushed = false;
+    bool ok = true;
+};
+
+/**
+ * @brief 仮想ゲームパッドを作成する
+ * @return 成功したらtrue（失敗した場合はerrnoが設定される）
+ */
+static bool setup_gamepad(int fd, const std::string& name)
+{
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0) return false;
+    if (ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0) return false;
+    for (const auto& button : BUTTON_MAP)
+        if (ioctl(fd, UI_SET_KEYBIT, button.code) < 0) return false;
+    if (ioctl(fd, UI_SET_KEYBIT, BTN_MODE) < 0) return false;
+
+    // スティックとトリガーは0-255、ハットスイッチは-1～1
+    auto setup_abs = [fd](uint16_t code, int32_t minimum, int32_t maximum, int32_t flat)
+        {
+            uinput_abs_setup abs{};
+            abs.code = code;
+            abs.absinfo.minimum = minimum;
+            abs.absinfo.maximum = maximum;
+            abs.absinfo.flat = flat;
+            abs.absinfo.value = (minimum + maximum) / 2;
+            return ioctl(fd, UI_SET_ABSBIT, code) >= 0 && ioctl(fd, UI_ABS_SETUP, &abs) >= 0;
+        };
+    for (const auto& axis : AXIS_MAP) {
+        bool trigger = axis.code == ABS_Z || axis.code == ABS_RZ;
+        if (!setup_abs(axis.code, 0, 255, trigger ? 0 : 4)) return false;
+    }
+    if (!setup_abs(ABS_HAT0X, -1, 1, 0) || !setup_abs(ABS_HAT0Y, -1, 1, 0)) return false;
+
+    uinput_setup setup{};
+    setup.id.bustype = BUS_USB;
+    setup.id.vendor = DS4_VENDOR_ID;
+    setup.id.product = DS4_PRODUCT_ID;
+    std::strncpy(setup.name, name.c_str(), UINPUT_MAX_NAME_SIZE - 1);
+    return ioctl(fd, UI_DEV_SETUP, &setup) >= 0 && ioctl(fd, UI_DEV_CREATE) >= 0;
+}
+
+/**
+ * @brief 相対移動のマウスを作成する
+ * @return 成功したらtrue（失敗した場合はerrnoが設定される）
+ */
+static bool setup_mouse(int fd, const std::string& name)
+{
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0) return false;
+    if (ioctl(fd, UI_SET_EVBIT, EV_REL) < 0) return false;
+    for (uint16_t code : MOUSE_BUTTONS)
+        if (ioctl(fd, UI_SET_KEYBIT, code) < 0) return false;
+    for (uint16_t code : { REL_X, REL_Y, REL_WHEEL, REL_WHEEL_HI_RES })
+        if (ioctl(fd, UI_SET_RELBIT, code) < 0) return false;
+
+    uinput_setup setup{};
+    setup.id.bustype = BUS_VIRTUAL;
+    std::strncpy(setup.name, name.c_str(), UINPUT_MAX_NAME_SIZE - 1);
+    return ioctl(fd, UI_DEV_SETUP, &setup) >= 0 && ioctl(fd, UI_DEV_CREATE) >= 0;
+}
+
+std::unique_ptr<UInputSink> UInputSink::Create(const UInputSinkConfig& config)
+{
+    std::wstring path(config.path.begin(), config.path.end());
+    int gamepadFd = open(config.path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (gamepadFd < 0) {
+        std::wcerr << L"Failed to open " << path << L": " << std::strerror(errno) << L"\n";
+        return nullptr;
+    }
+
+    if (!setup_gamepad(gamepadFd, config.name)) {
+        if (errno != ENOTTY && errno != EINVAL) {
+            std::wcerr << L"Failed to create uinput gamepad: " << std::strerror(errno) << L"\n";
+            close(gamepadFd);
+            return nullptr;
+        }
+        // uinputではないファイル: イベント列をそのまま書き込む（マウスも同じファイルの続きに書く）
+        std::wcout << path << L" is not a uinput device. Writing events to it as a stand-in.\n";
+        return std::unique_ptr<UInputSink>(new UInputSink(gamepadFd, dup(gamepadFd), false));
+    }
+
+    int mouseFd = open(config.path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (mouseFd < 0 || !setup_mouse(mouseFd, config.name + " Mouse")) {
+        std::wcerr << L"Failed to create uinput mouse: " << std::strerror(errno) << L"\n";
+        if (mouseFd >= 0) close(mouseFd);
+        ioctl(gamepadFd, UI_DEV_DESTROY);
+        close(gamepadFd);
+        return nullptr;
+    }
+    return std::unique_ptr<UInputSink>(new UInputSink(gamepadFd, mouseFd, true));
+}
+
+UInputSink::~UInputSink()
+{
+    if (virtualDevice) {
+        ioctl(gamepadFd, UI_DEV_DESTROY);
+        ioctl(mouseFd, UI_DEV_DESTROY);
+    }
+    close(gamepadFd);
+    close(mouseFd);
+}
+
+bool UInputSink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    EventFrame frame(gamepadFd);
+
+    // 前回から変化したボタンと軸だけを送る（最初のフレームは全て送る）
+    uint16_t buttons = report.Report.wButtons;
+    uint16_t previousButtons = previous.Report.wButtons;
+    for (const auto& button : BUTTON_MAP) {
+        bool pressed = (buttons & button.mask) != 0;
+        if (!hasPrevious || pressed != ((previousButtons & button.mask) != 0))
+            frame.Push(EV_KEY, button.code, pressed ? 1 : 0);
+    }
+    bool home = (report.Report.bSpecial & DS4_SPECIAL_BUTTON_PS) != 0;
+    if (!hasPrevious || home != ((previous.Report.bSpecial & DS4_SPECIAL_BUTTON_PS) != 0))
+        frame.Push(EV_KEY, BTN_MODE, home ? 1 : 0);
+
+    for (const auto& axis : AXIS_MAP) {
+        uint8_t value = report.ReportBuffer[axis.offset];
+        if (!hasPrevious || value != previous.ReportBuffer[axis.offset])
+            frame.Push(EV_ABS, axis.code, value);
+    }
+
+    int dpad = std::min(buttons & 0xF, 8);
+    int previousDpad = std::min(previousButtons & 0xF, 8);
+    if (!hasPrevious || HAT_X[dpad] != HAT_X[previousDpad]) frame.Push(EV_ABS, ABS_HAT0X, HAT_X[dpad]);
+    if (!hasPrevious || HAT_Y[dpad] != HAT_Y[previousDpad]) frame.Push(EV_ABS, ABS_HAT0Y, HAT_Y[dpad]);
+
+    previous = report;
+    hasPrevious = true;
+    return frame.Finish();
+}
+
+bool UInputSink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    EventFrame frame(mouseFd);
+    for (const auto& event : events) {
+        switch (event.type) {
+        case MouseEventType::Move:
+            if (event.dx != 0) frame.Push(EV_REL, REL_X, event.dx);
+            if (event.dy != 0) frame.Push(EV_REL, REL_Y, event.dy);
+            break;
+        case MouseEventType::Wheel:
+            // 高解像度のホイールと、ノッチ単位に換算したホイールの両方を送る
+            frame.Push(EV_REL, REL_WHEEL_HI_RES, event.wheel);
+            wheelRemainder += event.wheel;
+            if (wheelRemainder / 120 != 0) {
+                frame.Push(EV_REL, REL_WHEEL, wheelRemainder / 120);
+                wheelRemainder %= 120;
+            }
+            break;
+        case MouseEventType::Button:
+            frame.Push(EV_KEY, MOUSE_BUTTONS[event.button], event.pressed ? 1 : 0);
+            break;
+        }
+    }
+    return frame.Finish();
+}
+
+#endif // __linux__
@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#ifdef __linux__
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <linux/input.h>
+
+#include "OutputSink.h"
+
+/**
+ * @struct UInputSinkConfig
+ * @brief uinputの出力先の設定
+ */
+struct UInputSinkConfig {
+    std::string path = "/dev/uinput";               // デバイスノード（動作確認では通常のファイルやFIFOでもよい）
+    std::string name = "Joy-Con Virtual Gamepad";   // 作成する仮想デバイスの名前
+};
+
+/**
+ * @class UInputSink
+ * @brief /dev/uinput に仮想ゲームパッドと相対移動のマウスを作成して出力する
+ *
+ * 1フレーム分の変化（EV_KEY/EV_ABS/EV_REL）を固定長のバッファにまとめ、EV_SYNを付けて
+ * デバイスごとに1回のwriteで送る。前回から変化の無い軸やボタンは送らない。
+ * uinputではないファイルを指定した場合はデバイスの作成を省略し、同じイベント列を書き込む
+ * （書き込まれたinput_eventを読めば出力を確認できる）。
+ */
+class UInputSink : public OutputSink {
+public:
+    /**
+     * @brief 仮想ゲームパッドとマウスを作成する
+     * @return 作成した出力先（デバイスノードを開けない場合はnullptr）
+     */
+    static std::unique_ptr<UInputSink> Create(const UInputSinkConfig& config = UInputSinkConfig());
+
+    ~UInputSink() override;
+
+    UInputSink(const UInputSink&) = delete;
+    UInputSink& operator=(const UInputSink&) = delete;
+
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return L"uinput"; }
+
+    /**
+     * @brief uinputの仮想デバイスを作成できたか（falseなら通常のファイルに書き込んでいる）
+     */
+    bool IsVirtualDevice() const { return virtualDevice; }
+
+private:
+    UInputSink(int gamepadFd, int mouseFd, bool virtualDevice)
+        : gamepadFd(gamepadFd), mouseFd(mouseFd), virtualDevice(virtualDevice) {}
+
+    int gamepadFd;
+    int mouseFd;
+    bool virtualDevice;
+
+    // 前回送ったゲームパッドの状態（変化した分だけ送る）
+    bool hasPrevious = false;
+    DS4_REPORT_EX previous{};
+    int wheelRemainder = 0; // REL_WHEELに換算していないホイール量（ホイールは出力クロックからのみ届く）
+};
+
+#endif // __linux__
@@ -0,0 +1,301 @@
+﻿#include "ViGEmSink.h"
+
+#include <array>
+#include <iostream>
+#include <utility>
+
+/**
+ * @brief マウスボタンの操作に対応する押下・解放イベント
+ * @return [MouseAction][0=解放, 1=押下] のイベント
+ */
+static std::array<std::array<INPUT, 2>, MouseActionCount> build_button_events()
+{
+    struct Flags { DWORD up; DWORD down; DWORD data; };
+    constexpr Flags flags[MouseActionCount] = {
+        { MOUSEEVENTF_LEFTUP, MOUSEEVENTF_LEFTDOWN, 0 },
+        { MOUSEEVENTF_RIGHTUP, MOUSEEVENTF_RIGHTDOWN, 0 },
+        { MOUSEEVENTF_MIDDLEUP, MOUSEEVENTF_MIDDLEDOWN, 0 },
+        { MOUSEEVENTF_XUP, MOUSEEVENTF_XDOWN, XBUTTON1 },
+        { MOUSEEVENTF_XUP, MOUSEEVENTF_XDOWN, XBUTTON2 },
+    };
+
+    std::array<std::array<INPUT, 2>, MouseActionCount> events{};
+    for (size_t i = 0; i < MouseActionCount; ++i) {
+        for (size_t pressed = 0; pressed < 2; ++pressed) {
+            INPUT& input = events[i][pressed];
+            input.type = INPUT_MOUSE;
+            input.mi.dwFlags = pressed ? flags[i].down : flags[i].up;
+            input.mi.mouseData = flags[i].data;
+        }
+    }
+    return events;
+}
+
+static const std::array<std::array<INPUT, 2>, MouseActionCount> BUTTON_EVENTS = build_button_events();
+
+// 1回のSendInputで送るイベントの最大数
+constexpr size_t MAX_INPUTS = 32;
+// 出力レポートを待つ時間（停止の確認の間隔を兼ねる）
+constexpr DWORD OUTPUT_REPORT_TIMEOUT_MS = 100;
+
+std::unique_ptr<ViGEmSink> ViGEmSink::Create(PVIGEM_CLIENT client)
+{
+    PVIGEM_TARGET target = vigem_target_ds4_alloc();
+    auto ret = vigem_target_add(client, target);
+    if (!VIGEM_SUCCESS(ret))
+    {
+        std::wcerr << L"Failed to add DS4 controller target: 0x" << std::hex << ret << std::dec << L"\n";
+        vigem_target_free(target);
+        return nullptr;
+    }
+    return std::unique_ptr<ViGEmSink>(new ViGEmSink(client, target));
+}
+
+ViGEmSink::~ViGEmSink()
+{
+    // 出力レポートの待機を止めてから仮想コントローラーを削除する
+    feedbackRunning = false;
+    if (feedbackThread.joinable()) feedbackThread.join();
+
+    vigem_target_remove(client, target);
+    vigem_target_free(target);
+}
+
+bool ViGEmSink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    auto ret = vigem_target_ds4_update_ex(client, target, report);
+    if (!VIGEM_SUCCESS(ret)) {
+        std::wcerr << L"Failed to update DS4 EX report: 0x" << std::hex << ret << std::dec << L"\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief マウスイベントを固定長の配列に変換し、まとめてSendInputで送信する
+ * @return 全てのイベントを送信できたらtrue
+ */
+static bool send_mouse_input(std::span<const MouseEvent> events)
+{
+    std::array<INPUT, MAX_INPUTS> inputs{};
+    size_t count = 0;
+    bool ok = true;
+    auto flush = [&]()
+        {
+            if (count == 0) return;
+            if (SendInput(static_cast<UINT>(count), inputs.data(), sizeof(INPUT)) != count) ok = false;
+            count = 0;
+        };
+
+    for (const auto& event : events) {
+        if (count == MAX_INPUTS) flush();
+        INPUT& input = inputs[count++];
+        switch (event.type) {
+        case MouseEventType::Move:
+            input = INPUT{};
+            input.type = INPUT_MOUSE;
+            input.mi.dx = event.dx;
+            input.mi.dy = event.dy;
+            input.mi.dwFlags = MOUSEEVENTF_MOVE;
+            break;
+        case MouseEventType::Wheel:
+            input = INPUT{};
+            input.type = INPUT_MOUSE;
+            input.mi.mouseData = static_cast<DWORD>(event.wheel);
+            input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+            break;
+        case MouseEventType::Button:
+            input = BUTTON_EVENTS[event.button][event.pressed ? 1 : 0];
+            break;
+        }
+    }
+    flush();
+    return ok;
+}
+
+bool ViGEmSink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    return send_mouse_input(events);
+}
+
+void ViGEmSink::SetFeedbackHandler(FeedbackHandler handler)
+{
+    bool enable = static_cast<bool>(handler);
+    {
+        std::lock_guard<std::mutex> lock(feedbackMutex);
+        feedbackHandler = std::move(handler);
+    }
+    // 最初に設定されたときに出力レポートの待機を始める（解除では始めない）
+    if (enable && !feedbackRunning.exchange(true))
+        feedbackThread = std::thread(&ViGEmSink::RunFeedback, this);
+}
+
+void ViGEmSink::RunFeedback()
+{
+    OutputFeedback feedback;
+    DS4_OUTPUT_BUFFER buffer;
+    while (feedbackRunning) {
+        auto ret = vigem_target_ds4_await_output_report_timeout(client, target, OUTPUT_REPORT_TIMEOUT_MS, &buffer);
+        if (ret == VIGEM_ERROR_TIMED_OUT) continue;
+        if (!VIGEM_SUCCESS(ret)) {
+            std::wcerr << L"Failed to wait for DS4 output report: 0x" << std::hex << ret << std::dec << L"\n";
+            break;
+        }
+        if (!ParseDS4OutputReport(buffer.Buffer, sizeof(buffer.Buffer), feedback)) continue;
+
+        std::lock_guard<std::mutex> lock(feedbackMutex);
+        if (feedbackHandler) feedbackHandler(feedback);
+    }
+}
+
+// DS4のボタンとXbox 360のボタンの対応
+struct XusbButtonMapping {
+    uint16_t ds4;
+    uint16_t xusb;
+};
+static constexpr XusbButtonMapping XUSB_BUTTON_MAP[] = {
+    { DS4_BUTTON_CROSS, XUSB_GAMEPAD_A },
+    { DS4_BUTTON_CIRCLE, XUSB_GAMEPAD_B },
+    { DS4_BUTTON_SQUARE, XUSB_GAMEPAD_X },
+    { DS4_BUTTON_TRIANGLE, XUSB_GAMEPAD_Y },
+    { DS4_BUTTON_SHOULDER_LEFT, XUSB_GAMEPAD_LEFT_SHOULDER },
+    { DS4_BUTTON_SHOULDER_RIGHT, XUSB_GAMEPAD_RIGHT_SHOULDER },
+    { DS4_BUTTON_SHARE, XUSB_GAMEPAD_BACK },
+    { DS4_BUTTON_OPTIONS, XUSB_GAMEPAD_START },
+    { DS4_BUTTON_THUMB_LEFT, XUSB_GAMEPAD_LEFT_THUMB },
+    { DS4_BUTTON_THUMB_RIGHT, XUSB_GAMEPAD_RIGHT_THUMB },
+};
+
+/**
+ * @brief wButtonsのshiftビット目からのbitsビットを、Xbox 360のボタンに変換する表を作る
+ */
+template <int Shift, int Bits>
+static constexpr std::array<uint16_t, 1 << Bits> build_xusb_button_table()
+{
+    std::array<uint16_t, 1 << Bits> table{};
+    for (uint32_t value = 0; value < table.size(); ++value) {
+        uint32_t buttons = value << Shift;
+        for (const auto& mapping : XUSB_BUTTON_MAP)
+            if (buttons & mapping.ds4) table[value] |= mapping.xusb;
+    }
+    return table;
+}
+
+// wButtonsの4-7ビット目（□×○△）と8-15ビット目（L1～R3）の変換表（L2/R2はトリガーの値で送る）
+static constexpr auto XUSB_FACE_BUTTONS = build_xusb_button_table<4, 4>();
+static constexpr auto XUSB_OTHER_BUTTONS = build_xusb_button_table<8, 8>();
+
+// 十字キーの値（wButtonsの下位4ビット、8以上は中立）からXbox 360の十字キー
+static constexpr std::array<uint16_t, 16> XUSB_DPAD = {
+    XUSB_GAMEPAD_DPAD_UP,
+    XUSB_GAMEPAD_DPAD_UP | XUSB_GAMEPAD_DPAD_RIGHT,
+    XUSB_GAMEPAD_DPAD_RIGHT,
+    XUSB_GAMEPAD_DPAD_RIGHT | XUSB_GAMEPAD_DPAD_DOWN,
+    XUSB_GAMEPAD_DPAD_DOWN,
+    XUSB_GAMEPAD_DPAD_DOWN | XUSB_GAMEPAD_DPAD_LEFT,
+    XUSB_GAMEPAD_DPAD_LEFT,
+    XUSB_GAMEPAD_DPAD_LEFT | XUSB_GAMEPAD_DPAD_UP,
+};
+
+/**
+ * @brief スティックの値（0-255、中央128）を -32768～32767 に変換する表を作る
+ * @param invert trueなら上下を反転する（DS4は下が大きく、Xbox 360は上が正）
+ */
+static constexpr std::array<int16_t, 256> build_xusb_axis_table(bool invert)
+{
+    std::array<int16_t, 256> table{};
+    for (int value = 0; value < 256; ++value) {
+        int offset = invert ? 128 - value : value - 128;
+        // 正の側は最大が32767、負の側は最小が-32768になるように伸ばす
+        int positiveRange = invert ? 128 : 127;
+        int negativeRange = invert ? 127 : 128;
+        table[value] = static_cast<int16_t>(offset >= 0 ? offset * 32767 / positiveRange : offset * 32768 / negativeRange);
+    }
+    return table;
+}
+
+static constexpr auto XUSB_AXIS = build_xusb_axis_table(false);
+static constexpr auto XUSB_AXIS_INVERTED = build_xusb_axis_table(true);
+
+static_assert(XUSB_AXIS[0] == -32768 && XUSB_AXIS[128] == 0 && XUSB_AXIS[255] == 32767);
+static_assert(XUSB_AXIS_INVERTED[0] == 32767 && XUSB_AXIS_INVERTED[128] == 0 && XUSB_AXIS_INVERTED[255] == -32768);
+
+XUSB_REPORT ConvertToXusbReport(const DS4_REPORT_EX& report)
+{
+    uint16_t buttons = report.Report.wButtons;
+    XUSB_REPORT xusb{};
+    xusb.wButtons = XUSB_DPAD[buttons & 0xF] | XUSB_FACE_BUTTONS[(buttons >> 4) & 0xF] | XUSB_OTHER_BUTTONS[buttons >> 8];
+    if (report.Report.bSpecial & DS4_SPECIAL_BUTTON_PS) xusb.wButtons |= XUSB_GAMEPAD_GUIDE;
+    xusb.bLeftTrigger = report.Report.bTriggerL;
+    xusb.bRightTrigger = report.Report.bTriggerR;
+    xusb.sThumbLX = XUSB_AXIS[report.Report.bThumbLX];
+    xusb.sThumbLY = XUSB_AXIS_INVERTED[report.Report.bThumbLY];
+    xusb.sThumbRX = XUSB_AXIS[report.Report.bThumbRX];
+    xusb.sThumbRY = XUSB_AXIS_INVERTED[report.Report.bThumbRY];
+    return xusb;
+}
+
+std::unique_ptr<ViGEmX360Sink> ViGEmX360Sink::Create(PVIGEM_CLIENT client)
+{
+    PVIGEM_TARGET target = vigem_target_x360_alloc();
+    auto ret = vigem_target_add(client, target);
+    if (!VIGEM_SUCCESS(ret))
+    {
+        std::wcerr << L"Failed to add X360 controller target: 0x" << std::hex << ret << std::dec << L"\n";
+        vigem_target_free(target);
+        return nullptr;
+    }
+
+    std::unique_ptr<ViGEmX360Sink> sink(new ViGEmX360Sink(client, target));
+
+    // 振動とLEDの変化を受け取る（ハンドラが未設定の間は捨てる）
+    ret = vigem_target_x360_register_notification(client, target, &ViGEmX360Sink::OnNotification, sink.get());
+    if (!VIGEM_SUCCESS(ret))
+        std::wcerr << L"Failed to register X360 notification: 0x" << std::hex << ret << std::dec << L"\n";
+    return sink;
+}
+
+ViGEmX360Sink::~ViGEmX360Sink()
+{
+    // 通知を止めてから仮想コントローラーを削除する
+    vigem_target_x360_unregister_notification(target);
+    vigem_target_remove(client, target);
+    vigem_target_free(target);
+}
+
+bool ViGEmX360Sink::SubmitReport(const DS4_REPORT_EX& report)
+{
+    auto ret = vigem_target_x360_update(client, target, ConvertToXusbReport(report));
+    if (!VIGEM_SUCCESS(ret)) {
+        std::wcerr << L"Failed to update X360 report: 0x" << std::hex << ret << std::dec << L"\n";
+        return false;
+    }
+    return true;
+}
+
+bool ViGEmX360Sink::SubmitMouse(std::span<const MouseEvent> events)
+{
+    return send_mouse_input(events);
+}
+
+void ViGEmX360Sink::SetFeedbackHandler(FeedbackHandler handler)
+{
+    std::lock_guard<std::mutex> lock(feedbackMutex);
+    feedbackHandler = std::move(handler);
+}
+
+VOID CALLBACK ViGEmX360Sink::OnNotification(PVIGEM_CLIENT client, PVIGEM_TARGET target,
+    UCHAR largeMotor, UCHAR smallMotor, UCHAR ledNumber, LPVOID userData)
+{
+    (void)client;
+    (void)target;
+    auto* sink = static_cast<ViGEmX360Sink*>(userData);
+
+    OutputFeedback feedback;
+    feedback.largeMotor = largeMotor;
+    feedback.smallMotor = smallMotor;
+    feedback.ledNumber = static_cast<int8_t>(ledNumber);
+
+    std::lock_guard<std::mutex> lock(sink->feedbackMutex);
+    if (sink->feedbackHandler) sink->feedbackHandler(feedback);
+}
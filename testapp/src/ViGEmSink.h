@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "OutputSink.h"
+
+/**
+ * @class ViGEmSink
+ * @brief ViGEmの仮想DS4コントローラーとSendInputのマウスに出力する
+ *
+ * フィードバックのハンドラを設定すると専用のスレッドでゲームからの出力レポートを待ち、
+ * 振動とライトバーの状態をハンドラに渡す。
+ */
+class ViGEmSink : public OutputSink {
+public:
+    /**
+     * @brief 仮想DS4コントローラーを作成し、バスに追加する
+     * @param client 接続済みのViGEmクライアント（この出力先より長く存在すること）
+     * @return 作成した出力先（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<ViGEmSink> Create(PVIGEM_CLIENT client);
+
+    ~ViGEmSink() override;
+
+    ViGEmSink(const ViGEmSink&) = delete;
+    ViGEmSink& operator=(const ViGEmSink&) = delete;
+
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return L"ViGEm"; }
+    void SetFeedbackHandler(FeedbackHandler handler) override;
+
+    /**
+     * @brief 仮想コントローラー
+     */
+    PVIGEM_TARGET Target() const { return target; }
+
+private:
+    ViGEmSink(PVIGEM_CLIENT client, PVIGEM_TARGET target) : client(client), target(target) {}
+
+    void RunFeedback();
+
+    PVIGEM_CLIENT client;
+    PVIGEM_TARGET target;
+
+    std::mutex feedbackMutex;
+    FeedbackHandler feedbackHandler;
+    std::atomic<bool> feedbackRunning{ false };
+    std::thread feedbackThread;
+};
+
+/**
+ * @brief DS4のレポートをXbox 360のレポートに変換する
+ * @note ボタンと十字キーは表引きで変換し、スティックは上下を反転する（タッチパッドは使わない）
+ */
+XUSB_REPORT ConvertToXusbReport(const DS4_REPORT_EX& report);
+
+/**
+ * @class ViGEmX360Sink
+ * @brief ViGEmの仮想Xbox 360コントローラーとSendInputのマウスに出力する
+ *
+ * XInputしか扱わないゲーム向けに、DS4のレポートを変換して直接送る。
+ * ゲームからの振動とプレイヤー番号のLEDはViGEmの通知で受け取り、フィードバックのハンドラに渡す。
+ */
+class ViGEmX360Sink : public OutputSink {
+public:
+    /**
+     * @brief 仮想Xbox 360コントローラーを作成し、バスに追加する
+     * @param client 接続済みのViGEmクライアント（この出力先より長く存在すること）
+     * @return 作成した出力先（失敗した場合はnullptr）
+     */
+    static std::unique_ptr<ViGEmX360Sink> Create(PVIGEM_CLIENT client);
+
+    ~ViGEmX360Sink() override;
+
+    ViGEmX360Sink(const ViGEmX360Sink&) = delete;
+    ViGEmX360Sink& operator=(const ViGEmX360Sink&) = delete;
+
+    bool SubmitReport(const DS4_REPORT_EX& report) override;
+    bool SubmitMouse(std::span<const MouseEvent> events) override;
+    const wchar_t* Name() const override { return L"ViGEm X360"; }
+    void SetFeedbackHandler(FeedbackHandler handler) override;
+
+private:
+    ViGEmX360Sink(PVIGEM_CLIENT client, PVIGEM_TARGET target) : client(client), target(target) {}
+
+    static VOID CALLBACK OnNotification(PVIGEM_CLIENT client, PVIGEM_TARGET target,
+        UCHAR largeMotor, UCHAR smallMotor, UCHAR ledNumber, LPVOID userData);
+
+    PVIGEM_CLIENT client;
+    PVIGEM_TARGET target;
+
+    std::mutex feedbackMutex;
+    FeedbackHandler feedbackHandler;
+};
@@ -0,0 +1,274 @@
+﻿#include "WinRtTransport.h"
+
+#include <winrt/Windows.Foundation.h>
+#include <winrt/Windows.Foundation.Collections.h>
+#include <winrt/Windows.Storage.Streams.h>
+#include <winrt/Windows.Devices.Bluetooth.h>
+#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
+#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "DeviceCache.h"
+
+using namespace winrt;
+using namespace Windows::Devices::Bluetooth;
+using namespace Windows::Devices::Bluetooth::Advertisement;
+using namespace Windows::Devices::Bluetooth::GenericAttributeProfile;
+using namespace Windows::Storage::Streams;
+
+// このスレッドが処理中の通知のデバイス（ハンドラの中からそのデバイスを閉じた場合に、自分の終了を待たないため）
+static thread_local const void* notifying_device = nullptr;
+
+/**
+ * @class WinRtDevice
+ * @brief WinRTで接続したコントローラー
+ */
+class WinRtDevice : public TransportDevice {
+public:
+    WinRtDevice(BluetoothLEDevice device, GattCharacteristic inputChar, GattCharacteristic writeChar)
+        : device(device), inputChar(inputChar), writeChar(writeChar)
+    {
+    }
+
+    ~WinRtDevice() override { Close(); }
+
+    uint64_t Address() const override { return device ? device.BluetoothAddress() : 0; }
+
+    bool Subscribe(NotifyHandler handler) override
+    {
+        if (!inputChar) return false;
+
+        // 受信バッファを直接借用して渡す（コピーしない）
+        // 登録を解除しても実行中の通知は止まらないので、実行中の数を数えてCloseで終わるのを待つ
+        valueChangedToken = inputChar.ValueChanged([handler = std::move(handler), state = notifyState](GattCharacteristic const&, GattValueChangedEventArgs const& args)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (state->closed) return;
+                    state->running++;
+                }
+                notifying_device = state.get();
+                IBuffer value = args.CharacteristicValue();
+                handler(std::span<const uint8_t>(value.data(), value.Length()));
+                notifying_device = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->running--;
+                }
+                state->idle.notify_all();
+            });
+
+        auto status = inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
+            GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
+        return status == GattCommunicationStatus::Success;
+    }
+
+    bool WriteCommand(std::span<const uint8_t> data) override
+    {
+        if (!writeChar) return false;
+
+        auto writer = DataWriter();
+        writer.WriteBytes(array_view<const uint8_t>(data.data(), data.data() + data.size()));
+        auto status = writeChar.WriteValueAsync(writer.DetachBuffer(), GattWriteOption::WriteWithoutResponse).get();
+        return status == GattCommunicationStatus::Success;
+    }
+
+    bool CanWrite() const override { return static_cast<bool>(writeChar); }
+
+    void Close() override
+    {
+        if (inputChar && valueChangedToken) {
+            inputChar.ValueChanged(valueChangedToken);
+            valueChangedToken = {};
+        }
+
+        // 実行中の通知が終わるまで待つ（戻った後はハンドラが参照するものを破棄してよい）
+        {
+            std::unique_lock<std::mutex> lock(notifyState->mutex);
+            notifyState->closed = true;
+            int self = (notifying_device == notifyState.get()) ? 1 : 0;
+            notifyState->idle.wait(lock, [&]() { return notifyState->running <= self; });
+        }
+
+        if (device) {
+            device.Close();
+            device = nullptr;
+        }
+    }
+
+private:
+    BluetoothLEDevice device = nullptr;
+    GattCharacteristic inputChar = nullptr;
+    GattCharacteristic writeChar = nullptr;
+    event_token valueChangedToken{};
+
+    // 通知のハンドラと共有する状態（登録を解除した後に届く通知でも有効なように共有で持つ）
+    struct NotifyState {
+        std::mutex mutex;
+        std::condition_variable idle;
+        int running = 0;     // 実行中の通知の数
+        bool closed = false; // 閉じた後の通知は捨てる
+    };
+    std::shared_ptr<NotifyState> notifyState = std::make_shared<NotifyState>();
+};
+
+WinRtTransport::WinRtTransport()
+{
+    // WinRT (COM) を使用するためにアパートメントを初期化（初期化済みなら何もしない）
+    try {
+        init_apartment();
+    }
+    catch (const hresult_error&) {
+    }
+}
+
+bool WinRtTransport::Scan(ScanHandler handler, std::chrono::milliseconds timeout)
+{
+    BluetoothLEAdvertisementWatcher watcher;
+
+    // 同期用のミューテックスと条件変数
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+
+    watcher.Received([&](auto const&, BluetoothLEAdvertisementReceivedEventArgs const& args)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (done) return; // 既に終了済みの場合は無視
+
+            auto mfg = args.Advertisement().ManufacturerData();
+            for (uint32_t i = 0; i < mfg.Size(); i++)
+            {
+                auto section = mfg.GetAt(i);
+                IBuffer data = section.Data();
+
+                Advertisement adv;
+                adv.address = args.BluetoothAddress();
+                adv.companyId = section.CompanyId();
+                adv.manufacturerData = std::span<const uint8_t>(data.data(), data.Length());
+                adv.rssi = args.RawSignalStrengthInDBm();
+                if (handler(adv)) {
+                    done = true;
+                    cv.notify_one();
+                    return;
+                }
+            }
+        });
+
+    watcher.ScanningMode(BluetoothLEScanningMode::Active); // アクティブスキャンモード
+    watcher.Start();
+
+    bool found;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        found = cv.wait_for(lock, timeout, [&]() { return done; });
+        done = true;
+    }
+    watcher.Stop();
+    return found;
+}
+
+/**
+ * @brief キャラクタリスティックの位置をキャッシュ用の文字列にする（"<サービスUUID>/<ハンドル>"）
+ */
+static std::string gatt_location(GattCharacteristic const& characteristic)
+{
+    if (!characteristic) return {};
+    std::string uuid = to_string(to_hstring(characteristic.Service().Uuid()));
+    // to_hstringは"{...}"の形式なので括弧を外す
+    if (uuid.size() > 2 && uuid.front() == '{') uuid = uuid.substr(1, uuid.size() - 2);
+    return uuid + "/" + std::to_string(characteristic.AttributeHandle());
+}
+
+/**
+ * @brief キャッシュした位置から、サービスを1つだけ取得してキャラクタリスティックを解決する
+ * @return 見つからない（キャッシュが古い）場合はnullptr
+ */
+static GattCharacteristic find_cached_characteristic(BluetoothLEDevice const& device, const std::string& location, const guid& uuid)
+{
+    auto slash = location.find('/');
+    if (slash == std::string::npos) return nullptr;
+
+    try {
+        const guid serviceUuid(std::string_view(location).substr(0, slash));
+        const uint16_t handle = static_cast<uint16_t>(std::stoul(location.substr(slash + 1)));
+
+        auto servicesResult = device.GetGattServicesForUuidAsync(serviceUuid, BluetoothCacheMode::Cached).get();
+        if (servicesResult.Status() != GattCommunicationStatus::Success) return nullptr;
+        for (auto service : servicesResult.Services())
+        {
+            auto charsResult = service.GetCharacteristicsForUuidAsync(uuid, BluetoothCacheMode::Cached).get();
+            if (charsResult.Status() != GattCommunicationStatus::Success) continue;
+            for (auto characteristic : charsResult.Characteristics())
+            {
+                if (characteristic.AttributeHandle() == handle) return characteristic;
+            }
+        }
+    }
+    catch (const hresult_error&) {
+    }
+    catch (const std::exception&) {
+        // キャッシュファイルの内容が壊れている
+    }
+    return nullptr;
+}
+
+std::shared_ptr<TransportDevice> WinRtTransport::Connect(uint64_t address)
+{
+    // 接続全体と、キャラクタリスティックの解決（キャッシュで省略できる部分）の時間を計測する
+    auto start = std::chrono::steady_clock::now();
+    BluetoothLEDevice device = BluetoothLEDevice::FromBluetoothAddressAsync(address).get();
+    if (!device) return nullptr;
+    auto resolveStart = std::chrono::steady_clock::now();
+
+    GattCharacteristic inputChar = nullptr;
+    GattCharacteristic writeChar = nullptr;
+    const guid inputUuid(INPUT_REPORT_UUID);
+    const guid writeUuid(WRITE_COMMAND_UUID);
+
+    // 既知のコントローラーなら、前回解決した位置から直接取得する（全サービスの列挙を省略）
+    DeviceCacheEntry cached;
+    if (LookupDeviceCache(address, cached) && !cached.input.empty())
+    {
+        inputChar = find_cached_characteristic(device, cached.input, inputUuid);
+        if (inputChar && !cached.write.empty())
+            writeChar = find_cached_characteristic(device, cached.write, writeUuid);
+        if (inputChar && (cached.write.empty() || writeChar)) {
+            auto now = std::chrono::steady_clock::now();
+            RecordConnectTime(ConnectPath::Cached, now - start, now - resolveStart);
+            return std::make_shared<WinRtDevice>(device, inputChar, writeChar);
+        }
+
+        // キャッシュが古い場合は全て探し直す
+        inputChar = nullptr;
+        writeChar = nullptr;
+    }
+
+    // 全てのサービスをループして、目的のキャラクタリスティックを探す
+    auto servicesResult = device.GetGattServicesAsync().get();
+    if (servicesResult.Status() != GattCommunicationStatus::Success) return nullptr;
+
+    for (auto service : servicesResult.Services())
+    {
+        auto charsResult = service.GetCharacteristicsAsync().get();
+        if (charsResult.Status() != GattCommunicationStatus::Success) continue;
+        for (auto characteristic : charsResult.Characteristics())
+        {
+            if (characteristic.Uuid() == inputUuid)
+                inputChar = characteristic; // 入力用
+            else if (characteristic.Uuid() == writeUuid)
+                writeChar = characteristic; // 書き込み用
+        }
+    }
+    if (!inputChar) return nullptr;
+
+    StoreGattLocation(address, gatt_location(inputChar), gatt_location(writeChar));
+    auto now = std::chrono::steady_clock::now();
+    RecordConnectTime(ConnectPath::Discovery, now - start, now - resolveStart);
+    return std::make_shared<WinRtDevice>(device, inputChar, writeChar);
+}
@@ -0,0 +1,15 @@
+﻿#pragma once
+
+#include "Transport.h"
+
+/**
+ * @class WinRtTransport
+ * @brief WinRT (Windows.Devices.Bluetooth) による通信バックエンド
+ */
+class WinRtTransport : public Transport {
+public:
+    WinRtTransport();
+
+    bool Scan(ScanHandler handler, std::chrono::milliseconds timeout) override;
+    std::shared_ptr<TransportDevice> Connect(uint64_t address) override;
+};
@@ -1,12 +1,7 @@
-﻿#include <winrt/Windows.Foundation.h>
-#include <winrt/Windows.Foundation.Collections.h>
-#include <winrt/Windows.Storage.Streams.h>
-#include <winrt/Windows.Devices.Bluetooth.h>
-#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
-#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
-
+﻿#ifdef _WIN32
 #pragma comment(lib, "setupapi.lib") // SetupAPIライブラリをリンク（デバイス情報取得などに使用）
 #include <Windows.h>
+#endif
 
 #include <iostream>
 #include <vector>
@@ -22,26 +17,37 @@
 #include <chrono>
 #include <fstream>
 #include <string>
+#include <cmath>
 
 #include "JoyConDecoder.h"
-
+#include "GyroCalibration.h"
+#include "DeviceCache.h"
+#include "OutputClock.h"
+#include "ConfigWatcher.h"
+#include "MouseMapper.h"
+#include "OutputSink.h"
+#include "Transport.h"
+#include "JoyConConnection.h"
+#include "PlayerRegistry.h"
+#include "Session.h"
+
+#ifdef _WIN32
 #include <ViGEm/Client.h>  // ViGEm (Virtual Gamepad Emulation Framework) クライアント
 #include <ViGEm/Common.h>  // ViGEm の共通定義
-
-// マウス感度のグローバル変数
-double mouse_sensitivity = 1.0;
+#endif
 
 /**
  * @brief mouse_sensitivity.txt からマウス感度を読み込む
+ * @param config 読み込んだ値を格納する設定（読めなければ既定値のまま）
  */
-void LoadMouseSensitivity() {
+void LoadMouseSensitivity(MouseConfig& config) {
     std::ifstream ifs("mouse_sensitivity.txt");
     if (ifs.is_open()) {
         std::string line;
         if (std::getline(ifs, line)) {
             try {
-                mouse_sensitivity = std::stod(line);
-                std::wcout << L"Mouse sensitivity set to: " << mouse_sensitivity << std::endl;
+                config.sensitivity = std::stod(line);
+                std::wcout << L"Mouse sensitivity set to: " << config.sensitivity << std::endl;
             }
             catch (const std::invalid_argument&) {
                 std::wcerr << L"Invalid format in mouse_sensitivity.txt. Using default value 1.0." << std::endl;
@@ -56,23 +62,17 @@ void LoadMouseSensitivity() {
     }
 }
 
-using namespace winrt;
-using namespace Windows::Devices::Bluetooth;
-using namespace Windows::Devices::Bluetooth::Advertisement;
-using namespace Windows::Devices::Bluetooth::GenericAttributeProfile;
-using namespace Windows::Storage::Streams;
-using namespace Windows::Foundation;
-
-// 定数定義
-
-// Joy-ConのBluetooth Manufacturer ID (Nintendo)
-constexpr uint16_t JOYCON_MANUFACTURER_ID = 1363;
-// Joy-ConのAdvertisementパケットに含まれる製造元データのプレフィックス
-const std::vector<uint8_t> JOYCON_MANUFACTURER_PREFIX = { 0x01, 0x00, 0x03, 0x7E };
-// Joy-ConのGATTサービスで入力レポートを受け取るためのキャラクタリスティックUUID
-const wchar_t* INPUT_REPORT_UUID = L"ab7de9be-89fe-49ad-828f-118f09df7fd2";
-// Joy-Conにコマンドを送信するためのキャラクタリスティックUUID
-const wchar_t* WRITE_COMMAND_UUID = L"649d4ac9-8eb7-4e6c-af44-1ea54fe5f005";
+/**
+ * @brief マウス操作の設定をファイルから読み込む（mouse_sensitivity.txt, scroll.txt, mouse_bindings.txt）
+ */
+MouseConfig LoadMouseConfig()
+{
+    MouseConfig config;
+    LoadMouseSensitivity(config);
+    LoadScrollConfig(config.scroll);
+    LoadMouseBindings(config);
+    return config;
+}
 
 // ViGEmクライアントのグローバルポインタ
 PVIGEM_CLIENT vigem_client = nullptr;
@@ -82,6 +82,10 @@ PVIGEM_CLIENT vigem_client = nullptr;
  */
 void InitializeViGEm()
 {
+#ifndef _WIN32
+    std::wcerr << L"ViGEm is only available on Windows.\n";
+    exit(1); // エラーで終了
+#else
     // 既に初期化済みの場合は何もしない
     if (vigem_client != nullptr)
         return;
@@ -103,6 +107,7 @@ void InitializeViGEm()
     }
 
     std::wcout << L"ViGEm client initialized and connected.\n";
+#endif
 }
 
 /**
@@ -191,267 +196,6 @@ void PrintDS4ReportState(const DS4_REPORT_EX& report) {
     std::wcout << L"          ";
 }
 
-
-static bool prevLeftButtonState = false;
-static bool prevRightButtonState = false;
-static bool prevMiddleButtonState = false;
-static bool prevXButton1State = false;
-static bool prevXButton2State = false;
-static std::optional<std::pair<uint16_t, uint16_t>> prevMouseState = std::nullopt;
-
-void OperateMouse(const DS4_REPORT_EX& report, const JoyConSide& joyconSide)
-{
-    static auto last_call_time = std::chrono::system_clock::now();
-    auto now = std::chrono::system_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_call_time).count();
-    std::wcout << L"\r[DEBUG] OperateMouse called after " << std::setw(4) << duration << L" ms. ";
-    last_call_time = now;
-
-    std::vector<INPUT> inputs;
-
-    // マウスの左ボタンの状態を確認 (Joy-ConのZL)
-    uint16_t leftButtonMask = joyconSide == JoyConSide::Left ? DS4_BUTTON_TRIGGER_LEFT : DS4_BUTTON_TRIGGER_RIGHT;
-    bool currentLeftButtonState = (report.Report.wButtons & leftButtonMask);
-    if (currentLeftButtonState != prevLeftButtonState)
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = currentLeftButtonState ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP;
-        inputs.push_back(input);
-        prevLeftButtonState = currentLeftButtonState;
-    }
-
-    // マウスの右ボタンの状態を確認 (Joy-ConのL)
-    uint16_t rightButtonMask = joyconSide == JoyConSide::Left ? DS4_BUTTON_SHOULDER_LEFT: DS4_BUTTON_SHOULDER_RIGHT;
-    bool currentRightButtonState = (report.Report.wButtons & rightButtonMask);
-    if (currentRightButtonState != prevRightButtonState)
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = currentRightButtonState ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP;
-        inputs.push_back(input);
-        prevRightButtonState = currentRightButtonState;
-    }
-
-    // マウスの中ボタンの状態を確認 (Joy-Conのアナログスティックボタン)
-    uint16_t middleButtonMask = joyconSide == JoyConSide::Left ? DS4_BUTTON_THUMB_LEFT: DS4_BUTTON_THUMB_RIGHT;
-    bool currentMiddleButtonState = (report.Report.wButtons & middleButtonMask);
-    if (currentMiddleButtonState != prevMiddleButtonState)
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = currentMiddleButtonState ? MOUSEEVENTF_MIDDLEDOWN : MOUSEEVENTF_MIDDLEUP;
-        inputs.push_back(input);
-        prevMiddleButtonState = currentMiddleButtonState;
-    }
-
-    // マウスの進むボタンの状態を確認
-    bool currentXButton1State;
-    if(joyconSide == JoyConSide::Left)
-        currentXButton1State = ((report.Report.wButtons & 0xF)== DS4_BUTTON_DPAD_SOUTH);
-    else
-        currentXButton1State = (report.Report.wButtons & DS4_BUTTON_CROSS);
-    if (currentXButton1State != prevXButton1State)
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = currentXButton1State ? MOUSEEVENTF_XDOWN : MOUSEEVENTF_XUP;
-        input.mi.mouseData = XBUTTON1;
-        inputs.push_back(input);
-        prevXButton1State = currentXButton1State;
-    }
-
-    // マウスの戻るボタンの状態を確認
-    bool currentXButton2State;
-    if(joyconSide == JoyConSide::Left)
-        currentXButton2State = ((report.Report.wButtons & 0xF)== DS4_BUTTON_DPAD_NORTH);
-    else
-        currentXButton2State = (report.Report.wButtons & DS4_BUTTON_TRIANGLE);
-    if (currentXButton2State != prevXButton2State)
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.dwFlags = currentXButton2State ? MOUSEEVENTF_XDOWN : MOUSEEVENTF_XUP;
-        input.mi.mouseData = XBUTTON2;
-        inputs.push_back(input);
-        prevXButton2State = currentXButton2State;
-    }
-
-    // マウスカーソルの操作
-    uint16_t x = report.Report.sCurrentTouch.bTouchData1[0] | ((report.Report.sCurrentTouch.bTouchData1[1] & 0x0F) << 8);
-    uint16_t y = ((report.Report.sCurrentTouch.bTouchData1[1] & 0xF0) >> 4) | (report.Report.sCurrentTouch.bTouchData1[2] << 4);
-    if(prevMouseState)
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.dx = static_cast<LONG>((x - prevMouseState.value().first) * mouse_sensitivity);
-        input.mi.dy = static_cast<LONG>((prevMouseState.value().second - y) * mouse_sensitivity);
-        input.mi.dwFlags = MOUSEEVENTF_MOVE;
-        inputs.push_back(input);
-        prevMouseState = {x, y};
-    }
-    else
-        prevMouseState = {x, y};
-
-    // マウススクロールの操作
-    {
-        INPUT input{};
-        input.type = INPUT_MOUSE;
-        input.mi.mouseData = 128 - static_cast<int>(report.Report.bThumbLY);
-        input.mi.dwFlags = MOUSEEVENTF_WHEEL;
-        inputs.push_back(input);
-    }
-
-
-    if (!inputs.empty())
-    {
-        SendInput(static_cast<UINT>(inputs.size()), inputs.data(), sizeof(INPUT));
-    }
-}
-
-/**
- * @brief Joy-Conに初期化用のカスタムコマンドを送信
- * @param characteristic コマンド書き込み用のGATTキャラクタリスティック
- * @note Joy-Conが安定してレポートを送信するために必要
- */
-void SendCustomCommands(GattCharacteristic const& characteristic)
-{
-    // 送信するコマンドのリスト
-    std::vector<std::vector<uint8_t>> commands = {
-        { 0x0c, 0x91, 0x01, 0x02, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 },
-        { 0x0c, 0x91, 0x01, 0x04, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 }
-    };
-
-    for (const auto& cmd : commands)
-    {
-        auto writer = DataWriter();
-        writer.WriteBytes(cmd);
-        IBuffer buffer = writer.DetachBuffer();
-
-        // コマンドを非同期で書き込み、完了を待つ
-        auto status = characteristic.WriteValueAsync(buffer, GattWriteOption::WriteWithoutResponse).get();
-
-        if (status == GattCommunicationStatus::Success)
-        {
-            std::wcout << L"Command sent successfully.\n";
-        }
-        else
-        {
-            std::wcout << L"Failed to send command.\n";
-        }
-
-        // コマンド間に短い待機時間を入れる
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    }
-}
-
-/**
- * @struct ConnectedJoyCon
- * @brief 接続されたJoy-Conのデバイス情報とGATTキャラクタリスティックを保持する構造体
- */
-struct ConnectedJoyCon {
-    BluetoothLEDevice device = nullptr;       // Bluetoothデバイスオブジェクト
-    GattCharacteristic inputChar = nullptr; // 入力レポート用キャラクタリスティック
-    GattCharacteristic writeChar = nullptr; // コマンド書き込み用キャラクタリスティック
-};
-
-/**
- * @brief Joy-ConからのBluetooth LEアドバタイズを待ち受け、接続を試みる
- * @param prompt ユーザーに表示するプロンプトメッセージ
- * @return 接続に成功したJoy-Conの情報 (ConnectedJoyCon)
- */
-ConnectedJoyCon WaitForJoyCon(const std::wstring& prompt)
-{
-    std::wcout << prompt << L"\n";
-
-    ConnectedJoyCon cj{}; // 戻り値用の構造体
-
-    BluetoothLEDevice device = nullptr;
-    bool connected = false;
-
-    // Bluetooth LEアドバタイズメントウォッチャーを作成
-    BluetoothLEAdvertisementWatcher watcher;
-
-    // 同期用のミューテックスと条件変数
-    std::mutex mtx;
-    std::condition_variable cv;
-
-    // アドバタイズメント受信時のイベントハンドラ（ラムダ式）
-    watcher.Received([&](auto const&, auto const& args)
-        {
-            std::unique_lock<std::mutex> lock(mtx);
-            if (connected) return; // 既に接続済みの場合は無視
-
-            // アドバタイズメントから製造元データを取得
-            auto mfg = args.Advertisement().ManufacturerData();
-            for (uint32_t i = 0; i < mfg.Size(); i++)
-            {
-                auto section = mfg.GetAt(i);
-                // 会社IDが任天堂(1363)でなければスキップ
-                if (section.CompanyId() != JOYCON_MANUFACTURER_ID) continue;
-
-                // 製造元データがJoy-Conのプレフィックスと一致するか確認
-                auto reader = DataReader::FromBuffer(section.Data());
-                std::vector<uint8_t> data(reader.UnconsumedBufferLength());
-                reader.ReadBytes(data);
-                if (data.size() >= JOYCON_MANUFACTURER_PREFIX.size() &&
-                    std::equal(JOYCON_MANUFACTURER_PREFIX.begin(), JOYCON_MANUFACTURER_PREFIX.end(), data.begin()))
-                {
-                    // 一致したら、そのデバイスに接続を試みる
-                    device = BluetoothLEDevice::FromBluetoothAddressAsync(args.BluetoothAddress()).get();
-                    if (!device) return; // 接続失敗
-
-                    connected = true; // 接続成功フラグを立てる
-                    watcher.Stop();   // スキャンを停止
-                    cv.notify_one();  // 待機中のメインスレッドに通知
-                    return;
-                }
-            }
-        });
-
-    watcher.ScanningMode(BluetoothLEScanningMode::Active); // アクティブスキャンモード
-    watcher.Start(); // スキャン開始
-
-    std::wcout << L"Scanning for Joy-Con... (Waiting up to 30 seconds)\n";
-
-    {
-        std::unique_lock<std::mutex> lock(mtx);
-        // 30秒のタイムアウト付きで、接続が成功するのを待つ
-        if (!cv.wait_for(lock, std::chrono::seconds(30), [&]() { return connected; }))
-        {
-            watcher.Stop();
-            std::wcerr << L"Timeout: Joy-Con not found.\n";
-            exit(1);
-        }
-    }
-
-    cj.device = device;
-
-    // GATTサービスを取得
-    auto servicesResult = device.GetGattServicesAsync().get();
-    if (servicesResult.Status() != GattCommunicationStatus::Success)
-    {
-        std::wcerr << L"Failed to get GATT services.\n";
-        exit(1);
-    }
-
-    // 全てのサービスをループして、目的のキャラクタリスティックを探す
-    for (auto service : servicesResult.Services())
-    {
-        auto charsResult = service.GetCharacteristicsAsync().get();
-        if (charsResult.Status() != GattCommunicationStatus::Success) continue;
-        for (auto characteristic : charsResult.Characteristics())
-        {
-            if (characteristic.Uuid() == guid(INPUT_REPORT_UUID))
-                cj.inputChar = characteristic; // 入力用
-            else if (characteristic.Uuid() == guid(WRITE_COMMAND_UUID))
-                cj.writeChar = characteristic; // 書き込み用
-        }
-    }
-
-    return cj;
-}
-
 /**
  * @enum ControllerType
  * @brief ユーザーが選択するコントローラーの種類
@@ -474,99 +218,315 @@ struct PlayerConfig {
 };
 
 
-// 単体Joy-Conプレイヤー用
+// マウス操作を行う単体Joy-Conプレイヤー用
+// 破棄すると入力の通知を止めてから、出力先を解放する
 struct SingleJoyConPlayer {
-    ConnectedJoyCon joycon;         // 接続情報
-    PVIGEM_TARGET ds4Controller;    // 仮想DS4コントローラー
+    std::shared_ptr<ReconnectingDevice> joycon; // 接続したJoy-Con
+    std::unique_ptr<TimedSink> sink;            // 出力先（仮想DS4コントローラーとマウス）
+    std::optional<JoyConSide> requestedSide; // 選択された左右（自動判定はnullopt）
     JoyConSide side;                // 左右どちらか
     JoyConOrientation orientation;  // 持ち方
+    std::unique_ptr<GyroBiasEstimator> gyroBias; // ジャイロのバイアス推定器
+    std::unique_ptr<MouseState> mouse;           // プレイヤーごとのマウスの状態
+
+    ~SingleJoyConPlayer()
+    {
+        joycon->Close();
+        PrintReconnectStats(joycon->Address(), joycon->Stats());
+        if (sink) {
+            PrintSinkTiming(*sink);
+            sink.reset();
+        }
+    }
 };
 
+// デバッグ表示の間隔（秒）
+constexpr float DEBUG_PRINT_INTERVAL = 0.5f;
 
 /**
- * @brief メイン関数
+ * @brief Joy-Conの左右をコンソールで選択してもらう
+ * @param number プレイヤー番号（1から）
+ * @return 選択された左右（自動判定ならnullopt）
  */
-int main()
+std::optional<JoyConSide> PromptJoyConSide(int number)
 {
-    // マウス感度をファイルから読み込み
-    LoadMouseSensitivity();
-
-    // WinRT (COM) を使用するためにアパートメントを初期化
-    init_apartment();
-    // ViGEmを初期化
-    InitializeViGEm();
-
-    // L/Rの選択
     std::wstring line;
-    JoyConSide joyconSide;
+    std::wcout << L"Player " << number << L":\n";
     while (true) {
-        std::wcout << L"  Which side? (L=Left, R=Right): ";
+        std::wcout << L"  Which side? (L=Left, R=Right, A=Auto detect): ";
         std::getline(std::wcin, line);
-        if (line == L"L" || line == L"R" || line == L"l" || line == L"r") {
-            joyconSide = (line == L"L" || line == L"l") ? JoyConSide::Left : JoyConSide::Right;
-            break;
-        }
-        std::wcout << L"Invalid input. Please enter L or R.\n";
+        if (line == L"L" || line == L"R" || line == L"l" || line == L"r")
+            return (line == L"L" || line == L"l") ? JoyConSide::Left : JoyConSide::Right;
+        if (line == L"A" || line == L"a")
+            return std::nullopt;
+        std::wcout << L"Invalid input. Please enter L, R or A.\n";
+    }
+}
+
+/**
+ * @brief 接続したJoy-Conからプレイヤーを作成し、入力の通知を開始する
+ * @param number プレイヤー番号（表示用、1から）
+ * @param side 選択された左右（nulloptなら接続したJoy-Conから判定する）
+ * @param cj 接続したJoy-Con
+ * @param outputType 出力先の種類
+ * @param mouseConfig マウス操作の設定（実行中に差し替わる）
+ * @return 作成したプレイヤー
+ */
+std::shared_ptr<SingleJoyConPlayer> CreatePlayer(int number, std::optional<JoyConSide> side, std::shared_ptr<ReconnectingDevice> cj,
+    OutputSinkType outputType, const LiveConfig<MouseConfig>& mouseConfig)
+{
+    std::wcout << L"Player " << number << L" setup...\n";
+
+    ControllerModel model = cj->Model();
+    JoyConSide joyconSide;
+    if (side) {
+        joyconSide = *side;
+        if ((model == ControllerModel::JoyConLeft && joyconSide != JoyConSide::Left) ||
+            (model == ControllerModel::JoyConRight && joyconSide != JoyConSide::Right))
+            std::wcerr << L"Selected side does not match the connected " << ControllerModelName(model) << L".\n";
     }
-    std::wstring sideStr = (joyconSide == JoyConSide::Left) ? L"Left" : L"Right";
-    std::wcout << L"Please sync your single " + sideStr + L" Joy-Con.\n";
-    ConnectedJoyCon cj = WaitForJoyCon(L"Waiting for " + sideStr + L" Joy-Con...");
-
-    // 仮想DS4コントローラーを作成
-    PVIGEM_TARGET ds4_controller = vigem_target_ds4_alloc();
-    auto ret = vigem_target_add(vigem_client, ds4_controller);
-    if(!VIGEM_SUCCESS(ret))
+    else {
+        // 種類が分からない場合は右として扱う
+        joyconSide = (model == ControllerModel::JoyConLeft) ? JoyConSide::Left : JoyConSide::Right;
+        std::wcout << L"Detected " << ControllerModelName(model) << L".\n";
+    }
+    StoreControllerModel(cj->Address(), joyconSide == JoyConSide::Left ? ControllerModel::JoyConLeft : ControllerModel::JoyConRight);
+
+    auto player = std::make_shared<SingleJoyConPlayer>();
+    player->joycon = cj;
+
+    // 出力先（仮想DS4コントローラーとマウス）を作成
+    auto sink = CreateOutputSink(outputType, vigem_client);
+    if (!sink)
     {
-        std::wcerr << L"Failed to add DS4 contoller target: 0x" << std::hex << ret << L"\n";
+        std::wcerr << L"Failed to create output sink.\n";
         exit(1);
     }
+    player->sink = std::make_unique<TimedSink>(std::move(sink));
 
-    SingleJoyConPlayer player{cj, ds4_controller, joyconSide, JoyConOrientation::Upright};
+    player->requestedSide = side;
+    player->side = joyconSide;
+    player->orientation = JoyConOrientation::Upright;
+    player->gyroBias = std::make_unique<GyroBiasEstimator>(cj->Address());
+    player->mouse = std::make_unique<MouseState>(joyconSide, mouseConfig);
 
     // Joy-Conからの入力があったときのイベントハンドラを設定
-    player.joycon.inputChar.ValueChanged([joyconSide = player.side, joyconOrientation = player.orientation, &player](GattCharacteristic const&, GattValueChangedEventArgs const& args)
+    // （プレイヤーはJoy-Conを閉じてから破棄されるので、生ポインタで参照する）
+    bool subscribed = player->joycon->Subscribe([p = player.get(), buffer = std::vector<uint8_t>()](std::span<const uint8_t> data) mutable
         {
-            // 生データを読み取り
-            auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-            std::vector<uint8_t> buffer(reader.UnconsumedBufferLength());
-            reader.ReadBytes(buffer);
+            // 生データを読み取り（受信ごとに同じバッファを再利用）
+            buffer.assign(data.begin(), data.end());
 
-            // レポートを生成
-            DS4_REPORT_EX report = GenerateDS4Report(buffer, joyconSide, joyconOrientation);
+            // ジャイロのバイアスを推定・補正
+            p->gyroBias->Process(buffer);
 
-            // 状態をコンソール出力
-            // PrintDS4ReportState(report);
+            // レポートを生成
+            DS4_REPORT_EX report = GenerateDS4Report(buffer, p->side, p->orientation);
 
-            // マウス操作
-            OperateMouse(report, joyconSide);
+            // マウス操作（変化のあったイベントだけをまとめて1回で送信）
+            MouseEventBuffer events(*p->sink);
+            p->mouse->Update(report, events);
+            events.Flush();
 
             // 仮想コントローラーの状態を更新
-            auto ret = vigem_target_ds4_update_ex(vigem_client, player.ds4Controller, report);
-            if (!VIGEM_SUCCESS(ret)) {
-                std::wcerr << L"Failed to update DS4 EX report: 0x" << std::hex << ret << L"\n";
-            }
+            p->sink->SubmitReport(report);
         });
 
-    // 通知を有効化
-    auto status = player.joycon.inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
-        GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
-
-    // 初期化コマンドを送信
-    if (player.joycon.writeChar)
-        SendCustomCommands(player.joycon.writeChar);
-
-    if (status == GattCommunicationStatus::Success)
+    if (subscribed)
         std::wcout << L"Notifications enabled.\n";
     else
         std::wcout << L"Failed to enable notifications.\n";
 
-    std::wcout << L"LEFT Joy-Con connected. Press Enter to exit...\n";
-    std::wstring dummy;
-    std::getline(std::wcin, dummy);
+    return player;
+}
+
+
+/**
+ * @brief メイン関数
+ */
+int main(int argc, char* argv[])
+{
+    // コマンドライン引数を解析
+    SessionOptions options;
+    options.path = "mouse_session.txt";
+    if (!ParseSessionOptions(argc, argv, options)) {
+        PrintSessionUsage(argv[0]);
+        return 1;
+    }
+
+    // マウス感度、スクロール、ボタン割り当ての設定をファイルから読み込み、変更を監視して実行中に差し替える
+    LiveConfig<MouseConfig> mouseConfig(LoadMouseConfig());
+    ConfigWatcher configWatcher({ "mouse_sensitivity.txt", "scroll.txt", "mouse_bindings.txt" }, [&mouseConfig]()
+        {
+            mouseConfig.Publish(LoadMouseConfig());
+            std::wcout << L"Mouse settings reloaded.\n";
+        });
+    configWatcher.Start();
+    // 前回までのジャイロバイアスと接続情報を読み込み
+    LoadGyroBiasCache();
+    LoadDeviceCache();
+    // 通知の途絶の検出と再接続の設定を読み込み
+    ReconnectConfig reconnectConfig;
+    LoadReconnectConfig(reconnectConfig);
+
+    // 通信バックエンドを作成（WinRTのBluetooth、またはループバック）
+    auto transport = CreateTransport();
+    // コマンド送信キュー（初期化コマンドを全デバイスで交互に送る）
+    CommandQueue commandQueue;
+    // 出力先を選ぶ（ViGEmの場合は初期化）
+    OutputSinkType outputType = SelectOutputSinkType();
+    if (outputType == OutputSinkType::ViGEm)
+        InitializeViGEm();
+
+    // 引数で指定されたプレイヤー、または前回のセッションを使う（どちらも無ければ質問する）
+    Session session = ResolveSession(options);
+    std::wstring line;
+
+    bool is_debug = session.debug.value_or(false); // デバッグ表示のON/OFF
+    while (!session.debug) {
+        std::wcout << L"  Debug Mode? (y/n): ";
+        std::getline(std::wcin, line);
+        if (line == L"n" || line == L"N")      { session.debug = false; }
+        else if (line == L"y" || line == L"Y") { session.debug = true; }
+        else std::wcout << L"Invalid input. Please enter y or n.\n";
+        is_debug = session.debug.value_or(false);
+    }
+
+    // L/Rの選択（空なら接続したJoy-Conから自動判定）と、割り当てるアドレス（0はスキャンで探す）
+    std::vector<std::optional<JoyConSide>> playerSides;
+    std::vector<uint64_t> addresses;
+    if (session.players.empty()) {
+        int numPlayers;
+        std::wcout << L"How many players? ";
+        std::wcin >> numPlayers;
+        std::wcin.ignore(); // 改行文字をバッファからクリア
+
+        for (int i = 0; i < numPlayers; ++i)
+            playerSides.push_back(PromptJoyConSide(i + 1));
+        addresses.resize(playerSides.size(), 0);
+    }
+    else {
+        for (const auto& player : session.players) {
+            playerSides.push_back(player.side);
+            addresses.push_back(player.addresses.empty() ? 0 : player.addresses[0]);
+        }
+    }
+    size_t numPlayers = playerSides.size();
+
+    // 既知のJoy-Conはスキャンせずに並行して接続し、残りは1回のスキャンで探して接続・初期化
+    std::vector<std::shared_ptr<ReconnectingDevice>> devices;
+    if (std::all_of(addresses.begin(), addresses.end(), [](uint64_t address) { return address == 0; })) {
+        std::wcout << L"Please sync all Joy-Cons now, in player order.\n";
+        devices = ConnectJoyCons(*transport, numPlayers, commandQueue, reconnectConfig);
+    }
+    else {
+        devices = ConnectJoyConsByAddress(*transport, addresses, commandQueue, reconnectConfig);
+    }
+
+    // 実行中に追加・削除できるプレイヤーの一覧（カーソルクロックはロックを取らずに参照する）
+    PlayerRegistry<SingleJoyConPlayer> players;
+    for (size_t i = 0; i < numPlayers; ++i)
+        players.Add(CreatePlayer(static_cast<int>(i) + 1, playerSides[i], devices[i], outputType, mouseConfig));
+    devices.clear();
+
+    // スクロールは入力の通知とは独立に、高頻度のクロックで滑らかに送信する
+    // デバッグ表示も入力スレッドではなくこのクロックから低頻度で行う
+    float debugElapsed = 0.0f;
+    OutputClock cursorClock([&players, is_debug, &debugElapsed](float dt)
+        {
+            // プレイヤーの追加・削除中も、その時点の一覧で処理を続ける
+            auto snapshot = players.Read();
+
+            for (const auto& player : *snapshot) {
+                if (!player) continue;
+                MouseEventBuffer events(*player->sink);
+                player->mouse->Tick(dt, events);
+                events.Flush();
+            }
+
+            if (!is_debug) return;
+            debugElapsed += dt;
+            if (debugElapsed < DEBUG_PRINT_INTERVAL) return;
+            debugElapsed = 0.0f;
+
+            std::wcout << L"\r[DEBUG]";
+            for (size_t i = 0; i < snapshot->size(); ++i) {
+                const auto& player = (*snapshot)[i];
+                if (!player) continue;
+                std::wcout << L" P" << (i + 1) << L": " << std::setw(4) << std::lround(player->mouse->LastIntervalMs())
+                    << L" ms, buttons " << player->mouse->Buttons() << L".";
+            }
+            std::wcout << L"   " << std::flush;
+        });
+    cursorClock.Start();
+
+    std::wcout << L"All Joy-Cons connected.\n";
+
+    // 実行中のプレイヤーの追加・削除を受け付ける（他のプレイヤーの入力とカーソルは止まらない）
+    while (true) {
+        std::wcout << L"Commands: a=Add player, r<N>=Remove player N, Enter=Exit\n";
+        if (!std::getline(std::wcin, line) || line.empty()) break;
+
+        if (line == L"a" || line == L"A") {
+            // 空いている最初の番号で参加する
+            size_t slot = players.FreeSlot();
+            auto side = PromptJoyConSide(static_cast<int>(slot) + 1);
+            std::wcout << L"Please sync the Joy-Con now.\n";
+            auto added = TryConnectJoyCons(*transport, 1, commandQueue, reconnectConfig);
+            if (added.empty()) {
+                std::wcerr << L"Player " << (slot + 1) << L" was not added.\n";
+                continue;
+            }
+            players.Replace(slot, CreatePlayer(static_cast<int>(slot) + 1, side, added[0], outputType, mouseConfig));
+            std::wcout << L"Player " << (slot + 1) << L" ready.\n";
+        }
+        else if (line[0] == L'r' || line[0] == L'R') {
+            int number = 0;
+            try {
+                number = std::stoi(line.substr(1));
+            }
+            catch (const std::exception&) {
+            }
+            if (number <= 0 || !players.Remove(static_cast<size_t>(number) - 1)) {
+                std::wcout << L"Invalid player number.\n";
+                continue;
+            }
+            std::wcout << L"Player " << number << L" removed.\n";
+        }
+        else {
+            std::wcout << L"Invalid input.\n";
+        }
+    }
+
+    // 次回の起動時に同じプレイヤーとJoy-Conで復元できるように保存
+    if (options.save) {
+        Session saved;
+        saved.debug = is_debug;
+        {
+            auto snapshot = players.Read();
+            for (const auto& player : *snapshot) {
+                if (!player) continue;
+                SessionPlayer sp;
+                sp.controllerType = 1; // Joy-Con単体
+                sp.side = player->requestedSide;
+                sp.addresses.push_back(player->joycon->Address());
+                saved.players.push_back(sp);
+            }
+        }
+        SaveSession(options.path, saved);
+    }
+
+    // リソース開放（クロックを止めてから、入力の通知を止めて仮想コントローラーを解放する）
+    cursorClock.Stop();
+    players.Clear();
+    configWatcher.Stop();
+
+    // キャッシュの有無による接続時間の差を表示
+    PrintConnectTimingStats();
 
-    // リソース開放
-    vigem_target_remove(vigem_client, player.ds4Controller);
-    vigem_target_free(player.ds4Controller);
+    // 推定したジャイロバイアスと接続情報を次回の接続用に保存
+    SaveGyroBiasCache();
+    SaveDeviceCache();
 
 
     return 0;
@@ -1,15 +1,11 @@
-﻿#include <winrt/Windows.Foundation.h>
-#include <winrt/Windows.Foundation.Collections.h>
-#include <winrt/Windows.Storage.Streams.h>
-#include <winrt/Windows.Devices.Bluetooth.h>
-#include <winrt/Windows.Devices.Bluetooth.Advertisement.h>
-#include <winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h>
-
+﻿#ifdef _WIN32
 #pragma comment(lib, "setupapi.lib") // SetupAPIライブラリをリンク（デバイス情報取得などに使用）
 #include <Windows.h>
+#endif
 
 #include <iostream>
 #include <vector>
+#include <array>
 #include <algorithm>
 #include <thread>
 #include <mutex>
@@ -17,29 +13,29 @@
 #include <condition_variable>
 #include <memory>
 #include <iomanip>
+#include <string>
+#include <cwctype>
 
 #include "JoyConDecoder.h"
-
+#include "GyroCalibration.h"
+#include "DeviceCache.h"
+#include "OutputClock.h"
+#include "OutputPipeline.h"
+#include "StreamSync.h"
+#include "Transport.h"
+#include "JoyConConnection.h"
+#include "PlayerRegistry.h"
+#include "Session.h"
+#include "OutputSink.h"
+#include "ControllerFeedback.h"
+#include "DsuServer.h"
+#include "NetworkStream.h"
+#include "SharedStatePublisher.h"
+
+#ifdef _WIN32
 #include <ViGEm/Client.h>  // ViGEm (Virtual Gamepad Emulation Framework) クライアント
 #include <ViGEm/Common.h>  // ViGEm の共通定義
-
-using namespace winrt;
-using namespace Windows::Devices::Bluetooth;
-using namespace Windows::Devices::Bluetooth::Advertisement;
-using namespace Windows::Devices::Bluetooth::GenericAttributeProfile;
-using namespace Windows::Storage::Streams;
-using namespace Windows::Foundation;
-
-// 定数定義
-
-// Joy-ConのBluetooth Manufacturer ID (Nintendo)
-constexpr uint16_t JOYCON_MANUFACTURER_ID = 1363;
-// Joy-ConのAdvertisementパケットに含まれる製造元データのプレフィックス
-const std::vector<uint8_t> JOYCON_MANUFACTURER_PREFIX = { 0x01, 0x00, 0x03, 0x7E };
-// Joy-ConのGATTサービスで入力レポートを受け取るためのキャラクタリスティックUUID
-const wchar_t* INPUT_REPORT_UUID = L"ab7de9be-89fe-49ad-828f-118f09df7fd2";
-// Joy-Conにコマンドを送信するためのキャラクタリスティックUUID
-const wchar_t* WRITE_COMMAND_UUID = L"649d4ac9-8eb7-4e6c-af44-1ea54fe5f005";
+#endif
 
 // ViGEmクライアントのグローバルポインタ
 PVIGEM_CLIENT vigem_client = nullptr;
@@ -49,6 +45,10 @@ PVIGEM_CLIENT vigem_client = nullptr;
  */
 void InitializeViGEm()
 {
+#ifndef _WIN32
+    std::wcerr << L"ViGEm is only available on Windows.\n";
+    exit(1); // エラーで終了
+#else
     // 既に初期化済みの場合は何もしない
     if (vigem_client != nullptr)
         return;
@@ -70,6 +70,22 @@ void InitializeViGEm()
     }
 
     std::wcout << L"ViGEm client initialized and connected.\n";
+#endif
+}
+
+/**
+ * @brief ViGEmクライアントをバスから切断し、解放する（初期化していなければ何もしない）
+ */
+void ShutdownViGEm()
+{
+#ifdef _WIN32
+    if (vigem_client)
+    {
+        vigem_disconnect(vigem_client);
+        vigem_free(vigem_client);
+        vigem_client = nullptr;
+    }
+#endif
 }
 
 /**
@@ -158,154 +174,12 @@ void PrintDS4ReportState(const DS4_REPORT_EX& report) {
     std::wcout << L"          ";
 }
 
-/**
- * @brief Joy-Conに初期化用のカスタムコマンドを送信
- * @param characteristic コマンド書き込み用のGATTキャラクタリスティック
- * @note Joy-Conが安定してレポートを送信するために必要
- */
-void SendCustomCommands(GattCharacteristic const& characteristic)
-{
-    // 送信するコマンドのリスト
-    std::vector<std::vector<uint8_t>> commands = {
-        { 0x0c, 0x91, 0x01, 0x02, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 },
-        { 0x0c, 0x91, 0x01, 0x04, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 }
-    };
-
-    for (const auto& cmd : commands)
-    {
-        auto writer = DataWriter();
-        writer.WriteBytes(cmd);
-        IBuffer buffer = writer.DetachBuffer();
-
-        // コマンドを非同期で書き込み、完了を待つ
-        auto status = characteristic.WriteValueAsync(buffer, GattWriteOption::WriteWithoutResponse).get();
-
-        if (status == GattCommunicationStatus::Success)
-        {
-            std::wcout << L"Command sent successfully.\n";
-        }
-        else
-        {
-            std::wcout << L"Failed to send command.\n";
-        }
-
-        // コマンド間に短い待機時間を入れる
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    }
-}
-
-/**
- * @struct ConnectedJoyCon
- * @brief 接続されたJoy-Conのデバイス情報とGATTキャラクタリスティックを保持する構造体
- */
-struct ConnectedJoyCon {
-    BluetoothLEDevice device = nullptr;       // Bluetoothデバイスオブジェクト
-    GattCharacteristic inputChar = nullptr; // 入力レポート用キャラクタリスティック
-    GattCharacteristic writeChar = nullptr; // コマンド書き込み用キャラクタリスティック
-};
-
-/**
- * @brief Joy-ConからのBluetooth LEアドバタイズを待ち受け、接続を試みる
- * @param prompt ユーザーに表示するプロンプトメッセージ
- * @return 接続に成功したJoy-Conの情報 (ConnectedJoyCon)
- */
-ConnectedJoyCon WaitForJoyCon(const std::wstring& prompt)
-{
-    std::wcout << prompt << L"\n";
-
-    ConnectedJoyCon cj{}; // 戻り値用の構造体
-
-    BluetoothLEDevice device = nullptr;
-    bool connected = false;
-
-    // Bluetooth LEアドバタイズメントウォッチャーを作成
-    BluetoothLEAdvertisementWatcher watcher;
-
-    // 同期用のミューテックスと条件変数
-    std::mutex mtx;
-    std::condition_variable cv;
-
-    // アドバタイズメント受信時のイベントハンドラ（ラムダ式）
-    watcher.Received([&](auto const&, auto const& args)
-        {
-            std::unique_lock<std::mutex> lock(mtx);
-            if (connected) return; // 既に接続済みの場合は無視
-
-            // アドバタイズメントから製造元データを取得
-            auto mfg = args.Advertisement().ManufacturerData();
-            for (uint32_t i = 0; i < mfg.Size(); i++)
-            {
-                auto section = mfg.GetAt(i);
-                // 会社IDが任天堂(1363)でなければスキップ
-                if (section.CompanyId() != JOYCON_MANUFACTURER_ID) continue;
-
-                // 製造元データがJoy-Conのプレフィックスと一致するか確認
-                auto reader = DataReader::FromBuffer(section.Data());
-                std::vector<uint8_t> data(reader.UnconsumedBufferLength());
-                reader.ReadBytes(data);
-                if (data.size() >= JOYCON_MANUFACTURER_PREFIX.size() &&
-                    std::equal(JOYCON_MANUFACTURER_PREFIX.begin(), JOYCON_MANUFACTURER_PREFIX.end(), data.begin()))
-                {
-                    // 一致したら、そのデバイスに接続を試みる
-                    device = BluetoothLEDevice::FromBluetoothAddressAsync(args.BluetoothAddress()).get();
-                    if (!device) return; // 接続失敗
-
-                    connected = true; // 接続成功フラグを立てる
-                    watcher.Stop();   // スキャンを停止
-                    cv.notify_one();  // 待機中のメインスレッドに通知
-                    return;
-                }
-            }
-        });
-
-    watcher.ScanningMode(BluetoothLEScanningMode::Active); // アクティブスキャンモード
-    watcher.Start(); // スキャン開始
-
-    std::wcout << L"Scanning for Joy-Con... (Waiting up to 30 seconds)\n";
-
-    {
-        std::unique_lock<std::mutex> lock(mtx);
-        // 30秒のタイムアウト付きで、接続が成功するのを待つ
-        if (!cv.wait_for(lock, std::chrono::seconds(30), [&]() { return connected; }))
-        {
-            watcher.Stop();
-            std::wcerr << L"Timeout: Joy-Con not found.\n";
-            exit(1);
-        }
-    }
-
-    cj.device = device;
-
-    // GATTサービスを取得
-    auto servicesResult = device.GetGattServicesAsync().get();
-    if (servicesResult.Status() != GattCommunicationStatus::Success)
-    {
-        std::wcerr << L"Failed to get GATT services.\n";
-        exit(1);
-    }
-
-    // 全てのサービスをループして、目的のキャラクタリスティックを探す
-    for (auto service : servicesResult.Services())
-    {
-        auto charsResult = service.GetCharacteristicsAsync().get();
-        if (charsResult.Status() != GattCommunicationStatus::Success) continue;
-        for (auto characteristic : charsResult.Characteristics())
-        {
-            if (characteristic.Uuid() == guid(INPUT_REPORT_UUID))
-                cj.inputChar = characteristic; // 入力用
-            else if (characteristic.Uuid() == guid(WRITE_COMMAND_UUID))
-                cj.writeChar = characteristic; // 書き込み用
-        }
-    }
-
-    return cj;
-}
-
 /**
  * @enum ControllerType
  * @brief ユーザーが選択するコントローラーの種類
  */
 enum ControllerType {
+    AutoDetect = 0,      // 接続したコントローラーから自動判定
     SingleJoyCon = 1,    // Joy-Con単体
     DualJoyCon = 2,      // Joy-Con両手持ち
     ProController = 3,   // Proコントローラー
@@ -320,419 +194,820 @@ struct PlayerConfig {
     ControllerType controllerType;
     JoyConSide joyconSide;
     JoyConOrientation joyconOrientation;
+    GyroStickMode gyroStickMode;        // ジャイロ→右スティック変換のモード
+    StickFilterConfig stickFilter;      // スティックフィルターの設定（stick_filter.txt）
+    PadType pad;                        // 仮想ゲームパッドの種類
 };
 
 
-// 単体Joy-Conプレイヤー用
-struct SingleJoyConPlayer {
-    ConnectedJoyCon joycon;         // 接続情報
-    PVIGEM_TARGET ds4Controller;    // 仮想DS4コントローラー
-    JoyConSide side;                // 左右どちらか
-    JoyConOrientation orientation;  // 持ち方
+/**
+ * @struct Player
+ * @brief 接続中のプレイヤー（コントローラー、出力先、出力クロック）
+ * @note 破棄すると入力の通知を止めてから、出力クロックと出力先を解放する
+ */
+struct Player {
+    PlayerConfig config;                                      // 選択されたプレイヤー設定（自動判定はそのまま保持）
+    std::vector<std::shared_ptr<ReconnectingDevice>> devices; // 接続したコントローラー
+    std::unique_ptr<TimedSink> sink;                          // 出力先（仮想DS4コントローラーなど）
+    std::unique_ptr<OutputClock> clock;                       // 出力段を駆動する出力クロック（不要ならnullptr）
+    std::shared_ptr<DualStreamSync> sync;                     // 両手持ちの左右の入力の時刻合わせ
+    std::shared_ptr<ControllerFeedback> feedback;             // ゲームからの振動とライトバーをコントローラーに送る
+    DsuServer* dsuServer = nullptr;                           // 入力を公開しているDSUサーバー（公開していなければnullptr）
+    uint8_t dsuSlot = 0;                                      // DSUサーバーのスロット
+    SharedStatePublisher* sharedState = nullptr;              // 入力を公開している共有メモリ（公開していなければnullptr）
+    uint8_t sharedStateSlot = 0;                              // 共有メモリのスロット
+
+    ~Player();
 };
 
-// 両手持ちJoy-Conプレイヤー用
-struct DualJoyConPlayer {
-    ConnectedJoyCon leftJoyCon;     // 左Joy-Con
-    ConnectedJoyCon rightJoyCon;    // 右Joy-Con
-    PVIGEM_TARGET ds4Controller;    // 仮想DS4コントローラー
-    std::atomic<bool> running;      // 更新スレッドの実行フラグ
-    std::thread updateThread;       // 更新用スレッド
-};
+Player::~Player()
+{
+    // ゲームからの出力の受け取りを止めてから、振動を止めて送信スレッドを停止する
+    if (sink)
+        sink->SetFeedbackHandler(nullptr);
+    if (feedback)
+    {
+        feedback->Stop();
+        FeedbackStats stats = feedback->Stats();
+        std::wcout << L"Feedback: " << stats.received << L" received, " << stats.sent << L" sent, "
+            << stats.coalesced << L" coalesced\n";
+    }
 
-// Proコントローラープレイヤー用
-struct ProControllerPlayer {
-    ConnectedJoyCon controller;     // 接続情報
-    PVIGEM_TARGET ds4Controller;    // 仮想DS4コントローラー
-};
+    // 入力の通知を止める（以降、出力段が呼ばれないようにする）
+    for (auto& device : devices)
+        device->Close();
+
+    // DSUサーバーと共有メモリのスロットを空ける（入れ替えで既に新しいコントローラーが使っていればそのまま）
+    if (dsuServer)
+        dsuServer->Disconnect(dsuSlot, devices.front()->Address());
+    if (sharedState)
+        sharedState->Disconnect(sharedStateSlot, devices.front()->Address());
+
+    // 再接続の統計を表示
+    for (const auto& device : devices)
+        PrintReconnectStats(device->Address(), device->Stats());
+
+    // 出力クロックを停止（出力先を解放する前に止める）
+    if (clock)
+        clock->Stop();
+
+    // 両手持ちの同期状態を表示
+    if (sync)
+    {
+        StreamSyncStats stats = sync->Stats();
+        std::wcout << L"Dual Joy-Con sync: " << stats.merged << L" reports, skew mean "
+            << stats.meanSkew * 1000.0 << L" ms / max " << stats.maxSkew * 1000.0 << L" ms, drift L "
+            << stats.left.driftPpm << L" ppm / R " << stats.right.driftPpm << L" ppm\n";
+    }
+
+    if (sink)
+    {
+        PrintSinkTiming(*sink);
+        sink.reset();
+    }
+}
 
 // Proコントローラーのレポート生成関数（JoyConDecoder.cppで実装）
 DS4_REPORT_EX GenerateProControllerReport(const std::vector<uint8_t>& buffer);
 
 /**
- * @brief メイン関数
+ * @brief 自動判定のプレイヤー設定を、接続したコントローラーの種類から決める
+ * @param config 設定するプレイヤー設定
+ * @param model 接続したコントローラーの種類
+ * @return 種類が分からずProコントローラーとして扱う場合はfalse
+ * @note Joy-Con単体は横持ちとして扱う
  */
-int main()
+bool ResolveAutoConfig(PlayerConfig& config, ControllerModel model)
 {
-    // WinRT (COM) を使用するためにアパートメントを初期化
-    init_apartment();
+    switch (model) {
+    case ControllerModel::JoyConLeft:
+    case ControllerModel::JoyConRight:
+        config.controllerType = SingleJoyCon;
+        config.joyconSide = (model == ControllerModel::JoyConLeft) ? JoyConSide::Left : JoyConSide::Right;
+        config.joyconOrientation = JoyConOrientation::Sideways;
+        return true;
+    case ControllerModel::NSOGCController:
+        config.controllerType = NSOGCController;
+        config.gyroStickMode = GyroStickMode::Off; // GCコンにはジャイロが無い
+        return true;
+    case ControllerModel::ProController:
+        config.controllerType = ProController;
+        return true;
+    default:
+        config.controllerType = ProController;
+        return false;
+    }
+}
 
-    // プレイヤー設定の受付
-    int numPlayers;
-    std::wcout << L"How many players? ";
-    std::wcin >> numPlayers;
-    std::wcin.ignore(); // 改行文字をバッファからクリア
+/**
+ * @brief 選択されたコントローラーの種類が、接続したコントローラーと矛盾しないか
+ * @note 種類が不明な場合と、レポートから区別できないProコン/GCコンの違いは矛盾とみなさない
+ */
+bool ConfigMatchesModel(const PlayerConfig& config, ControllerModel model)
+{
+    switch (config.controllerType) {
+    case SingleJoyCon:
+        return model == ControllerModel::Unknown ||
+            model == (config.joyconSide == JoyConSide::Left ? ControllerModel::JoyConLeft : ControllerModel::JoyConRight);
+    case DualJoyCon:
+        return model == ControllerModel::Unknown || model == ControllerModel::JoyConLeft || model == ControllerModel::JoyConRight;
+    case ProController:
+    case NSOGCController:
+        return model == ControllerModel::Unknown || model == ControllerModel::ProController || model == ControllerModel::NSOGCController;
+    default:
+        return true;
+    }
+}
 
-    bool is_debug; // デバッグ表示のON/OFF
+/**
+ * @brief プレイヤーの出力段を作成し、必要なら出力クロックを開始
+ * @param config 出力段の設定
+ * @param sink 更新する出力先（出力クロックを止めるまで存在すること）
+ * @param clock 開始した出力クロックを格納する（クロックが不要ならnullptrのまま）
+ * @return 入力ハンドラからレポートを投入する出力段
+ */
+std::shared_ptr<OutputPipeline> CreatePlayerOutput(const OutputPipelineConfig& config, OutputSink& sink,
+    std::unique_ptr<OutputClock>& clock)
+{
+    auto pipeline = std::make_shared<OutputPipeline>(config, [&sink](const DS4_REPORT_EX& report)
+        {
+            sink.SubmitReport(report);
+        });
 
-    std::vector<PlayerConfig> playerConfigs;
+    // 通知の間も一定レートで出力するためのクロック
+    if (pipeline->NeedsClock()) {
+        clock = std::make_unique<OutputClock>([pipeline](float dt) { pipeline->Tick(dt); });
+        clock->Start();
+    }
+    return pipeline;
+}
+
+/**
+ * @brief プレイヤーのスティックフィルターの設定を読み込み、遅れの目安を表示
+ * @param config 読み込んだ設定を格納するプレイヤー設定
+ * @param number プレイヤー番号（1から）
+ */
+void LoadPlayerStickFilter(PlayerConfig& config, int number)
+{
+    LoadStickFilterConfig(config.stickFilter, number);
+    if (config.stickFilter.type != StickFilterType::None) {
+        float rate = 1e6f / OutputClock::DEFAULT_PERIOD.count();
+        std::wcout << L"  Stick filter: " << StickFilterName(config.stickFilter.type) << L" (delay "
+            << MeasureStickFilterDelay(config.stickFilter, rate) * 1000.0f << L" ms, residual jitter "
+            << MeasureStickFilterJitter(config.stickFilter, rate) * 100.0f << L"% at " << rate << L" Hz)\n";
+    }
+}
 
-    for (int i = 0; i < numPlayers; ++i) {
-        PlayerConfig config{};
-        std::wstring line;
+/**
+ * @brief プレイヤー設定をコンソールで入力してもらう
+ * @param number プレイヤー番号（1から）
+ * @param is_debug デバッグ表示のON/OFFを格納する
+ * @return 入力されたプレイヤー設定
+ */
+PlayerConfig PromptPlayerConfig(int number, std::atomic<bool>& is_debug)
+{
+    PlayerConfig config{};
+    std::wstring line;
+
+    while (true) {
+        std::wcout << L"Player " << number << L":\n";
+        std::wcout << L"  What controller type? (0=Auto detect, 1=Single JoyCon, 2=Dual JoyCon, 3=Pro Controller, 4=NSO GC Controller): ";
+        std::getline(std::wcin, line);
+        if (line == L"0" || line == L"1" || line == L"2" || line == L"3" || line == L"4") {
+            config.controllerType = static_cast<ControllerType>(std::stoi(std::string(line.begin(), line.end())));
+            break;
+        }
+        std::wcout << L"Invalid input. Please enter 0, 1, 2, 3, or 4.\n";
+    }
 
+    if (config.controllerType == SingleJoyCon) {
         while (true) {
-            std::wcout << L"Player " << (i + 1) << L":\n";
-            std::wcout << L"  What controller type? (1=Single JoyCon, 2=Dual JoyCon, 3=Pro Controller, 4=NSO GC Controller): ";
+            std::wcout << L"  Which side? (L=Left, R=Right): ";
             std::getline(std::wcin, line);
-            if (line == L"1" || line == L"2" || line == L"3" || line == L"4") {
-                config.controllerType = static_cast<ControllerType>(std::stoi(std::string(line.begin(), line.end())));
+            if (line == L"L" || line == L"R" || line == L"l" || line == L"r") {
+                config.joyconSide = (line == L"L" || line == L"l") ? JoyConSide::Left : JoyConSide::Right;
                 break;
             }
-            std::wcout << L"Invalid input. Please enter 1, 2, 3, or 4.\n";
+            std::wcout << L"Invalid input. Please enter L or R.\n";
         }
-
-        if (config.controllerType == SingleJoyCon) {
-            while (true) {
-                std::wcout << L"  Which side? (L=Left, R=Right): ";
-                std::getline(std::wcin, line);
-                if (line == L"L" || line == L"R" || line == L"l" || line == L"r") {
-                    config.joyconSide = (line == L"L" || line == L"l") ? JoyConSide::Left : JoyConSide::Right;
-                    break;
-                }
-                std::wcout << L"Invalid input. Please enter L or R.\n";
-            }
-            while (true) {
-                std::wcout << L"  What orientation? (U=Upright, S=Sideways): ";
-                std::getline(std::wcin, line);
-                if (line == L"U" || line == L"S" || line == L"u" || line == L"s") {
-                    config.joyconOrientation = (line == L"S" || line == L"s") ? JoyConOrientation::Sideways : JoyConOrientation::Upright;
-                    break;
-                }
-                std::wcout << L"Invalid input. Please enter U or S.\n";
+        while (true) {
+            std::wcout << L"  What orientation? (U=Upright, S=Sideways): ";
+            std::getline(std::wcin, line);
+            if (line == L"U" || line == L"S" || line == L"u" || line == L"s") {
+                config.joyconOrientation = (line == L"S" || line == L"s") ? JoyConOrientation::Sideways : JoyConOrientation::Upright;
+                break;
             }
+            std::wcout << L"Invalid input. Please enter U or S.\n";
         }
-        else if (config.controllerType == DualJoyCon) {
-            // 両手持ちは常に縦持ち
-            config.joyconSide = JoyConSide::Left; // ダミー値
-            config.joyconOrientation = JoyConOrientation::Upright;
-        }
+    }
+    else if (config.controllerType == DualJoyCon) {
+        // 両手持ちは常に縦持ち
+        config.joyconSide = JoyConSide::Left; // ダミー値
+        config.joyconOrientation = JoyConOrientation::Upright;
+    }
 
-        while(true){
-            std::wcout << L"  Debug Mode? (y/n): ";
+    config.gyroStickMode = GyroStickMode::Off;
+    if (config.controllerType != NSOGCController) {
+        while (true) {
+            std::wcout << L"  Gyro to right stick? (N=Off, A=Aim, F=Flick stick): ";
             std::getline(std::wcin, line);
-            if(line == L"n" || line == L"N")      {is_debug = false; break;}
-            else if(line == L"y" || line == L"Y") {is_debug = true;  break;}
-            else std::wcout << "Invalid input. Please enter y or n.\n";
+            if (line == L"N" || line == L"n") { config.gyroStickMode = GyroStickMode::Off; break; }
+            if (line == L"A" || line == L"a") { config.gyroStickMode = GyroStickMode::Aim; break; }
+            if (line == L"F" || line == L"f") { config.gyroStickMode = GyroStickMode::Flick; break; }
+            std::wcout << L"Invalid input. Please enter N, A or F.\n";
         }
+    }
 
-        playerConfigs.push_back(config);
+    config.pad = PadType::DS4;
+    while (true) {
+        std::wcout << L"  Virtual pad? (D=DualShock 4, X=Xbox 360): ";
+        std::getline(std::wcin, line);
+        if (line == L"D" || line == L"d") { config.pad = PadType::DS4; break; }
+        if (line == L"X" || line == L"x") { config.pad = PadType::X360; break; }
+        std::wcout << L"Invalid input. Please enter D or X.\n";
     }
 
-    // ViGEmを初期化
-    InitializeViGEm();
+    // スティックフィルターの設定を読み込み、遅れの目安を表示
+    LoadPlayerStickFilter(config, number);
 
-    // プレイヤーオブジェクトの管理用ベクター
-    std::vector<SingleJoyConPlayer> singlePlayers;
-    std::vector<std::unique_ptr<DualJoyConPlayer>> dualPlayers;
-    std::vector<ProControllerPlayer> proPlayers;
+    while(true){
+        std::wcout << L"  Debug Mode? (y/n): ";
+        std::getline(std::wcin, line);
+        if(line == L"n" || line == L"N")      {is_debug = false; break;}
+        else if(line == L"y" || line == L"Y") {is_debug = true;  break;}
+        else std::wcout << "Invalid input. Please enter y or n.\n";
+    }
 
-    // 各プレイヤーのセットアップ
-    for (int i = 0; i < numPlayers; ++i) {
-        auto& config = playerConfigs[i];
-        std::wcout << L"Player " << (i + 1) << L" setup...\n";
+    return config;
+}
 
-        if (config.controllerType == SingleJoyCon) {
-            std::wstring sideStr = (config.joyconSide == JoyConSide::Left) ? L"Left" : L"Right";
-            std::wcout << L"Please sync your single Joy-Con (" << sideStr << L") now.\n";
+/**
+ * @brief プレイヤーが使うコントローラーの台数
+ */
+size_t DeviceCount(const PlayerConfig& config)
+{
+    return (config.controllerType == DualJoyCon) ? 2 : 1;
+}
 
-            ConnectedJoyCon cj = WaitForJoyCon(L"Waiting for single Joy-Con...");
+/**
+ * @brief セッションに保存したプレイヤー設定をプレイヤー設定にする
+ * @note 左右が自動判定のJoy-Con単体は右として扱う（スティックフィルターは別に読み込む）
+ */
+PlayerConfig PlayerConfigFromSession(const SessionPlayer& player)
+{
+    PlayerConfig config{};
+    config.controllerType = static_cast<ControllerType>(player.controllerType);
+    config.joyconSide = player.side.value_or(JoyConSide::Right);
+    config.joyconOrientation = (config.controllerType == DualJoyCon) ? JoyConOrientation::Upright : player.orientation;
+    config.gyroStickMode = (config.controllerType == NSOGCController) ? GyroStickMode::Off : player.gyroStickMode;
+    config.pad = player.pad;
+    return config;
+}
 
-            // 仮想DS4コントローラーを作成
-            PVIGEM_TARGET ds4_controller = vigem_target_ds4_alloc();
-            auto ret = vigem_target_add(vigem_client, ds4_controller);
-            if (!VIGEM_SUCCESS(ret)) 
+/**
+ * @brief プレイヤー設定をセッションに保存する形にする
+ * @param config プレイヤー設定
+ * @param devices プレイヤーに割り当てたコントローラー
+ */
+SessionPlayer SessionFromPlayerConfig(const PlayerConfig& config, const std::vector<std::shared_ptr<ReconnectingDevice>>& devices)
+{
+    SessionPlayer player;
+    player.controllerType = config.controllerType;
+    if (config.controllerType == SingleJoyCon) player.side = config.joyconSide;
+    player.orientation = config.joyconOrientation;
+    player.gyroStickMode = config.gyroStickMode;
+    player.pad = config.pad;
+    for (const auto& device : devices)
+        player.addresses.push_back(device->Address());
+    return player;
+}
+
+/**
+ * @brief プレイヤーの出力先を作成する
+ * @param type 出力先の種類
+ * @param pad 仮想ゲームパッドの種類
+ * @param player プレイヤー番号（0から。ネットワークの送信先はこの番号で振り分ける）
+ * @return 処理時間を計測する出力先（失敗した場合はエラーで終了する）
+ */
+std::unique_ptr<TimedSink> CreatePlayerSink(OutputSinkType type, PadType pad, uint8_t player)
+{
+    auto sink = CreateOutputSink(type, vigem_client, pad, player);
+    if (!sink)
+    {
+        std::wcerr << L"Failed to create output sink.\n";
+        exit(1);
+    }
+    return std::make_unique<TimedSink>(std::move(sink));
+}
+
+/**
+ * @brief 接続したコントローラーからプレイヤーを作成し、入力の通知を開始する
+ * @param number プレイヤー番号（表示用、1から）
+ * @param config プレイヤー設定（自動判定の場合は接続したコントローラーの種類から決める）
+ * @param devices 接続したコントローラー（両手持ちは同期した順）
+ * @param sink 出力先（プレイヤーが所有し、破棄時に解放する）
+ * @param upsamplerConfig IMUアップサンプリングの設定
+ * @param gyroStickConfig ジャイロ→右スティック変換の設定
+ * @param is_debug デバッグ表示のON/OFF（入力ハンドラから参照するので、プレイヤーより長く存在すること）
+ * @param commandQueue 振動とLEDのコマンドの送信キュー（プレイヤーより長く存在すること）
+ * @param dsuServer 入力を公開するDSUサーバー（使わなければnullptr。プレイヤーより長く存在すること）
+ * @param sharedState 入力を公開する共有メモリ（使わなければnullptr。プレイヤーより長く存在すること）
+ * @return 作成したプレイヤー
+ */
+std::shared_ptr<Player> CreatePlayer(int number, const PlayerConfig& config, std::vector<std::shared_ptr<ReconnectingDevice>> devices,
+    std::unique_ptr<TimedSink> sink, const ImuUpsamplerConfig& upsamplerConfig, const GyroStickConfig& gyroStickConfig, const std::atomic<bool>& is_debug,
+    CommandQueue& commandQueue, DsuServer* dsuServer, SharedStatePublisher* sharedState)
+{
+    auto player = std::make_shared<Player>();
+    player->config = config;
+    player->devices = devices;
+    player->sink = std::move(sink);
+
+    // 接続したコントローラーの種類から、自動判定の設定を決め、選択された種類と違えば警告する
+    PlayerConfig resolved = config;
+    ControllerModel model = devices.front()->Model();
+    if (resolved.controllerType == AutoDetect) {
+        if (!ResolveAutoConfig(resolved, model))
+            std::wcerr << L"Player " << number << L": could not detect the controller type. Using Pro Controller mapping.\n";
+        std::wcout << L"Player " << number << L": " << ControllerModelName(model) << L"\n";
+    }
+    else if (!ConfigMatchesModel(resolved, model)) {
+        std::wcerr << L"Player " << number << L": selected controller type does not match the connected "
+            << ControllerModelName(model) << L".\n";
+    }
+
+    std::wcout << L"Player " << number << L" setup...\n";
+
+    // 出力段（IMUアップサンプリング、ジャイロ→右スティック。GCコンはジャイロ→右スティックを使わない）
+    OutputPipelineConfig outputConfig{ upsamplerConfig, gyroStickConfig, resolved.stickFilter };
+    outputConfig.gyroStick.mode = (resolved.controllerType == NSOGCController) ? GyroStickMode::Off : resolved.gyroStickMode;
+    auto output = CreatePlayerOutput(outputConfig, *player->sink, player->clock);
+
+    // DSUサーバーと共有メモリには出力段を通す前の入力を、コントローラーの時計のサンプル時刻（マイクロ秒）で公開する
+    if (dsuServer && static_cast<size_t>(number) <= DSU_MAX_SLOTS) {
+        player->dsuServer = dsuServer;
+        player->dsuSlot = static_cast<uint8_t>(number - 1);
+        dsuServer->Connect(player->dsuSlot, devices.front()->Address());
+    }
+    if (sharedState && static_cast<size_t>(number) <= SHARED_STATE_MAX_SLOTS) {
+        player->sharedState = sharedState;
+        player->sharedStateSlot = static_cast<uint8_t>(number - 1);
+        sharedState->Connect(player->sharedStateSlot, devices.front()->Address());
+    }
+    if (player->dsuServer || player->sharedState) {
+        output->SetSampleHandler([dsuServer = player->dsuServer, dsuSlot = player->dsuSlot,
+            sharedState = player->sharedState, sharedStateSlot = player->sharedStateSlot,
+            address = devices.front()->Address()](const DS4_REPORT_EX& report, double sampleTime)
             {
-                std::wcerr << L"Failed to add DS4 controller target: 0x" << std::hex << ret << L"\n";
-                exit(1);
-            }
+                uint64_t sampleTimeUs = static_cast<uint64_t>(sampleTime * 1e6);
+                if (dsuServer) dsuServer->Publish(dsuSlot, address, report, sampleTimeUs);
+                if (sharedState) sharedState->Publish(sharedStateSlot, address, report, sampleTimeUs);
+            });
+    }
 
-            // プレイヤー情報をベクターに追加
-            singlePlayers.push_back({ cj, ds4_controller, config.joyconSide, config.joyconOrientation });
-            auto& player = singlePlayers.back();
-
-            // Joy-Conからの入力があったときのイベントハンドラを設定
-            player.joycon.inputChar.ValueChanged([joyconSide = player.side, joyconOrientation = player.orientation, &player, &is_debug](GattCharacteristic const&, GattValueChangedEventArgs const& args)
-                {
-                    // 生データを読み取り
-                    auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-                    std::vector<uint8_t> buffer(reader.UnconsumedBufferLength());
-                    reader.ReadBytes(buffer);
-
-                    // レポートを生成
-                    DS4_REPORT_EX report = GenerateDS4Report(buffer, joyconSide, joyconOrientation);
-
-                    // 状態をコンソール出力
-                    if(is_debug) PrintDS4ReportState(report);
-
-                    // 仮想コントローラーの状態を更新
-                    auto ret = vigem_target_ds4_update_ex(vigem_client, player.ds4Controller, report);
-                    if (!VIGEM_SUCCESS(ret)) {
-                        std::wcerr << L"Failed to update DS4 EX report: 0x" << std::hex << ret << L"\n";
-                    }
-                });
-
-            // 通知を有効化
-            auto status = player.joycon.inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
-
-            // 初期化コマンドを送信
-            if (player.joycon.writeChar)
-                SendCustomCommands(player.joycon.writeChar);
-
-            if (status == GattCommunicationStatus::Success)
-                std::wcout << L"Notifications enabled.\n";
-            else
-                std::wcout << L"Failed to enable notifications.\n";
-
-            std::wcout << L"Press Enter to continue...\n";
-            std::wstring dummy;
-            std::getline(std::wcin, dummy);
-        }
-        else if (config.controllerType == DualJoyCon) {
-            // 両手持ちJoy-Conのセットアップ
-            std::wcout << L"Please sync your RIGHT Joy-Con now.\n";
-            ConnectedJoyCon rightJoyCon = WaitForJoyCon(L"Waiting for RIGHT Joy-Con...");
-            if (rightJoyCon.writeChar) SendCustomCommands(rightJoyCon.writeChar);
-
-            std::wcout << L"Please sync your LEFT Joy-Con now.\n";
-            ConnectedJoyCon leftJoyCon = WaitForJoyCon(L"Waiting for LEFT Joy-Con...");
-            if (leftJoyCon.writeChar) SendCustomCommands(leftJoyCon.writeChar);
-
-            // 仮想DS4コントローラーを作成
-            PVIGEM_TARGET ds4Controller = vigem_target_ds4_alloc();
-            auto ret = vigem_target_add(vigem_client, ds4Controller);
-            if (!VIGEM_SUCCESS(ret)) 
+    // 振動とLEDを送るコントローラー（両手持ちは左に強い振動、右に弱い振動）
+    std::vector<FeedbackTarget> feedbackTargets;
+
+    if (resolved.controllerType == SingleJoyCon) {
+        auto cj = devices[0];
+        StoreControllerModel(cj->Address(), resolved.joyconSide == JoyConSide::Left ? ControllerModel::JoyConLeft : ControllerModel::JoyConRight);
+        auto gyroBias = std::make_shared<GyroBiasEstimator>(cj->Address());
+        feedbackTargets.push_back({ cj, FeedbackMotor::Both });
+
+        // Joy-Conからの入力があったときのイベントハンドラを設定
+        bool subscribed = cj->Subscribe([joyconSide = resolved.joyconSide, joyconOrientation = resolved.joyconOrientation, &is_debug, gyroBias, output, buffer = std::vector<uint8_t>()](std::span<const uint8_t> data) mutable
             {
-                std::wcerr << L"Failed to add DS4 controller target: 0x" << std::hex << ret << L"\n";
-                exit(1);
-            }
+                // 生データを読み取り（受信ごとに同じバッファを再利用）
+                buffer.assign(data.begin(), data.end());
 
-            // プレイヤー情報を生成
-            auto dualPlayer = std::make_unique<DualJoyConPlayer>();
-            dualPlayer->leftJoyCon = leftJoyCon;
-            dualPlayer->rightJoyCon = rightJoyCon;
-            dualPlayer->ds4Controller = ds4Controller;
-            dualPlayer->running.store(true);
-
-            // 左右のJoy-Conの最新データを保持するためのアトミックな共有ポインタ
-            std::atomic<std::shared_ptr<std::vector<uint8_t>>> leftBufferAtomic{ std::make_shared<std::vector<uint8_t>>() };
-            std::atomic<std::shared_ptr<std::vector<uint8_t>>> rightBufferAtomic{ std::make_shared<std::vector<uint8_t>>() };
-
-            // 左Joy-Conのイベントハンドラ
-            dualPlayer->leftJoyCon.inputChar.ValueChanged([&leftBufferAtomic](GattCharacteristic const&, GattValueChangedEventArgs const& args)
-                {
-                    auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-                    auto buf = std::make_shared<std::vector<uint8_t>>(reader.UnconsumedBufferLength());
-                    reader.ReadBytes(*buf);
-                    // 最新のデータをアトミックに格納
-                    leftBufferAtomic.store(buf, std::memory_order_release);
-                });
-
-            // 左Joy-Conの通知を有効化
-            auto statusLeft = dualPlayer->leftJoyCon.inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
-            if (statusLeft == GattCommunicationStatus::Success) std::wcout << L"LEFT Joy-Con notifications enabled.\n";
-            else std::wcout << L"Failed to enable LEFT Joy-Con notifications.\n";
-
-            // 右Joy-Conのイベントハンドラ
-            dualPlayer->rightJoyCon.inputChar.ValueChanged([&rightBufferAtomic](GattCharacteristic const&, GattValueChangedEventArgs const& args)
-                {
-                    auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-                    auto buf = std::make_shared<std::vector<uint8_t>>(reader.UnconsumedBufferLength());
-                    reader.ReadBytes(*buf);
-                    // 最新のデータをアトミックに格納
-                    rightBufferAtomic.store(buf, std::memory_order_release);
-                });
-
-            // 右Joy-Conの通知を有効化
-            auto statusRight = dualPlayer->rightJoyCon.inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
-            if (statusRight == GattCommunicationStatus::Success) std::wcout << L"RIGHT Joy-Con notifications enabled.\n";
-            else std::wcout << L"Failed to enable RIGHT Joy-Con notifications.\n";
-
-            // 状態更新用スレッド
-            // 左右のデータを同期してレポートを生成・送信
-            dualPlayer->updateThread = std::thread([dualPlayerPtr = dualPlayer.get(), &leftBufferAtomic, &rightBufferAtomic, &is_debug]()
-                {
-                    while (dualPlayerPtr->running.load(std::memory_order_acquire))
-                    {
-                        // 最新の左右のバッファを取得
-                        auto leftBuf = leftBufferAtomic.load(std::memory_order_acquire);
-                        auto rightBuf = rightBufferAtomic.load(std::memory_order_acquire);
-
-                        // データがまだ空なら少し待ってリトライ
-                        if (leftBuf->empty() || rightBuf->empty())
-                        {
-                            std::this_thread::sleep_for(std::chrono::milliseconds(5));
-                            continue;
-                        }
-
-                        // 結合レポートを生成
-                        DS4_REPORT_EX report = GenerateDualJoyConDS4Report(*leftBuf, *rightBuf);
-
-                        // 状態をコンソール出力
-                        if(is_debug) PrintDS4ReportState(report);
-
-                        // 仮想コントローラーを更新
-                        auto ret = vigem_target_ds4_update_ex(vigem_client, dualPlayerPtr->ds4Controller, report);
-                        if (!VIGEM_SUCCESS(ret))
-                        {
-                            std::wcerr << L"Failed to update DS4 report: 0x" << std::hex << ret << L"\n";
-                        }
-
-                        // 約60Hzで更新するために16ms待機
-                        std::this_thread::sleep_for(std::chrono::milliseconds(16)); // ~60Hz
-                    }
-                });
-
-            dualPlayers.push_back(std::move(dualPlayer));
-
-            std::wcout << L"Dual Joy-Cons connected and configured. Press Enter to continue...\n";
-            std::wstring dummy;
-            std::getline(std::wcin, dummy);
-        }
-        else if (config.controllerType == ProController) {
-            // Proコントローラーのセットアップ
-            std::wcout << L"Please sync your Pro Controller now.\n";
+                // ジャイロのバイアスを推定・補正
+                gyroBias->Process(buffer);
 
-            ConnectedJoyCon proController = WaitForJoyCon(L"Waiting for Pro Controller...");
+                // レポートを生成
+                DS4_REPORT_EX report = GenerateDS4Report(buffer, joyconSide, joyconOrientation);
 
-            PVIGEM_TARGET ds4_controller = vigem_target_ds4_alloc();
-            auto ret = vigem_target_add(vigem_client, ds4_controller);
-            if (!VIGEM_SUCCESS(ret)) 
+                // 状態をコンソール出力
+                if(is_debug) PrintDS4ReportState(report);
+
+                // 出力段を通して仮想コントローラーの状態を更新
+                output->Submit(report, DecodeTimestamp(buffer));
+            });
+
+        if (subscribed)
+            std::wcout << L"Notifications enabled.\n";
+        else
+            std::wcout << L"Failed to enable notifications.\n";
+    }
+    else if (resolved.controllerType == DualJoyCon) {
+        // 両手持ちJoy-Conのセットアップ
+        auto rightJoyCon = devices[0];
+        auto leftJoyCon = devices[1];
+        // 種類が分かっていれば、同期した順番ではなく種類で左右を決める
+        if (rightJoyCon->Model() == ControllerModel::JoyConLeft || leftJoyCon->Model() == ControllerModel::JoyConRight)
+            std::swap(rightJoyCon, leftJoyCon);
+        StoreControllerModel(rightJoyCon->Address(), ControllerModel::JoyConRight);
+        StoreControllerModel(leftJoyCon->Address(), ControllerModel::JoyConLeft);
+        feedbackTargets.push_back({ leftJoyCon, FeedbackMotor::Large });
+        feedbackTargets.push_back({ rightJoyCon, FeedbackMotor::Small });
+
+        player->sync = std::make_shared<DualStreamSync>(upsamplerConfig);
+
+        // 左右それぞれのジャイロバイアス推定器
+        auto leftGyroBias = std::make_shared<GyroBiasEstimator>(leftJoyCon->Address());
+        auto rightGyroBias = std::make_shared<GyroBiasEstimator>(rightJoyCon->Address());
+
+        // 片側の入力が届くたびに、左右を同じ時刻に揃えて結合レポートを生成・送信
+        // 合成用のバッファはラムダが持って使い回す（左右のハンドラがそれぞれ自分のコピーを持つので、スレッド間で共有しない）
+        auto onInput = [&is_debug, sync = player->sync, output, leftBuf = std::vector<uint8_t>(), rightBuf = std::vector<uint8_t>()](JoyConSide side, const std::vector<uint8_t>& buffer) mutable
             {
-                std::wcerr << L"Failed to add DS4 controller target: 0x" << std::hex << ret << L"\n";
-                exit(1);
-            }
+                sync->Push(side, buffer, HostTimeSeconds());
 
-            // イベントハンドラ
-            proController.inputChar.ValueChanged([ds4_controller, &is_debug](GattCharacteristic const&, GattValueChangedEventArgs const& args) mutable
-                {
-                    auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-                    std::vector<uint8_t> buffer(reader.UnconsumedBufferLength());
-                    reader.ReadBytes(buffer);
-
-                    // Proコン用のレポートを生成
-                    DS4_REPORT_EX report = GenerateProControllerReport(buffer);
-                    
-                    // 状態をコンソール出力
-                    if(is_debug) PrintDS4ReportState(report);
-
-                    auto ret = vigem_target_ds4_update_ex(vigem_client, ds4_controller, report);
-                    if (!VIGEM_SUCCESS(ret)) {
-                        std::wcerr << L"Failed to update DS4 EX report: 0x" << std::hex << ret << L"\n";
-                    }
-                });
-
-            // 通知を有効化
-            auto status = proController.inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
-
-            if (proController.writeChar)
-                SendCustomCommands(proController.writeChar);
-
-            if (status == GattCommunicationStatus::Success)
-                std::wcout << L"Pro Controller notifications enabled.\n";
-            else
-                std::wcout << L"Failed to enable Pro Controller notifications.\n";
-
-            std::wcout << L"Press Enter to continue...\n";
-            std::wstring dummy;
-            std::getline(std::wcin, dummy);
-
-            proPlayers.push_back({ proController, ds4_controller });
-        }
-        else if (config.controllerType == NSOGCController) {
-            // NSOゲームキューブコントローラーのセットアップ
-            std::wcout << L"Please sync your NSO GameCube Controller now.\n";
+                double sampleTime;
+                if (!sync->Merge(leftBuf, rightBuf, sampleTime)) return; // 両方のデータが揃うまで待つ
 
-            ConnectedJoyCon gcController = WaitForJoyCon(L"Waiting for NSO GC Controller...");
+                DS4_REPORT_EX report = GenerateDualJoyConDS4Report(leftBuf, rightBuf);
 
-            PVIGEM_TARGET ds4_controller = vigem_target_ds4_alloc();
-            auto ret = vigem_target_add(vigem_client, ds4_controller);
-            if (!VIGEM_SUCCESS(ret)) {
-                std::wcerr << L"Failed to add DS4 controller target: 0x" << std::hex << ret << L"\n";
-                exit(1);
-            }
+                // 状態をコンソール出力
+                if(is_debug) PrintDS4ReportState(report);
+
+                output->SubmitAt(report, sampleTime);
+            };
 
-            // イベントハンドラ
-            gcController.inputChar.ValueChanged([ds4_controller, &is_debug](GattCharacteristic const&, GattValueChangedEventArgs const& args) mutable {
-                auto reader = DataReader::FromBuffer(args.CharacteristicValue());
-                std::vector<uint8_t> buffer(reader.UnconsumedBufferLength());
-                reader.ReadBytes(buffer);
+        // 左Joy-Conのイベントハンドラ
+        bool subscribedLeft = leftJoyCon->Subscribe([onInput, leftGyroBias, buffer = std::vector<uint8_t>()](std::span<const uint8_t> data) mutable
+            {
+                buffer.assign(data.begin(), data.end());
+                leftGyroBias->Process(buffer);
+                onInput(JoyConSide::Left, buffer);
+            });
+        if (subscribedLeft) std::wcout << L"LEFT Joy-Con notifications enabled.\n";
+        else std::wcout << L"Failed to enable LEFT Joy-Con notifications.\n";
+
+        // 右Joy-Conのイベントハンドラ
+        bool subscribedRight = rightJoyCon->Subscribe([onInput, rightGyroBias, buffer = std::vector<uint8_t>()](std::span<const uint8_t> data) mutable
+            {
+                buffer.assign(data.begin(), data.end());
+                rightGyroBias->Process(buffer);
+                onInput(JoyConSide::Right, buffer);
+            });
+        if (subscribedRight) std::wcout << L"RIGHT Joy-Con notifications enabled.\n";
+        else std::wcout << L"Failed to enable RIGHT Joy-Con notifications.\n";
+
+        std::wcout << L"Dual Joy-Cons connected and configured.\n";
+    }
+    else if (resolved.controllerType == ProController) {
+        // Proコントローラーのセットアップ
+        auto proController = devices[0];
+        StoreControllerModel(proController->Address(), ControllerModel::ProController);
+        auto gyroBias = std::make_shared<GyroBiasEstimator>(proController->Address());
+        feedbackTargets.push_back({ proController, FeedbackMotor::Both });
+
+        // イベントハンドラ
+        bool subscribed = proController->Subscribe([&is_debug, gyroBias, output, buffer = std::vector<uint8_t>()](std::span<const uint8_t> data) mutable
+            {
+                buffer.assign(data.begin(), data.end());
+                gyroBias->Process(buffer);
 
-                // NSO GCコン用のレポートを生成
-                DS4_REPORT_EX report = GenerateNSOGCReport(buffer);
+                // Proコン用のレポートを生成
+                DS4_REPORT_EX report = GenerateProControllerReport(buffer);
 
                 // 状態をコンソール出力
                 if(is_debug) PrintDS4ReportState(report);
 
-                auto ret = vigem_target_ds4_update_ex(vigem_client, ds4_controller, report);
-                if (!VIGEM_SUCCESS(ret)) {
-                    std::wcerr << L"Failed to update DS4 EX report: 0x" << std::hex << ret << L"\n";
-                }
-                });
+                output->Submit(report, DecodeTimestamp(buffer));
+            });
 
-            // 通知を有効化
-            auto status = gcController.inputChar.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify).get();
+        if (subscribed)
+            std::wcout << L"Pro Controller notifications enabled.\n";
+        else
+            std::wcout << L"Failed to enable Pro Controller notifications.\n";
+    }
+    else if (resolved.controllerType == NSOGCController) {
+        // NSOゲームキューブコントローラーのセットアップ
+        auto gcController = devices[0];
+        StoreControllerModel(gcController->Address(), ControllerModel::NSOGCController);
+        auto gyroBias = std::make_shared<GyroBiasEstimator>(gcController->Address());
+        feedbackTargets.push_back({ gcController, FeedbackMotor::Both });
+
+        // イベントハンドラ
+        bool subscribed = gcController->Subscribe([&is_debug, gyroBias, output, buffer = std::vector<uint8_t>()](std::span<const uint8_t> data) mutable {
+            buffer.assign(data.begin(), data.end());
+            gyroBias->Process(buffer);
+
+            // NSO GCコン用のレポートを生成
+            DS4_REPORT_EX report = GenerateNSOGCReport(buffer);
 
-            if (gcController.writeChar)
-                SendCustomCommands(gcController.writeChar); // Optional, only if NSO GC expects init commands
+            // 状態をコンソール出力
+            if(is_debug) PrintDS4ReportState(report);
+
+            output->Submit(report, DecodeTimestamp(buffer));
+            });
+
+        if (subscribed)
+            std::wcout << L"NSO GC Controller notifications enabled.\n";
+        else
+            std::wcout << L"Failed to enable NSO GC Controller notifications.\n";
+    }
 
-            if (status == GattCommunicationStatus::Success)
-                std::wcout << L"NSO GC Controller notifications enabled.\n";
-            else
-                std::wcout << L"Failed to enable NSO GC Controller notifications.\n";
+    // ゲームからの振動とライトバーを受け取ったら、最新の状態をコマンドの送信スレッドに渡す
+    FeedbackConfig feedbackConfig;
+    feedbackConfig.defaultLeds = PlayerLedsForNumber(number);
+    player->feedback = ControllerFeedback::Create(commandQueue, std::move(feedbackTargets), feedbackConfig);
+    player->sink->SetFeedbackHandler([feedback = player->feedback](const OutputFeedback& state)
+        {
+            feedback->Update(state);
+        });
+    // 接続できたことを短い振動で知らせる
+    player->feedback->Play(HAPTIC_CLICK);
 
-            std::wcout << L"Press Enter to continue...\n";
-            std::wstring dummy;
-            std::getline(std::wcin, dummy);
+    return player;
+}
 
-            // ProControllerPlayer構造体を再利用
-            proPlayers.push_back({ gcController, ds4_controller });
+/**
+ * @brief 実行中のプレイヤーの一覧をコンソールに表示
+ */
+void PrintPlayers(const PlayerRegistry<Player>& players)
+{
+    auto snapshot = players.Read();
+    for (size_t slot = 0; slot < snapshot->size(); ++slot) {
+        const auto& player = (*snapshot)[slot];
+        if (!player) continue;
+        std::wcout << L"  Player " << (slot + 1) << L":";
+        for (const auto& device : player->devices)
+            std::wcout << L" " << ControllerModelName(device->Model()) << L" (" << std::hex << device->Address() << std::dec << L")";
+        std::wcout << L" -> " << player->sink->Name() << L"\n";
+    }
+}
+
+/**
+ * @brief 別のマシンから JOYCON_OUTPUT=network で送られた入力を受信し、プレイヤーごとにローカルの出力先に出す
+ * @param address 待ち受けるアドレス（空ならローカルのみ）
+ * @param port 待ち受けるポート
+ * @return 終了コード
+ */
+int RunNetworkReceiver(const std::string& address, uint16_t port)
+{
+    OutputSinkType outputType = SelectOutputSinkType();
+    if (outputType == OutputSinkType::Network) {
+        std::wcerr << L"JOYCON_OUTPUT=network cannot be used with --receive.\n";
+        return 1;
+    }
+    if (outputType == OutputSinkType::ViGEm)
+        InitializeViGEm();
+
+    // 出力先は最初のフレームを受信したときに作る（受信スレッドからだけ触るので排他しない）
+    std::array<std::unique_ptr<TimedSink>, NET_MAX_PLAYERS> sinks;
+    NetworkSourceConfig config;
+    if (!address.empty()) config.address = address;
+    config.port = port;
+    auto source = NetworkSource::Create(config, [&](uint8_t player) -> OutputSink* {
+        sinks[player] = CreatePlayerSink(outputType, PadType::DS4, player);
+        std::wcout << L"Network player " << (player + 1) << L" connected (" << sinks[player]->Name() << L").\n";
+        return sinks[player].get();
+    });
+    if (!source) return 1;
+
+    std::wcout << L"Receiving players on " << std::wstring(config.address.begin(), config.address.end()) << L":" << source->Port() << L". Press Enter to exit.\n";
+    std::wstring line;
+    std::getline(std::wcin, line);
+
+    // 受信を止めてから統計を表示し、出力先を解放する
+    std::array<NetworkStreamStats, NET_MAX_PLAYERS> stats;
+    for (size_t i = 0; i < NET_MAX_PLAYERS; ++i)
+        stats[i] = source->Stats(static_cast<uint8_t>(i));
+    source.reset();
+    for (size_t i = 0; i < NET_MAX_PLAYERS; ++i) {
+        if (!sinks[i]) continue;
+        PrintNetworkStreamStats(static_cast<uint8_t>(i), stats[i]);
+        PrintSinkTiming(*sinks[i]);
+        sinks[i].reset();
+    }
+
+    ShutdownViGEm();
+    return 0;
+}
+
+/**
+ * @brief メイン関数
+ */
+int main(int argc, char* argv[])
+{
+    // コマンドライン引数を解析
+    SessionOptions options;
+    options.path = "session.txt";
+    if (!ParseSessionOptions(argc, argv, options)) {
+        PrintSessionUsage(argv[0]);
+        return 1;
+    }
+
+    // 受信モードではコントローラーに接続せず、ネットワークの入力だけを出力する
+    if (options.receivePort != 0)
+        return RunNetworkReceiver(options.receiveAddress, options.receivePort);
+
+    // 通信バックエンドを作成（WinRTのBluetooth、またはループバック）
+    auto transport = CreateTransport();
+    // コマンド送信キュー（初期化コマンドを全デバイスで交互に送る）
+    CommandQueue commandQueue;
+
+    // 前回までのジャイロバイアスと接続情報を読み込み
+    LoadGyroBiasCache();
+    LoadDeviceCache();
+
+    // ジャイロ→右スティック変換の設定を読み込み
+    GyroStickConfig gyroStickConfig;
+    LoadGyroStickConfig(gyroStickConfig);
+
+    // IMUアップサンプリングの設定を読み込み
+    ImuUpsamplerConfig upsamplerConfig;
+    LoadImuUpsamplerConfig(upsamplerConfig);
+
+    // 通知の途絶の検出と再接続の設定を読み込み
+    ReconnectConfig reconnectConfig;
+    LoadReconnectConfig(reconnectConfig);
+
+    // 引数で指定されたプレイヤー、または前回のセッションを使う（どちらも無ければ質問する）
+    Session session = ResolveSession(options);
+    std::atomic<bool> is_debug{ session.debug.value_or(false) }; // デバッグ表示のON/OFF（入力ハンドラから参照する）
+
+    std::vector<PlayerConfig> playerConfigs;
+    std::vector<uint64_t> addresses; // 各コントローラーに割り当てるアドレス（0はスキャンで探す）
+    if (session.players.empty()) {
+        // プレイヤー設定の受付
+        int numPlayers;
+        std::wcout << L"How many players? ";
+        std::wcin >> numPlayers;
+        std::wcin.ignore(); // 改行文字をバッファからクリア
+
+        for (int i = 0; i < numPlayers; ++i)
+            playerConfigs.push_back(PromptPlayerConfig(i + 1, is_debug));
+        for (const auto& config : playerConfigs)
+            addresses.resize(addresses.size() + DeviceCount(config), 0);
+    }
+    else {
+        for (size_t i = 0; i < session.players.size(); ++i) {
+            const auto& player = session.players[i];
+            PlayerConfig config = PlayerConfigFromSession(player);
+            LoadPlayerStickFilter(config, static_cast<int>(i) + 1);
+            playerConfigs.push_back(config);
+            for (size_t k = 0; k < DeviceCount(config); ++k)
+                addresses.push_back(k < player.addresses.size() ? player.addresses[k] : 0);
         }
     }
 
-    std::wcout << L"All players connected. Press Enter to exit...\n";
-    std::wstring dummy;
-    std::getline(std::wcin, dummy);
+    // 出力先を選び（ViGEmの場合は初期化し）、接続を待たずに全プレイヤーの出力先を作成
+    OutputSinkType outputType = SelectOutputSinkType();
+    if (outputType == OutputSinkType::ViGEm)
+        InitializeViGEm();
+    std::vector<std::unique_ptr<TimedSink>> sinks;
+    for (size_t i = 0; i < playerConfigs.size(); ++i)
+        sinks.push_back(CreatePlayerSink(outputType, playerConfigs[i].pad, static_cast<uint8_t>(i)));
+
+    // 既知のコントローラーはスキャンせずに並行して接続し、残りは1回のスキャンで探して接続・初期化
+    std::vector<std::shared_ptr<ReconnectingDevice>> devices;
+    if (std::all_of(addresses.begin(), addresses.end(), [](uint64_t address) { return address == 0; })) {
+        std::wcout << L"Please sync all controllers now, in player order (Dual Joy-Con: RIGHT, then LEFT).\n";
+        devices = ConnectJoyCons(*transport, addresses.size(), commandQueue, reconnectConfig);
+    }
+    else {
+        devices = ConnectJoyConsByAddress(*transport, addresses, commandQueue, reconnectConfig);
+    }
 
-    // --- クリーンアップ処理 ---
+    // エミュレーター向けのDSUサーバー（環境変数 JOYCON_DSU で有効にする）
+    std::unique_ptr<DsuServer> dsuServer;
+    DsuServerConfig dsuConfig;
+    if (SelectDsuServerConfig(dsuConfig)) {
+        dsuServer = CreateDsuServer(dsuConfig);
+        if (dsuServer)
+            std::wcout << L"DSU server listening on port " << dsuServer->Port() << L".\n";
+    }
 
-    // DualJoyConプレイヤーのスレッドを停止し、リソースを解放
-    for (auto& dp : dualPlayers)
-    {
-        dp->running.store(false); // スレッドに停止を通知
-        if (dp->updateThread.joinable())
-            dp->updateThread.join(); // スレッドの終了を待つ
+    // オーバーレイや解析ツール向けの共有メモリ（環境変数 JOYCON_SHARED_STATE で有効にする）
+    std::unique_ptr<SharedStatePublisher> sharedState;
+    SharedStateConfig sharedStateConfig;
+    if (SelectSharedStateConfig(sharedStateConfig)) {
+        sharedState = SharedStatePublisher::Create(sharedStateConfig);
+        if (sharedState)
+            std::wcout << L"Publishing shared state as \"" << sharedStateConfig.name.c_str() << L"\".\n";
+    }
+
+    // 実行中に追加・削除・置換できるプレイヤーの一覧
+    // 各プレイヤーの入力ハンドラと出力クロックは独立しているので、変更中も他のプレイヤーは止まらない
+    PlayerRegistry<Player> players;
 
-        vigem_target_remove(vigem_client, dp->ds4Controller);
-        vigem_target_free(dp->ds4Controller);
+    // 各プレイヤーのセットアップ（接続したデバイスを順に割り当てる）
+    for (size_t i = 0, nextDevice = 0; i < playerConfigs.size(); ++i) {
+        size_t count = DeviceCount(playerConfigs[i]);
+        std::vector<std::shared_ptr<ReconnectingDevice>> playerDevices(devices.begin() + nextDevice, devices.begin() + nextDevice + count);
+        nextDevice += count;
+        players.Add(CreatePlayer(static_cast<int>(i) + 1, playerConfigs[i], std::move(playerDevices), std::move(sinks[i]), upsamplerConfig, gyroStickConfig, is_debug, commandQueue, dsuServer.get(), sharedState.get()));
     }
+    devices.clear();
 
-    // SingleJoyConプレイヤーのリソースを解放
-    for (auto& sp : singlePlayers)
-    {
-        vigem_target_remove(vigem_client, sp.ds4Controller);
-        vigem_target_free(sp.ds4Controller);
+    std::wcout << L"All players connected.\n";
+
+    // 実行中のプレイヤーの追加・削除・置換を受け付ける
+    std::wstring line;
+    while (true) {
+        std::wcout << L"Commands: a=Add player, r<N>=Remove player N, s<N>=Swap controller of player N, l=List players, Enter=Exit\n";
+        if (!std::getline(std::wcin, line) || line.empty()) break;
+
+        wchar_t command = static_cast<wchar_t>(std::towlower(line[0]));
+        if (command == L'l') {
+            PrintPlayers(players);
+            continue;
+        }
+
+        size_t slot;
+        PlayerConfig config;
+        if (command == L'a') {
+            // 空いている最初の番号で参加する
+            slot = players.FreeSlot();
+            config = PromptPlayerConfig(static_cast<int>(slot) + 1, is_debug);
+        }
+        else if (command == L'r' || command == L's') {
+            int number = 0;
+            try {
+                number = std::stoi(std::wstring(line.begin() + 1, line.end()));
+            }
+            catch (const std::exception&) {
+            }
+            std::shared_ptr<Player> current;
+            if (number > 0) {
+                // スナップショットは変更の前に手放す（保持したままだと古い一覧の解放を待ち続ける）
+                auto snapshot = players.Read();
+                if (static_cast<size_t>(number) <= snapshot->size()) current = (*snapshot)[number - 1];
+            }
+            if (!current) {
+                std::wcout << L"Invalid player number.\n";
+                continue;
+            }
+            slot = static_cast<size_t>(number) - 1;
+            if (command == L'r') {
+                current.reset();
+                players.Remove(slot);
+                std::wcout << L"Player " << number << L" removed.\n";
+                continue;
+            }
+            // 同じ設定のまま、新しく同期したコントローラーに置き換える
+            config = current->config;
+        }
+        else {
+            std::wcout << L"Invalid input.\n";
+            continue;
+        }
+
+        // 他のプレイヤーの入力と出力を止めずに、新しいコントローラーを接続する
+        size_t count = DeviceCount(config);
+        std::wcout << L"Please sync the controller now" << (count > 1 ? L" (Dual Joy-Con: RIGHT, then LEFT)" : L"") << L".\n";
+        auto added = TryConnectJoyCons(*transport, count, commandQueue, reconnectConfig);
+        if (added.size() < count) {
+            for (auto& device : added)
+                device->Close();
+            std::wcerr << L"Player " << (slot + 1) << L" was not changed.\n";
+            continue;
+        }
+        players.Replace(slot, CreatePlayer(static_cast<int>(slot) + 1, config, std::move(added), CreatePlayerSink(outputType, config.pad, static_cast<uint8_t>(slot)), upsamplerConfig, gyroStickConfig, is_debug, commandQueue, dsuServer.get(), sharedState.get()));
+        std::wcout << L"Player " << (slot + 1) << L" ready.\n";
     }
 
-    // Pro/GCコントローラープレイヤーのリソースを解放
-    for (auto& pp : proPlayers)
-    {
-        vigem_target_remove(vigem_client, pp.ds4Controller);
-        vigem_target_free(pp.ds4Controller);
+    // --- クリーンアップ処理 ---
+
+    // 次回の起動時に同じプレイヤーとコントローラーで復元できるように保存
+    if (options.save) {
+        Session saved;
+        saved.debug = is_debug.load();
+        {
+            auto snapshot = players.Read();
+            for (const auto& player : *snapshot)
+                if (player) saved.players.push_back(SessionFromPlayerConfig(player->config, player->devices));
+        }
+        SaveSession(options.path, saved);
     }
 
-    // ViGEmクライアントをクリーンアップ
-    if (vigem_client)
-    {
-        vigem_disconnect(vigem_client);
-        vigem_free(vigem_client);
-        vigem_client = nullptr;
+    // 全プレイヤーを削除（入力の通知を止め、出力クロックと出力先を解放する）
+    players.Clear();
+
+    // DSUサーバーの送受信の統計を表示
+    if (dsuServer) {
+        DsuStats stats = dsuServer->Stats();
+        std::wcout << L"DSU server: " << stats.requests << L" requests (" << stats.invalid << L" invalid), "
+            << stats.sent << L" packets sent, " << stats.dropped << L" dropped\n";
+        dsuServer.reset();
+    }
+    if (sharedState) {
+        std::wcout << L"Shared state: " << sharedState->Published() << L" samples published\n";
+        sharedState.reset();
     }
 
+    // キャッシュの有無による接続時間の差を表示
+    PrintConnectTimingStats();
+
+    // 推定したジャイロバイアスと接続情報を次回の接続用に保存
+    SaveGyroBiasCache();
+    SaveDeviceCache();
+
+    // ViGEmクライアントをクリーンアップ
+    ShutdownViGEm();
+
     return 0;
 }
\ No newline at end of file
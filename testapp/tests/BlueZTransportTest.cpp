@@ -0,0 +1,393 @@
+﻿// BlueZTransportをモックのorg.bluezに対して動かすテスト
+// dbus-run-sessionで起動したプライベートなバスをシステムバスとして使い、同じプロセスでモックを動かす
+#include "BlueZTransport.h"
+
+#include <systemd/sd-bus.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeviceCache.h"
+#include "TestCheck.h"
+
+constexpr const char* ADAPTER_PATH = "/org/bluez/hci0";
+constexpr const char* DEVICE_PATH = "/org/bluez/hci0/dev_98_B6_E9_00_00_01";
+constexpr const char* DEVICE_ADDRESS = "98:B6:E9:00:00:01";
+constexpr uint64_t DEVICE_ADDRESS_VALUE = 0x98B6E9000001;
+constexpr const char* INPUT_PATH = "/org/bluez/hci0/dev_98_B6_E9_00_00_01/service000a/char000b";
+constexpr const char* WRITE_PATH = "/org/bluez/hci0/dev_98_B6_E9_00_00_01/service000a/char000d";
+constexpr uint16_t NOTIFY_MTU = 64;
+
+// 右Joy-Conのアドバタイズ（先頭4バイトと製品ID）
+constexpr uint8_t MANUFACTURER_DATA[] = { 0x01, 0x00, 0x03, 0x7E, 0x05, 0x66, 0x20, 0x00 };
+
+/**
+ * @class MockBlueZ
+ * @brief テストで使う分だけのorg.bluez（アダプター1つ、Joy-Con 1台、キャラクタリスティック2つ）
+ *
+ * 専用のスレッドでバスを処理する。通知はAcquireNotifyで渡したソケットの相手側に書き込む。
+ */
+class MockBlueZ {
+public:
+    ~MockBlueZ()
+    {
+        running = false;
+        if (thread.joinable()) thread.join();
+        if (notifyPeer >= 0) close(notifyPeer);
+        if (bus) sd_bus_flush_close_unref(bus);
+    }
+
+    bool Start()
+    {
+        if (sd_bus_open_system(&bus) < 0) return false;
+        if (sd_bus_request_name(bus, "org.bluez", 0) < 0) return false;
+        if (sd_bus_add_fallback(bus, nullptr, "/", &MockBlueZ::Handle, this) < 0) return false;
+        thread = std::thread([this]()
+            {
+                while (running) {
+                    int r = sd_bus_process(bus, nullptr);
+                    if (r < 0) break;
+                    if (r == 0) sd_bus_wait(bus, 50000);
+                }
+            });
+        return true;
+    }
+
+    /**
+     * @brief 受信側に通知を1つ送る
+     */
+    bool Notify(const std::vector<uint8_t>& packet)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return notifyPeer >= 0 && write(notifyPeer, packet.data(), packet.size()) == static_cast<ssize_t>(packet.size());
+    }
+
+    std::atomic<int> managedObjectsCalls{ 0 };
+    std::atomic<int> connectCalls{ 0 };
+    std::atomic<int> disconnectCalls{ 0 };
+    std::atomic<int> discoveryStarts{ 0 };
+
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> writes; // WriteValueで受け取ったデータ
+    std::vector<std::string> writeTypes;      // WriteValueのtypeオプション
+
+private:
+    static int Handle(sd_bus_message* m, void* userdata, sd_bus_error*)
+    {
+        // 返信済みのメッセージは処理済みとして返す（sd-busが重ねてエラーを返さないように）
+        int r = static_cast<MockBlueZ*>(userdata)->HandleMethod(m);
+        return r < 0 ? r : 1;
+    }
+
+    int HandleMethod(sd_bus_message* m)
+    {
+        std::string iface = sd_bus_message_get_interface(m) ? sd_bus_message_get_interface(m) : "";
+        std::string member = sd_bus_message_get_member(m) ? sd_bus_message_get_member(m) : "";
+        std::string path = sd_bus_message_get_path(m) ? sd_bus_message_get_path(m) : "";
+
+        if (iface == "org.freedesktop.DBus.ObjectManager" && member == "GetManagedObjects") {
+            managedObjectsCalls++;
+            return ReplyManagedObjects(m);
+        }
+        if (iface == "org.freedesktop.DBus.Properties" && member == "Get")
+            return ReplyProperty(m, path);
+        if (iface == "org.bluez.Adapter1") {
+            if (member == "StartDiscovery") discoveryStarts++;
+            return sd_bus_reply_method_return(m, "");
+        }
+        if (iface == "org.bluez.Device1" && path == DEVICE_PATH) {
+            if (member == "Connect") {
+                connectCalls++;
+                connected = true;
+            }
+            else if (member == "Disconnect") {
+                disconnectCalls++;
+                connected = false;
+            }
+            return sd_bus_reply_method_return(m, "");
+        }
+        if (iface == "org.bluez.GattCharacteristic1" && path == INPUT_PATH && member == "AcquireNotify")
+            return ReplyAcquireNotify(m);
+        if (iface == "org.bluez.GattCharacteristic1" && path == WRITE_PATH && member == "WriteValue")
+            return HandleWriteValue(m);
+
+        return sd_bus_reply_method_errorf(m, "org.freedesktop.DBus.Error.UnknownMethod", "%s.%s", iface.c_str(), member.c_str());
+    }
+
+    int ReplyManagedObjects(sd_bus_message* m)
+    {
+        sd_bus_message* reply = nullptr;
+        int r = sd_bus_message_new_method_return(m, &reply);
+        if (r < 0) return r;
+
+        auto open_object = [&](const char* objectPath, const char* iface)
+            {
+                sd_bus_message_open_container(reply, 'e', "oa{sa{sv}}");
+                sd_bus_message_append(reply, "o", objectPath);
+                sd_bus_message_open_container(reply, 'a', "{sa{sv}}");
+                sd_bus_message_open_container(reply, 'e', "sa{sv}");
+                sd_bus_message_append(reply, "s", iface);
+                sd_bus_message_open_container(reply, 'a', "{sv}");
+            };
+        auto close_object = [&]()
+            {
+                sd_bus_message_close_container(reply); // a{sv}
+                sd_bus_message_close_container(reply); // e
+                sd_bus_message_close_container(reply); // a{sa{sv}}
+                sd_bus_message_close_container(reply); // e
+            };
+
+        sd_bus_message_open_container(reply, 'a', "{oa{sa{sv}}}");
+
+        open_object(ADAPTER_PATH, "org.bluez.Adapter1");
+        sd_bus_message_append(reply, "{sv}", "Powered", "b", 1);
+        close_object();
+
+        open_object(DEVICE_PATH, "org.bluez.Device1");
+        sd_bus_message_append(reply, "{sv}", "Address", "s", DEVICE_ADDRESS);
+        sd_bus_message_append(reply, "{sv}", "RSSI", "n", static_cast<int16_t>(-48));
+        sd_bus_message_append(reply, "{sv}", "Connected", "b", connected ? 1 : 0);
+        sd_bus_message_append(reply, "{sv}", "ServicesResolved", "b", connected ? 1 : 0);
+        sd_bus_message_open_container(reply, 'e', "sv");
+        sd_bus_message_append(reply, "s", "ManufacturerData");
+        sd_bus_message_open_container(reply, 'v', "a{qv}");
+        sd_bus_message_open_container(reply, 'a', "{qv}");
+        sd_bus_message_open_container(reply, 'e', "qv");
+        sd_bus_message_append(reply, "q", JOYCON_MANUFACTURER_ID);
+        sd_bus_message_open_container(reply, 'v', "ay");
+        sd_bus_message_append_array(reply, 'y', MANUFACTURER_DATA, sizeof(MANUFACTURER_DATA));
+        sd_bus_message_close_container(reply); // v
+        sd_bus_message_close_container(reply); // e
+        sd_bus_message_close_container(reply); // a
+        sd_bus_message_close_container(reply); // v
+        sd_bus_message_close_container(reply); // e
+        close_object();
+
+        open_object(INPUT_PATH, "org.bluez.GattCharacteristic1");
+        sd_bus_message_append(reply, "{sv}", "UUID", "s", INPUT_REPORT_UUID);
+        close_object();
+
+        open_object(WRITE_PATH, "org.bluez.GattCharacteristic1");
+        sd_bus_message_append(reply, "{sv}", "UUID", "s", WRITE_COMMAND_UUID);
+        close_object();
+
+        r = sd_bus_message_close_container(reply);
+        if (r >= 0) r = sd_bus_send(nullptr, reply, nullptr);
+        sd_bus_message_unref(reply);
+        return r;
+    }
+
+    int ReplyProperty(sd_bus_message* m, const std::string& path)
+    {
+        const char* iface = nullptr;
+        const char* name = nullptr;
+        int r = sd_bus_message_read(m, "ss", &iface, &name);
+        if (r < 0) return r;
+        std::string property = name;
+
+        if (path == DEVICE_PATH && property == "ServicesResolved")
+            return sd_bus_reply_method_return(m, "v", "b", connected ? 1 : 0);
+        if (path == INPUT_PATH && property == "UUID")
+            return sd_bus_reply_method_return(m, "v", "s", INPUT_REPORT_UUID);
+        if (path == WRITE_PATH && property == "UUID")
+            return sd_bus_reply_method_return(m, "v", "s", WRITE_COMMAND_UUID);
+        return sd_bus_reply_method_errorf(m, "org.freedesktop.DBus.Error.UnknownProperty", "%s", name);
+    }
+
+    int ReplyAcquireNotify(sd_bus_message* m)
+    {
+        // BlueZと同じく、1回の書き込みが1つの通知になるSOCK_SEQPACKETを渡す
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+            return sd_bus_reply_method_errorf(m, "org.bluez.Error.Failed", "socketpair");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (notifyPeer >= 0) close(notifyPeer);
+            notifyPeer = fds[0];
+        }
+        // 返信には複製が入るので、こちらの記述子は閉じる
+        int r = sd_bus_reply_method_return(m, "hq", fds[1], NOTIFY_MTU);
+        close(fds[1]);
+        return r;
+    }
+
+    int HandleWriteValue(sd_bus_message* m)
+    {
+        const void* data = nullptr;
+        size_t size = 0;
+        int r = sd_bus_message_read_array(m, 'y', &data, &size);
+        if (r < 0) return r;
+
+        std::string type;
+        if ((r = sd_bus_message_enter_container(m, 'a', "{sv}")) < 0) return r;
+        while ((r = sd_bus_message_enter_container(m, 'e', "sv")) > 0) {
+            const char* key = nullptr;
+            if ((r = sd_bus_message_read(m, "s", &key)) < 0) return r;
+            if (std::string(key) == "type") {
+                const char* value = nullptr;
+                if ((r = sd_bus_message_read(m, "v", "s", &value)) < 0) return r;
+                type = value;
+            }
+            else if ((r = sd_bus_message_skip(m, "v")) < 0) return r;
+            if ((r = sd_bus_message_exit_container(m)) < 0) return r;
+        }
+        if (r < 0) return r;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            writes.emplace_back(bytes, bytes + size);
+            writeTypes.push_back(type);
+        }
+        return sd_bus_reply_method_return(m, "");
+    }
+
+    sd_bus* bus = nullptr;
+    std::thread thread;
+    std::atomic<bool> running{ true };
+    std::atomic<bool> connected{ false };
+    int notifyPeer = -1;
+};
+
+/**
+ * @brief Joy-Conのアドバタイズを探して見つかったアドレスを返す
+ */
+static uint64_t scan_for_joycon(BlueZTransport& transport)
+{
+    uint64_t found = 0;
+    transport.Scan([&](const Advertisement& adv)
+        {
+            if (!IsJoyConAdvertisement(adv)) return false;
+            CHECK(ParseControllerModel(adv.manufacturerData) == ControllerModel::JoyConRight);
+            CHECK_EQ(adv.rssi, -48);
+            found = adv.address;
+            return true;
+        }, std::chrono::milliseconds(2000));
+    return found;
+}
+
+/**
+ * @brief 購読、通知の受信、コマンドの書き込み、切断を確認する
+ */
+static void check_device(MockBlueZ& mock, TransportDevice& device)
+{
+    std::mutex mutex;
+    std::vector<std::vector<uint8_t>> received;
+    CHECK(device.Subscribe([&](std::span<const uint8_t> data)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.emplace_back(data.begin(), data.end());
+        }));
+
+    // 通知はパケットの区切りを保って届く
+    std::vector<uint8_t> first(0x40, 0x11);
+    std::vector<uint8_t> second = { 0x08, 0x67, 0x00, 0x01 };
+    CHECK(mock.Notify(first));
+    CHECK(mock.Notify(second));
+    CHECK(WaitUntil([&]() { std::lock_guard<std::mutex> lock(mutex); return received.size() >= 2; }));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK_EQ(received.size(), 2u);
+        if (received.size() >= 2) {
+            CHECK(received[0] == first);
+            CHECK(received[1] == second);
+        }
+    }
+
+    // コマンドは応答なし書き込み（type=command）で送る
+    const uint8_t command[] = { 0x0c, 0x91, 0x01, 0x02, 0x00, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00 };
+    CHECK(device.CanWrite());
+    CHECK(device.WriteCommand(command));
+    {
+        std::lock_guard<std::mutex> lock(mock.mutex);
+        CHECK_EQ(mock.writes.size(), 1u);
+        if (!mock.writes.empty()) {
+            CHECK(mock.writes.back() == std::vector<uint8_t>(std::begin(command), std::end(command)));
+            CHECK(mock.writeTypes.back() == "command");
+        }
+        mock.writes.clear();
+        mock.writeTypes.clear();
+    }
+
+    // 閉じると受信スレッドが止まり、デバイスを切断する
+    int disconnects = mock.disconnectCalls;
+    device.Close();
+    CHECK_EQ(mock.disconnectCalls.load(), disconnects + 1);
+}
+
+int main()
+{
+    // dbus-run-sessionが起動したバスを、BlueZTransportが開くシステムバスとして使う
+    const char* session = std::getenv("DBUS_SESSION_BUS_ADDRESS");
+    if (!session) {
+        std::wcerr << L"DBUS_SESSION_BUS_ADDRESS is not set (run under dbus-run-session).\n";
+        return 1;
+    }
+    setenv("DBUS_SYSTEM_BUS_ADDRESS", session, 1);
+
+    MockBlueZ mock;
+    if (!mock.Start()) {
+        std::wcerr << L"Failed to start the mock BlueZ service.\n";
+        return 1;
+    }
+
+    BlueZTransport transport;
+    CHECK(transport.IsAvailable());
+
+    // 探索: 製造元ID 1363 と先頭4バイトで見つける
+    uint64_t address = scan_for_joycon(transport);
+    CHECK_EQ(address, DEVICE_ADDRESS_VALUE);
+    CHECK(mock.discoveryStarts.load() >= 1);
+
+    // キャッシュが無い接続は全オブジェクトを列挙してキャラクタリスティックを探し、位置を記録する
+    DeviceCacheEntry entry;
+    CHECK(!LookupDeviceCache(DEVICE_ADDRESS_VALUE, entry));
+    int listed = mock.managedObjectsCalls;
+    auto device = transport.Connect(DEVICE_ADDRESS_VALUE);
+    CHECK(device != nullptr);
+    CHECK_EQ(mock.connectCalls.load(), 1);
+    CHECK(mock.managedObjectsCalls.load() > listed);
+    CHECK(LookupDeviceCache(DEVICE_ADDRESS_VALUE, entry));
+    CHECK(entry.input == "service000a/char000b");
+    CHECK(entry.write == "service000a/char000d");
+    if (device) {
+        CHECK_EQ(device->Address(), DEVICE_ADDRESS_VALUE);
+        check_device(mock, *device);
+    }
+    device.reset();
+
+    // キャッシュがあれば列挙せずに、記録した位置のUUIDだけを確認する
+    listed = mock.managedObjectsCalls;
+    device = transport.Connect(DEVICE_ADDRESS_VALUE);
+    CHECK(device != nullptr);
+    CHECK_EQ(mock.connectCalls.load(), 2);
+    CHECK_EQ(mock.managedObjectsCalls.load(), listed);
+    if (device) check_device(mock, *device);
+    device.reset();
+
+    ConnectTimingStats timing = GetConnectTimingStats();
+    CHECK_EQ(timing.discovery.count, 1u);
+    CHECK_EQ(timing.cached.count, 1u);
+
+    // 古いキャッシュ（存在しないパス）なら、全て探し直して正しい位置で上書きする
+    StoreGattLocation(DEVICE_ADDRESS_VALUE, "service0001/char0002", "service0001/char0003");
+    listed = mock.managedObjectsCalls;
+    device = transport.Connect(DEVICE_ADDRESS_VALUE);
+    CHECK(device != nullptr);
+    CHECK(mock.managedObjectsCalls.load() > listed);
+    CHECK(LookupDeviceCache(DEVICE_ADDRESS_VALUE, entry));
+    CHECK(entry.input == "service000a/char000b");
+    if (device) device->Close();
+    device.reset();
+
+    return TestResult(L"BlueZTransportTest");
+}
@@ -0,0 +1,161 @@
+﻿// コマンドの送信キューの順序と確認、キューと送信スレッドの片付けを確認するテスト
+#include "CommandQueue.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "TestCheck.h"
+
+/**
+ * @class TestDevice
+ * @brief 書き込まれたコマンドを記録するデバイス（書き込みに時間がかかる実機の代わりに待つこともできる）
+ */
+class TestDevice : public TransportDevice {
+public:
+    explicit TestDevice(std::chrono::milliseconds writeTime = std::chrono::milliseconds(0), CommandQueue* cancelOnDestroy = nullptr)
+        : writeTime(writeTime), cancelOnDestroy(cancelOnDestroy)
+    {
+    }
+
+    // 閉じるときにキューを片付けるデバイス（ReconnectingDeviceと同じ）
+    ~TestDevice() override
+    {
+        if (cancelOnDestroy) cancelOnDestroy->Cancel(*this);
+    }
+
+    uint64_t Address() const override { return 0x98B6E9000001; }
+    bool Subscribe(NotifyHandler) override { return true; }
+    bool CanWrite() const override { return true; }
+    void Close() override {}
+
+    bool WriteCommand(std::span<const uint8_t> data) override
+    {
+        started++;
+        std::this_thread::sleep_for(writeTime);
+        std::lock_guard<std::mutex> lock(mutex);
+        written.emplace_back(data.begin(), data.end());
+        return true;
+    }
+
+    std::vector<std::vector<uint8_t>> Written() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return written;
+    }
+
+    std::atomic<int> started{ 0 };
+
+private:
+    std::chrono::milliseconds writeTime;
+    CommandQueue* cancelOnDestroy;
+    mutable std::mutex mutex;
+    std::vector<std::vector<uint8_t>> written;
+};
+
+static void check_order_and_verify()
+{
+    CommandQueueConfig config;
+    config.interval = std::chrono::milliseconds(1);
+    config.verifyTimeout = std::chrono::milliseconds(200);
+    CommandQueue queue(config);
+    auto device = std::make_shared<TestDevice>();
+
+    // 確認は入力レポートが届くまで以降のコマンドを待たせる
+    std::atomic<int> verified{ -1 };
+    queue.Enqueue(device, { 0x01 });
+    queue.EnqueueVerify(device, [&](bool success) { verified = success ? 1 : 0; });
+    queue.Enqueue(device, { 0x02 });
+    CHECK(WaitUntil([&] { return device->Written().size() == 1; }));
+    CHECK(!queue.WaitIdle(*device, std::chrono::milliseconds(20)));
+    CHECK_EQ(device->Written().size(), 1u);
+    queue.ReportReceived(*device);
+    CHECK(queue.WaitIdle(*device, std::chrono::milliseconds(1000)));
+    CHECK_EQ(verified.load(), 1);
+    CHECK(device->Written() == (std::vector<std::vector<uint8_t>>{ { 0x01 }, { 0x02 } }));
+
+    // 入力レポートが届かなければ期限で失敗として完了し、次に進む
+    queue.EnqueueVerify(device, [&](bool success) { verified = success ? 1 : 0; });
+    queue.Enqueue(device, { 0x03 });
+    CHECK(queue.WaitIdle(*device, std::chrono::milliseconds(1000)));
+    CHECK_EQ(verified.load(), 0);
+    CHECK_EQ(device->Written().size(), 3u);
+}
+
+static void check_cancel()
+{
+    CommandQueueConfig config;
+    config.interval = std::chrono::milliseconds(1);
+    CommandQueue queue(config);
+    auto slow = std::make_shared<TestDevice>(std::chrono::milliseconds(50));
+    auto other = std::make_shared<TestDevice>();
+
+    // 書き込み中のコマンドは終わらせ、未送信のコマンドは破棄してキューを片付ける
+    int completed = 0;
+    for (uint8_t i = 0; i < 3; ++i)
+        queue.Enqueue(slow, { i }, [&](bool) { completed++; });
+    queue.Enqueue(other, { 0x10 });
+    CHECK(WaitUntil([&] { return slow->started.load() == 1; }));
+    CHECK_EQ(queue.DeviceCount(), 2u);
+    queue.Cancel(*slow);
+    CHECK_EQ(queue.DeviceCount(), 1u);
+    CHECK(queue.WaitIdle(*slow, std::chrono::milliseconds(0)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK_EQ(slow->Written().size(), 1u);
+    CHECK_EQ(completed, 1);
+
+    // 片付けた後に追加したコマンドは新しいキューで送る（終了した送信スレッドはここで待つ）
+    queue.Enqueue(slow, { 0x20 });
+    CHECK(queue.WaitIdle(*slow, std::chrono::milliseconds(1000)));
+    CHECK_EQ(slow->Written().size(), 2u);
+    CHECK_EQ(queue.DeviceCount(), 2u);
+    CHECK(queue.WaitIdle(*other, std::chrono::milliseconds(1000)));
+    CHECK_EQ(other->Written().size(), 1u);
+}
+
+static void check_idle_and_destroyed()
+{
+    CommandQueueConfig config;
+    config.interval = std::chrono::milliseconds(1);
+    config.idleTimeout = std::chrono::milliseconds(50);
+    CommandQueue queue(config);
+
+    // 空のまま一定時間経ったキューは送信スレッドごと片付ける
+    auto device = std::make_shared<TestDevice>();
+    queue.Enqueue(device, { 0x01 });
+    CHECK(queue.WaitIdle(*device, std::chrono::milliseconds(1000)));
+    CHECK(WaitUntil([&] { return queue.DeviceCount() == 0; }));
+
+    // 閉じるときにCancelするデバイスは、破棄したときにキューが無くなる
+    auto closing = std::make_shared<TestDevice>(std::chrono::milliseconds(0), &queue);
+    queue.Enqueue(closing, { 0x02 });
+    CHECK(queue.WaitIdle(*closing, std::chrono::milliseconds(1000)));
+    CHECK_EQ(queue.DeviceCount(), 1u);
+    closing.reset();
+    CHECK_EQ(queue.DeviceCount(), 0u);
+
+    // 破棄したデバイスのキューは、同じアドレスに作られたデバイスにも引き継がない
+    CommandQueueConfig keep = config;
+    keep.idleTimeout = std::chrono::milliseconds(10000);
+    CommandQueue reused(keep);
+    for (int i = 0; i < 4; ++i) {
+        auto first = std::make_shared<TestDevice>();
+        reused.Enqueue(first, { 0x03 });
+        CHECK(reused.WaitIdle(*first, std::chrono::milliseconds(1000)));
+        first.reset();
+        auto second = std::make_shared<TestDevice>();
+        CHECK(reused.WaitIdle(*second, std::chrono::milliseconds(0)));
+        reused.Enqueue(second, { 0x04 });
+        CHECK(reused.WaitIdle(*second, std::chrono::milliseconds(1000)));
+        CHECK_EQ(second->Written().size(), 1u);
+        CHECK_EQ(reused.DeviceCount(), static_cast<size_t>(2 * (i + 1)));
+    }
+}
+
+int main()
+{
+    check_order_and_verify();
+    check_cancel();
+    check_idle_and_destroyed();
+    return TestResult(L"CommandQueueTest");
+}
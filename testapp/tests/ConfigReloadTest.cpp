@@ -0,0 +1,242 @@
+﻿// 読み取り側が回り続けている間に設定を差し替えるテスト（LiveConfigとConfigWatcher、ボタン割り当ての読み直し）
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConfigWatcher.h"
+#include "MouseMapper.h"
+#include "ScrollEngine.h"
+#include "TestCheck.h"
+
+constexpr int READER_COUNT = 3;
+constexpr int PUBLISH_COUNT = 20000;
+
+/**
+ * @brief 全てのフィールドが同じ世代の値を持つ設定を作る（途中まで書かれた設定を見分けるため）
+ */
+static MouseConfig make_config(int generation)
+{
+    MouseConfig config;
+    config.sensitivity = generation;
+    config.scroll.maxSpeed = static_cast<float>(generation);
+    config.scroll.step = generation;
+    config.scroll.invert = generation % 2 != 0;
+    return config;
+}
+
+/**
+ * @brief 読み取り側が見た設定が1つの世代で揃っているか
+ */
+static bool is_consistent(const MouseConfig& config)
+{
+    int generation = config.scroll.step;
+    return config.sensitivity == generation && config.scroll.maxSpeed == static_cast<float>(generation) &&
+        config.scroll.invert == (generation % 2 != 0);
+}
+
+/**
+ * @brief 読み取り側を回しながら公開を繰り返し、どの読み取りも揃った設定を古い順に見ることを確認する
+ */
+static void check_swap_under_load()
+{
+    LiveConfig<MouseConfig> config(make_config(0));
+    std::atomic<bool> done{ false };
+    std::atomic<int> torn{ 0 };
+    std::atomic<int> backwards{ 0 };
+    std::atomic<uint64_t> reads{ 0 };
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < READER_COUNT; ++i) {
+        readers.emplace_back([&]()
+            {
+                int last = 0;
+                uint64_t count = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    const MouseConfig& current = config.Get();
+                    if (!is_consistent(current)) torn++;
+                    if (current.scroll.step < last) backwards++;
+                    last = current.scroll.step;
+                    ++count;
+                }
+                reads += count;
+            });
+    }
+
+    for (int generation = 1; generation <= PUBLISH_COUNT; ++generation) {
+        config.Publish(make_config(generation));
+        if (generation % 64 == 0) std::this_thread::yield(); // 1コアでも読み取り側に順番を回す
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+
+    CHECK_EQ(torn.load(), 0);
+    CHECK_EQ(backwards.load(), 0);
+    CHECK(reads.load() > 0);
+    CHECK_EQ(config.Version(), static_cast<uint32_t>(PUBLISH_COUNT + 1));
+    CHECK_EQ(config.Get().scroll.step, PUBLISH_COUNT);
+}
+
+static void write_scroll_config(int step)
+{
+    std::ofstream ofs("scroll.txt", std::ios::trunc);
+    ofs << "# test\nstep=" << step << "\nmax_speed=" << step << "\n";
+}
+
+/**
+ * @brief ファイルの保存から、監視スレッドでの読み込みと公開を経て、回り続けている読み取り側に届くまでを確認する
+ */
+static void check_file_reload()
+{
+    write_scroll_config(10);
+    ScrollConfig initial;
+    LoadScrollConfig(initial);
+    LiveConfig<ScrollConfig> config(initial);
+    CHECK_EQ(config.Get().step, 10);
+
+    std::atomic<int> reloads{ 0 };
+    ConfigWatcher watcher({ "scroll.txt", "missing.txt" }, [&]()
+        {
+            ScrollConfig loaded;
+            LoadScrollConfig(loaded);
+            config.Publish(loaded);
+            reloads++;
+        });
+    watcher.Start();
+
+    // 入力ハンドラのように、レポートごとに最新の設定を読み続ける
+    std::atomic<bool> done{ false };
+    std::atomic<int> seen{ 10 };
+    std::thread reader([&]()
+        {
+            while (!done.load(std::memory_order_relaxed)) {
+                const ScrollConfig& current = config.Get();
+                if (current.step != static_cast<int>(current.maxSpeed)) seen = -1;
+                else if (seen.load() != -1) seen = current.step;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+
+    // 1回の保存
+    write_scroll_config(20);
+    CHECK(WaitUntil([&]() { return seen.load() == 20; }, std::chrono::milliseconds(3000)));
+    CHECK_EQ(reloads.load(), 1);
+
+    // エディタのように続けて書き込んでも、最後の内容が公開される
+    int before = reloads;
+    for (int step = 21; step <= 30; ++step) write_scroll_config(step);
+    CHECK(WaitUntil([&]() { return seen.load() == 30; }, std::chrono::milliseconds(3000)));
+    CHECK(reloads.load() - before < 10);
+
+    // 変更が無ければ読み込まない
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    int settled = reloads;
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    CHECK_EQ(reloads.load(), settled);
+
+    // 監視していないファイルの変更では読み込まない
+    { std::ofstream("other.txt") << "x\n"; }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    CHECK_EQ(reloads.load(), settled);
+
+    done = true;
+    reader.join();
+    watcher.Stop();
+    CHECK(seen.load() != -1);
+
+    // 停止後の変更は通知されない
+    write_scroll_config(40);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    CHECK_EQ(reloads.load(), settled);
+}
+
+/**
+ * @brief mouse_bindings.txtだけを読んだ設定（mouseappのLoadMouseConfigの割り当て部分）
+ */
+static MouseConfig load_bindings()
+{
+    MouseConfig config;
+    LoadMouseBindings(config);
+    return config;
+}
+
+/**
+ * @brief 指定したボタンを押している右Joy-Conのレポート
+ */
+static DS4_REPORT_EX buttons_report(uint16_t buttons)
+{
+    DS4_REPORT_EX report{};
+    DS4_REPORT_INIT(reinterpret_cast<PDS4_REPORT>(&report.Report));
+    report.Report.wButtons |= buttons;
+    return report;
+}
+
+/**
+ * @brief mouse_bindings.txtの保存が、動いているMouseStateの次のレポートから反映されることを確認する
+ */
+static void check_binding_reload()
+{
+    // 既定の割り当て（右Joy-ConのX=進む）
+    LiveConfig<MouseConfig> config(load_bindings());
+    RecordingSink sink;
+    MouseEventBuffer buffer(sink);
+    MouseState state(JoyConSide::Right, config);
+    state.Update(buttons_report(DS4_BUTTON_CROSS), buffer);
+    buffer.Flush();
+    CHECK_EQ(state.Buttons(), 1u << MouseX1);
+
+    ConfigWatcher watcher({ "mouse_bindings.txt" }, [&]()
+        {
+            config.Publish(load_bindings());
+        });
+    watcher.Start();
+    {
+        std::ofstream ofs("mouse_bindings.txt", std::ios::trunc);
+        ofs << "# test\nright.forward=A\nright.back=NONE\nleft.middle=UP\nright.jump=A\nright.left=HOME\n";
+    }
+    CHECK(WaitUntil([&]() { return config.Get().right[MouseX1].mask == DS4_BUTTON_CIRCLE; }, std::chrono::milliseconds(3000)));
+    watcher.Stop();
+
+    // 読めた行だけ差し替え、書かれていない操作と読めない行の操作は既定のまま
+    const MouseConfig& loaded = config.Get();
+    CHECK_EQ(loaded.right[MouseX2].mask, 0u);
+    CHECK_EQ(loaded.right[MouseLeft].mask, DefaultMouseBindings(JoyConSide::Right)[MouseLeft].mask);
+    CHECK_EQ(loaded.left[MouseMiddle].mask, 0xFu);
+    CHECK_EQ(loaded.left[MouseMiddle].value, static_cast<uint16_t>(DS4_BUTTON_DPAD_NORTH));
+    CHECK_EQ(loaded.left[MouseLeft].mask, DefaultMouseBindings(JoyConSide::Left)[MouseLeft].mask);
+
+    // 同じMouseStateの次のレポートから新しい割り当てで判定する（Xは離したことになり、Aで進む）
+    state.Update(buttons_report(DS4_BUTTON_CROSS), buffer);
+    CHECK_EQ(state.Buttons(), 0u);
+    state.Update(buttons_report(DS4_BUTTON_CIRCLE | DS4_BUTTON_TRIANGLE), buffer);
+    CHECK_EQ(state.Buttons(), 1u << MouseX1);
+    buffer.Flush();
+
+    std::vector<MouseEvent> events = sink.MouseEvents();
+    CHECK_EQ(events.size(), 3u);
+    if (events.size() == 3) {
+        CHECK(events[0].button == MouseX1 && events[0].pressed);
+        CHECK(events[1].button == MouseX1 && !events[1].pressed);
+        CHECK(events[2].button == MouseX1 && events[2].pressed);
+    }
+}
+
+int main()
+{
+    check_swap_under_load();
+
+    // 監視は作業ディレクトリのファイルが対象なので、空のディレクトリで行う
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / ("joycon_config_test_" +
+        std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(dir);
+    std::filesystem::path previous = std::filesystem::current_path();
+    std::filesystem::current_path(dir);
+    check_file_reload();
+    check_binding_reload();
+    std::filesystem::current_path(previous);
+    std::filesystem::remove_all(dir);
+
+    return TestResult(L"ConfigReloadTest");
+}
@@ -0,0 +1,310 @@
+﻿// DsuServerにローカルのUDPクライアントから要求を送り、応答とデータのパケットをバイト単位で確認するテスト
+#include "DsuServer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include "TestCheck.h"
+
+constexpr uint64_t CONTROLLER_ADDRESS = 0x98B6E9000001;
+constexpr uint64_t SWAPPED_ADDRESS = 0x98B6E9000002;
+constexpr uint32_t MESSAGE_VERSION = 0x100000;
+constexpr uint32_t MESSAGE_INFO = 0x100001;
+constexpr uint32_t MESSAGE_DATA = 0x100002;
+
+/**
+ * @brief CRC32（1ビットずつ計算する。サーバーの表による計算と独立に確認するため）
+ */
+static uint32_t crc32(const uint8_t* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static uint16_t get_le16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+        (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static float get_float(const uint8_t* data)
+{
+    uint32_t bits = get_le32(data);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void put_le32(uint8_t* out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+/**
+ * @class DsuClient
+ * @brief エミュレーターの代わりに要求を送り、サーバーからのパケットを受け取るUDPクライアント
+ */
+class DsuClient {
+public:
+    explicit DsuClient(uint16_t serverPort)
+    {
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        server.sin_family = AF_INET;
+        server.sin_port = htons(serverPort);
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    ~DsuClient() { if (fd >= 0) close(fd); }
+
+    /**
+     * @brief 要求を送る（ヘッダーとCRC32はここで付ける）
+     * @param corrupt CRC32をわざと壊す
+     */
+    bool Send(uint32_t type, const std::vector<uint8_t>& payload, bool corrupt = false)
+    {
+        std::vector<uint8_t> packet(20 + payload.size());
+        std::memcpy(packet.data(), "DSUC", 4);
+        packet[4] = 1001 & 0xFF;
+        packet[5] = 1001 >> 8;
+        packet[6] = static_cast<uint8_t>(packet.size() - 16);
+        packet[7] = static_cast<uint8_t>((packet.size() - 16) >> 8);
+        put_le32(packet.data() + 12, 0x12345678);
+        put_le32(packet.data() + 16, type);
+        std::memcpy(packet.data() + 20, payload.data(), payload.size());
+        put_le32(packet.data() + 8, crc32(packet.data(), packet.size()) ^ (corrupt ? 1u : 0u));
+        return sendto(fd, packet.data(), packet.size(), 0, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) ==
+            static_cast<ssize_t>(packet.size());
+    }
+
+    /**
+     * @brief パケットを1つ受け取る
+     * @return 受け取ったパケット（タイムアウトなら空）
+     */
+    std::vector<uint8_t> Receive(int timeoutMs = 1000)
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeoutMs) <= 0) return {};
+        std::vector<uint8_t> packet(1024);
+        ssize_t size = recv(fd, packet.data(), packet.size(), 0);
+        packet.resize(size > 0 ? static_cast<size_t>(size) : 0);
+        return packet;
+    }
+
+    /**
+     * @brief スロットのデータを購読する
+     * @param flags 登録方法（0は全スロット、1はスロット番号、2はMACアドレス）
+     */
+    bool Subscribe(uint8_t flags, uint8_t slot, uint64_t mac = 0)
+    {
+        std::vector<uint8_t> payload = { flags, slot, 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 6; ++i)
+            payload[2 + i] = static_cast<uint8_t>(mac >> ((5 - i) * 8));
+        return Send(MESSAGE_DATA, payload);
+    }
+
+private:
+    int fd = -1;
+    sockaddr_in server{};
+};
+
+/**
+ * @brief サーバーからのパケットのヘッダー（マジック、バージョン、長さ、CRC32、種類）を確認する
+ */
+static void check_header(const std::vector<uint8_t>& packet, uint32_t type, size_t size)
+{
+    CHECK_EQ(packet.size(), size);
+    if (packet.size() != size) return;
+    CHECK(std::memcmp(packet.data(), "DSUS", 4) == 0);
+    CHECK_EQ(get_le16(packet.data() + 4), 1001);
+    CHECK_EQ(get_le16(packet.data() + 6), size - 16);
+    CHECK_EQ(get_le32(packet.data() + 16), type);
+
+    std::vector<uint8_t> copy = packet;
+    std::memset(copy.data() + 8, 0, 4);
+    CHECK_EQ(get_le32(packet.data() + 8), crc32(copy.data(), copy.size()));
+}
+
+/**
+ * @brief スロットの情報（状態、種類、接続方法、MACアドレス）を確認する
+ */
+static void check_slot_info(const uint8_t* info, uint8_t slot, uint64_t address)
+{
+    CHECK_EQ(info[0], slot);
+    if (address == 0) {
+        CHECK_EQ(info[1], 0);
+        return;
+    }
+    CHECK_EQ(info[1], 2); // 接続中
+    CHECK_EQ(info[2], 2); // ジャイロあり
+    CHECK_EQ(info[3], 2); // Bluetooth
+    for (int i = 0; i < 6; ++i)
+        CHECK_EQ(info[4 + i], static_cast<uint8_t>(address >> ((5 - i) * 8)));
+}
+
+static std::vector<uint8_t> request_info(DsuClient& client, uint8_t slot)
+{
+    CHECK(client.Send(MESSAGE_INFO, { 1, 0, 0, 0, slot }));
+    std::vector<uint8_t> packet = client.Receive();
+    check_header(packet, MESSAGE_INFO, 32);
+    return packet;
+}
+
+static DS4_REPORT_EX sample_report()
+{
+    DS4_REPORT_EX report{};
+    DS4_REPORT_INIT(reinterpret_cast<PDS4_REPORT>(&report.Report));
+    report.Report.wButtons |= DS4_BUTTON_CROSS | DS4_BUTTON_SHOULDER_LEFT | DS4_BUTTON_OPTIONS;
+    DS4_SET_DPAD(reinterpret_cast<PDS4_REPORT>(&report.Report), DS4_BUTTON_DPAD_EAST);
+    report.Report.bSpecial = DS4_SPECIAL_BUTTON_PS;
+    report.Report.bThumbLX = 0x20;
+    report.Report.bThumbLY = 0x30;
+    report.Report.bTriggerR = 0x99;
+    report.Report.wAccelZ = 4096;   // 1G
+    report.Report.wGyroX = 24000;   // 180deg/s
+    report.Report.wGyroZ = -4800;   // -36deg/s
+    return report;
+}
+
+/**
+ * @brief データのパケットの中身（スロット、番号、ボタン、スティック、モーション）を確認する
+ */
+static void check_data(const std::vector<uint8_t>& packet, uint8_t slot, uint64_t address, uint32_t number)
+{
+    check_header(packet, MESSAGE_DATA, DSU_DATA_PACKET_SIZE);
+    if (packet.size() != DSU_DATA_PACKET_SIZE) return;
+    check_slot_info(packet.data() + 20, slot, address);
+    CHECK_EQ(packet[31], 1); // 接続中
+    CHECK_EQ(get_le32(packet.data() + 32), number);
+
+    const uint8_t* input = packet.data() + 36;
+    CHECK_EQ(input[0], 0x20 | 0x08);  // 右とOptions
+    CHECK_EQ(input[1], 0x40 | 0x04);  // ×とL1
+    CHECK_EQ(input[2], 1);            // PS
+    CHECK_EQ(input[3], 0);
+    CHECK_EQ(input[4], 0x20);
+    CHECK_EQ(input[5], 255 - 0x30);   // 上が正
+    CHECK_EQ(input[6], 0x80);
+    CHECK_EQ(input[10], 0xFF);        // アナログの右
+    CHECK_EQ(input[13], 0xFF);        // アナログの×
+    CHECK_EQ(input[17], 0xFF);        // アナログのL1
+    CHECK_EQ(input[18], 0x99);        // R2
+
+    const uint8_t* motion = input + 32;
+    uint64_t timestamp = 0;
+    for (int i = 0; i < 8; ++i) timestamp |= static_cast<uint64_t>(motion[i]) << (i * 8);
+    CHECK_EQ(timestamp, 123456789ull + number);
+    CHECK(get_float(motion + 16) == 1.0f);
+    CHECK(get_float(motion + 20) == 180.0f);
+    CHECK(get_float(motion + 28) == -36.0f);
+}
+
+int main()
+{
+    DsuServerConfig config;
+    config.port = 0;
+    config.clientTimeout = std::chrono::milliseconds(300);
+    auto server = CreateDsuServer(config);
+    CHECK(server != nullptr);
+    if (!server) return TestResult(L"DsuServerTest");
+    CHECK(server->Port() != 0);
+
+    DsuClient client(server->Port());
+    DS4_REPORT_EX report = sample_report();
+
+    // バージョン
+    CHECK(client.Send(MESSAGE_VERSION, {}));
+    std::vector<uint8_t> version = client.Receive();
+    check_header(version, MESSAGE_VERSION, 22);
+    if (version.size() == 22) CHECK_EQ(get_le16(version.data() + 20), 1001);
+
+    // CRC32が正しくない要求には応答しない
+    CHECK(client.Send(MESSAGE_VERSION, {}, true));
+    CHECK(client.Receive(200).empty());
+    CHECK(WaitUntil([&]() { return server->Stats().invalid == 1; }));
+
+    // 接続前後のスロットの情報（複数のスロットの要求には1つずつ応答する）
+    CHECK(client.Send(MESSAGE_INFO, { 2, 0, 0, 0, 0, 1 }));
+    for (uint8_t slot = 0; slot < 2; ++slot) {
+        std::vector<uint8_t> info = client.Receive();
+        check_header(info, MESSAGE_INFO, 32);
+        if (info.size() == 32) check_slot_info(info.data() + 20, slot, 0);
+    }
+    server->Connect(0, CONTROLLER_ADDRESS);
+    std::vector<uint8_t> info = request_info(client, 0);
+    if (info.size() == 32) check_slot_info(info.data() + 20, 0, CONTROLLER_ADDRESS);
+
+    // 購読していなければ送らない
+    server->Publish(0, CONTROLLER_ADDRESS, report, 123456789);
+    CHECK(client.Receive(200).empty());
+    CHECK_EQ(server->Stats().sent, 0u);
+
+    // スロット番号で購読すると、入力ごとに番号が増えるパケットが届く（CRC32は先頭の途中の状態から続けて計算したもの）
+    uint64_t requests = server->Stats().requests;
+    CHECK(client.Subscribe(1, 0));
+    CHECK(WaitUntil([&]() { return server->Stats().requests > requests; }));
+    for (uint32_t number = 0; number < 3; ++number) {
+        server->Publish(0, CONTROLLER_ADDRESS, report, 123456789 + number);
+        check_data(client.Receive(), 0, CONTROLLER_ADDRESS, number);
+    }
+    CHECK_EQ(server->Stats().sent, 3u);
+
+    // 購読していないスロットと、範囲外のスロットは送らない
+    server->Connect(1, CONTROLLER_ADDRESS + 0x10);
+    server->Publish(1, CONTROLLER_ADDRESS + 0x10, report, 1);
+    server->Publish(DSU_MAX_SLOTS, CONTROLLER_ADDRESS, report, 1);
+    CHECK(client.Receive(200).empty());
+
+    // 入れ替え: 新しいコントローラーが接続した後は、古いコントローラーの入力と切断を無視する
+    server->Connect(0, SWAPPED_ADDRESS);
+    server->Publish(0, CONTROLLER_ADDRESS, report, 1);
+    server->Disconnect(0, CONTROLLER_ADDRESS);
+    CHECK(client.Receive(200).empty());
+    info = request_info(client, 0);
+    if (info.size() == 32) check_slot_info(info.data() + 20, 0, SWAPPED_ADDRESS);
+    // エミュレーターと同じく購読を更新してから（上の確認の待ち時間で購読の期限が切れている）
+    requests = server->Stats().requests;
+    CHECK(client.Subscribe(1, 0));
+    CHECK(WaitUntil([&]() { return server->Stats().requests > requests; }));
+    server->Publish(0, SWAPPED_ADDRESS, report, 123456789);
+    check_data(client.Receive(), 0, SWAPPED_ADDRESS, 0);
+
+    // 接続しているコントローラーの切断ではスロットが空になる
+    server->Disconnect(0, SWAPPED_ADDRESS);
+    info = request_info(client, 0);
+    if (info.size() == 32) check_slot_info(info.data() + 20, 0, 0);
+    server->Publish(0, SWAPPED_ADDRESS, report, 1);
+    CHECK(client.Receive(200).empty());
+
+    // MACアドレスで購読する
+    requests = server->Stats().requests;
+    CHECK(client.Subscribe(2, 0, CONTROLLER_ADDRESS + 0x10));
+    CHECK(WaitUntil([&]() { return server->Stats().requests > requests; }));
+    server->Publish(1, CONTROLLER_ADDRESS + 0x10, report, 123456789);
+    std::vector<uint8_t> data = client.Receive();
+    check_header(data, MESSAGE_DATA, DSU_DATA_PACKET_SIZE);
+    if (data.size() == DSU_DATA_PACKET_SIZE) check_slot_info(data.data() + 20, 1, CONTROLLER_ADDRESS + 0x10);
+
+    // 要求が途絶えたクライアントには送らない
+    std::this_thread::sleep_for(config.clientTimeout + std::chrono::milliseconds(100));
+    uint64_t sent = server->Stats().sent;
+    server->Publish(1, CONTROLLER_ADDRESS + 0x10, report, 1);
+    CHECK(client.Receive(200).empty());
+    CHECK_EQ(server->Stats().sent, sent);
+
+    return TestResult(L"DsuServerTest");
+}
@@ -0,0 +1,153 @@
+﻿// IMUアップサンプリングが描画の遅延で補間し、次のサンプルが遅れたときだけ上限付きで外挿することを確認するテスト
+#include "ImuUpsampler.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "TestCheck.h"
+
+constexpr double PERIOD = 0.01; // 通知の間隔（秒）
+
+static MotionData motion(int16_t gyroX, int16_t accelZ)
+{
+    return MotionData{ gyroX, 0, 0, 0, 0, accelZ };
+}
+
+/**
+ * @brief 出力時刻から描画の遅延を引いた時刻のモーションデータ（出力段と同じ手順）
+ */
+static MotionData render(const ImuUpsampler& upsampler, double now)
+{
+    MotionData out{};
+    CHECK(upsampler.Sample(now - upsampler.RenderDelay(), out));
+    return out;
+}
+
+static void check_interpolation()
+{
+    ImuUpsampler upsampler;
+    MotionData out{};
+    CHECK(!upsampler.Sample(0.0, out));
+
+    // 1つだけならその値を保つ
+    upsampler.Push(1.0, motion(0, 4000));
+    CHECK(upsampler.Sample(1.005, out));
+    CHECK_EQ(out.gyroX, 0);
+    CHECK_EQ(out.accelZ, 4000);
+
+    // 自動の遅延は通知の間隔になり、2つ目のサンプルが届いた後の出力は間の補間になる
+    upsampler.Push(1.0 + PERIOD, motion(1000, 2000));
+    CHECK(upsampler.RenderDelay() > PERIOD * 0.99 && upsampler.RenderDelay() < PERIOD * 1.01);
+    out = render(upsampler, 1.0 + PERIOD + PERIOD / 2);
+    CHECK_EQ(out.gyroX, 500);
+    CHECK_EQ(out.accelZ, 3000);
+    out = render(upsampler, 1.0 + PERIOD + PERIOD / 4);
+    CHECK_EQ(out.gyroX, 250);
+
+    // 次のサンプルがちょうど届く時刻には最新サンプルの値になる（外挿しない）
+    out = render(upsampler, 1.0 + 2 * PERIOD);
+    CHECK_EQ(out.gyroX, 1000);
+    CHECK_EQ(out.accelZ, 2000);
+
+    // 描画する時刻が最新サンプルより前になるように遅延が決まる（1周期の中で出力しても外挿しない）
+    for (int i = 0; i <= 10; ++i) {
+        out = render(upsampler, 1.0 + PERIOD + PERIOD * i / 10);
+        CHECK(out.gyroX >= 0 && out.gyroX <= 1000);
+    }
+}
+
+static void check_late_sample()
+{
+    ImuUpsampler upsampler;
+    upsampler.Push(2.0, motion(0, 0));
+    upsampler.Push(2.0 + PERIOD, motion(1000, -1000));
+
+    // 次のサンプルが遅れたときだけ外挿する（描画の時刻は最新サンプルの4ms後）
+    MotionData out = render(upsampler, 2.0 + 2 * PERIOD + 0.004);
+    CHECK_EQ(out.gyroX, 1400);
+    CHECK_EQ(out.accelZ, -1400);
+
+    // 外挿はmax_extrapolation_ms（既定8ms）で止まる
+    out = render(upsampler, 2.0 + 2 * PERIOD + 0.008);
+    CHECK_EQ(out.gyroX, 1800);
+    out = render(upsampler, 2.0 + 2 * PERIOD + 0.5);
+    CHECK_EQ(out.gyroX, 1800);
+    CHECK_EQ(out.accelZ, -1800);
+
+    // 上限を小さくすると外挿も小さく止まり、値はint16_tの範囲に収める
+    ImuUpsamplerConfig config;
+    config.maxExtrapolation = 0.002f;
+    ImuUpsampler capped(config);
+    capped.Push(3.0, motion(0, 0));
+    capped.Push(3.0 + PERIOD, motion(30000, 0));
+    out = render(capped, 3.0 + 3 * PERIOD);
+    CHECK_EQ(out.gyroX, 32767);
+    capped.Push(3.0 + 2 * PERIOD, motion(31000, 0));
+    out = render(capped, 3.0 + 4 * PERIOD);
+    CHECK_EQ(out.gyroX, 31200);
+}
+
+static void check_fixed_delay()
+{
+    // 遅延を設定した場合は通知の間隔によらずその値を使い、0なら出力時刻そのもの（常に外挿）
+    ImuUpsamplerConfig config;
+    config.renderDelay = 0.005f;
+    ImuUpsampler fixed(config);
+    fixed.Push(1.0, motion(0, 0));
+    fixed.Push(1.0 + PERIOD, motion(1000, 0));
+    CHECK(fixed.RenderDelay() > 0.00499 && fixed.RenderDelay() < 0.00501);
+    CHECK_EQ(render(fixed, 1.0 + PERIOD).gyroX, 500);
+
+    config.renderDelay = 0.0f;
+    ImuUpsampler immediate(config);
+    immediate.Push(1.0, motion(0, 0));
+    immediate.Push(1.0 + PERIOD, motion(1000, 0));
+    CHECK_EQ(render(immediate, 1.0 + PERIOD + 0.004).gyroX, 1400);
+
+    // 自動の遅延は間隔の変化に少しずつ追従し、Resetで忘れる
+    ImuUpsampler adaptive;
+    for (int i = 0; i < 200; ++i)
+        adaptive.Push(i * 0.008, motion(0, 0));
+    CHECK(adaptive.RenderDelay() > 0.0079 && adaptive.RenderDelay() < 0.0081);
+    adaptive.Push(200 * 0.008 + 0.1, motion(0, 0));
+    CHECK(adaptive.RenderDelay() > 0.008 && adaptive.RenderDelay() < 0.02);
+    adaptive.Reset();
+    CHECK(adaptive.RenderDelay() == 0.0);
+}
+
+static void check_config_file()
+{
+    auto previous = std::filesystem::current_path();
+    auto directory = std::filesystem::temp_directory_path() / "joycon_imu_upsampler_test";
+    std::filesystem::create_directories(directory);
+    std::filesystem::current_path(directory);
+
+    {
+        std::ofstream ofs("imu_upsampler.txt");
+        ofs << "# test\nrender_delay_ms=12.5\nmax_extrapolation_ms=4\n";
+    }
+    ImuUpsamplerConfig config;
+    LoadImuUpsamplerConfig(config);
+    CHECK(config.renderDelay > 0.01249f && config.renderDelay < 0.01251f);
+    CHECK(config.maxExtrapolation > 0.00399f && config.maxExtrapolation < 0.00401f);
+
+    {
+        std::ofstream ofs("imu_upsampler.txt");
+        ofs << "render_delay_ms=auto\n";
+    }
+    LoadImuUpsamplerConfig(config);
+    CHECK(config.renderDelay < 0.0f);
+
+    std::filesystem::current_path(previous);
+    std::filesystem::remove_all(directory);
+}
+
+int main()
+{
+    check_interpolation();
+    check_late_sample();
+    check_fixed_delay();
+    check_config_file();
+    return TestResult(L"ImuUpsamplerTest");
+}
@@ -0,0 +1,75 @@
+﻿// ローカルのループバックでNetworkSinkからNetworkSourceへ250Hzでレポートを送り、帯域と遅延を計測する
+// スティックとモーションを毎フレーム変える（実際のプレイに近い差分の大きさ）
+// 数値は最適化したビルド（-DCMAKE_BUILD_TYPE=Release）で比べる
+#include "NetworkStream.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+#include "TestCheck.h"
+
+constexpr int RATE_HZ = 250;
+constexpr int FRAMES = RATE_HZ * 4;
+
+/**
+ * @brief i番目のフレームのレポート（ゆっくり回すスティックと揺れるモーション）
+ */
+static DS4_REPORT_EX moving_report(int i)
+{
+    DS4_REPORT_EX report{};
+    DS4_REPORT_INIT(reinterpret_cast<PDS4_REPORT>(&report.Report));
+    double phase = i * 0.05;
+    auto& r = report.Report;
+    r.bThumbLX = static_cast<uint8_t>(128 + 100 * std::cos(phase));
+    r.bThumbLY = static_cast<uint8_t>(128 + 100 * std::sin(phase));
+    if ((i / 50) % 2) r.wButtons |= DS4_BUTTON_CROSS;
+    r.wTimestamp = static_cast<uint16_t>(i * 188);
+    r.bBatteryLvl = 0x0B;
+    r.wGyroX = static_cast<int16_t>(400 * std::sin(phase * 3));
+    r.wGyroY = static_cast<int16_t>(250 * std::cos(phase * 2));
+    r.wGyroZ = static_cast<int16_t>(i % 7 - 3);
+    r.wAccelX = static_cast<int16_t>(60 * std::sin(phase));
+    r.wAccelY = static_cast<int16_t>(8192 + i % 5);
+    r.wAccelZ = static_cast<int16_t>(30 * std::cos(phase));
+    return report;
+}
+
+int main()
+{
+    RecordingSink recording;
+    NetworkSourceConfig sourceConfig;
+    sourceConfig.port = 0;
+    auto source = NetworkSource::Create(sourceConfig, [&](uint8_t) -> OutputSink* { return &recording; });
+    if (!source) {
+        std::wcerr << L"NetworkStreamBenchmark: failed to open the receiver.\n";
+        return 1;
+    }
+
+    NetworkSinkConfig sinkConfig;
+    sinkConfig.port = source->Port();
+    auto sink = NetworkSink::Create(sinkConfig, 0);
+    if (!sink) {
+        std::wcerr << L"NetworkStreamBenchmark: failed to open the sender.\n";
+        return 1;
+    }
+
+    // 出力クロックと同じく、一定の間隔の時刻まで待って送る
+    auto period = std::chrono::microseconds(1000000 / RATE_HZ);
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < FRAMES; ++i) {
+        std::this_thread::sleep_until(next);
+        sink->SubmitReport(moving_report(i));
+        next += period;
+    }
+
+    // ループバックでは失われないので、全てのフレームが届くまで待つ
+    WaitUntil([&] { return source->Stats(0).frames + source->Stats(0).lost >= FRAMES; });
+    NetworkStreamStats stats = source->Stats(0);
+    std::wcout << L"NetworkStreamBenchmark: " << FRAMES << L" frames at " << RATE_HZ << L" Hz, "
+        << sink->BytesSent() << L" bytes sent, " << recording.Reports().size() << L" reports recorded\n";
+    PrintNetworkStreamStats(0, stats);
+    return stats.frames > 0 ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+﻿// ネットワークの入力ストリームのフレームをバイト単位で確認し、欠落や順序の入れ替わりからの回復を確かめるテスト
+#include "NetworkStream.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "TestCheck.h"
+
+using Frame = std::vector<uint8_t>;
+using Result = NetFrameDecoder::Result;
+
+constexpr uint64_t MS = 1000; // マイクロ秒の時刻でのミリ秒
+
+static Frame encode(NetFrameEncoder& encoder, const DS4_REPORT_EX& report, uint64_t timeUs)
+{
+    Frame frame(NET_MAX_FRAME_SIZE);
+    frame.resize(encoder.Encode(report, timeUs, frame.data()));
+    return frame;
+}
+
+static Result decode(NetFrameDecoder& decoder, const Frame& frame, DS4_REPORT_EX& report, NetFrameInfo& info)
+{
+    return decoder.Decode(frame.data(), frame.size(), report, info);
+}
+
+static void put_varint(Frame& frame, uint64_t value)
+{
+    while (value >= 0x80) {
+        frame.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    frame.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * @brief 左スティックのXだけを持つフレームを形式の通りに組み立てる（エンコーダーでは作れない連番を試すため）
+ * @param keyOffset 差分のフレームのキーフレームからの連番の差
+ * @param value キーフレームでは値、差分のフレームではキーフレームからの差
+ */
+static Frame make_frame(bool keyframe, uint32_t sequence, uint32_t keyOffset, uint64_t timeUs, int32_t value)
+{
+    Frame frame = { static_cast<uint8_t>(0x02 | (keyframe ? 0x01 : 0x00)), 0 };
+    put_varint(frame, sequence);
+    if (!keyframe) put_varint(frame, keyOffset);
+    put_varint(frame, timeUs);
+    put_varint(frame, 1);
+    put_varint(frame, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+    return frame;
+}
+
+/**
+ * @brief 送る全てのフィールドに値を入れたレポート（送らないバイトは0のまま）
+ */
+static DS4_REPORT_EX sample_report(int i)
+{
+    DS4_REPORT_EX report{};
+    auto& r = report.Report;
+    r.bThumbLX = static_cast<uint8_t>(0x80 + i);
+    r.bThumbLY = static_cast<uint8_t>(0x7F - i);
+    r.bThumbRX = 0x01;
+    r.bThumbRY = 0xFE;
+    r.wButtons = static_cast<uint16_t>(0x1238 + i);
+    r.bSpecial = 0x01;
+    r.bTriggerL = 0xFF;
+    r.bTriggerR = static_cast<uint8_t>(i * 16);
+    r.wTimestamp = static_cast<uint16_t>(0xFFF0 + i * 188);
+    r.bBatteryLvl = 0x0B;
+    r.wGyroX = static_cast<int16_t>(-32768 + i);
+    r.wGyroY = 32767;
+    r.wGyroZ = static_cast<int16_t>(-1 - i * 1000);
+    r.wAccelX = 8192;
+    r.wAccelY = -8192;
+    r.wAccelZ = static_cast<int16_t>(i * 3);
+    r.bTouchPacketsN = 1;
+    r.sCurrentTouch.bPacketCounter = static_cast<uint8_t>(i);
+    r.sCurrentTouch.bIsUpTrackingNum1 = 0x05;
+    r.sCurrentTouch.bTouchData1[0] = 0x12;
+    r.sCurrentTouch.bTouchData1[1] = 0x34;
+    r.sCurrentTouch.bTouchData1[2] = static_cast<uint8_t>(0x56 + i);
+    r.sCurrentTouch.bIsUpTrackingNum2 = 0x80;
+    r.sCurrentTouch.bTouchData2[0] = 0xFF;
+    r.sCurrentTouch.bTouchData2[1] = 0xFF;
+    r.sCurrentTouch.bTouchData2[2] = 0xFF;
+    return report;
+}
+
+static bool same_report(const DS4_REPORT_EX& a, const DS4_REPORT_EX& b)
+{
+    return std::memcmp(a.ReportBuffer, b.ReportBuffer, sizeof(a.ReportBuffer)) == 0;
+}
+
+static void check_encode_bytes()
+{
+    // キーフレーム: 先頭（版1、キーフレーム）、プレイヤー、連番、時刻、ビットマスク、差（128のジグザグ）
+    NetFrameEncoder encoder(2);
+    DS4_REPORT_EX report{};
+    report.Report.bThumbLX = 0x80;
+    CHECK(encode(encoder, report, 1000) == (Frame{ 0x03, 0x02, 0x00, 0xE8, 0x07, 0x01, 0x80, 0x02 }));
+
+    // 差分: キーフレームからの連番と時刻の差を付け、キーフレームとの差だけを送る
+    report.Report.bThumbLX = 0x7F;
+    CHECK(encode(encoder, report, 2000) == (Frame{ 0x02, 0x02, 0x01, 0x01, 0xE8, 0x07, 0x01, 0x01 }));
+
+    // キーフレームと同じ状態ならビットマスクは0
+    report.Report.bThumbLX = 0x80;
+    CHECK(encode(encoder, report, 3000) == (Frame{ 0x02, 0x02, 0x02, 0x02, 0xD0, 0x0F, 0x00 }));
+
+    // 組み立てたフレームと同じ形式になる
+    CHECK(make_frame(true, 0, 0, 1000, 0x80) == (Frame{ 0x03, 0x00, 0x00, 0xE8, 0x07, 0x01, 0x80, 0x02 }));
+}
+
+static void check_round_trip()
+{
+    // 全てのフィールドが変わるキーフレームと差分を、送ったレポートとバイト単位で同じに戻す
+    NetFrameEncoder encoder(0);
+    NetFrameDecoder decoder;
+    for (int i = 0; i < 8; ++i) {
+        DS4_REPORT_EX sent = sample_report(i);
+        Frame frame = encode(encoder, sent, 5000 + i * 4000);
+        CHECK(frame.size() <= NET_MAX_FRAME_SIZE);
+
+        DS4_REPORT_EX received;
+        NetFrameInfo info;
+        CHECK(decode(decoder, frame, received, info) == Result::Ok);
+        CHECK(same_report(received, sent));
+        CHECK_EQ(info.sequence, static_cast<uint32_t>(i));
+        CHECK_EQ(info.sendTimeUs, 5000u + i * 4000u);
+        CHECK_EQ(info.keyframe, i == 0);
+        CHECK_EQ(info.lost, 0u);
+    }
+
+    // 壊れたフレームや別の版のフレームは復元しない
+    DS4_REPORT_EX received;
+    NetFrameInfo info;
+    NetFrameEncoder other(0);
+    Frame frame = encode(other, sample_report(1), 40000);
+    NetFrameDecoder fresh;
+    CHECK(decode(fresh, Frame(frame.begin(), frame.end() - 1), received, info) == Result::Invalid);
+    frame[0] = static_cast<uint8_t>((frame[0] & 0x01) | 0x04);
+    CHECK(decode(fresh, frame, received, info) == Result::Invalid);
+    CHECK(decode(fresh, Frame{ 0x03, 0x00 }, received, info) == Result::Invalid);
+}
+
+static void check_keyframe_interval()
+{
+    // 間隔が経つまでは差分、ちょうど経ったらキーフレーム（間隔はキーフレームの時刻から数える）
+    NetFrameEncoder encoder(0, std::chrono::milliseconds(100));
+    DS4_REPORT_EX report = sample_report(0);
+    const uint64_t times[] = { 0, 50 * MS, 100 * MS - 1, 100 * MS, 150 * MS, 199 * MS, 230 * MS, 240 * MS };
+    const bool keyframes[] = { true, false, false, true, false, false, true, false };
+    for (size_t i = 0; i < std::size(times); ++i)
+        CHECK_EQ(encode(encoder, report, times[i])[0] & 0x01, keyframes[i] ? 1 : 0);
+}
+
+static void check_stale()
+{
+    NetFrameEncoder encoder(0);
+    std::vector<Frame> frames;
+    for (int i = 0; i < 4; ++i)
+        frames.push_back(encode(encoder, sample_report(i), i * MS));
+
+    NetFrameDecoder decoder;
+    DS4_REPORT_EX received;
+    NetFrameInfo info;
+    CHECK(decode(decoder, frames[0], received, info) == Result::Ok);
+    CHECK(decode(decoder, frames[2], received, info) == Result::Ok);
+    CHECK_EQ(info.lost, 1u);
+
+    // 遅れて届いたフレームと、同じフレームの重複は捨てる
+    CHECK(decode(decoder, frames[1], received, info) == Result::Stale);
+    CHECK(decode(decoder, frames[2], received, info) == Result::Stale);
+    CHECK(decode(decoder, frames[0], received, info) == Result::Stale);
+
+    // 捨てたフレームは次のフレームに影響しない
+    CHECK(decode(decoder, frames[3], received, info) == Result::Ok);
+    CHECK_EQ(info.lost, 0u);
+    CHECK(same_report(received, sample_report(3)));
+}
+
+static void check_lost_delta()
+{
+    // 差分はキーフレームだけに依存するので、間の差分が失われても次の差分を復元できる
+    NetFrameEncoder encoder(0);
+    std::vector<Frame> frames;
+    for (int i = 0; i < 5; ++i)
+        frames.push_back(encode(encoder, sample_report(i), i * 10 * MS));
+
+    NetFrameDecoder decoder;
+    DS4_REPORT_EX received;
+    NetFrameInfo info;
+    CHECK(decode(decoder, frames[0], received, info) == Result::Ok);
+    CHECK(decode(decoder, frames[3], received, info) == Result::Ok);
+    CHECK_EQ(info.lost, 2u);
+    CHECK(same_report(received, sample_report(3)));
+    CHECK(decode(decoder, frames[4], received, info) == Result::Ok);
+    CHECK(same_report(received, sample_report(4)));
+}
+
+static void check_lost_keyframe()
+{
+    // 0 K, 1 D, 2 K（失われる）, 3 D, 4 D, 5 K, 6 D
+    NetFrameEncoder encoder(0, std::chrono::milliseconds(100));
+    const uint64_t times[] = { 0, 50 * MS, 100 * MS, 150 * MS, 160 * MS, 200 * MS, 210 * MS };
+    std::vector<Frame> frames;
+    for (size_t i = 0; i < std::size(times); ++i)
+        frames.push_back(encode(encoder, sample_report(static_cast<int>(i)), times[i]));
+    CHECK_EQ(frames[2][0] & 0x01, 1);
+    CHECK_EQ(frames[5][0] & 0x01, 1);
+
+    NetFrameDecoder decoder;
+    DS4_REPORT_EX received;
+    NetFrameInfo info;
+    uint32_t lost = 0;
+    CHECK(decode(decoder, frames[0], received, info) == Result::Ok);
+    CHECK(decode(decoder, frames[1], received, info) == Result::Ok);
+
+    // 失われたキーフレームに依存する差分は復元しない（欠落はここで1回だけ数える）
+    CHECK(decode(decoder, frames[3], received, info) == Result::MissingKeyframe);
+    CHECK_EQ(info.lost, 1u);
+    lost += info.lost;
+    CHECK(decode(decoder, frames[4], received, info) == Result::MissingKeyframe);
+    CHECK_EQ(info.lost, 0u);
+    lost += info.lost;
+
+    // 次のキーフレームで回復し、復元できなかったフレームを欠落として数え直さない
+    CHECK(decode(decoder, frames[5], received, info) == Result::Ok);
+    CHECK_EQ(info.lost, 0u);
+    lost += info.lost;
+    CHECK(same_report(received, sample_report(5)));
+    CHECK(decode(decoder, frames[6], received, info) == Result::Ok);
+    CHECK(same_report(received, sample_report(6)));
+    CHECK_EQ(lost, 1u);
+
+    // 復元できなかったフレームより古いフレームは、最後に復元したフレームより新しければまだ復元できる
+    NetFrameDecoder late;
+    CHECK(decode(late, frames[0], received, info) == Result::Ok);
+    CHECK(decode(late, frames[3], received, info) == Result::MissingKeyframe);
+    CHECK_EQ(info.lost, 2u);
+    CHECK(decode(late, frames[1], received, info) == Result::Ok);
+    CHECK_EQ(info.lost, 0u);
+    CHECK(same_report(received, sample_report(1)));
+}
+
+static void check_wraparound()
+{
+    // 連番が一周しても、差で新旧と欠落を判断する
+    NetFrameDecoder decoder;
+    DS4_REPORT_EX received;
+    NetFrameInfo info;
+    CHECK(decode(decoder, make_frame(true, 0xFFFFFFFEu, 0, 1000, 100), received, info) == Result::Ok);
+    CHECK(decode(decoder, make_frame(false, 0xFFFFFFFFu, 1, 1000, 5), received, info) == Result::Ok);
+    CHECK_EQ(received.Report.bThumbLX, 105);
+
+    // 一周した差分はキーフレームからの連番の差で依存先を判断する
+    CHECK(decode(decoder, make_frame(false, 1, 3, 3000, -10), received, info) == Result::Ok);
+    CHECK_EQ(info.sequence, 1u);
+    CHECK_EQ(info.lost, 1u);
+    CHECK_EQ(received.Report.bThumbLX, 90);
+    CHECK(decode(decoder, make_frame(false, 0, 2, 2000, 0), received, info) == Result::Stale);
+    CHECK(decode(decoder, make_frame(false, 0xFFFFFFFFu, 1, 1000, 5), received, info) == Result::Stale);
+
+    // 一周の後のキーフレーム
+    CHECK(decode(decoder, make_frame(true, 2, 0, 4000, 7), received, info) == Result::Ok);
+    CHECK_EQ(received.Report.bThumbLX, 7);
+    CHECK_EQ(info.lost, 0u);
+}
+
+/**
+ * @brief 受信側は復元できたフレームで初めて出力先を作り、関係の無いパケットでパッドを作らない
+ */
+static void check_source()
+{
+    RecordingSink recording;
+    std::atomic<int> created{ 0 };
+    NetworkSourceConfig config;
+    config.port = 0;
+    auto source = NetworkSource::Create(config, [&](uint8_t player) -> OutputSink* {
+        CHECK_EQ(player, 0);
+        created++;
+        return &recording;
+    });
+    CHECK(source != nullptr);
+    if (!source) return;
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(source->Port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto send = [&](const Frame& frame) {
+        CHECK_EQ(sendto(fd, frame.data(), frame.size(), 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address)),
+            static_cast<ssize_t>(frame.size()));
+    };
+
+    // 別の版、途中で終わるフレーム、キーフレームの無い差分
+    send(Frame{ 0x7E, 0x00, 0x00, 0x00 });
+    send(Frame{ 0x02, 0x00, 0x00 });
+    Frame orphan = make_frame(false, 5, 1, 1000, 1);
+    send(orphan);
+    CHECK(WaitUntil([&] { return source->Stats(0).skipped == 1; }));
+    CHECK_EQ(created.load(), 0);
+
+    Frame keyframe = make_frame(true, 6, 0, 2000, 0x40);
+    send(keyframe);
+
+    CHECK(WaitUntil([&] { return !recording.Reports().empty(); }));
+    CHECK_EQ(created.load(), 1);
+    std::vector<RecordedReport> reports = recording.Reports();
+    CHECK_EQ(reports.size(), 1u);
+    if (!reports.empty()) CHECK_EQ(reports[0].report.Report.bThumbLX, 0x40);
+
+    // 形式の正しくないパケットは統計にも数えない
+    NetworkStreamStats stats = source->Stats(0);
+    CHECK_EQ(stats.frames, 1u);
+    CHECK_EQ(stats.keyframes, 1u);
+    CHECK_EQ(stats.skipped, 1u);
+    CHECK_EQ(stats.lost, 0u);
+    CHECK_EQ(stats.bytes, orphan.size() + keyframe.size());
+
+    close(fd);
+    source.reset();
+}
+
+int main()
+{
+    check_encode_bytes();
+    check_round_trip();
+    check_keyframe_interval();
+    check_stale();
+    check_lost_delta();
+    check_lost_keyframe();
+    check_wraparound();
+    check_source();
+    return TestResult(L"NetworkStreamTest");
+}
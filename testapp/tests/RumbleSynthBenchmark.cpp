@@ -0,0 +1,42 @@
+﻿// 振動の合成とパケット化の1フレームあたりの時間を計測する
+// ゲームの振動を毎フレーム変えながら、クリックを一定の間隔で重ねる（出力クロックの1ティック分の処理）
+// 数値は最適化したビルド（-DCMAKE_BUILD_TYPE=Release）で比べる
+#include "RumbleSynth.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+constexpr int WARMUP_FRAMES = 100000;
+constexpr int FRAMES = 5000000;
+
+/**
+ * @brief 指定したフレーム数だけ合成し、パケットのバイトを足した値を返す（最適化で消されないように）
+ */
+static uint32_t render_frames(RumbleMixer& mixer, int frames)
+{
+    uint32_t checksum = 0;
+    for (int i = 0; i < frames; ++i) {
+        uint8_t amplitude = static_cast<uint8_t>(i * 37);
+        mixer.SetContinuous({ { static_cast<uint16_t>(RUMBLE_LOW_FREQUENCY + (i & 63)), amplitude },
+            { RUMBLE_HIGH_FREQUENCY, static_cast<uint8_t>(255 - amplitude) } });
+        if (i % 8 == 0) mixer.Play(HAPTIC_CLICK);
+        RumblePacket packet = mixer.Render();
+        for (uint8_t byte : packet) checksum += byte;
+    }
+    return checksum;
+}
+
+int main()
+{
+    RumbleMixer mixer;
+    uint32_t checksum = render_frames(mixer, WARMUP_FRAMES);
+
+    auto start = std::chrono::steady_clock::now();
+    checksum += render_frames(mixer, FRAMES);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::wcout << L"RumbleSynthBenchmark: " << FRAMES << L" frames, " << elapsed.count() / FRAMES << L" ns/frame (checksum "
+        << checksum << L")\n";
+    return 0;
+}
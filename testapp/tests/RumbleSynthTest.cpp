@@ -0,0 +1,123 @@
+﻿// HD振動のパケットをバイト単位で確認するテスト（期待値は表の式から別に計算した値）
+#include "RumbleSynth.h"
+
+#include <cstdio>
+
+#include "TestCheck.h"
+
+/**
+ * @brief パケットが期待したバイト列と一致することを確認する（違えば両方を表示する）
+ */
+#define CHECK_PACKET(actual, ...) check_packet(__LINE__, actual, RumblePacket{ __VA_ARGS__ })
+
+static void check_packet(int line, const RumblePacket& actual, const RumblePacket& expected)
+{
+    if (actual == expected) return;
+    char text[64];
+    std::snprintf(text, sizeof(text), "%02x %02x %02x %02x %02x vs %02x %02x %02x %02x %02x",
+        actual[0], actual[1], actual[2], actual[3], actual[4], expected[0], expected[1], expected[2], expected[3], expected[4]);
+    std::wcerr << __FILE__ << L":" << line << L": packet mismatch (" << text << L")\n";
+    ++g_testFailures;
+}
+
+static void check_tables()
+{
+    // 振幅: 0は0、最大は100（対数の表なので中間は大きめになる）
+    CHECK_EQ(EncodeRumbleAmplitude(0), 0);
+    CHECK_EQ(EncodeRumbleAmplitude(60), 33);
+    CHECK_EQ(EncodeRumbleAmplitude(128), 68);
+    CHECK_EQ(EncodeRumbleAmplitude(200), 89);
+    CHECK_EQ(EncodeRumbleAmplitude(255), 100);
+    for (int i = 1; i < 256; ++i)
+        CHECK(EncodeRumbleAmplitude(static_cast<uint8_t>(i)) >= EncodeRumbleAmplitude(static_cast<uint8_t>(i - 1)));
+
+    // 周波数: log2(f / 10) * 32。オクターブごとに0x20増える
+    CHECK_EQ(EncodeRumbleFrequency(40), 0x40);
+    CHECK_EQ(EncodeRumbleFrequency(80), 0x60);
+    CHECK_EQ(EncodeRumbleFrequency(160), 0x80);
+    CHECK_EQ(EncodeRumbleFrequency(320), 0xA0);
+    CHECK_EQ(EncodeRumbleFrequency(626), 0xBF);
+    CHECK_EQ(EncodeRumbleFrequency(640), 0xC0);
+    CHECK_EQ(EncodeRumbleFrequency(1252), 0xDF);
+    CHECK_EQ(EncodeRumbleFrequency(5000), 0xDF); // 表より上は端の値
+}
+
+static void check_encode()
+{
+    // 無音（既定の周波数、振幅0）
+    CHECK_PACKET(EncodeRumbleFrame(0, RumbleFrame()), 0x50, 0x00, 0x01, 0x40, 0x40);
+
+    // 低い帯域を最大、高い帯域を半分（高い周波数の9ビット目は3バイト目に入る）
+    CHECK_PACKET(EncodeRumbleFrame(1, { { 160, 255 }, { 320, 128 } }), 0x51, 0x00, 0x89, 0x40, 0x72);
+    CHECK_PACKET(EncodeRumbleFrame(0, { { 160, 0 }, { 320, 255 } }), 0x50, 0x00, 0xC9, 0x40, 0x40);
+    CHECK_PACKET(EncodeRumbleFrame(0, { { 100, 128 }, { 900, 64 } }), 0x50, 0xC0, 0x49, 0x2A, 0x62);
+
+    // 周波数は帯域の範囲に収める（低い帯域は40Hz、高い帯域は1252Hzで止まる）
+    CHECK_PACKET(EncodeRumbleFrame(2, { { 40, 255 }, { 1252, 255 } }), 0x52, 0xFC, 0xC9, 0x00, 0x72);
+    CHECK(EncodeRumbleFrame(2, { { 10, 255 }, { 2000, 255 } }) == EncodeRumbleFrame(2, { { 40, 255 }, { 1252, 255 } }));
+    CHECK_PACKET(EncodeRumbleFrame(3, { { 626, 255 }, { 80, 200 } }), 0x53, 0x00, 0xB2, 0x7F, 0x72);
+
+    // 連番は下位4ビットだけ使う
+    CHECK_PACKET(EncodeRumbleFrame(0x13, RumbleFrame()), 0x53, 0x00, 0x01, 0x40, 0x40);
+}
+
+static void check_mixer()
+{
+    // 何も鳴らしていなければ無音で、連番は16で一周する
+    RumbleMixer mixer;
+    for (int i = 0; i < 17; ++i) {
+        RumblePacket packet = mixer.Render();
+        CHECK_EQ(packet[0], RUMBLE_HEADER | (i & 0x0F));
+    }
+    CHECK(!mixer.Active());
+
+    // ゲームの振動にクリックを重ねる: クリックの帯域だけが2フレームでフェードし、その後はゲームの振動に戻る
+    RumbleMixer click;
+    click.SetContinuous({ { 160, 255 }, { 320, 0 } });
+    click.Play(HAPTIC_CLICK);
+    CHECK(click.Active());
+    CHECK_PACKET(click.Render(), 0x50, 0x80, 0xB3, 0x40, 0x72); // 640Hz 振幅200
+    CHECK_PACKET(click.Render(), 0x51, 0x80, 0x73, 0x40, 0x72); // 640Hz 振幅100
+    CHECK(!click.Active());
+    CHECK_PACKET(click.Render(), 0x52, 0x00, 0x01, 0x40, 0x72); // 高い帯域は無音で既定の周波数
+
+    // 振幅は足して255で切り、周波数は最も大きく鳴らしているものを使う
+    RumbleMixer saturate;
+    saturate.SetContinuous({ { 160, 0 }, { 320, 200 } });
+    saturate.Play({ { { 160, 0 }, { 640, 100 } }, 1, false });
+    RumbleFrame mixed = saturate.Mix();
+    CHECK_EQ(mixed.high.amplitude, 255);
+    CHECK_EQ(mixed.high.frequency, 320);
+    CHECK(mixed.low.amplitude == 0);
+
+    // いっぱいのときは残りが最も短い効果を置き換える
+    RumbleMixer full;
+    const uint16_t frames[] = { 3, 1, 4, 2 };
+    const uint8_t amplitudes[] = { 1, 2, 4, 8 };
+    for (size_t i = 0; i < RumbleMixer::MAX_EFFECTS; ++i)
+        full.Play({ { { 160, 0 }, { 320, amplitudes[i] } }, frames[i], false });
+    CHECK_EQ(full.Mix().high.amplitude, 15);
+    full.Play({ { { 160, 0 }, { 320, 16 } }, 6, false });
+    CHECK_EQ(full.Mix().high.amplitude, 1 + 4 + 8 + 16);
+    full.Advance();
+    full.Advance();
+    CHECK_EQ(full.Mix().high.amplitude, 1 + 4 + 16); // 2フレームの効果が終わった
+    full.Advance();
+    CHECK_EQ(full.Mix().high.amplitude, 4 + 16);
+
+    // 0フレームの効果は鳴らさず、Clearはゲームの振動も止める
+    full.Play({ { { 160, 255 }, { 320, 255 } }, 0, false });
+    CHECK_EQ(full.Mix().high.amplitude, 20);
+    full.SetContinuous({ { 160, 50 }, { 320, 50 } });
+    full.Clear();
+    CHECK(full.Mix().Silent());
+    CHECK(!full.Active());
+}
+
+int main()
+{
+    check_tables();
+    check_encode();
+    check_mixer();
+    return TestResult(L"RumbleSynthTest");
+}
@@ -0,0 +1,191 @@
+﻿// 共有メモリへの公開を、読み取り側と書き込み側を並行に動かして確認するテスト（壊れた状態や戻った状態を読まない）
+#include "SharedStatePublisher.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestCheck.h"
+
+constexpr uint64_t ADDRESS = 0x98B6E9000001;
+constexpr uint64_t SWAPPED_ADDRESS = 0x98B6E9000002;
+constexpr uint64_t FRAMES = 200000;
+constexpr int READERS = 3;
+
+/**
+ * @brief 公開した全てのフィールドに世代番号が入るレポート
+ */
+static DS4_REPORT_EX generation_report(uint64_t generation)
+{
+    DS4_REPORT_EX report{};
+    auto& r = report.Report;
+    auto byte = static_cast<uint8_t>(generation);
+    auto word = static_cast<uint16_t>(generation);
+    r.bThumbLX = r.bThumbLY = r.bThumbRX = r.bThumbRY = byte;
+    r.bTriggerL = r.bTriggerR = byte;
+    r.bBatteryLvl = byte;
+    r.wButtons = word;
+    r.bSpecial = static_cast<uint8_t>(generation >> 16);
+    r.wTimestamp = word;
+    r.wGyroX = r.wGyroY = r.wGyroZ = static_cast<int16_t>(word);
+    r.wAccelX = r.wAccelY = r.wAccelZ = static_cast<int16_t>(word);
+    return report;
+}
+
+/**
+ * @brief 読み取った状態の全てのフィールドが同じ世代のものか（1つでも違えば書き込みの途中を読んでいる）
+ */
+static bool consistent(const SharedPlayerState& state)
+{
+    uint64_t generation = state.sampleTimeUs;
+    auto byte = static_cast<uint8_t>(generation);
+    auto word = static_cast<int16_t>(static_cast<uint16_t>(generation));
+    if (state.address != ADDRESS || !state.connected || state.samples != generation) return false;
+    if (state.buttons != (static_cast<uint32_t>(generation) & 0xFFFFFF) || state.reportTimestamp != static_cast<uint16_t>(generation))
+        return false;
+    if (state.battery != byte || state.triggers[0] != byte || state.triggers[1] != byte) return false;
+    for (uint8_t stick : state.sticks)
+        if (stick != byte) return false;
+    for (int i = 0; i < 3; ++i)
+        if (state.gyro[i] != word || state.accel[i] != word) return false;
+    return true;
+}
+
+static void check_concurrent(SharedStatePublisher& publisher, const std::string& name)
+{
+    publisher.Connect(0, ADDRESS);
+
+    std::atomic<bool> done{ false };
+    std::atomic<int> torn{ 0 };
+    std::atomic<int> backwards{ 0 };
+    std::atomic<uint64_t> reads{ 0 };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < READERS; ++i) {
+        readers.emplace_back([&]()
+            {
+                auto reader = SharedStateReader::Open(name);
+                if (!reader) {
+                    torn++;
+                    return;
+                }
+                uint64_t last = 0;
+                uint64_t lastPublish = 0;
+                SharedPlayerState state;
+                while (!done.load(std::memory_order_relaxed)) {
+                    if (!reader->Read(0, state) || state.samples == 0) continue;
+                    reads.fetch_add(1, std::memory_order_relaxed);
+                    if (!consistent(state)) torn++;
+                    if (state.samples < last || state.publishTimeUs < lastPublish) backwards++;
+                    last = state.samples;
+                    lastPublish = state.publishTimeUs;
+                }
+            });
+    }
+
+    // 世代番号をサンプル時刻と全てのフィールドに入れて公開する（公開した数も世代番号と一致する）
+    for (uint64_t generation = 1; generation <= FRAMES; ++generation) {
+        publisher.Publish(0, ADDRESS, generation_report(generation), generation);
+        if (generation % 1024 == 0) std::this_thread::yield();
+    }
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    CHECK_EQ(torn.load(), 0);
+    CHECK_EQ(backwards.load(), 0);
+    CHECK(reads.load() > 0);
+    CHECK_EQ(publisher.Published(), FRAMES);
+
+    // 書き終えた後は最後の世代を読む
+    auto reader = SharedStateReader::Open(name);
+    SharedPlayerState state;
+    CHECK(reader && reader->Read(0, state));
+    CHECK_EQ(state.samples, FRAMES);
+    CHECK(consistent(state));
+}
+
+static void check_disconnect(SharedStatePublisher& publisher, const std::string& name)
+{
+    auto reader = SharedStateReader::Open(name);
+    CHECK(reader != nullptr);
+    if (!reader) return;
+    SharedPlayerState state;
+
+    publisher.Connect(1, ADDRESS);
+    publisher.Publish(1, ADDRESS, generation_report(7), 7);
+    CHECK(reader->Read(1, state));
+    CHECK_EQ(state.address, ADDRESS);
+    CHECK_EQ(state.samples, 1u);
+
+    // 入れ替えで別のコントローラーが接続した後は、古いコントローラーの切断と入力を無視する
+    publisher.Connect(1, SWAPPED_ADDRESS);
+    publisher.Disconnect(1, ADDRESS);
+    publisher.Publish(1, ADDRESS, generation_report(8), 8);
+    CHECK(reader->Read(1, state));
+    CHECK_EQ(state.address, SWAPPED_ADDRESS);
+    CHECK_EQ(state.connected, 1);
+    CHECK_EQ(state.samples, 0u);
+
+    publisher.Publish(1, SWAPPED_ADDRESS, generation_report(9), 9);
+    CHECK(reader->Read(1, state));
+    CHECK_EQ(state.samples, 1u);
+    CHECK_EQ(state.sampleTimeUs, 9u);
+
+    // 接続しているコントローラーの切断は反映し、その後の入力は公開しない
+    publisher.Disconnect(1, SWAPPED_ADDRESS);
+    publisher.Publish(1, SWAPPED_ADDRESS, generation_report(10), 10);
+    CHECK(reader->Read(1, state));
+    CHECK_EQ(state.connected, 0);
+    CHECK_EQ(state.address, SWAPPED_ADDRESS);
+    CHECK_EQ(state.samples, 1u);
+
+    // 範囲外のスロットは読めず、書き込みも無視する
+    publisher.Connect(SHARED_STATE_MAX_SLOTS, ADDRESS);
+    CHECK(!reader->Read(SHARED_STATE_MAX_SLOTS, state));
+    CHECK(reader->Read(2, state));
+    CHECK_EQ(state.connected, 0);
+}
+
+int main()
+{
+    // 同時に動く他のテストや実行中のアプリと重ならない名前
+    std::string name = "joycon2-state-test-" + std::to_string(SharedStateNowUs());
+    CHECK(SharedStateReader::Open(name) == nullptr);
+
+    // 書き込み側が初期化を終えるまで（magicが無い、または版が違う）は開かない
+    auto raw = SharedStateRegion::Create(name);
+    CHECK(raw != nullptr);
+    if (!raw) return TestResult(L"SharedStateTest");
+    CHECK(SharedStateReader::Open(name) == nullptr);
+    raw->Layout().header.version = SHARED_STATE_VERSION + 1;
+    raw->Layout().header.slotSize = sizeof(SharedStateSlot);
+    raw->Layout().header.magic.store(SHARED_STATE_MAGIC);
+    CHECK(SharedStateReader::Open(name) == nullptr);
+
+    // 残っていた領域を初期化し直して公開する
+    SharedStateConfig config;
+    config.name = name;
+    auto publisher = SharedStatePublisher::Create(config);
+    CHECK(publisher != nullptr);
+    if (!publisher) return TestResult(L"SharedStateTest");
+    auto reader = SharedStateReader::Open(name);
+    CHECK(reader != nullptr);
+    if (reader) {
+        CHECK(reader->Active());
+        CHECK_EQ(reader->SlotCount(), SHARED_STATE_MAX_SLOTS);
+        SharedPlayerState state;
+        CHECK(reader->Read(0, state));
+        CHECK_EQ(state.connected, 0);
+    }
+
+    check_concurrent(*publisher, name);
+    check_disconnect(*publisher, name);
+
+    // 書き込み側が終了すると、開いたままの読み取り側はactiveが0になったことで気付く
+    publisher.reset();
+    if (reader) CHECK(!reader->Active());
+    raw.reset();
+    CHECK(SharedStateReader::Open(name) == nullptr);
+    return TestResult(L"SharedStateTest");
+}
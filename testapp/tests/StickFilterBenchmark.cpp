@@ -0,0 +1,88 @@
+﻿// スティックフィルターの設定を変えながら、出力クロックのレートでの遅れ、残る揺れ、1フレームあたりの時間を計測する
+// 遅れは一定速度の入力、揺れは静止した入力に一様ノイズを加えて測る（MeasureStickFilterDelay/Jitter）
+// 数値は最適化したビルド（-DCMAKE_BUILD_TYPE=Release）で比べる
+#include "StickFilter.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "OutputClock.h"
+
+constexpr int FRAMES = 1000000;
+constexpr size_t INPUT_FRAMES = 4096; // 繰り返して使う入力（計測に入力の生成を含めない）
+
+/**
+ * @brief 動かし続けるスティックの入力（左右の軸で違う速さの正弦波と、小さな段差）
+ */
+static std::vector<StickFilter::Axes> make_inputs(float dt)
+{
+    std::vector<StickFilter::Axes> inputs(INPUT_FRAMES);
+    for (size_t i = 0; i < INPUT_FRAMES; ++i) {
+        float t = i * dt;
+        inputs[i] = { std::sin(t * 3.0f), std::cos(t * 2.0f), 0.5f * std::sin(t * 7.0f), 0.1f * (static_cast<int>(i & 7) - 4) };
+    }
+    return inputs;
+}
+
+/**
+ * @brief 指定したフレーム数だけ4軸を処理し、出力を足した値を返す（最適化で消されないように）
+ */
+static float process_frames(StickFilter& filter, const std::vector<StickFilter::Axes>& inputs, float dt, int frames)
+{
+    float checksum = 0.0f;
+    for (int i = 0; i < frames; ++i) {
+        StickFilter::Axes axes = inputs[static_cast<size_t>(i) % INPUT_FRAMES];
+        filter.Process(axes, dt);
+        checksum += axes[0] + axes[3];
+    }
+    return checksum;
+}
+
+static void measure(const StickFilterConfig& config, float rate)
+{
+    float dt = 1.0f / rate;
+    std::vector<StickFilter::Axes> inputs = make_inputs(dt);
+    StickFilter filter(config);
+    float checksum = process_frames(filter, inputs, dt, FRAMES / 20);
+
+    auto start = std::chrono::steady_clock::now();
+    checksum += process_frames(filter, inputs, dt, FRAMES);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::wcout << L"  " << StickFilterName(config.type);
+    if (config.type == StickFilterType::OneEuro)
+        std::wcout << L" min_cutoff=" << config.minCutoff << L" beta=" << config.beta;
+    else
+        std::wcout << L" process_noise=" << config.processNoise << L" measurement_noise=" << config.measurementNoise;
+    std::wcout << L": delay " << MeasureStickFilterDelay(config, rate) * 1000.0f << L" ms, jitter "
+        << MeasureStickFilterJitter(config, rate) * 100.0f << L"%, " << elapsed.count() / FRAMES << L" ns/frame (checksum "
+        << checksum << L")\n";
+}
+
+int main()
+{
+    float rate = 1e6f / OutputClock::DEFAULT_PERIOD.count();
+    std::wcout << L"StickFilterBenchmark: " << rate << L" Hz, " << FRAMES << L" frames per setting\n";
+
+    for (float minCutoff : { 1.0f, 2.0f, 4.0f }) {
+        for (float beta : { 0.1f, 0.5f, 2.0f }) {
+            StickFilterConfig config;
+            config.type = StickFilterType::OneEuro;
+            config.minCutoff = minCutoff;
+            config.beta = beta;
+            measure(config, rate);
+        }
+    }
+    for (float processNoise : { 100.0f, 1000.0f, 10000.0f }) {
+        for (float measurementNoise : { 0.00001f, 0.0001f, 0.001f }) {
+            StickFilterConfig config;
+            config.type = StickFilterType::Kalman;
+            config.processNoise = processNoise;
+            config.measurementNoise = measurementNoise;
+            measure(config, rate);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+﻿// スティックフィルターの遅れと残る揺れが有限で、設定に対して期待した順に並ぶことを確認するテスト
+#include "StickFilter.h"
+
+#include <cmath>
+
+#include "TestCheck.h"
+
+constexpr float RATE = 250.0f; // 出力クロックのレート（4ms）
+
+static StickFilterConfig one_euro(float minCutoff, float beta)
+{
+    StickFilterConfig config;
+    config.type = StickFilterType::OneEuro;
+    config.minCutoff = minCutoff;
+    config.beta = beta;
+    return config;
+}
+
+static StickFilterConfig kalman(float processNoise, float measurementNoise)
+{
+    StickFilterConfig config;
+    config.type = StickFilterType::Kalman;
+    config.processNoise = processNoise;
+    config.measurementNoise = measurementNoise;
+    return config;
+}
+
+static bool finite_delay(float delay)
+{
+    return std::isfinite(delay) && delay >= 0.0f && delay < 1.0f;
+}
+
+static void check_delay()
+{
+    // フィルターなしは遅れも揺れの除去もない
+    CHECK(MeasureStickFilterDelay(StickFilterConfig(), RATE) == 0.0f);
+    CHECK(MeasureStickFilterJitter(StickFilterConfig(), RATE) == 1.0f);
+
+    // One Euro: betaが大きいほど動いているときの遅れが小さい
+    float previous = MeasureStickFilterDelay(one_euro(2.0f, 0.0f), RATE);
+    CHECK(finite_delay(previous) && previous > 0.0f);
+    for (float beta : { 0.1f, 0.5f, 2.0f, 10.0f }) {
+        float delay = MeasureStickFilterDelay(one_euro(2.0f, beta), RATE);
+        CHECK(finite_delay(delay));
+        CHECK(delay < previous);
+        previous = delay;
+    }
+
+    // 静止時のカットオフが高いほど遅れは小さく、揺れは多く残る
+    CHECK(MeasureStickFilterDelay(one_euro(4.0f, 0.1f), RATE) < MeasureStickFilterDelay(one_euro(1.0f, 0.1f), RATE));
+    CHECK(MeasureStickFilterJitter(one_euro(4.0f, 0.1f), RATE) > MeasureStickFilterJitter(one_euro(1.0f, 0.1f), RATE));
+
+    // カルマン: 等速度のモデルなので一定速度の入力には遅れず、追従を速くするほど揺れが残る
+    CHECK(finite_delay(MeasureStickFilterDelay(kalman(1000.0f, 0.0001f), RATE)));
+    CHECK(MeasureStickFilterDelay(kalman(1000.0f, 0.0001f), RATE) < 0.001f);
+    float low = MeasureStickFilterJitter(kalman(100.0f, 0.0001f), RATE);
+    float high = MeasureStickFilterJitter(kalman(10000.0f, 0.0001f), RATE);
+    CHECK(low < high);
+    CHECK(high < 1.0f);
+}
+
+static void check_jitter()
+{
+    // どのフィルターも揺れを減らし、結果は有限
+    for (const StickFilterConfig& config : { one_euro(2.0f, 0.5f), one_euro(1.0f, 10.0f), kalman(1000.0f, 0.0001f) }) {
+        float jitter = MeasureStickFilterJitter(config, RATE);
+        CHECK(std::isfinite(jitter));
+        CHECK(jitter > 0.0f && jitter < 1.0f);
+    }
+}
+
+int main()
+{
+    check_delay();
+    check_jitter();
+    return TestResult(L"StickFilterTest");
+}
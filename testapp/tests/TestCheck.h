@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+// テストで失敗した確認の数（mainの戻り値に使う）
+inline int g_testFailures = 0;
+
+/**
+ * @brief 条件を確認し、満たさなければ場所と式を表示して失敗を数える（テストは続ける）
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::wcerr << __FILE__ << L":" << __LINE__ << L": CHECK failed: " << #condition << L"\n"; \
+            ++g_testFailures; \
+        } \
+    } while (0)
+
+/**
+ * @brief 2つの値が等しいことを確認する（違えば両方の値を表示する）
+ */
+#define CHECK_EQ(actual, expected) \
+    do { \
+        auto checkActual = (actual); \
+        auto checkExpected = (expected); \
+        if (!(checkActual == checkExpected)) { \
+            std::wcerr << __FILE__ << L":" << __LINE__ << L": CHECK_EQ failed: " << #actual << L" == " << #expected \
+                << L" (" << +checkActual << L" vs " << +checkExpected << L")\n"; \
+            ++g_testFailures; \
+        } \
+    } while (0)
+
+/**
+ * @brief 条件が満たされるまで待つ（別スレッドからの通知やパケットの到着を待つため）
+ * @return タイムアウトまでに満たされたらtrue
+ */
+inline bool WaitUntil(const std::function<bool()>& condition, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/**
+ * @brief テストの結果を表示して終了コードを返す
+ */
+inline int TestResult(const wchar_t* name)
+{
+    if (g_testFailures == 0) std::wcout << name << L": passed\n";
+    else std::wcerr << name << L": " << g_testFailures << L" check(s) failed\n";
+    return g_testFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+﻿// UHidSinkをカーネルの代わりのハーネスに接続し、UHIDのイベントのやり取りを確認するテスト
+// ハーネスはソケットペアの片側で、/dev/uhid と同じく1回のread/writeで1つのuhid_eventを扱う
+#include "UHidSink.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestCheck.h"
+
+/**
+ * @class UHidHarness
+ * @brief /dev/uhid の向こう側（カーネル）の代わりにイベントを読み書きする
+ */
+class UHidHarness {
+public:
+    ~UHidHarness() { if (fd >= 0) close(fd); }
+
+    /**
+     * @brief ソケットペアを作り、出力先に渡す側のデスクリプターを返す
+     */
+    int Open()
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) return -1;
+        fd = fds[0];
+        return fds[1];
+    }
+
+    /**
+     * @brief 出力先が書き込んだイベントを1つ読む
+     * @return 読んだ大きさ（タイムアウトなら-1）
+     */
+    ssize_t Read(uhid_event& event, int timeoutMs = 2000)
+    {
+        event = uhid_event{};
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeoutMs) <= 0) return -1;
+        return read(fd, &event, sizeof(event));
+    }
+
+    /**
+     * @brief 出力先にイベントを送る（ドライバーからの要求）
+     */
+    bool Write(const uhid_event& event)
+    {
+        return write(fd, &event, sizeof(event)) == static_cast<ssize_t>(sizeof(event));
+    }
+
+    /**
+     * @brief 機能レポートを要求し、応答を待つ
+     */
+    bool GetReport(uint32_t id, uint8_t rnum, uint8_t rtype, uhid_event& reply)
+    {
+        uhid_event request{};
+        request.type = UHID_GET_REPORT;
+        request.u.get_report.id = id;
+        request.u.get_report.rnum = rnum;
+        request.u.get_report.rtype = rtype;
+        if (!Write(request)) return false;
+        if (Read(reply) < 0) return false;
+        CHECK_EQ(reply.type, UHID_GET_REPORT_REPLY);
+        CHECK_EQ(reply.u.get_report_reply.id, id);
+        return reply.type == UHID_GET_REPORT_REPLY;
+    }
+
+private:
+    int fd = -1;
+};
+
+static int16_t get_le16(const uint8_t* data)
+{
+    return static_cast<int16_t>(data[0] | (data[1] << 8));
+}
+
+static void check_create(const uhid_event& create, const UHidSink& sink)
+{
+    CHECK_EQ(create.type, UHID_CREATE2);
+    CHECK(std::string(reinterpret_cast<const char*>(create.u.create2.name)) == "Joy-Con Virtual DualShock 4");
+    CHECK_EQ(create.u.create2.bus, BUS_USB);
+    CHECK_EQ(create.u.create2.vendor, 0x054Cu);
+    CHECK_EQ(create.u.create2.product, 0x05C4u);
+
+    // uniqはMACアドレス（ドライバーが同じコントローラーの重複を判定する）
+    const auto& mac = sink.MacAddress();
+    char uniq[18];
+    std::snprintf(uniq, sizeof(uniq), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    CHECK(std::string(reinterpret_cast<const char*>(create.u.create2.uniq)) == uniq);
+
+    // ゲームパッドのアプリケーションコレクションで始まる、入力レポート0x01を含むディスクリプター
+    const uint8_t* rd = create.u.create2.rd_data;
+    CHECK(create.u.create2.rd_size > 0 && create.u.create2.rd_size <= HID_MAX_DESCRIPTOR_SIZE);
+    CHECK(rd[0] == 0x05 && rd[1] == 0x01 && rd[2] == 0x09 && rd[3] == 0x05 && rd[4] == 0xA1 && rd[5] == 0x01);
+    bool hasInputReport = false;
+    for (size_t i = 0; i + 1 < create.u.create2.rd_size; ++i)
+        if (rd[i] == 0x85 && rd[i + 1] == 0x01) hasInputReport = true;
+    CHECK(hasInputReport);
+}
+
+/**
+ * @brief 入力レポートは0x01とReportBufferの63バイトで、イベントはその大きさまでしか書かない
+ */
+static void check_input(UHidHarness& harness, UHidSink& sink)
+{
+    DS4_REPORT_EX report{};
+    for (size_t i = 0; i < sizeof(report.ReportBuffer); ++i)
+        report.ReportBuffer[i] = static_cast<uint8_t>(i * 7 + 3);
+    CHECK(sink.SubmitReport(report));
+
+    uhid_event event;
+    ssize_t size = harness.Read(event);
+    CHECK_EQ(size, static_cast<ssize_t>(offsetof(uhid_event, u.input2.data) + 64));
+    CHECK_EQ(event.type, UHID_INPUT2);
+    CHECK_EQ(event.u.input2.size, 64);
+    CHECK_EQ(event.u.input2.data[0], 0x01);
+    CHECK(std::memcmp(event.u.input2.data + 1, report.ReportBuffer, sizeof(report.ReportBuffer)) == 0);
+
+    // 次のレポートは前の内容を残さない
+    report.Report.bThumbLX = 0x10;
+    report.Report.wGyroZ = -1000;
+    CHECK(sink.SubmitReport(report));
+    CHECK(harness.Read(event) > 0);
+    CHECK(std::memcmp(event.u.input2.data + 1, report.ReportBuffer, sizeof(report.ReportBuffer)) == 0);
+
+    // DS4にマウスは無い
+    CHECK(!sink.SubmitMouse({}));
+}
+
+/**
+ * @brief 機能レポートの応答（キャリブレーションはUSBの並び）
+ */
+static void check_feature_reports(UHidHarness& harness, const UHidSink& sink)
+{
+    uhid_event reply;
+
+    // キャリブレーション: バイアス0、ジャイロはピッチ、ヨー、ロールの順に+と-が交互、速度、加速度の+と-
+    CHECK(harness.GetReport(11, 0x02, UHID_FEATURE_REPORT, reply));
+    CHECK_EQ(reply.u.get_report_reply.err, 0);
+    CHECK_EQ(reply.u.get_report_reply.size, 37);
+    const uint8_t* data = reply.u.get_report_reply.data;
+    CHECK_EQ(data[0], 0x02);
+    for (int i = 0; i < 3; ++i)
+        CHECK_EQ(get_le16(data + 1 + i * 2), 0);
+    for (int i = 0; i < 3; ++i) {
+        CHECK_EQ(get_le16(data + 7 + i * 4), 8640);
+        CHECK_EQ(get_le16(data + 9 + i * 4), -8640);
+    }
+    CHECK_EQ(get_le16(data + 19), 540);
+    CHECK_EQ(get_le16(data + 21), 540);
+    for (int i = 0; i < 3; ++i) {
+        CHECK_EQ(get_le16(data + 23 + i * 4), 8192);
+        CHECK_EQ(get_le16(data + 25 + i * 4), -8192);
+    }
+
+    // ペアリング情報: MACアドレスを下位バイトから
+    CHECK(harness.GetReport(12, 0x12, UHID_FEATURE_REPORT, reply));
+    CHECK_EQ(reply.u.get_report_reply.err, 0);
+    CHECK_EQ(reply.u.get_report_reply.size, 16);
+    const auto& mac = sink.MacAddress();
+    for (size_t i = 0; i < mac.size(); ++i)
+        CHECK_EQ(reply.u.get_report_reply.data[1 + i], mac[mac.size() - 1 - i]);
+
+    CHECK(harness.GetReport(13, 0x81, UHID_FEATURE_REPORT, reply));
+    CHECK_EQ(reply.u.get_report_reply.size, 7);
+
+    CHECK(harness.GetReport(14, 0xA3, UHID_FEATURE_REPORT, reply));
+    CHECK_EQ(reply.u.get_report_reply.err, 0);
+    CHECK_EQ(reply.u.get_report_reply.size, 49);
+
+    // 対応しない機能レポートや、機能レポート以外の要求は失敗を返す
+    CHECK(harness.GetReport(15, 0x99, UHID_FEATURE_REPORT, reply));
+    CHECK_EQ(reply.u.get_report_reply.err, EIO);
+    CHECK_EQ(reply.u.get_report_reply.size, 0);
+    CHECK(harness.GetReport(16, 0x02, UHID_INPUT_REPORT, reply));
+    CHECK_EQ(reply.u.get_report_reply.err, EIO);
+}
+
+/**
+ * @brief 出力レポート0x05（OUTPUTとSET_REPORTの両方）が振動とライトバーとしてハンドラに届く
+ */
+static void check_feedback(UHidHarness& harness, UHidSink& sink)
+{
+    std::mutex mutex;
+    std::vector<OutputFeedback> received;
+    sink.SetFeedbackHandler([&](const OutputFeedback& feedback)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.push_back(feedback);
+        });
+    auto count = [&]() { std::lock_guard<std::mutex> lock(mutex); return received.size(); };
+
+    uhid_event output{};
+    output.type = UHID_OUTPUT;
+    output.u.output.rtype = UHID_OUTPUT_REPORT;
+    output.u.output.size = 32;
+    uint8_t* data = output.u.output.data;
+    data[0] = 0x05;
+    data[1] = 0x03; // 振動とライトバー
+    data[4] = 0x20; // 弱い振動
+    data[5] = 0xC0; // 強い振動
+    data[6] = 0x11;
+    data[7] = 0x22;
+    data[8] = 0x33;
+    CHECK(harness.Write(output));
+    CHECK(WaitUntil([&]() { return count() >= 1; }));
+
+    // 振動だけを変える要求はSET_REPORTで届き、応答を返す
+    uhid_event set{};
+    set.type = UHID_SET_REPORT;
+    set.u.set_report.id = 21;
+    set.u.set_report.rtype = UHID_OUTPUT_REPORT;
+    set.u.set_report.size = 32;
+    set.u.set_report.data[0] = 0x05;
+    set.u.set_report.data[1] = 0x01;
+    set.u.set_report.data[4] = 0x00;
+    set.u.set_report.data[5] = 0x80;
+    set.u.set_report.data[6] = 0xFF; // ライトバーは有効フラグが無いので無視される
+    CHECK(harness.Write(set));
+    uhid_event reply;
+    CHECK(harness.Read(reply) > 0);
+    CHECK_EQ(reply.type, UHID_SET_REPORT_REPLY);
+    CHECK_EQ(reply.u.set_report_reply.id, 21u);
+    CHECK_EQ(reply.u.set_report_reply.err, 0);
+    CHECK(WaitUntil([&]() { return count() >= 2; }));
+
+    // 出力レポート以外（有効フラグの無い出力やSTART/OPEN）はハンドラを呼ばない
+    data[1] = 0x00;
+    CHECK(harness.Write(output));
+    uhid_event open{};
+    open.type = UHID_OPEN;
+    CHECK(harness.Write(open));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK_EQ(received.size(), 2u);
+    if (received.size() >= 2) {
+        CHECK_EQ(received[0].smallMotor, 0x20);
+        CHECK_EQ(received[0].largeMotor, 0xC0);
+        CHECK_EQ(received[0].red, 0x11);
+        CHECK_EQ(received[0].green, 0x22);
+        CHECK_EQ(received[0].blue, 0x33);
+        CHECK_EQ(received[1].smallMotor, 0x00);
+        CHECK_EQ(received[1].largeMotor, 0x80);
+        CHECK_EQ(received[1].red, 0x11);
+    }
+}
+
+int main()
+{
+    UHidHarness harness;
+    int fd = harness.Open();
+    if (fd < 0) {
+        std::wcerr << L"Failed to create the UHID harness socket pair.\n";
+        return 1;
+    }
+
+    auto sink = UHidSink::Attach(fd);
+    CHECK(sink != nullptr);
+    if (!sink) return TestResult(L"UHidSinkTest");
+
+    uhid_event create;
+    CHECK(harness.Read(create) > 0);
+    check_create(create, *sink);
+    check_input(harness, *sink);
+    check_feature_reports(harness, *sink);
+    check_feedback(harness, *sink);
+
+    // 出力先を破棄すると仮想デバイスを削除する
+    sink.reset();
+    uhid_event destroy;
+    CHECK(harness.Read(destroy) > 0);
+    CHECK_EQ(destroy.type, UHID_DESTROY);
+
+    return TestResult(L"UHidSinkTest");
+}
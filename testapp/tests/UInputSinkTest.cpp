@@ -0,0 +1,187 @@
+﻿// UInputSinkをFIFOのデバイスノードの代わりに対して動かし、書き込まれるイベント列を確認するテスト
+#include "UInputSink.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "TestCheck.h"
+
+struct ExpectedEvent {
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+/**
+ * @brief FIFOに書き込まれた分のイベントを全て読む
+ */
+static std::vector<input_event> read_events(int fd)
+{
+    std::vector<input_event> events;
+    input_event buffer[64];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        CHECK_EQ(n % static_cast<ssize_t>(sizeof(input_event)), 0);
+        events.insert(events.end(), buffer, buffer + n / sizeof(input_event));
+    }
+    return events;
+}
+
+/**
+ * @brief 1フレーム分のイベントが期待した順に並び、EV_SYNで終わることを確認する
+ */
+static void check_frame(const std::vector<input_event>& events, const std::vector<ExpectedEvent>& expected)
+{
+    CHECK_EQ(events.size(), expected.size() + 1);
+    for (size_t i = 0; i < expected.size() && i < events.size(); ++i) {
+        CHECK_EQ(events[i].type, expected[i].type);
+        CHECK_EQ(events[i].code, expected[i].code);
+        CHECK_EQ(events[i].value, expected[i].value);
+    }
+    if (!events.empty()) {
+        CHECK_EQ(events.back().type, EV_SYN);
+        CHECK_EQ(events.back().code, SYN_REPORT);
+    }
+}
+
+static DS4_REPORT_EX neutral_report()
+{
+    DS4_REPORT_EX report{};
+    DS4_REPORT_INIT(reinterpret_cast<PDS4_REPORT>(&report.Report));
+    return report;
+}
+
+static void check_gamepad(UInputSink& sink, int fd)
+{
+    // 最初のフレームは全てのボタンと軸を送る
+    DS4_REPORT_EX report = neutral_report();
+    CHECK(sink.SubmitReport(report));
+    std::vector<ExpectedEvent> initial = {
+        { EV_KEY, BTN_SOUTH, 0 }, { EV_KEY, BTN_EAST, 0 }, { EV_KEY, BTN_WEST, 0 }, { EV_KEY, BTN_NORTH, 0 },
+        { EV_KEY, BTN_TL, 0 }, { EV_KEY, BTN_TR, 0 }, { EV_KEY, BTN_TL2, 0 }, { EV_KEY, BTN_TR2, 0 },
+        { EV_KEY, BTN_SELECT, 0 }, { EV_KEY, BTN_START, 0 }, { EV_KEY, BTN_THUMBL, 0 }, { EV_KEY, BTN_THUMBR, 0 },
+        { EV_KEY, BTN_MODE, 0 },
+        { EV_ABS, ABS_X, 0x80 }, { EV_ABS, ABS_Y, 0x80 }, { EV_ABS, ABS_RX, 0x80 }, { EV_ABS, ABS_RY, 0x80 },
+        { EV_ABS, ABS_Z, 0 }, { EV_ABS, ABS_RZ, 0 },
+        { EV_ABS, ABS_HAT0X, 0 }, { EV_ABS, ABS_HAT0Y, 0 },
+    };
+    check_frame(read_events(fd), initial);
+
+    // 変化が無ければ何も書き込まない
+    CHECK(sink.SubmitReport(report));
+    CHECK(read_events(fd).empty());
+
+    // 変化したボタンと軸だけを送る
+    report.Report.wButtons |= DS4_BUTTON_CROSS;
+    DS4_SET_DPAD(reinterpret_cast<PDS4_REPORT>(&report.Report), DS4_BUTTON_DPAD_NORTHEAST);
+    report.Report.bSpecial |= DS4_SPECIAL_BUTTON_PS;
+    report.Report.bThumbLX = 0xFF;
+    report.Report.bTriggerR = 0x40;
+    report.Report.wGyroX = 1234; // evdevのゲームパッドには無いフィールドは送らない
+    CHECK(sink.SubmitReport(report));
+    check_frame(read_events(fd), {
+        { EV_KEY, BTN_SOUTH, 1 }, { EV_KEY, BTN_MODE, 1 },
+        { EV_ABS, ABS_X, 0xFF }, { EV_ABS, ABS_RZ, 0x40 },
+        { EV_ABS, ABS_HAT0X, 1 }, { EV_ABS, ABS_HAT0Y, -1 },
+        });
+
+    // 十字キーの斜めから上だけになると、横の軸だけが変わる
+    DS4_SET_DPAD(reinterpret_cast<PDS4_REPORT>(&report.Report), DS4_BUTTON_DPAD_NORTH);
+    CHECK(sink.SubmitReport(report));
+    check_frame(read_events(fd), { { EV_ABS, ABS_HAT0X, 0 } });
+}
+
+static void check_mouse(UInputSink& sink, int fd)
+{
+    MouseEvent move;
+    move.type = MouseEventType::Move;
+    move.dx = 5;
+    move.dy = -3;
+    MouseEvent press;
+    press.type = MouseEventType::Button;
+    press.button = MouseRight;
+    press.pressed = true;
+    MouseEvent wheel;
+    wheel.type = MouseEventType::Wheel;
+    wheel.wheel = 60;
+
+    // 1回の送信のイベントは1フレームになり、ホイールはノッチ単位に達したときだけREL_WHEELも送る
+    std::vector<MouseEvent> events = { move, press, wheel, wheel };
+    CHECK(sink.SubmitMouse(events));
+    check_frame(read_events(fd), {
+        { EV_REL, REL_X, 5 }, { EV_REL, REL_Y, -3 }, { EV_KEY, BTN_RIGHT, 1 },
+        { EV_REL, REL_WHEEL_HI_RES, 60 }, { EV_REL, REL_WHEEL_HI_RES, 60 }, { EV_REL, REL_WHEEL, 1 },
+        });
+
+    // 端数は次の送信に持ち越す（下向きは負）
+    wheel.wheel = -150;
+    CHECK(sink.SubmitMouse(std::vector<MouseEvent>{ wheel }));
+    check_frame(read_events(fd), { { EV_REL, REL_WHEEL_HI_RES, -150 }, { EV_REL, REL_WHEEL, -1 } });
+
+    // 移動の無い移動イベントや空の送信では書き込まない
+    move.dx = 0;
+    move.dy = 0;
+    CHECK(sink.SubmitMouse(std::vector<MouseEvent>{ move }));
+    CHECK(sink.SubmitMouse({}));
+    CHECK(read_events(fd).empty());
+}
+
+/**
+ * @brief 1回の送信が1フレームの上限（32イベント）を超えても、全てのイベントの後にEV_SYNが1つだけ付く
+ */
+static void check_large_frame(UInputSink& sink, int fd)
+{
+    MouseEvent move;
+    move.type = MouseEventType::Move;
+    move.dx = 1;
+    move.dy = 1;
+    std::vector<MouseEvent> events(40, move);
+    CHECK(sink.SubmitMouse(events));
+
+    std::vector<input_event> written = read_events(fd);
+    CHECK_EQ(written.size(), 81u);
+    size_t syncs = 0;
+    for (const auto& event : written)
+        if (event.type == EV_SYN) ++syncs;
+    CHECK_EQ(syncs, 1u);
+    if (!written.empty()) CHECK_EQ(written.back().type, EV_SYN);
+}
+
+int main()
+{
+    // 読み取り側を先に開いておく（書き込み側はO_NONBLOCKで開くので、読み取り側が無いと失敗する）
+    std::filesystem::path fifo = std::filesystem::temp_directory_path() /
+        ("joycon_uinput_test_" + std::to_string(getpid()));
+    std::filesystem::remove(fifo);
+    if (mkfifo(fifo.c_str(), 0600) < 0) {
+        std::wcerr << L"Failed to create the stand-in FIFO.\n";
+        return 1;
+    }
+    int fd = open(fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    CHECK(fd >= 0);
+
+    UInputSinkConfig config;
+    config.path = fifo.string();
+    auto sink = UInputSink::Create(config);
+    CHECK(sink != nullptr);
+    if (sink && fd >= 0) {
+        CHECK(!sink->IsVirtualDevice());
+        check_gamepad(*sink, fd);
+        check_mouse(*sink, fd);
+        check_large_frame(*sink, fd);
+    }
+    sink.reset();
+
+    // 開けないノードではnullptrを返す
+    config.path = (std::filesystem::temp_directory_path() / "joycon_uinput_test_missing" / "uinput").string();
+    CHECK(UInputSink::Create(config) == nullptr);
+
+    if (fd >= 0) close(fd);
+    std::filesystem::remove(fifo);
+    return TestResult(L"UInputSinkTest");
+}